@@ -35,6 +35,7 @@ struct cdb
 	int cdb_fd; /* file descriptor */
 	char *filename; /* file name */
 	time_t mtime; /* mtime of cdb file */
+	ino_t ino; /* inode of cdb file */
 	struct ev_loop *loop;
 	ev_stat stat_ev; /* event structure for checking cdb for modifications */
 	ev_tstamp check_ts;
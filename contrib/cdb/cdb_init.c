@@ -56,6 +56,7 @@ int cdb_init(struct cdb *cdbp, int fd)
 	cdbp->cdb_fsize = fsize;
 	cdbp->cdb_mem = mem;
 	cdbp->mtime = st.st_mtime;
+	cdbp->ino = st.st_ino;
 
 	cdbp->cdb_vpos = cdbp->cdb_vlen = 0;
 	cdbp->cdb_kpos = cdbp->cdb_klen = 0;
@@ -91,6 +91,26 @@ local function gen_learn_functor(redis_params, learn_script_id)
   end
 end
 
+local function gen_learn_batch_functor(redis_params, learn_batch_script_id, ev_base)
+  return function(expanded_key, class_label, symbol, learns, learns_floor, stat_tokens, deltas, floors, callback)
+    local function learn_batch_redis_cb(err, data)
+      lua_util.debugm(N, rspamd_config, 'learn batch redis cb: %s, %s for class %s',
+          err, data, class_label)
+      if err then
+        callback(rspamd_config, false, err)
+      else
+        callback(rspamd_config, true)
+      end
+    end
+
+    lua_redis.exec_redis_script(learn_batch_script_id,
+        { ev_base = ev_base, cfg = rspamd_config, is_write = true, key = expanded_key },
+        learn_batch_redis_cb,
+        { expanded_key }, { class_label, symbol, tostring(learns), tostring(learns_floor),
+                            stat_tokens, deltas, floors })
+  end
+end
+
 local function load_redis_params(classifier_ucl, statfile_ucl)
   local redis_params
 
@@ -154,6 +174,12 @@ exports.lua_bayes_init_statfile = function(classifier_ucl, statfile_ucl, symbol,
     logger.errx(ev_base, script_err)
     return nil
   end
+  local learn_batch_script_id
+  learn_batch_script_id, script_err = lua_redis.load_redis_script_from_file("bayes_learn_batch.lua", redis_params)
+  if not learn_batch_script_id then
+    logger.errx(ev_base, script_err)
+    return nil
+  end
   local stat_script_id
   stat_script_id, script_err = lua_redis.load_redis_script_from_file("bayes_stat.lua", redis_params)
   if not stat_script_id then
@@ -219,7 +245,15 @@ exports.lua_bayes_init_statfile = function(classifier_ucl, statfile_ucl, symbol,
     end)
   end
 
-  return gen_classify_functor(redis_params, classify_script_id), gen_learn_functor(redis_params, learn_script_id)
+  -- Learns can be coalesced only in workers with their own event loop
+  local learn_batch_functor
+  if ev_base then
+    learn_batch_functor = gen_learn_batch_functor(redis_params, learn_batch_script_id, ev_base)
+  end
+
+  return gen_classify_functor(redis_params, classify_script_id),
+      gen_learn_functor(redis_params, learn_script_id),
+      learn_batch_functor
 end
 
 local function gen_cache_check_functor(redis_params, check_script_id, conf)
@@ -109,6 +109,7 @@ local config = {
   text_quality_threshold = 0.4, -- Minimum confidence to accept extracted text
   text_quality_min_length = 10, -- Minimum text length to apply quality filtering
   text_quality_enabled = true, -- Enable text quality filtering
+  cache_size = 128, -- Number of processed PDFs reused by their content digest (0 to disable)
 }
 
 -- Used to process patterns found in PDF
@@ -1615,6 +1616,7 @@ local function search_text(task, pdf, mpart)
     end
 
     if #all_text > 0 then
+      pdf.extracted_text = all_text
       task:inject_part('text', all_text, mpart)
     end
   end
@@ -1645,6 +1647,7 @@ local function search_urls(task, pdf, mpart)
           if url_ok and url then
             lua_util.debugm(N, task, 'found url %s in object %s:%s',
                 v, obj.major, obj.minor)
+            table.insert(pdf.extracted_urls, v)
             task:inject_url(url, mpart)
           end
         elseif type(v) == 'userdata' then
@@ -1655,6 +1658,7 @@ local function search_urls(task, pdf, mpart)
             if url_ok and url then
               lua_util.debugm(N, task, 'found url %s in object %s:%s',
                   str_v, obj.major, obj.minor)
+              table.insert(pdf.extracted_urls, str_v)
               task:inject_url(url, mpart)
             end
           end
@@ -1675,12 +1679,89 @@ local function search_urls(task, pdf, mpart)
   end
 end
 
+-- Results of processing the same attachment in the bulk mail, keyed by digest;
+-- digests are ordered from the least to the most recently used one
+local results_cache = {}
+local results_cache_order = {}
+
+local function touch_cached_results(digest)
+  for i, d in ipairs(results_cache_order) do
+    if d == digest then
+      table.remove(results_cache_order, i)
+      break
+    end
+  end
+
+  table.insert(results_cache_order, digest)
+end
+
+local function cache_results(digest, pdf_object, pdf_output)
+  local res = {
+    output = {},
+    text = {},
+    urls = pdf_object.extracted_urls,
+  }
+
+  -- Objects are internal and could be huge, so the cached output is just a
+  -- summary: it has no `objects` and is marked by the `cached` flag
+  for k, v in pairs(pdf_output) do
+    if k ~= 'objects' and k ~= 'extracted_urls' then
+      res.output[k] = v
+    end
+  end
+
+  if pdf_object.extracted_text then
+    for i, t in ipairs(pdf_object.extracted_text) do
+      res.text[i] = tostring(t)
+    end
+  end
+
+  touch_cached_results(digest)
+
+  if #results_cache_order > config.cache_size then
+    results_cache[table.remove(results_cache_order, 1)] = nil
+  end
+
+  results_cache[digest] = res
+end
+
+local function restore_results(task, mpart, res)
+  local pdf_output = lua_util.shallowcopy(res.output)
+  pdf_output.cached = true
+
+  if #res.text > 0 and task.inject_part then
+    task:inject_part('text', res.text, mpart)
+  end
+
+  for _, u in ipairs(res.urls) do
+    local url_ok, url = pcall(rspamd_url.create, task:get_mempool(), u, { 'content' })
+
+    if url_ok and url then
+      task:inject_url(url, mpart)
+    end
+  end
+
+  return pdf_output
+end
+
 local function process_pdf(input, mpart, task)
   if not config.enabled then
     -- Skip processing
     return {}
   end
 
+  local digest
+  if config.cache_size > 0 and mpart then
+    digest = mpart:get_digest()
+    local cached = results_cache[digest]
+
+    if cached then
+      lua_util.debugm(N, task, 'pdf: reuse cached results for %s', digest)
+      touch_cached_results(digest)
+      return restore_results(task, mpart, cached)
+    end
+  end
+
   local matches = pdf_trie:match(input)
 
   if matches then
@@ -1691,6 +1772,7 @@ local function process_pdf(input, mpart, task)
       extract_text = extract_text_data,
       start_timestamp = start_ts,
       end_timestamp = start_ts + config.pdf_process_timeout,
+      extracted_urls = {},
     }
     -- Output object that excludes all internal stuff
     local pdf_output = lua_util.shallowcopy(pdf_object)
@@ -1807,6 +1889,11 @@ local function process_pdf(input, mpart, task)
       pdf_output.scripts = true
     end
 
+    -- Partial results depend on timing, so they are not reused
+    if digest and not pdf_object.timeout_processing then
+      cache_results(digest, pdf_object, pdf_output)
+    end
+
     return pdf_output
   end
 end
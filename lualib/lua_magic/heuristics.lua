@@ -493,7 +493,13 @@ exports.text_part_heuristic = function(part, log_obj, _)
     end
   end
 
-  local content = part:get_content()
+  local content
+  if part:is_decoded() then
+    content = part:get_content()
+  else
+    -- Spans below and csv validation use just the beginning of the content
+    content = part:get_content_prefix(32768)
+  end
   local mtype, msubtype = part:get_type()
   local clen = #content
   local is_text
@@ -291,12 +291,9 @@ local function process_detected(res)
   return nil
 end
 
-exports.detect = function(part, log_obj)
-  if not log_obj then
-    log_obj = rspamd_config
-  end
-  local input = part:get_content()
-
+-- Detects type of the input, if it is not `complete` then it is just a prefix
+-- of the content, so the patterns at the end of the content are not checked
+local function detect_input(input, complete, part, log_obj)
   local res = {}
 
   if type(input) == 'string' then
@@ -312,7 +309,7 @@ exports.detect = function(part, log_obj)
     end
 
     -- Check tail matches
-    if inplen > min_tail_offset then
+    if complete and inplen > min_tail_offset then
       local tail = input:span(inplen - min_tail_offset, min_tail_offset)
       match_chunk(tail, input, inplen, inplen - min_tail_offset,
         compiled_tail_patterns, tail_patterns, log_obj, res, part)
@@ -334,7 +331,11 @@ exports.detect = function(part, log_obj)
     end
 
     -- No way, let's check data in chunks or just the whole input if it is small enough
-    if #input > exports.chunk_size * 3 then
+    if not complete then
+      -- The prefix is not longer than the first chunk
+      match_chunk(input, input, inplen, 0,
+        compiled_patterns, processed_patterns, log_obj, res, part)
+    elseif #input > exports.chunk_size * 3 then
       -- Chunked version as input is too long
       local chunk1, chunk2 = input:span(1, exports.chunk_size * 2),
           input:span(inplen - exports.chunk_size, exports.chunk_size)
@@ -364,6 +365,27 @@ exports.detect = function(part, log_obj)
   return nil
 end
 
+exports.detect = function(part, log_obj)
+  if not log_obj then
+    log_obj = rspamd_config
+  end
+
+  if part.is_decoded and not part:is_decoded() then
+    -- Do not decode the whole attachment if its beginning is enough
+    local prefix, complete = part:get_content_prefix(exports.chunk_size * 2)
+    local ext, t = detect_input(prefix, complete, part, log_obj)
+
+    if ext or complete then
+      return ext, t
+    end
+
+    lua_util.debugm(N, log_obj, 'nothing found in the first %s bytes, check the whole content',
+      #prefix)
+  end
+
+  return detect_input(part:get_content(), true, part, log_obj)
+end
+
 exports.detect_mime_part = function(part, log_obj)
   local ext, weight = heuristics.mime_part_heuristic(part, log_obj)
 
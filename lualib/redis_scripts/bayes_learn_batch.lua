@@ -0,0 +1,64 @@
+-- Lua script to apply a batch of coalesced bayes learns (multi-class)
+-- This script accepts the following parameters:
+-- key1 - prefix for bayes tokens (e.g. for per-user classification)
+-- argv1 - class label string (e.g. "S", "H", "T")
+-- argv2 - string symbol
+-- argv3 - signed number of learns in the batch
+-- argv4 - floor of learns in the batch
+-- argv5 - set of tokens encoded in messagepack array of strings
+-- argv6 - signed deltas for tokens encoded in messagepack array of integers (size must be equal to `ARGV[5]`)
+-- argv7 - floors for tokens encoded in messagepack array of integers (size must be equal to `ARGV[5]`)
+--
+-- Each learn or unlearn in the batch never takes a counter below zero, so the
+-- whole batch sets a counter `x` to `max(x + delta, floor)`
+
+local prefix = KEYS[1]
+local class_label = ARGV[1]
+local symbol = ARGV[2]
+local learns = tonumber(ARGV[3]) or 0
+local learns_floor = tonumber(ARGV[4]) or 0
+local input_tokens = cmsgpack.unpack(ARGV[5])
+local deltas = cmsgpack.unpack(ARGV[6])
+local floors = cmsgpack.unpack(ARGV[7])
+
+-- Handle RS_<ID> HASH booleans and full class name strings for backward compatibility
+if class_label == 'true' or class_label == 'spam' then
+  class_label = 'S'
+elseif class_label == 'false' or class_label == 'ham' then
+  class_label = 'H'
+end
+
+local hash_key = class_label
+local learned_key = 'learns_' .. string.lower(class_label)
+
+-- Handle RS HASH keys for backward compatibility
+if class_label == 'S' then
+  learned_key = 'learns_spam'
+elseif class_label == 'H' then
+  learned_key = 'learns_ham'
+end
+
+-- Set a hash field to max(current + delta, floor)
+local function apply(key, field, delta, floor)
+  if floor <= delta then
+    -- Counters are never negative, so the floor cannot be reached
+    if delta ~= 0 then
+      redis.call('HINCRBY', key, field, delta)
+    end
+  else
+    local current = tonumber(redis.call('HGET', key, field)) or 0
+    local new = math.max(current + delta, floor)
+    if new ~= current then
+      redis.call('HINCRBY', key, field, new - current)
+    end
+  end
+end
+
+redis.call('SADD', symbol .. '_keys', prefix)
+redis.call('HSET', prefix, 'version', '2') -- new schema
+
+apply(prefix, learned_key, learns, learns_floor)
+
+for i, token in ipairs(input_tokens) do
+  apply(token, hash_key, tonumber(deltas[i]) or 0, tonumber(floors[i]) or 0)
+end
@@ -21,7 +21,9 @@ local rspamd_zstd = require "rspamd_zstd"
 local rspamd_text = require "rspamd_text"
 local rspamd_util = require "rspamd_util"
 local rspamd_cdb = require "rspamd_cdb"
+local rspamd_sqlite3 = require "rspamd_sqlite3"
 local lua_util = require "lua_util"
+local lua_stat = require "lua_stat"
 local rspamd_i64 = require "rspamd_int64"
 local ucl = require "ucl"
 
@@ -107,6 +109,31 @@ migrate:option "-b --batch-size"
        :convert(tonumber)
        :default(1000)
 
+-- Snapshot
+local snapshot = parser:command "snapshot s"
+                       :description "Compile global bayes statistics into a read-only CDB snapshot"
+snapshot:argument "output"
+        :description "CDB file to write, an existing file is replaced atomically"
+        :argname "<file>"
+snapshot:flag "-q --quantize"
+        :description "Store counts as 16 bit numbers instead of floats"
+snapshot:option "-m --min-count"
+        :description "Skip tokens seen less than <n> times in all classes"
+        :argname("<n>")
+        :convert(tonumber)
+        :default(0)
+snapshot:option "-p --prefix"
+        :description "Redis prefix of the global (not per user) statistics"
+        :argname("<prefix>")
+        :default("RS")
+snapshot:flag "--sqlite"
+        :description "Read tokens from the sqlite3 classifier instead of redis"
+snapshot:option "-b --batch-size"
+        :description "Number of entries to process at once"
+        :argname("<elts>")
+        :convert(tonumber)
+        :default(1000)
+
 local function load_config(opts)
   local _r, err = rspamd_config:load_ucl(opts['config'])
 
@@ -312,6 +339,37 @@ local function connect_to_upstream(up, redis_params)
   return true, conn
 end
 
+-- Connects to all read shards of a classifier, exits on failure
+local function connect_all_shards(cls)
+  local connections = {}
+  local read_servers = cls.redis_params.read_servers
+  if read_servers then
+    local all_ups = read_servers:all_upstreams()
+    if all_ups and #all_ups > 0 then
+      for _, up in ipairs(all_ups) do
+        local res, conn = connect_to_upstream(up, cls.redis_params)
+        if res then
+          connections[#connections + 1] = { up = up, conn = conn }
+        else
+          rspamd_logger.errx("cannot connect to redis shard %s", up:get_name())
+        end
+      end
+    end
+  end
+
+  -- Fallback: single connection via round-robin
+  if #connections == 0 then
+    local res, conn = lua_redis.redis_connect_sync(cls.redis_params, false)
+    if not res then
+      rspamd_logger.errx("cannot connect to redis server: %s", cls.redis_params)
+      os.exit(1)
+    end
+    connections[#connections + 1] = { conn = conn }
+  end
+
+  return connections
+end
+
 local compress_ctx
 
 local function dump_out(out, opts, last)
@@ -338,25 +396,35 @@ local pipeline_max = 1000
 local append_redis_hash_hmset
 local exec_redis_commands
 
+-- Field of the prefix hash that stores learns of a class
+local function learns_field(lbl)
+  if lbl == 'S' then
+    return 'learns_spam'
+  elseif lbl == 'H' then
+    return 'learns_ham'
+  end
+
+  return 'learns_' .. lbl
+end
+
+-- Pad CDB key to 8 bytes for consistent lookup
+local function cdb_learns_key(lbl)
+  return string.format('_lrn%-4s', lbl)
+end
+
 local function dump_cdb(out, opts, last, pattern, class_labels)
   local results = out[pattern]
 
   if not out.cdb_builder then
     -- First invocation
     out.cdb_builder = rspamd_cdb.build(string.format('%s.cdb', pattern))
+    class_labels = class_labels or { 'S', 'H' }
+    -- Order of the packed counters, used by the cdb backend
+    out.cdb_builder:add('_labels', table.concat(class_labels, ','))
     -- Write learned counts for all class labels
-    for _, lbl in ipairs(class_labels or { 'S', 'H' }) do
-      local learned_key
-      if lbl == 'S' then
-        learned_key = 'learns_spam'
-      elseif lbl == 'H' then
-        learned_key = 'learns_ham'
-      else
-        learned_key = 'learns_' .. lbl
-      end
-      -- Pad CDB key to 8 bytes for consistent lookup
-      local cdb_key = string.format('_lrn%-4s', lbl)
-      out.cdb_builder:add(cdb_key, rspamd_i64.fromstring(results[learned_key] or '0'))
+    for _, lbl in ipairs(class_labels) do
+      out.cdb_builder:add(cdb_learns_key(lbl),
+          rspamd_i64.fromstring(results[learns_field(lbl)] or '0'))
     end
   end
 
@@ -506,31 +574,7 @@ local function dump_handler(opts)
     end
 
     -- Connect to all shards to ensure complete dump
-    local connections = {}
-    local read_servers = cls.redis_params.read_servers
-    if read_servers then
-      local all_ups = read_servers:all_upstreams()
-      if all_ups and #all_ups > 0 then
-        for _, up in ipairs(all_ups) do
-          local res, conn = connect_to_upstream(up, cls.redis_params)
-          if res then
-            connections[#connections + 1] = { up = up, conn = conn }
-          else
-            rspamd_logger.errx("cannot connect to redis shard %s", up:get_name())
-          end
-        end
-      end
-    end
-
-    -- Fallback: single connection via round-robin
-    if #connections == 0 then
-      local res, conn = lua_redis.redis_connect_sync(cls.redis_params, false)
-      if not res then
-        rspamd_logger.errx("cannot connect to redis server: %s", cls.redis_params)
-        os.exit(1)
-      end
-      connections[#connections + 1] = { conn = conn }
-    end
+    local connections = connect_all_shards(cls)
 
     local out = {}
     local function check_keys(conn, sym)
@@ -1239,6 +1283,207 @@ local function migrate_handler(opts)
       stats.checked, stats.correct, stats.migrated, stats.tokens, stats.errors)
 end
 
+-- Counts above 0x7fff keep 11 significant bits: 0x8000 | exponent << 10 | mantissa
+-- and are restored as (1024 + mantissa) << exponent by the cdb backend
+local function quantize_count(v)
+  v = math.floor(v + 0.5)
+
+  if v <= 0 then
+    return 0
+  elseif v < 0x8000 then
+    return v
+  end
+
+  local e = 0
+  while v >= 2048 do
+    v = math.floor(v / 2)
+    e = e + 1
+  end
+
+  if e > 31 then
+    return 0xffff
+  end
+
+  return 0x8000 + e * 1024 + (v - 1024)
+end
+
+-- Writes a snapshot to a temporary file, `finish` renames it over the output
+local function snapshot_writer(opts, class_labels)
+  local tmp = string.format('%s.new', opts.output)
+  local builder, err = rspamd_cdb.build(tmp, tonumber('644', 8))
+
+  if not builder then
+    rspamd_logger.errx("cannot create snapshot: %s", err)
+    os.exit(1)
+  end
+
+  local fmt = string.rep(opts.quantize and 'H' or 'f', #class_labels)
+  local writer = {
+    written = 0,
+    skipped = 0,
+  }
+
+  function writer.add_token(token, counts)
+    local total = 0
+    for _, c in ipairs(counts) do
+      total = total + c
+    end
+
+    if total <= 0 or total < opts.min_count then
+      writer.skipped = writer.skipped + 1
+      return
+    end
+
+    if opts.quantize then
+      for i, c in ipairs(counts) do
+        counts[i] = quantize_count(c)
+      end
+    end
+
+    builder:add(rspamd_i64.fromstring(token), rspamd_util.pack(fmt, lua_util.unpack(counts)))
+    writer.written = writer.written + 1
+  end
+
+  function writer.finish(learns)
+    builder:add('_labels', table.concat(class_labels, ','))
+    for i, lbl in ipairs(class_labels) do
+      builder:add(cdb_learns_key(lbl),
+          rspamd_i64.fromstring(string.format('%d', math.floor(learns[i] or 0))))
+    end
+    builder:finalize()
+
+    local ret, rename_err = os.rename(tmp, opts.output)
+    if not ret then
+      rspamd_logger.errx("cannot rename %s to %s: %s", tmp, opts.output, rename_err)
+      os.remove(tmp)
+      os.exit(1)
+    end
+
+    rspamd_logger.messagex("written snapshot %s: %s tokens, %s skipped",
+        opts.output, writer.written, writer.skipped)
+  end
+
+  return writer
+end
+
+local function snapshot_from_redis(opts)
+  local cls = select_classifier(opts)[1]
+  local class_labels = {}
+  for _, s in ipairs(cls.symbols) do
+    class_labels[#class_labels + 1] = s.label
+  end
+
+  local writer = snapshot_writer(opts, class_labels)
+  local learns = {}
+  local pattern = string.format('%s_*', opts.prefix)
+
+  -- Each token key lives on a single shard, learns are summed over shards
+  for _, c in ipairs(connect_all_shards(cls)) do
+    local conn = c.conn
+    conn:add_cmd('HGETALL', { opts.prefix })
+    local ret, meta = conn:exec()
+
+    if ret and meta then
+      meta = redis_map_zip(meta)
+      for i, lbl in ipairs(class_labels) do
+        learns[i] = (learns[i] or 0) + (tonumber(meta[learns_field(lbl)]) or 0)
+      end
+    end
+
+    local cursor = 0
+    repeat
+      conn:add_cmd('SCAN', { tostring(cursor),
+                             'MATCH', pattern,
+                             'COUNT', tostring(opts.batch_size) })
+      local results
+      ret, results = conn:exec()
+
+      if not ret then
+        rspamd_logger.errx("cannot execute scan command: %s", results)
+        os.exit(1)
+      end
+
+      cursor = tonumber(results[1])
+      local elts = results[2]
+
+      for chunk_start = 1, #elts, pipeline_max do
+        local chunk_end = math.min(chunk_start + pipeline_max - 1, #elts)
+        for ei = chunk_start, chunk_end do
+          conn:add_cmd('HGETALL', { elts[ei] })
+        end
+        local all_results = { conn:exec() }
+
+        for i = 1, #all_results, 2 do
+          local r, hash_content = all_results[i], all_results[i + 1]
+          local token = string.match(elts[chunk_start + (i - 1) / 2], '_(%d+)$')
+
+          if r and token then
+            local data = redis_map_zip(hash_content)
+            local counts = {}
+            for j, lbl in ipairs(class_labels) do
+              counts[j] = tonumber(data[lbl]) or 0
+            end
+            writer.add_token(token, counts)
+          end
+        end
+      end
+    until cursor == 0
+  end
+
+  writer.finish(learns)
+end
+
+local function snapshot_from_sqlite(opts, cfg)
+  local sqlite_params = lua_stat.load_sqlite_config(cfg)
+
+  if #sqlite_params ~= 1 then
+    rspamd_logger.errx("expected a single sqlite3 classifier, found %s", #sqlite_params)
+    os.exit(1)
+  end
+
+  local cls = sqlite_params[1]
+  local class_labels = { 'S', 'H' }
+  local writer = snapshot_writer(opts, class_labels)
+  local learns = {}
+  local tokens = {}
+
+  -- Tokens of each class are stored in a separate database
+  for i, path in ipairs({ cls.db_spam, cls.db_ham }) do
+    local db = rspamd_sqlite3.open(path)
+
+    if not db then
+      rspamd_logger.errx("cannot open source db: %s", path)
+      os.exit(1)
+    end
+
+    local row = db:query('SELECT learns FROM users WHERE id = 0;')
+    learns[i] = row and tonumber(row.learns) or 0
+
+    for tok in db:rows('SELECT token,value FROM tokens WHERE user = 0;') do
+      local counts = tokens[tok.token]
+      if not counts then
+        counts = { 0, 0 }
+        tokens[tok.token] = counts
+      end
+      counts[i] = counts[i] + (tonumber(tok.value) or 0)
+    end
+  end
+
+  for token, counts in pairs(tokens) do
+    writer.add_token(token, counts)
+  end
+
+  writer.finish(learns)
+end
+
+local function snapshot_handler(opts, cfg)
+  if opts.sqlite then
+    snapshot_from_sqlite(opts, cfg)
+  else
+    snapshot_from_redis(opts)
+  end
+end
+
 local function handler(args)
   local opts = parser:parse(args)
 
@@ -1292,6 +1537,8 @@ local function handler(args)
     restore_handler(opts)
   elseif command == 'migrate' then
     migrate_handler(opts)
+  elseif command == 'snapshot' then
+    snapshot_handler(opts, obj)
   else
     parser:error('command %s is not implemented', command)
   end
@@ -2893,6 +2893,21 @@ rspamd_controller_handle_stat_common(
 	ucl_object_insert_key(top,
 						  ucl_object_fromint(stat->control_connections_count),
 						  "control_connections", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->words_cache_hits),
+						  "words_cache_hits", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->words_cache_misses),
+						  "words_cache_misses", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_ascii),
+						  "charset_detect_ascii", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_utf8),
+						  "charset_detect_utf8", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_ced),
+						  "charset_detect_ced", 0, false);
 
 
 	ucl_object_insert_key(top,
@@ -2929,6 +2944,11 @@ rspamd_controller_handle_stat_common(
 		session->ctx->srv->stat->messages_learned = 0;
 		session->ctx->srv->stat->connections_count = 0;
 		session->ctx->srv->stat->control_connections_count = 0;
+		session->ctx->srv->stat->words_cache_hits = 0;
+		session->ctx->srv->stat->words_cache_misses = 0;
+		session->ctx->srv->stat->charset_detect_ascii = 0;
+		session->ctx->srv->stat->charset_detect_utf8 = 0;
+		session->ctx->srv->stat->charset_detect_ced = 0;
 		rspamd_mempool_stat_reset();
 	}
 
@@ -3165,6 +3185,11 @@ rspamd_controller_handle_metrics_common(
 		session->ctx->srv->stat->messages_learned = 0;
 		session->ctx->srv->stat->connections_count = 0;
 		session->ctx->srv->stat->control_connections_count = 0;
+		session->ctx->srv->stat->words_cache_hits = 0;
+		session->ctx->srv->stat->words_cache_misses = 0;
+		session->ctx->srv->stat->charset_detect_ascii = 0;
+		session->ctx->srv->stat->charset_detect_utf8 = 0;
+		session->ctx->srv->stat->charset_detect_ced = 0;
 		rspamd_mempool_stat_reset();
 	}
 
@@ -55,6 +55,9 @@
 /* TCP constants */
 #define FUZZY_TCP_BUFFER_LENGTH 8192
 #define DEFAULT_TCP_TIMEOUT 5.0
+/* Replication */
+#define DEFAULT_REPLICATION_LOG_SIZE (128 * 1024 * 1024)
+#define DEFAULT_REPLICATION_BATCH 1024
 
 static const char *local_db_name = "local";
 
@@ -137,6 +140,7 @@ struct rspamd_updates_cbdata {
 	GArray *updates_pending;
 	struct rspamd_fuzzy_storage_ctx *ctx;
 	char *source;
+	uint64_t replication_seq;
 	gboolean final;
 };
 
@@ -240,6 +244,7 @@ rspamd_fuzzy_updates_cb(gboolean success,
 						unsigned int ndeleted,
 						unsigned int nextended,
 						unsigned int nignored,
+						unsigned int ncommitted,
 						void *ud)
 {
 	struct rspamd_updates_cbdata *cbdata = ud;
@@ -259,6 +264,8 @@ rspamd_fuzzy_updates_cb(gboolean success,
 				 cbdata->updates_pending->len,
 				 ctx->updates_pending->len,
 				 nadded, ndeleted, nextended, nignored);
+		rspamd_fuzzy_replication_committed(ctx, cbdata->updates_pending,
+										   cbdata->replication_seq);
 		rspamd_fuzzy_backend_version(ctx->backend, source,
 									 fuzzy_update_version_callback, NULL);
 		ctx->updates_failed = 0;
@@ -269,7 +276,27 @@ rspamd_fuzzy_updates_cb(gboolean success,
 		}
 	}
 	else {
-		if (++ctx->updates_failed > ctx->updates_maxfail) {
+		if (ncommitted > 0) {
+			GArray *committed = g_array_sized_new(FALSE, FALSE,
+												  sizeof(struct fuzzy_peer_cmd),
+												  ncommitted);
+
+			/* Stored part of the queue is replicated and must not be retried */
+			g_array_append_vals(committed, cbdata->updates_pending->data, ncommitted);
+			rspamd_fuzzy_replication_committed(ctx, committed, 0);
+			g_array_free(committed, TRUE);
+			g_array_remove_range(cbdata->updates_pending, 0, ncommitted);
+		}
+
+		if (++ctx->updates_failed > ctx->updates_maxfail &&
+			rspamd_fuzzy_replication_hold(ctx, cbdata->replication_seq,
+										  cbdata->final ||
+											  ctx->worker->state != rspamd_worker_state_running)) {
+			/* Replica must not skip updates of primary, so retry them */
+			ctx->updates_failed = ctx->updates_maxfail;
+		}
+
+		if (ctx->updates_failed > ctx->updates_maxfail) {
 			msg_err("cannot commit update transaction to fuzzy backend %s, discard "
 					"%ud updates after %d retries",
 					ctx->worker->cf->bind_conf ? ctx->worker->cf->bind_conf->bind_line : "unknown",
@@ -291,10 +318,10 @@ rspamd_fuzzy_updates_cb(gboolean success,
 						cbdata->updates_pending->len,
 						ctx->updates_pending->len,
 						ctx->updates_maxfail - ctx->updates_failed);
-				/* Move the remaining updates to ctx queue */
-				g_array_append_vals(ctx->updates_pending,
-									cbdata->updates_pending->data,
-									cbdata->updates_pending->len);
+				/* Move the remaining updates to ctx queue before the newer ones */
+				g_array_prepend_vals(ctx->updates_pending,
+									 cbdata->updates_pending->data,
+									 cbdata->updates_pending->len);
 
 				if (cbdata->final) {
 					/* Try one more time */
@@ -328,6 +355,8 @@ rspamd_fuzzy_process_updates_queue(struct rspamd_fuzzy_storage_ctx *ctx,
 		cbdata = g_malloc(sizeof(*cbdata));
 		cbdata->ctx = ctx;
 		cbdata->final = final;
+		/* Everything received from the primary so far is in this batch */
+		cbdata->replication_seq = rspamd_fuzzy_replication_received(ctx);
 		cbdata->updates_pending = ctx->updates_pending;
 		ctx->updates_pending = g_array_sized_new(FALSE, FALSE,
 												 sizeof(struct fuzzy_peer_cmd),
@@ -2741,6 +2770,8 @@ init_fuzzy(struct rspamd_config *cfg)
 	ctx->leaky_bucket_rate = NAN;
 	ctx->delay = NAN;
 	ctx->tcp_timeout = DEFAULT_TCP_TIMEOUT;
+	ctx->replication_log_size = DEFAULT_REPLICATION_LOG_SIZE;
+	ctx->replication_batch = DEFAULT_REPLICATION_BATCH;
 	ctx->default_forbidden_ids = kh_init(fuzzy_key_ids_set);
 	rspamd_mempool_add_destructor(cfg->cfg_pool,
 								  (rspamd_mempool_destruct_t) kh_destroy_fuzzy_key_ids_set,
@@ -2975,6 +3006,64 @@ init_fuzzy(struct rspamd_config *cfg)
 									  0,
 									  "Don't really ban on ratelimit reaching, just log");
 
+	/* Replication */
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_log",
+									  rspamd_rcl_parse_struct_string,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_log),
+									  RSPAMD_CL_FLAG_STRING_PATH,
+									  "Path to the binary log of committed updates used for replication");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_log_size",
+									  rspamd_rcl_parse_struct_integer,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_log_size),
+									  RSPAMD_CL_FLAG_INT_SIZE,
+									  "Compact replication log when it grows over this size (default: 128Mb)");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_bind",
+									  rspamd_rcl_parse_struct_string,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_bind),
+									  0,
+									  "Serve replication log to replicas on this address (e.g. *:" G_STRINGIFY(RSPAMD_FUZZY_REPLICATION_PORT) ")");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_allow",
+									  rspamd_rcl_parse_struct_ucl,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_allow_map),
+									  0,
+									  "Allow replicas from these addresses (only local addresses are allowed by default)");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_master",
+									  rspamd_rcl_parse_struct_string,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_master),
+									  0,
+									  "Tail replication log of the specified primary storage and apply its updates");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_state",
+									  rspamd_rcl_parse_struct_string,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_state),
+									  RSPAMD_CL_FLAG_STRING_PATH,
+									  "File to store the last applied replication sequence (default: $DBDIR/fuzzy_replication.state)");
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "replication_batch",
+									  rspamd_rcl_parse_struct_integer,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_fuzzy_storage_ctx, replication_batch),
+									  RSPAMD_CL_FLAG_UINT,
+									  "Apply replicated updates in batches of this size (default: " G_STRINGIFY(DEFAULT_REPLICATION_BATCH) ")");
+
 
 	return ctx;
 }
@@ -3109,6 +3198,10 @@ start_fuzzy(struct rspamd_worker *worker)
 	if (ctx->keypair_cache_size > 0) {
 		/* Create keypairs cache */
 		ctx->keypair_cache = rspamd_keypair_cache_new(ctx->keypair_cache_size);
+
+		if (cfg->nm_cache) {
+			rspamd_keypair_cache_set_shared(ctx->keypair_cache, cfg->nm_cache);
+		}
 	}
 
 
@@ -3130,6 +3223,16 @@ start_fuzzy(struct rspamd_worker *worker)
 		rspamd_fuzzy_backend_start_update(ctx->backend, ctx->sync_timeout,
 										  rspamd_fuzzy_storage_periodic_callback, ctx);
 
+		if (ctx->replication_master && ctx->replication_state == NULL) {
+			ctx->replication_state = rspamd_mempool_strdup(cfg->cfg_pool,
+														   RSPAMD_DBDIR G_DIR_SEPARATOR_S "fuzzy_replication.state");
+		}
+
+		if (!rspamd_fuzzy_replication_init(ctx, worker,
+										   rspamd_fuzzy_process_updates_queue)) {
+			msg_err("cannot initialize fuzzy replication");
+		}
+
 		if (ctx->dedicated_update_worker && worker->cf->count > 1) {
 			msg_info_config("stop serving clients request in dedicated update mode");
 			rspamd_worker_stop_accept(worker);
@@ -3355,6 +3458,7 @@ start_fuzzy(struct rspamd_worker *worker)
 	rspamd_fuzzy_backend_close(ctx->backend);
 
 	if (worker->index == 0) {
+		rspamd_fuzzy_replication_destroy(ctx);
 		g_array_free(ctx->updates_pending, TRUE);
 		ctx->updates_pending = NULL;
 	}
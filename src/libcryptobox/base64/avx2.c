@@ -281,6 +281,41 @@ repeat:
 	return ret;
 }
 
+size_t qp_span_avx2(const char *in, size_t inlen,
+					char *out, int rfc2047) __attribute__((__target__("avx2")));
+size_t qp_span_avx2(const char *in, size_t inlen,
+					char *out, int rfc2047)
+{
+	const __m256i eq = _mm256_set1_epi8('='),
+				  us = _mm256_set1_epi8(rfc2047 ? '_' : '=');
+	size_t i = 0;
+
+	while (i + 32 <= inlen) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, eq),
+																 _mm256_cmpeq_epi8(v, us)));
+
+		/* Store the whole block, the caller overwrites the tail after a match */
+		_mm256_storeu_si256((__m256i *) (out + i), v);
+
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+
+		i += 32;
+	}
+
+	for (; i < inlen; i++) {
+		if (in[i] == '=' || (rfc2047 && in[i] == '_')) {
+			break;
+		}
+
+		out[i] = in[i];
+	}
+
+	return i;
+}
+
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC pop_options
 #endif
@@ -375,6 +375,109 @@ rspamd_cryptobox_base64_decode(const char *in, gsize inlen,
 	return opt_impl->decode(in, inlen, out, outlen);
 }
 
+typedef struct qp_impl {
+	unsigned short enabled;
+	unsigned short min_len;
+	unsigned int cpu_flags;
+	const char *desc;
+	size_t (*span)(const char *in, size_t inlen, char *out, int rfc2047);
+} qp_impl_t;
+
+#define QP_DECLARE(ext) \
+	size_t qp_span_##ext(const char *in, size_t inlen, char *out, int rfc2047);
+#define QP_IMPL(cpuflags, min_len, desc, ext)       \
+	{                                               \
+		0, (min_len), (cpuflags), desc, qp_span_##ext \
+	}
+
+QP_DECLARE(ref);
+#define QP_REF QP_IMPL(0, 0, "ref", ref)
+
+#ifdef RSPAMD_HAS_TARGET_ATTR
+#if defined(HAVE_SSE42) && defined(__x86_64__)
+size_t qp_span_sse42(const char *in, size_t inlen,
+					 char *out, int rfc2047) __attribute__((__target__("sse4.2")));
+
+#define QP_SSE42 QP_IMPL(CPUID_SSE42, 16, "sse42", sse42)
+#endif
+#endif
+
+#ifdef RSPAMD_HAS_TARGET_ATTR
+#if defined(HAVE_AVX2) && defined(__x86_64__)
+size_t qp_span_avx2(const char *in, size_t inlen,
+					char *out, int rfc2047) __attribute__((__target__("avx2")));
+
+#define QP_AVX2 QP_IMPL(CPUID_AVX2, 64, "avx2", avx2)
+#endif
+#endif
+
+static qp_impl_t qp_list[] = {
+	QP_REF,
+#ifdef QP_SSE42
+	QP_SSE42,
+#endif
+#ifdef QP_AVX2
+	QP_AVX2,
+#endif
+};
+
+static const qp_impl_t *qp_ref = &qp_list[0];
+
+size_t
+qp_span_ref(const char *in, size_t inlen, char *out, int rfc2047)
+{
+	const char *p;
+	size_t span;
+
+	if (rfc2047) {
+		span = rspamd_memcspn(in, inlen, "=_", 2);
+	}
+	else {
+		p = memchr(in, '=', inlen);
+		span = p ? p - in : inlen;
+	}
+
+	memcpy(out, in, span);
+
+	return span;
+}
+
+const char *
+qp_load(void)
+{
+	unsigned int i;
+	const qp_impl_t *opt_impl = qp_ref;
+
+	qp_list[0].enabled = true;
+
+	if (cpu_config != 0) {
+		for (i = 1; i < G_N_ELEMENTS(qp_list); i++) {
+			if (qp_list[i].cpu_flags & cpu_config) {
+				qp_list[i].enabled = true;
+				opt_impl = &qp_list[i];
+			}
+		}
+	}
+
+	return opt_impl->desc;
+}
+
+gsize
+rspamd_cryptobox_qp_span(const char *in, gsize inlen,
+						 char *out, gboolean rfc2047)
+{
+	const qp_impl_t *opt_impl = qp_ref;
+
+	for (int i = G_N_ELEMENTS(qp_list) - 1; i > 0; i--) {
+		if (qp_list[i].enabled && qp_list[i].min_len <= inlen) {
+			opt_impl = &qp_list[i];
+			break;
+		}
+	}
+
+	return opt_impl->span(in, inlen, out, rfc2047);
+}
+
 double
 base64_test(bool generic, size_t niters, size_t len, size_t str_len)
 {
@@ -24,6 +24,8 @@ extern "C" {
 
 const char *base64_load(void);
 
+const char *qp_load(void);
+
 #ifdef __cplusplus
 }
 #endif
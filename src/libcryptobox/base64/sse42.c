@@ -262,6 +262,41 @@ repeat:
 	return ret;
 }
 
+size_t qp_span_sse42(const char *in, size_t inlen,
+					 char *out, int rfc2047) __attribute__((__target__("sse4.2")));
+size_t qp_span_sse42(const char *in, size_t inlen,
+					 char *out, int rfc2047)
+{
+	const __m128i eq = _mm_set1_epi8('='),
+				  us = _mm_set1_epi8(rfc2047 ? '_' : '=');
+	size_t i = 0;
+
+	while (i + 16 <= inlen) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, eq),
+												  _mm_cmpeq_epi8(v, us)));
+
+		/* Store the whole block, the caller overwrites the tail after a match */
+		_mm_storeu_si128((__m128i *) (out + i), v);
+
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+
+		i += 16;
+	}
+
+	for (; i < inlen; i++) {
+		if (in[i] == '=' || (rfc2047 && in[i] == '_')) {
+			break;
+		}
+
+		out[i] = in[i];
+	}
+
+	return i;
+}
+
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC pop_options
 #endif
@@ -408,6 +408,7 @@ rspamd_cryptobox_init(void)
 
 	ctx->chacha20_impl = chacha_load();
 	ctx->base64_impl = base64_load();
+	ctx->qp_impl = qp_load();
 #if defined(HAVE_USABLE_OPENSSL) && (OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER))
 	/* Needed for old openssl api, not sure about LibreSSL */
 	ERR_load_EC_strings();
@@ -77,6 +77,7 @@ struct rspamd_cryptobox_library_ctx {
 	char *cpu_extensions;
 	const char *chacha20_impl;
 	const char *base64_impl;
+	const char *qp_impl;
 	unsigned long cpu_config;
 };
 
@@ -410,6 +411,19 @@ gboolean rspamd_cryptobox_base64_decode(const char *in, gsize inlen,
 */
 gboolean rspamd_cryptobox_base64_is_valid(const char *in, gsize inlen);
 
+/**
+* Copies input to output up to the first quoted-printable special character:
+* '=' or, if `rfc2047` is TRUE, also '_'. Output must have space for `inlen`
+* bytes, bytes after the copied span might be overwritten as well
+* @param in
+* @param inlen
+* @param out
+* @param rfc2047
+* @return number of bytes copied
+*/
+gsize rspamd_cryptobox_qp_span(const char *in, gsize inlen,
+							   char *out, gboolean rfc2047);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,14 +18,41 @@
 #include "keypair_private.h"
 #include "libutil/util.h"
 #include "hash.h"
+#include "mem_pool.h"
+#include "contrib/libottery/ottery.h"
+
+/* Number of slots probed for a single key in the shared cache */
+#define RSPAMD_KEYPAIR_SHARED_WAYS 4
+/* We store truncated ids of both keys, they are blake2b hashes anyway */
+#define RSPAMD_KEYPAIR_SHARED_IDLEN 32
 
 struct rspamd_keypair_elt {
 	struct rspamd_cryptobox_nm *nm;
 	unsigned char pair[rspamd_cryptobox_HASHBYTES * 2];
 };
 
+/*
+ * Element of the shared cache, protected by a sequence lock: `seq` is odd
+ * while the element is being written; readers never retry and treat a torn
+ * read as a cache miss
+ */
+struct rspamd_keypair_shared_elt {
+	uint64_t seq;
+	unsigned char pair[RSPAMD_KEYPAIR_SHARED_IDLEN * 2];
+	unsigned char nm[rspamd_cryptobox_MAX_NMBYTES];
+};
+
+struct rspamd_keypair_shared_cache {
+	uint64_t seed;
+	uint64_t mask; /* number of buckets - 1 */
+	uint64_t hits;
+	uint64_t misses;
+	struct rspamd_keypair_shared_elt elts[];
+};
+
 struct rspamd_keypair_cache {
 	rspamd_lru_hash_t *hash;
+	struct rspamd_keypair_shared_cache *shared;
 };
 
 static void
@@ -69,6 +96,141 @@ rspamd_keypair_cache_new(unsigned int max_items)
 	return c;
 }
 
+struct rspamd_keypair_shared_cache *
+rspamd_keypair_shared_cache_new(rspamd_mempool_t *pool, unsigned int max_items)
+{
+	struct rspamd_keypair_shared_cache *sc;
+	uint64_t nbuckets = 1;
+
+	g_assert(max_items > 0);
+
+	while (nbuckets * RSPAMD_KEYPAIR_SHARED_WAYS < max_items) {
+		nbuckets <<= 1;
+	}
+
+	/* Shared pages are zero filled, so all elements are empty initially */
+	sc = rspamd_mempool_alloc0_shared(pool,
+									  sizeof(*sc) +
+										  nbuckets * RSPAMD_KEYPAIR_SHARED_WAYS *
+											  sizeof(struct rspamd_keypair_shared_elt));
+	sc->seed = ottery_rand_uint64();
+	sc->mask = nbuckets - 1;
+
+	return sc;
+}
+
+void rspamd_keypair_cache_set_shared(struct rspamd_keypair_cache *c,
+									 struct rspamd_keypair_shared_cache *sc)
+{
+	g_assert(c != NULL);
+
+	c->shared = sc;
+}
+
+void rspamd_keypair_shared_cache_stat(struct rspamd_keypair_shared_cache *sc,
+									  uint64_t *hits, uint64_t *misses)
+{
+	g_assert(sc != NULL);
+
+	if (hits) {
+		*hits = __atomic_load_n(&sc->hits, __ATOMIC_RELAXED);
+	}
+
+	if (misses) {
+		*misses = __atomic_load_n(&sc->misses, __ATOMIC_RELAXED);
+	}
+}
+
+static inline struct rspamd_keypair_shared_elt *
+rspamd_keypair_shared_bucket(struct rspamd_keypair_shared_cache *sc,
+							 const unsigned char *pair, uint64_t *ph)
+{
+	uint64_t h = rspamd_cryptobox_fast_hash(pair, RSPAMD_KEYPAIR_SHARED_IDLEN * 2,
+											sc->seed);
+
+	*ph = h;
+
+	return &sc->elts[(h & sc->mask) * RSPAMD_KEYPAIR_SHARED_WAYS];
+}
+
+/*
+ * Lock-free lookup: copy nm out of the matching element and validate that
+ * the element has not been changed while we were copying it
+ */
+static gboolean
+rspamd_keypair_shared_lookup(struct rspamd_keypair_shared_cache *sc,
+							 const unsigned char *pair,
+							 unsigned char *nm)
+{
+	struct rspamd_keypair_shared_elt *bucket;
+	uint64_t h;
+
+	bucket = rspamd_keypair_shared_bucket(sc, pair, &h);
+
+	for (unsigned int i = 0; i < RSPAMD_KEYPAIR_SHARED_WAYS; i++) {
+		struct rspamd_keypair_shared_elt *elt = &bucket[i];
+		uint64_t seq = __atomic_load_n(&elt->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == 0 || (seq & 1)) {
+			continue;
+		}
+
+		if (memcmp(elt->pair, pair, sizeof(elt->pair)) == 0) {
+			memcpy(nm, elt->nm, sizeof(elt->nm));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (__atomic_load_n(&elt->seq, __ATOMIC_RELAXED) == seq) {
+				__atomic_add_fetch(&sc->hits, 1, __ATOMIC_RELAXED);
+
+				return TRUE;
+			}
+		}
+	}
+
+	__atomic_add_fetch(&sc->misses, 1, __ATOMIC_RELAXED);
+
+	return FALSE;
+}
+
+/*
+ * Writers never wait: if a slot is being updated by another process we
+ * just skip caching this value
+ */
+static void
+rspamd_keypair_shared_insert(struct rspamd_keypair_shared_cache *sc,
+							 const unsigned char *pair,
+							 const unsigned char *nm)
+{
+	struct rspamd_keypair_shared_elt *bucket, *elt = NULL;
+	uint64_t h, seq;
+
+	bucket = rspamd_keypair_shared_bucket(sc, pair, &h);
+
+	for (unsigned int i = 0; i < RSPAMD_KEYPAIR_SHARED_WAYS; i++) {
+		if (__atomic_load_n(&bucket[i].seq, __ATOMIC_RELAXED) == 0) {
+			elt = &bucket[i];
+			break;
+		}
+	}
+
+	if (elt == NULL) {
+		/* Bucket is full, evict pseudo-random element */
+		elt = &bucket[(h >> 32) % RSPAMD_KEYPAIR_SHARED_WAYS];
+	}
+
+	seq = __atomic_load_n(&elt->seq, __ATOMIC_RELAXED);
+
+	if ((seq & 1) ||
+		!__atomic_compare_exchange_n(&elt->seq, &seq, seq + 1, FALSE,
+									 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	memcpy(elt->pair, pair, sizeof(elt->pair));
+	memcpy(elt->nm, nm, sizeof(elt->nm));
+	__atomic_store_n(&elt->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 void rspamd_keypair_cache_process(struct rspamd_keypair_cache *c,
 								  struct rspamd_cryptobox_keypair *lk,
 								  struct rspamd_cryptobox_pubkey *rk)
@@ -105,12 +267,27 @@ void rspamd_keypair_cache_process(struct rspamd_keypair_cache *c,
 			   rspamd_cryptobox_HASHBYTES);
 		memcpy(&new->nm->sk_id, lk->id, sizeof(uint64_t));
 
-		struct rspamd_cryptobox_pubkey_25519 *rk_25519 =
-			RSPAMD_CRYPTOBOX_PUBKEY_25519(rk);
-		struct rspamd_cryptobox_keypair_25519 *sk_25519 =
-			RSPAMD_CRYPTOBOX_KEYPAIR_25519(lk);
+		unsigned char shared_pair[RSPAMD_KEYPAIR_SHARED_IDLEN * 2];
+
+		if (c->shared) {
+			memcpy(shared_pair, rk->id, RSPAMD_KEYPAIR_SHARED_IDLEN);
+			memcpy(&shared_pair[RSPAMD_KEYPAIR_SHARED_IDLEN], lk->id,
+				   RSPAMD_KEYPAIR_SHARED_IDLEN);
+		}
+
+		if (c->shared == NULL ||
+			!rspamd_keypair_shared_lookup(c->shared, shared_pair, new->nm->nm)) {
+			struct rspamd_cryptobox_pubkey_25519 *rk_25519 =
+				RSPAMD_CRYPTOBOX_PUBKEY_25519(rk);
+			struct rspamd_cryptobox_keypair_25519 *sk_25519 =
+				RSPAMD_CRYPTOBOX_KEYPAIR_25519(lk);
 
-		rspamd_cryptobox_nm(new->nm->nm, rk_25519->pk, sk_25519->sk);
+			rspamd_cryptobox_nm(new->nm->nm, rk_25519->pk, sk_25519->sk);
+
+			if (c->shared) {
+				rspamd_keypair_shared_insert(c->shared, shared_pair, new->nm->nm);
+			}
+		}
 
 		rspamd_lru_hash_insert(c->hash, new, new, time(NULL), -1);
 	}
@@ -18,6 +18,7 @@
 
 #include "config.h"
 #include "keypair.h"
+#include "mem_pool.h"
 
 
 #ifdef __cplusplus
@@ -25,6 +26,7 @@ extern "C" {
 #endif
 
 struct rspamd_keypair_cache;
+struct rspamd_keypair_shared_cache;
 
 /**
  * Create new keypair cache of the specified size
@@ -44,6 +46,33 @@ void rspamd_keypair_cache_process(struct rspamd_keypair_cache *c,
 								  struct rspamd_cryptobox_keypair *lk,
 								  struct rspamd_cryptobox_pubkey *rk);
 
+/**
+ * Create a cache of shared secrets placed in the shared memory of the pool,
+ * so it must be created before workers are forked. Lookups are lock-free.
+ * @param pool memory pool (shared memory is allocated from it)
+ * @param max_items approximate number of elements in the cache
+ * @return new shared cache
+ */
+struct rspamd_keypair_shared_cache *rspamd_keypair_shared_cache_new(rspamd_mempool_t *pool,
+																	unsigned int max_items);
+
+/**
+ * Use shared cache as the second level for the specified keypairs cache
+ * @param c cache of keypairs
+ * @param sc shared cache (or NULL to disable)
+ */
+void rspamd_keypair_cache_set_shared(struct rspamd_keypair_cache *c,
+									 struct rspamd_keypair_shared_cache *sc);
+
+/**
+ * Get hits and misses of the shared cache (across all processes)
+ * @param sc shared cache
+ * @param hits output hits (may be NULL)
+ * @param misses output misses (may be NULL)
+ */
+void rspamd_keypair_shared_cache_stat(struct rspamd_keypair_shared_cache *sc,
+									  uint64_t *hits, uint64_t *misses);
+
 /**
  * Destroy old keypair cache
  * @param c cache object
@@ -28,6 +28,7 @@
 #include <archive_entry.h>
 #include <zlib.h>
 #include "ottery.h"
+#include "hash.h"
 
 #define msg_debug_archive(...) rspamd_conditional_debug_fast(NULL, NULL,                                                 \
 															 rspamd_archive_log_id, "archive", task->task_pool->tag.uid, \
@@ -71,6 +72,132 @@ rspamd_archive_dtor(gpointer p)
 	g_ptr_array_free(arch->files, TRUE);
 }
 
+/* Archive listings are reused for the same attachments in the bulk mail */
+struct rspamd_archive_cache_entry {
+	unsigned char digest[rspamd_cryptobox_HASHBYTES];
+	struct rspamd_archive arch;
+};
+
+static rspamd_lru_hash_t *archives_hash = NULL;
+
+static void
+rspamd_archive_cache_entry_dtor(gpointer p)
+{
+	struct rspamd_archive_cache_entry *entry = p;
+
+	rspamd_archive_dtor(&entry->arch);
+	g_free(entry);
+}
+
+static uint32_t
+rspamd_archive_digest_hash(gconstpointer p)
+{
+	return rspamd_cryptobox_fast_hash(p, rspamd_cryptobox_HASHBYTES,
+									  rspamd_hash_seed());
+}
+
+static gboolean
+rspamd_archive_digest_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, rspamd_cryptobox_HASHBYTES) == 0;
+}
+
+static GPtrArray *
+rspamd_archive_copy_files(GPtrArray *files)
+{
+	GPtrArray *res = g_ptr_array_sized_new(files->len);
+	struct rspamd_archive_file *f, *copy;
+	unsigned int i;
+
+	PTR_ARRAY_FOREACH(files, i, f)
+	{
+		copy = g_malloc(sizeof(*copy));
+		memcpy(copy, f, sizeof(*copy));
+
+		if (f->fname) {
+			copy->fname = g_string_new_len(f->fname->str, f->fname->len);
+		}
+
+		g_ptr_array_add(res, copy);
+	}
+
+	return res;
+}
+
+static gboolean
+rspamd_archive_check_cache(struct rspamd_task *task,
+						   struct rspamd_mime_part *part,
+						   enum rspamd_archive_type type)
+{
+	struct rspamd_archive_cache_entry *found;
+	struct rspamd_archive *arch;
+
+	if (archives_hash == NULL) {
+		if (task->cfg == NULL || task->cfg->archives_cache_size == 0) {
+			return FALSE;
+		}
+
+		archives_hash = rspamd_lru_hash_new_full(task->cfg->archives_cache_size, NULL,
+												 rspamd_archive_cache_entry_dtor,
+												 rspamd_archive_digest_hash,
+												 rspamd_archive_digest_equal);
+	}
+
+	found = rspamd_lru_hash_lookup(archives_hash, rspamd_mime_part_get_digest(part),
+								   task->tv.tv_sec);
+
+	if (found == NULL || found->arch.type != type) {
+		return FALSE;
+	}
+
+	/* Copy as found could be destroyed by LRU */
+	arch = rspamd_mempool_alloc0(task->task_pool, sizeof(*arch));
+	arch->type = found->arch.type;
+	arch->size = found->arch.size;
+	arch->flags = found->arch.flags;
+	arch->files = rspamd_archive_copy_files(found->arch.files);
+
+	if (part->cd) {
+		arch->archive_name = &part->cd->filename;
+	}
+
+	rspamd_mempool_add_destructor(task->task_pool, rspamd_archive_dtor,
+								  arch);
+	part->part_type = RSPAMD_MIME_PART_ARCHIVE;
+	part->specific.arch = arch;
+	msg_debug_archive("reuse cached %s archive listing of %ud files",
+					  rspamd_archive_type_str(type), arch->files->len);
+
+	return TRUE;
+}
+
+static void
+rspamd_archive_save_cache(struct rspamd_task *task,
+						  struct rspamd_mime_part *part)
+{
+	struct rspamd_archive_cache_entry *entry;
+	struct rspamd_archive *arch = part->specific.arch;
+
+	if (archives_hash == NULL || part->part_type != RSPAMD_MIME_PART_ARCHIVE ||
+		arch == NULL) {
+		return;
+	}
+
+	if (rspamd_lru_hash_lookup(archives_hash, rspamd_mime_part_get_digest(part), task->tv.tv_sec)) {
+		return;
+	}
+
+	entry = g_malloc0(sizeof(*entry));
+	memcpy(entry->digest, rspamd_mime_part_get_digest(part), sizeof(entry->digest));
+	entry->arch.type = arch->type;
+	entry->arch.size = arch->size;
+	entry->arch.flags = arch->flags;
+	entry->arch.files = rspamd_archive_copy_files(arch->files);
+
+	rspamd_lru_hash_insert(archives_hash, entry->digest, entry,
+						   task->tv.tv_sec, 0);
+}
+
 
 static bool
 rspamd_archive_file_try_utf(struct rspamd_task *task,
@@ -2057,19 +2184,38 @@ void rspamd_archives_process(struct rspamd_task *task)
 
 	PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, parts), i, part)
 	{
-		if (part->parsed_data.len > 0 && part->part_type != RSPAMD_MIME_PART_ARCHIVE) {
+		if (part->part_type != RSPAMD_MIME_PART_ARCHIVE &&
+			rspamd_mime_part_has_content(part)) {
 			const char *ext = part->detected_ext;
 			if (ext) {
+				/* Parts are decoded only if they are archives */
 				if (g_ascii_strcasecmp(ext, "zip") == 0) {
-					rspamd_archive_process_zip(task, part);
+					rspamd_mime_part_get_content(part);
+
+					if (!rspamd_archive_check_cache(task, part, RSPAMD_ARCHIVE_ZIP)) {
+						rspamd_archive_process_zip(task, part);
+						rspamd_archive_save_cache(task, part);
+					}
 				}
 				else if (g_ascii_strcasecmp(ext, "rar") == 0) {
-					rspamd_archive_process_rar(task, part);
+					rspamd_mime_part_get_content(part);
+
+					if (!rspamd_archive_check_cache(task, part, RSPAMD_ARCHIVE_RAR)) {
+						rspamd_archive_process_rar(task, part);
+						rspamd_archive_save_cache(task, part);
+					}
 				}
 				else if (g_ascii_strcasecmp(ext, "7z") == 0) {
-					rspamd_archive_process_7zip(task, part);
+					rspamd_mime_part_get_content(part);
+
+					if (!rspamd_archive_check_cache(task, part, RSPAMD_ARCHIVE_7ZIP)) {
+						rspamd_archive_process_7zip(task, part);
+						rspamd_archive_save_cache(task, part);
+					}
 				}
 				else if (g_ascii_strcasecmp(ext, "gz") == 0) {
+					rspamd_mime_part_get_content(part);
+					/* Not cached: the file name might come from the part's filename */
 					rspamd_archive_process_gzip(task, part);
 				}
 			}
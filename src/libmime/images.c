@@ -18,6 +18,7 @@
 #include "task.h"
 #include "message.h"
 #include "libserver/html/html.h"
+#include "hash.h"
 
 #define msg_debug_images(...) rspamd_conditional_debug_fast(NULL, NULL,                                               \
 															rspamd_images_log_id, "images", task->task_pool->tag.uid, \
@@ -28,13 +29,22 @@ INIT_LOG_MODULE(images)
 
 #ifdef USABLE_GD
 #include "gd.h"
-#include "hash.h"
 #include <math.h>
 
 #define RSPAMD_NORMALIZED_DIM 64
+#endif
+
+/* Metadata and DCT of images are reused for the same attachments */
+struct rspamd_image_cache_entry {
+	unsigned char digest[64];
+	enum rspamd_image_type type;
+	uint32_t width;
+	uint32_t height;
+	gboolean has_dct;
+	unsigned char dct[RSPAMD_DCT_LEN / NBBY];
+};
 
 static rspamd_lru_hash_t *images_hash = NULL;
-#endif
 
 static const uint8_t png_signature[] = {137, 80, 78, 71, 13, 10, 26, 10};
 static const uint8_t jpg_sig1[] = {0xff, 0xd8};
@@ -52,7 +62,7 @@ bool rspamd_images_process_mime_part_maybe(struct rspamd_task *task,
 	if (part->part_type == RSPAMD_MIME_PART_UNDEFINED) {
 		if (part->detected_type &&
 			strcmp(part->detected_type, "image") == 0 &&
-			part->parsed_data.len > 0) {
+			rspamd_mime_part_get_content(part)->len > 0) {
 
 			return process_image(task, part);
 		}
@@ -368,52 +378,19 @@ rspamd_image_dct_block(int pixels[8][8], double *out)
 	}
 }
 
-struct rspamd_image_cache_entry {
-	unsigned char digest[64];
-	unsigned char dct[RSPAMD_DCT_LEN / NBBY];
-};
-
-static void
-rspamd_image_cache_entry_dtor(gpointer p)
-{
-	struct rspamd_image_cache_entry *entry = p;
-	g_free(entry);
-}
-
-static uint32_t
-rspamd_image_dct_hash(gconstpointer p)
-{
-	return rspamd_cryptobox_fast_hash(p, rspamd_cryptobox_HASHBYTES,
-									  rspamd_hash_seed());
-}
-
-static gboolean
-rspamd_image_dct_equal(gconstpointer a, gconstpointer b)
-{
-	return memcmp(a, b, rspamd_cryptobox_HASHBYTES) == 0;
-}
-
-static void
-rspamd_image_create_cache(struct rspamd_config *cfg)
-{
-	images_hash = rspamd_lru_hash_new_full(cfg->images_cache_size, NULL,
-										   rspamd_image_cache_entry_dtor,
-										   rspamd_image_dct_hash, rspamd_image_dct_equal);
-}
-
 static gboolean
 rspamd_image_check_hash(struct rspamd_task *task, struct rspamd_image *img)
 {
 	struct rspamd_image_cache_entry *found;
 
 	if (images_hash == NULL) {
-		rspamd_image_create_cache(task->cfg);
+		return FALSE;
 	}
 
-	found = rspamd_lru_hash_lookup(images_hash, img->parent->digest,
+	found = rspamd_lru_hash_lookup(images_hash, rspamd_mime_part_get_digest(img->parent),
 								   task->tv.tv_sec);
 
-	if (found) {
+	if (found && found->has_dct) {
 		/* We need to decompress */
 		img->dct = g_malloc(RSPAMD_DCT_LEN / NBBY);
 		rspamd_mempool_add_destructor(task->task_pool, g_free,
@@ -433,17 +410,14 @@ rspamd_image_save_hash(struct rspamd_task *task, struct rspamd_image *img)
 {
 	struct rspamd_image_cache_entry *found;
 
-	if (img->is_normalized) {
-		found = rspamd_lru_hash_lookup(images_hash, img->parent->digest,
+	if (img->is_normalized && images_hash != NULL) {
+		found = rspamd_lru_hash_lookup(images_hash, rspamd_mime_part_get_digest(img->parent),
 									   task->tv.tv_sec);
 
-		if (!found) {
-			found = g_malloc0(sizeof(*found));
+		/* Metadata entry is normally inserted when the image is parsed */
+		if (found && !found->has_dct) {
 			memcpy(found->dct, img->dct, RSPAMD_DCT_LEN / NBBY);
-			memcpy(found->digest, img->parent->digest, sizeof(found->digest));
-
-			rspamd_lru_hash_insert(images_hash, found->digest, found,
-								   task->tv.tv_sec, 0);
+			found->has_dct = TRUE;
 		}
 	}
 }
@@ -603,38 +577,135 @@ rspamd_maybe_process_image(rspamd_mempool_t *pool,
 	return img;
 }
 
+static void
+rspamd_image_cache_entry_dtor(gpointer p)
+{
+	struct rspamd_image_cache_entry *entry = p;
+	g_free(entry);
+}
+
+static uint32_t
+rspamd_image_dct_hash(gconstpointer p)
+{
+	return rspamd_cryptobox_fast_hash(p, rspamd_cryptobox_HASHBYTES,
+									  rspamd_hash_seed());
+}
+
+static gboolean
+rspamd_image_dct_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, rspamd_cryptobox_HASHBYTES) == 0;
+}
+
+static struct rspamd_image *
+rspamd_image_check_cache(struct rspamd_task *task, struct rspamd_mime_part *part,
+						 enum rspamd_image_type type)
+{
+	struct rspamd_image_cache_entry *found;
+	struct rspamd_image *img;
+
+	if (images_hash == NULL) {
+		if (task->cfg == NULL || task->cfg->images_cache_size == 0) {
+			return NULL;
+		}
+
+		images_hash = rspamd_lru_hash_new_full(task->cfg->images_cache_size, NULL,
+											   rspamd_image_cache_entry_dtor,
+											   rspamd_image_dct_hash, rspamd_image_dct_equal);
+	}
+
+	found = rspamd_lru_hash_lookup(images_hash, rspamd_mime_part_get_digest(part), task->tv.tv_sec);
+
+	if (found == NULL || (type != IMAGE_TYPE_UNKNOWN && found->type != type)) {
+		return NULL;
+	}
+
+	img = rspamd_mempool_alloc0(task->task_pool, sizeof(*img));
+	img->type = found->type;
+	img->data = &part->parsed_data;
+	img->width = found->width;
+	img->height = found->height;
+	msg_debug_images("reuse cached %s image metadata: %ud x %ud",
+					 rspamd_image_type_str(img->type), img->width, img->height);
+
+	return img;
+}
+
+static void
+rspamd_image_save_cache(struct rspamd_task *task, struct rspamd_mime_part *part,
+						struct rspamd_image *img)
+{
+	struct rspamd_image_cache_entry *entry;
+
+	if (images_hash == NULL ||
+		rspamd_lru_hash_lookup(images_hash, rspamd_mime_part_get_digest(part), task->tv.tv_sec)) {
+		return;
+	}
+
+	entry = g_malloc0(sizeof(*entry));
+	memcpy(entry->digest, rspamd_mime_part_get_digest(part), sizeof(entry->digest));
+	entry->type = img->type;
+	entry->width = img->width;
+	entry->height = img->height;
+
+	rspamd_lru_hash_insert(images_hash, entry->digest, entry,
+						   task->tv.tv_sec, 0);
+}
+
 static bool
 process_image(struct rspamd_task *task, struct rspamd_mime_part *part)
 {
 	struct rspamd_image *img;
 	const char *ext = part->detected_ext;
+	enum rspamd_image_type type = IMAGE_TYPE_UNKNOWN;
 
 	if (ext != NULL && part->parsed_data.len > 0) {
 		/* Prefer Lua Magic decision; do not re-detect by magic */
 		if (g_ascii_strcasecmp(ext, "png") == 0) {
-			img = process_png_image(task->task_pool, &part->parsed_data);
+			type = IMAGE_TYPE_PNG;
 		}
 		else if (g_ascii_strcasecmp(ext, "jpg") == 0 || g_ascii_strcasecmp(ext, "jpeg") == 0) {
-			img = process_jpg_image(task->task_pool, &part->parsed_data);
+			type = IMAGE_TYPE_JPG;
 		}
 		else if (g_ascii_strcasecmp(ext, "gif") == 0) {
-			img = process_gif_image(task->task_pool, &part->parsed_data);
+			type = IMAGE_TYPE_GIF;
 		}
 		else if (g_ascii_strcasecmp(ext, "bmp") == 0) {
-			img = process_bmp_image(task->task_pool, &part->parsed_data);
+			type = IMAGE_TYPE_BMP;
 		}
 		else {
 			/* Unsupported image subtype for structural parsing; skip without re-magic */
 			return false;
 		}
 	}
-	else {
-		/* Fallback for legacy/unknown cases */
-		img = rspamd_maybe_process_image(task->task_pool, &part->parsed_data);
-	}
+
+	img = rspamd_image_check_cache(task, part, type);
 
 	if (img == NULL) {
-		return false;
+		switch (type) {
+		case IMAGE_TYPE_PNG:
+			img = process_png_image(task->task_pool, &part->parsed_data);
+			break;
+		case IMAGE_TYPE_JPG:
+			img = process_jpg_image(task->task_pool, &part->parsed_data);
+			break;
+		case IMAGE_TYPE_GIF:
+			img = process_gif_image(task->task_pool, &part->parsed_data);
+			break;
+		case IMAGE_TYPE_BMP:
+			img = process_bmp_image(task->task_pool, &part->parsed_data);
+			break;
+		default:
+			/* Fallback for legacy/unknown cases */
+			img = rspamd_maybe_process_image(task->task_pool, &part->parsed_data);
+			break;
+		}
+
+		if (img == NULL) {
+			return false;
+		}
+
+		rspamd_image_save_cache(task, part, img);
 	}
 
 	img->parent = part;
@@ -24,6 +24,7 @@
 #include "libstemmer.h"
 
 #include <glob.h>
+#include <sys/mman.h>
 #include <unicode/utf8.h>
 #include <unicode/utf16.h>
 #include <unicode/ucnv.h>
@@ -35,6 +36,7 @@ static const gsize default_short_text_limit = 10;
 static const gsize default_words = 80;
 static const double update_prob = 0.6;
 static const char *default_languages_path = RSPAMD_SHAREDIR "/languages";
+static const char *default_compiled_languages = "languages.bin";
 
 #undef EXTRA_LANGDET_DEBUG
 
@@ -88,6 +90,7 @@ struct rspamd_language_elt {
 	double mean;
 	double std;
 	unsigned int occurrences; /* total number of parts with this language */
+	unsigned int ngramm_idx;  /* index in the packed trigrams of the category */
 };
 
 struct rspamd_ngramm_elt {
@@ -102,6 +105,29 @@ struct rspamd_ngramm_chain {
 	char *utf;
 };
 
+/*
+ * Trigrams of a category packed for scoring: open addressing table of trigrams
+ * packed into 64 bit keys, each slot refers to a contiguous run of
+ * (language index, probability) pairs, so scoring a trigram costs one probe in
+ * most cases and a sequential scan
+ */
+struct rspamd_trigram_slot {
+	uint64_t key; /* 0 for empty slots */
+	uint32_t start;
+	uint32_t len;
+};
+
+struct rspamd_trigrams_packed {
+	struct rspamd_trigram_slot *slots;
+	unsigned int mask;
+	unsigned int nlangs;
+	unsigned int nelts;
+	unsigned int ntrigrams;
+	struct rspamd_language_elt **langs;
+	uint16_t *lang_idx;
+	double *probs;
+};
+
 struct rspamd_stop_word_range {
 	unsigned int start;
 	unsigned int stop;
@@ -113,6 +139,53 @@ struct rspamd_stop_word_elt {
 	GArray *ranges; /* of rspamd_stop_word_range */
 };
 
+/*
+ * Compiled languages data written by rspamd_language_detector_compile:
+ * header, languages grouped by category in the order of the packed trigrams,
+ * NUL separated stop words and the packed trigrams of each category exactly
+ * as they are used for scoring. Arrays are aligned to 16 bytes, numbers are
+ * stored in the host byte order
+ */
+#define RSPAMD_LANGUAGES_COMPILED_MAGIC "rsldata1"
+/* Version 2: trigrams below the chain mean are no longer packed */
+#define RSPAMD_LANGUAGES_COMPILED_VERSION 2u
+#define RSPAMD_LANGUAGES_COMPILED_BOM 0x01020304u
+#define RSPAMD_LANGUAGES_COMPILED_ALIGN 16u
+
+struct rspamd_languages_compiled_category {
+	uint32_t langs_base; /* index of the first language of the category */
+	uint32_t nlangs;
+	uint32_t nslots; /* power of two */
+	uint32_t nelts;
+	uint32_t ntrigrams;
+	uint32_t padding;
+	uint64_t slots_off;
+	uint64_t lang_idx_off;
+	uint64_t probs_off;
+};
+
+struct rspamd_languages_compiled_lang {
+	char name[16];
+	int32_t flags;
+	uint32_t category;
+	uint32_t trigrams_words;
+	uint32_t nstop_words;
+	uint64_t stop_words_off;
+	uint64_t stop_words_len;
+	double mean;
+	double std;
+};
+
+struct rspamd_languages_compiled_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t bom;
+	uint32_t nlangs;
+	uint32_t padding;
+	uint64_t langs_off;
+	struct rspamd_languages_compiled_category categories[RSPAMD_LANGUAGE_MAX];
+};
+
 #define msg_debug_lang_det(...) rspamd_conditional_debug_fast(NULL, NULL,                                                 \
 															  rspamd_langdet_log_id, "langdet", task->task_pool->tag.uid, \
 															  G_STRFUNC,                                                  \
@@ -178,7 +251,8 @@ KHASH_INIT(rspamd_languages_hash, const char *, struct rspamd_language_elt *, tr
 		   rspamd_str_hash, rspamd_str_equal);
 struct rspamd_lang_detector {
 	khash_t(rspamd_languages_hash) * languages;
-	khash_t(rspamd_trigram_hash) * trigrams[RSPAMD_LANGUAGE_MAX]; /* trigrams frequencies */
+	khash_t(rspamd_trigram_hash) * trigrams[RSPAMD_LANGUAGE_MAX]; /* trigrams frequencies, used on load only */
+	struct rspamd_trigrams_packed packed_trigrams[RSPAMD_LANGUAGE_MAX];
 	struct rspamd_stop_word_elt stop_words[RSPAMD_LANGUAGE_MAX];
 	khash_t(rspamd_stopwords_hash) * stop_words_norm;
 	UConverter *uchar_converter;
@@ -186,6 +260,8 @@ struct rspamd_lang_detector {
 	bool prefer_fasttext;
 	gsize total_occurrences; /* number of all languages found */
 	gpointer fasttext_detector;
+	gpointer map; /* compiled languages data, packed trigrams point there */
+	gsize map_len;
 	ref_entry_t ref;
 };
 
@@ -350,6 +426,64 @@ rspamd_language_detector_cmp_ngramm(gconstpointer a, gconstpointer b)
 	return (int) e2->freq - (int) e1->freq;
 }
 
+static void
+rspamd_language_detector_add_stop_word(struct rspamd_config *cfg,
+									   struct rspamd_lang_detector *d,
+									   struct rspamd_language_elt *nelt,
+									   struct sb_stemmer *stem,
+									   const char *word, gsize wlen)
+{
+	const char *saved = word;
+	unsigned int mp_flags = RSPAMD_MULTIPATTERN_ICASE | RSPAMD_MULTIPATTERN_UTF8;
+	rspamd_ftok_t *tok;
+	char *dst;
+	int rc;
+
+	if (rspamd_multipattern_has_hyperscan()) {
+		mp_flags |= RSPAMD_MULTIPATTERN_RE;
+	}
+
+	rspamd_multipattern_add_pattern_len(d->stop_words[nelt->category].mp,
+										word, wlen,
+										mp_flags);
+	nelt->stop_words++;
+
+	/* Also lemmatise and store normalised */
+	if (stem) {
+		const char *nw = sb_stemmer_stem(stem, word, wlen);
+
+		if (nw) {
+			saved = nw;
+			wlen = strlen(nw);
+		}
+	}
+
+	tok = rspamd_mempool_alloc(cfg->cfg_pool,
+							   sizeof(*tok) + wlen + 1);
+	dst = ((char *) tok) + sizeof(*tok);
+	rspamd_strlcpy(dst, saved, wlen + 1);
+	tok->begin = dst;
+	tok->len = wlen;
+
+	kh_put(rspamd_stopwords_hash, d->stop_words_norm,
+		   tok, &rc);
+}
+
+/* Binds stop words added since `start` pattern to the language */
+static void
+rspamd_language_detector_add_stop_words_range(struct rspamd_lang_detector *d,
+											  struct rspamd_language_elt *nelt,
+											  unsigned int start)
+{
+	struct rspamd_stop_word_range r;
+
+	r.start = start;
+	r.stop = rspamd_multipattern_get_npatterns(d->stop_words[nelt->category].mp);
+	r.elt = nelt;
+
+	g_array_append_val(d->stop_words[nelt->category].ranges, r);
+}
+
 static void
 rspamd_language_detector_read_file(struct rspamd_config *cfg,
 								   struct rspamd_lang_detector *d,
@@ -471,6 +605,8 @@ rspamd_language_detector_read_file(struct rspamd_config *cfg,
 		}
 	}
 
+	nelt->category = cat;
+
 	if (stop_words) {
 		const ucl_object_t *specific_stop_words;
 
@@ -478,80 +614,30 @@ rspamd_language_detector_read_file(struct rspamd_config *cfg,
 
 		if (specific_stop_words) {
 			struct sb_stemmer *stem = NULL;
-			it = NULL;
 			const ucl_object_t *w;
-			unsigned int start, stop;
+			unsigned int start;
 
 			stem = sb_stemmer_new(nelt->name, "UTF_8");
 			start = rspamd_multipattern_get_npatterns(d->stop_words[cat].mp);
+			it = NULL;
 
 			while ((w = ucl_object_iterate(specific_stop_words, &it, true)) != NULL) {
 				gsize wlen;
 				const char *word = ucl_object_tolstring(w, &wlen);
-				const char *saved;
-				unsigned int mp_flags = RSPAMD_MULTIPATTERN_ICASE | RSPAMD_MULTIPATTERN_UTF8;
-
-				if (rspamd_multipattern_has_hyperscan()) {
-					mp_flags |= RSPAMD_MULTIPATTERN_RE;
-				}
-
-				rspamd_multipattern_add_pattern_len(d->stop_words[cat].mp,
-													word, wlen,
-													mp_flags);
-				nelt->stop_words++;
-
-				/* Also lemmatise and store normalised */
-				if (stem) {
-					const char *nw = sb_stemmer_stem(stem, word, wlen);
-
-
-					if (nw) {
-						saved = nw;
-						wlen = strlen(nw);
-					}
-					else {
-						saved = word;
-					}
-				}
-				else {
-					saved = word;
-				}
-
-				if (saved) {
-					int rc;
-					rspamd_ftok_t *tok;
-					char *dst;
 
-					tok = rspamd_mempool_alloc(cfg->cfg_pool,
-											   sizeof(*tok) + wlen + 1);
-					dst = ((char *) tok) + sizeof(*tok);
-					rspamd_strlcpy(dst, saved, wlen + 1);
-					tok->begin = dst;
-					tok->len = wlen;
-
-					kh_put(rspamd_stopwords_hash, d->stop_words_norm,
-						   tok, &rc);
-				}
+				rspamd_language_detector_add_stop_word(cfg, d, nelt, stem,
+													   word, wlen);
 			}
 
 			if (stem) {
 				sb_stemmer_delete(stem);
 			}
 
-			stop = rspamd_multipattern_get_npatterns(d->stop_words[cat].mp);
-
-			struct rspamd_stop_word_range r;
-
-			r.start = start;
-			r.stop = stop;
-			r.elt = nelt;
-
-			g_array_append_val(d->stop_words[cat].ranges, r);
+			rspamd_language_detector_add_stop_words_range(d, nelt, start);
 			it = NULL;
 		}
 	}
 
-	nelt->category = cat;
 	htb = d->trigrams[cat];
 
 	GPtrArray *ngramms;
@@ -757,11 +843,15 @@ rspamd_language_detector_process_chain(struct rspamd_config *cfg,
 		chain->mean = mean;
 		chain->std = std;
 
-		/* Now, filter elements that are lower than mean */
-		PTR_ARRAY_FOREACH(chain->languages, i, elt)
-		{
+		/*
+		 * Now, filter elements that are lower than mean; backwards, as the
+		 * last element is moved to the removed position
+		 */
+		for (i = chain->languages->len; i > 0; i--) {
+			elt = g_ptr_array_index(chain->languages, i - 1);
+
 			if (elt->prob < mean) {
-				g_ptr_array_remove_index_fast(chain->languages, i);
+				g_ptr_array_remove_index_fast(chain->languages, i - 1);
 #ifdef EXTRA_LANGDET_DEBUG
 				msg_debug_lang_det_cfg("remove %s from %s; prob: %.4f; mean: %.4f, std: %.4f",
 									   elt->elt->name, chain->utf, elt->prob, mean, std);
@@ -782,12 +872,467 @@ rspamd_language_detector_process_chain(struct rspamd_config *cfg,
 	}
 }
 
+static inline uint64_t
+rspamd_language_detector_pack_trigram(const UChar32 *s)
+{
+	if ((uint32_t) s[0] > 0x10FFFF || (uint32_t) s[1] > 0x10FFFF ||
+		(uint32_t) s[2] > 0x10FFFF) {
+		return 0;
+	}
+
+	return ((uint64_t) s[0] << 42u) | ((uint64_t) s[1] << 21u) | (uint64_t) s[2];
+}
+
+static inline unsigned int
+rspamd_language_detector_trigram_slot(uint64_t key, unsigned int mask)
+{
+	return (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 32u) & mask;
+}
+
+static inline const struct rspamd_trigram_slot *
+rspamd_language_detector_trigram_lookup(const struct rspamd_trigrams_packed *packed,
+										const UChar32 *window)
+{
+	uint64_t key = rspamd_language_detector_pack_trigram(window);
+	unsigned int i;
+
+	if (key == 0 || packed->slots == NULL) {
+		return NULL;
+	}
+
+	i = rspamd_language_detector_trigram_slot(key, packed->mask);
+
+	for (;;) {
+		if (packed->slots[i].key == key) {
+			return &packed->slots[i];
+		}
+		else if (packed->slots[i].key == 0) {
+			return NULL;
+		}
+
+		i = (i + 1) & packed->mask;
+	}
+}
+
+static void
+rspamd_language_detector_pack_trigrams(struct rspamd_lang_detector *d,
+									   enum rspamd_language_category cat)
+{
+	struct rspamd_trigrams_packed *packed = &d->packed_trigrams[cat];
+	khash_t(rspamd_trigram_hash) *htb = d->trigrams[cat];
+	struct rspamd_language_elt *lelt;
+	struct rspamd_ngramm_elt *elt;
+	struct rspamd_ngramm_chain chain;
+	const UChar32 *trigram;
+	unsigned int nslots = 16, nelts = 0, pos = 0, i, j;
+	uint64_t key;
+
+	kh_foreach_value(d->languages, lelt, {
+		if (lelt->category == cat) {
+			packed->nlangs++;
+		}
+	});
+
+	packed->langs = g_new0(struct rspamd_language_elt *, packed->nlangs);
+	i = 0;
+
+	kh_foreach_value(d->languages, lelt, {
+		if (lelt->category == cat) {
+			lelt->ngramm_idx = i;
+			packed->langs[i++] = lelt;
+		}
+	});
+
+	while (nslots < kh_size(htb) * 2) {
+		nslots *= 2;
+	}
+
+	/* Languages below the chain mean are never scored */
+	kh_foreach_value(htb, chain, {
+		PTR_ARRAY_FOREACH(chain.languages, j, elt)
+		{
+			if (elt->prob >= chain.mean) {
+				nelts++;
+			}
+		}
+	});
+
+	packed->slots = g_new0(struct rspamd_trigram_slot, nslots);
+	packed->mask = nslots - 1;
+	packed->nelts = nelts;
+	packed->lang_idx = g_new(uint16_t, MAX(nelts, 1));
+	packed->probs = g_new(double, MAX(nelts, 1));
+
+	kh_foreach(htb, trigram, chain, {
+		key = rspamd_language_detector_pack_trigram(trigram);
+
+		if (key == 0) {
+			continue;
+		}
+
+		i = rspamd_language_detector_trigram_slot(key, packed->mask);
+
+		while (packed->slots[i].key != 0) {
+			i = (i + 1) & packed->mask;
+		}
+
+		packed->slots[i].key = key;
+		packed->slots[i].start = pos;
+		packed->ntrigrams++;
+
+		PTR_ARRAY_FOREACH(chain.languages, j, elt)
+		{
+			if (elt->prob < chain.mean) {
+				continue;
+			}
+
+			packed->lang_idx[pos] = elt->elt->ngramm_idx;
+			packed->probs[pos] = elt->prob;
+			pos++;
+		}
+
+		packed->slots[i].len = pos - packed->slots[i].start;
+	});
+}
+
+static GQuark
+rspamd_language_detector_quark(void)
+{
+	return g_quark_from_static_string("lang-detector");
+}
+
+static inline gboolean
+rspamd_languages_compiled_array_ok(gsize len, uint64_t off, uint64_t nmemb,
+								   gsize size)
+{
+	return off <= len && nmemb <= (len - off) / size &&
+		   off % RSPAMD_LANGUAGES_COMPILED_ALIGN == 0;
+}
+
+static gboolean
+rspamd_language_detector_check_compiled(const unsigned char *map, gsize len,
+										GError **err)
+{
+	const struct rspamd_languages_compiled_header *hdr =
+		(const struct rspamd_languages_compiled_header *) map;
+	const struct rspamd_languages_compiled_lang *langs;
+	unsigned int i, j, nempty;
+
+	if (len < sizeof(*hdr) ||
+		memcmp(hdr->magic, RSPAMD_LANGUAGES_COMPILED_MAGIC, sizeof(hdr->magic)) != 0) {
+		g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+					"bad magic");
+		return FALSE;
+	}
+
+	if (hdr->version != RSPAMD_LANGUAGES_COMPILED_VERSION ||
+		hdr->bom != RSPAMD_LANGUAGES_COMPILED_BOM) {
+		g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+					"unsupported version %u or byte order", hdr->version);
+		return FALSE;
+	}
+
+	if (!rspamd_languages_compiled_array_ok(len, hdr->langs_off, hdr->nlangs,
+											sizeof(*langs))) {
+		g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+					"bad languages array");
+		return FALSE;
+	}
+
+	langs = (const struct rspamd_languages_compiled_lang *) (map + hdr->langs_off);
+
+	for (i = 0; i < hdr->nlangs; i++) {
+		const struct rspamd_languages_compiled_lang *lang = &langs[i];
+
+		if (lang->name[0] == '\0' ||
+			memchr(lang->name, '\0', sizeof(lang->name)) == NULL ||
+			lang->category >= RSPAMD_LANGUAGE_MAX ||
+			lang->stop_words_off > len ||
+			lang->stop_words_len > len - lang->stop_words_off ||
+			(lang->stop_words_len > 0 &&
+			 map[lang->stop_words_off + lang->stop_words_len - 1] != '\0')) {
+			g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+						"bad language %u", i);
+			return FALSE;
+		}
+	}
+
+	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+		const struct rspamd_languages_compiled_category *cat = &hdr->categories[i];
+		const struct rspamd_trigram_slot *slots;
+		const uint16_t *lang_idx;
+
+		if ((uint64_t) cat->langs_base + cat->nlangs > hdr->nlangs ||
+			cat->nslots == 0 || (cat->nslots & (cat->nslots - 1)) != 0 ||
+			!rspamd_languages_compiled_array_ok(len, cat->slots_off, cat->nslots,
+												sizeof(*slots)) ||
+			!rspamd_languages_compiled_array_ok(len, cat->lang_idx_off, cat->nelts,
+												sizeof(*lang_idx)) ||
+			!rspamd_languages_compiled_array_ok(len, cat->probs_off, cat->nelts,
+												sizeof(double))) {
+			g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+						"bad category %u", i);
+			return FALSE;
+		}
+
+		for (j = 0; j < cat->nlangs; j++) {
+			if (langs[cat->langs_base + j].category != i) {
+				g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+							"language %u does not belong to category %u",
+							cat->langs_base + j, i);
+				return FALSE;
+			}
+		}
+
+		slots = (const struct rspamd_trigram_slot *) (map + cat->slots_off);
+		lang_idx = (const uint16_t *) (map + cat->lang_idx_off);
+		nempty = 0;
+
+		for (j = 0; j < cat->nslots; j++) {
+			if (slots[j].key == 0) {
+				nempty++;
+			}
+			else if ((uint64_t) slots[j].start + slots[j].len > cat->nelts) {
+				g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+							"bad trigram slot %u in category %u", j, i);
+				return FALSE;
+			}
+		}
+
+		/* Lookups stop on an empty slot */
+		if (nempty == 0) {
+			g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+						"no empty slots in category %u", i);
+			return FALSE;
+		}
+
+		for (j = 0; j < cat->nelts; j++) {
+			if (lang_idx[j] >= cat->nlangs) {
+				g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+							"bad language index %u in category %u", j, i);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+/*
+ * Maps compiled languages data if it exists, is not older than the sources
+ * and passes the checks
+ */
+static gpointer
+rspamd_language_detector_map_compiled(struct rspamd_config *cfg,
+									  const char *path,
+									  gboolean explicit_path,
+									  const char *languages_path,
+									  glob_t *gl,
+									  gsize *len)
+{
+	struct stat st, src_st;
+	gpointer map;
+	GError *err = NULL;
+	char stop_words_path[PATH_MAX];
+	const char *newer = NULL;
+	size_t i;
+
+	if (stat(path, &st) == -1) {
+		if (explicit_path) {
+			msg_warn_config("cannot stat compiled languages %s: %s",
+							path, strerror(errno));
+		}
+
+		return NULL;
+	}
+
+	rspamd_snprintf(stop_words_path, sizeof(stop_words_path), "%s/stop_words",
+					languages_path);
+
+	if (stat(stop_words_path, &src_st) != -1 && src_st.st_mtime > st.st_mtime) {
+		newer = stop_words_path;
+	}
+
+	for (i = 0; i < gl->gl_pathc && newer == NULL; i++) {
+		if (stat(gl->gl_pathv[i], &src_st) != -1 && src_st.st_mtime > st.st_mtime) {
+			newer = gl->gl_pathv[i];
+		}
+	}
+
+	if (newer) {
+		msg_warn_config("compiled languages %s are older than %s, load json files; "
+						"run `rspamadm langdata compile` to update them",
+						path, newer);
+
+		return NULL;
+	}
+
+	map = rspamd_file_xmap(path, PROT_READ, len, TRUE);
+
+	if (map == NULL) {
+		msg_warn_config("cannot map compiled languages %s: %s",
+						path, strerror(errno));
+
+		return NULL;
+	}
+
+	if (!rspamd_language_detector_check_compiled(map, *len, &err)) {
+		msg_err_config("cannot use compiled languages %s: %e", path, err);
+		g_error_free(err);
+		munmap(map, *len);
+
+		return NULL;
+	}
+
+	return map;
+}
+
+/* Map must be already checked by rspamd_language_detector_check_compiled */
+static void
+rspamd_language_detector_load_compiled(struct rspamd_config *cfg,
+									   struct rspamd_lang_detector *d)
+{
+	const unsigned char *map = d->map;
+	const struct rspamd_languages_compiled_header *hdr =
+		(const struct rspamd_languages_compiled_header *) map;
+	const struct rspamd_languages_compiled_lang *langs =
+		(const struct rspamd_languages_compiled_lang *) (map + hdr->langs_off);
+	struct rspamd_language_elt *nelt;
+	unsigned int i, j;
+
+	kh_resize(rspamd_languages_hash, d->languages, hdr->nlangs);
+
+	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+		const struct rspamd_languages_compiled_category *cat = &hdr->categories[i];
+		struct rspamd_trigrams_packed *packed = &d->packed_trigrams[i];
+
+		packed->nlangs = cat->nlangs;
+		packed->langs = g_new0(struct rspamd_language_elt *, cat->nlangs);
+
+		for (j = 0; j < cat->nlangs; j++) {
+			const struct rspamd_languages_compiled_lang *lang = &langs[cat->langs_base + j];
+			khiter_t k;
+			int ret;
+
+			nelt = rspamd_mempool_alloc0(cfg->cfg_pool, sizeof(*nelt));
+			nelt->name = rspamd_mempool_strdup(cfg->cfg_pool, lang->name);
+			nelt->flags = lang->flags;
+			nelt->category = i;
+			nelt->trigrams_words = lang->trigrams_words;
+			nelt->mean = lang->mean;
+			nelt->std = lang->std;
+			nelt->ngramm_idx = j;
+			packed->langs[j] = nelt;
+
+			if (lang->stop_words_len > 0) {
+				struct sb_stemmer *stem = sb_stemmer_new(nelt->name, "UTF_8");
+				const char *word = (const char *) map + lang->stop_words_off,
+						   *end = word + lang->stop_words_len;
+				unsigned int start;
+
+				start = rspamd_multipattern_get_npatterns(d->stop_words[i].mp);
+
+				while (word < end) {
+					gsize wlen = strlen(word);
+
+					if (wlen > 0) {
+						rspamd_language_detector_add_stop_word(cfg, d, nelt, stem,
+															   word, wlen);
+					}
+
+					word += wlen + 1;
+				}
+
+				if (stem) {
+					sb_stemmer_delete(stem);
+				}
+
+				rspamd_language_detector_add_stop_words_range(d, nelt, start);
+			}
+
+			k = kh_put(rspamd_languages_hash, d->languages, nelt->name, &ret);
+
+			if (ret > 0) {
+				kh_value(d->languages, k) = nelt;
+			}
+			else {
+				msg_warn_config("duplicate compiled language %s", nelt->name);
+			}
+
+			msg_debug_lang_det_cfg("loaded compiled %s language, %d stop words (%s)",
+								   nelt->name, nelt->stop_words,
+								   rspamd_language_detector_print_flags(nelt));
+		}
+
+		/* Packed trigrams are used directly from the shared mapping */
+		packed->slots = (struct rspamd_trigram_slot *) (map + cat->slots_off);
+		packed->mask = cat->nslots - 1;
+		packed->nelts = cat->nelts;
+		packed->ntrigrams = cat->ntrigrams;
+		packed->lang_idx = (uint16_t *) (map + cat->lang_idx_off);
+		packed->probs = (double *) (map + cat->probs_off);
+	}
+}
+
+static inline const ucl_object_t *
+rspamd_language_detector_option(struct rspamd_config *cfg, const char *name)
+{
+	const ucl_object_t *section = ucl_object_lookup(cfg->cfg_ucl_obj, "lang_detection");
+
+	if (section == NULL) {
+		return NULL;
+	}
+
+	return ucl_object_lookup(section, name);
+}
+
+static const char *
+rspamd_language_detector_languages_path(struct rspamd_config *cfg)
+{
+	const ucl_object_t *elt = rspamd_language_detector_option(cfg, "languages");
+
+	if (elt) {
+		return ucl_object_tostring(elt);
+	}
+
+	return default_languages_path;
+}
+
+static const char *
+rspamd_language_detector_compiled_path(struct rspamd_config *cfg,
+									   gboolean *explicit_path)
+{
+	const ucl_object_t *elt = rspamd_language_detector_option(cfg, "compiled_languages");
+
+	if (explicit_path) {
+		*explicit_path = (elt != NULL);
+	}
+
+	if (elt) {
+		return ucl_object_tostring(elt);
+	}
+
+	char *path = g_build_filename(rspamd_language_detector_languages_path(cfg),
+								  default_compiled_languages, NULL);
+	rspamd_mempool_add_destructor(cfg->cfg_pool, (rspamd_mempool_destruct_t) g_free, path);
+
+	return path;
+}
+
 static void
 rspamd_language_detector_dtor(struct rspamd_lang_detector *d)
 {
 	if (d) {
 		for (unsigned int i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
 			kh_destroy(rspamd_trigram_hash, d->trigrams[i]);
+			g_free(d->packed_trigrams[i].langs);
+
+			if (d->map == NULL) {
+				g_free(d->packed_trigrams[i].slots);
+				g_free(d->packed_trigrams[i].lang_idx);
+				g_free(d->packed_trigrams[i].probs);
+			}
+
 			rspamd_multipattern_destroy(d->stop_words[i].mp);
 			g_array_free(d->stop_words[i].ranges, TRUE);
 		}
@@ -798,15 +1343,25 @@ rspamd_language_detector_dtor(struct rspamd_lang_detector *d)
 
 		kh_destroy(rspamd_stopwords_hash, d->stop_words_norm);
 		rspamd_lang_detection_fasttext_destroy(d->fasttext_detector);
+
+		if (d->map) {
+			munmap(d->map, d->map_len);
+		}
 	}
 }
 
-struct rspamd_lang_detector *
-rspamd_language_detector_init(struct rspamd_config *cfg)
+/*
+ * Loads the compiled languages data if possible and json files otherwise;
+ * `for_compile` loads all json files to write them with
+ * rspamd_language_detector_compile
+ */
+static struct rspamd_lang_detector *
+rspamd_language_detector_init_internal(struct rspamd_config *cfg,
+									   gboolean for_compile)
 {
 	const ucl_object_t *section, *elt, *languages_enable = NULL,
 									   *languages_disable = NULL;
-	const char *languages_path = default_languages_path;
+	const char *languages_path, *compiled_path;
 	glob_t gl;
 	size_t i, short_text_limit = default_short_text_limit, total = 0;
 	UErrorCode uc_err = U_ZERO_ERROR;
@@ -815,26 +1370,27 @@ rspamd_language_detector_init(struct rspamd_config *cfg)
 	char *fname;
 	struct rspamd_lang_detector *ret = NULL;
 	struct ucl_parser *parser;
-	ucl_object_t *stop_words;
+	ucl_object_t *stop_words = NULL;
 	bool prefer_fasttext = true;
+	gboolean explicit_compiled, have_json;
+	gpointer map = NULL;
+	gsize map_len = 0;
 
 	section = ucl_object_lookup(cfg->cfg_ucl_obj, "lang_detection");
+	languages_path = rspamd_language_detector_languages_path(cfg);
+	compiled_path = rspamd_language_detector_compiled_path(cfg, &explicit_compiled);
 
 	if (section != NULL) {
-		elt = ucl_object_lookup(section, "languages");
-
-		if (elt) {
-			languages_path = ucl_object_tostring(elt);
-		}
-
 		elt = ucl_object_lookup(section, "short_text_limit");
 
 		if (elt) {
 			short_text_limit = ucl_object_toint(elt);
 		}
 
-		languages_enable = ucl_object_lookup(section, "languages_enable");
-		languages_disable = ucl_object_lookup(section, "languages_disable");
+		if (!for_compile) {
+			languages_enable = ucl_object_lookup(section, "languages_enable");
+			languages_disable = ucl_object_lookup(section, "languages_disable");
+		}
 
 		elt = ucl_object_lookup(section, "prefer_fasttext");
 		if (elt) {
@@ -843,41 +1399,36 @@ rspamd_language_detector_init(struct rspamd_config *cfg)
 	}
 
 	languages_pattern = g_string_sized_new(PATH_MAX);
-	rspamd_printf_gstring(languages_pattern, "%s/stop_words", languages_path);
-	parser = ucl_parser_new(UCL_PARSER_SAFE_FLAGS);
-
-	if (ucl_parser_add_file(parser, languages_pattern->str)) {
-		stop_words = ucl_parser_get_object(parser);
-	}
-	else {
-		msg_err_config("cannot read stop words from %s: %s",
-					   languages_pattern->str,
-					   ucl_parser_get_error(parser));
-		stop_words = NULL;
-	}
-
-	ucl_parser_free(parser);
-	languages_pattern->len = 0;
-
 	rspamd_printf_gstring(languages_pattern, "%s/*.json", languages_path);
 	memset(&gl, 0, sizeof(gl));
+	have_json = glob(languages_pattern->str, 0, NULL, &gl) == 0;
 
-	if (glob(languages_pattern->str, 0, NULL, &gl) != 0) {
+	if (!for_compile) {
+		if (languages_enable == NULL && languages_disable == NULL) {
+			map = rspamd_language_detector_map_compiled(cfg, compiled_path,
+														explicit_compiled, languages_path,
+														&gl, &map_len);
+		}
+		else if (explicit_compiled) {
+			msg_info_config("do not use compiled languages %s: languages_enable or "
+							"languages_disable are set",
+							compiled_path);
+		}
+	}
+
+	if (map == NULL && !have_json) {
 		msg_err_config("cannot read any files matching %v", languages_pattern);
 		goto end;
 	}
 
 	ret = rspamd_mempool_alloc0(cfg->cfg_pool, sizeof(*ret));
 	ret->languages = kh_init(rspamd_languages_hash);
-	kh_resize(rspamd_languages_hash, ret->languages, gl.gl_pathc);
 	ret->uchar_converter = rspamd_get_utf8_converter();
 	ret->short_text_limit = short_text_limit;
 	ret->stop_words_norm = kh_init(rspamd_stopwords_hash);
 	ret->prefer_fasttext = prefer_fasttext;
 
-	/* Map from ngramm in ucs32 to GPtrArray of rspamd_language_elt */
 	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
-		ret->trigrams[i] = kh_init(rspamd_trigram_hash);
 #ifdef WITH_HYPERSCAN
 		ret->stop_words[i].mp = rspamd_multipattern_create(
 			RSPAMD_MULTIPATTERN_ICASE | RSPAMD_MULTIPATTERN_UTF8 |
@@ -895,29 +1446,75 @@ rspamd_language_detector_init(struct rspamd_config *cfg)
 
 	g_assert(uc_err == U_ZERO_ERROR);
 
-	for (i = 0; i < gl.gl_pathc; i++) {
-		fname = g_path_get_basename(gl.gl_pathv[i]);
+	if (map != NULL) {
+		ret->map = map;
+		ret->map_len = map_len;
+		rspamd_language_detector_load_compiled(cfg, ret);
+	}
+	else {
+		languages_pattern->len = 0;
+		rspamd_printf_gstring(languages_pattern, "%s/stop_words", languages_path);
+		parser = ucl_parser_new(UCL_PARSER_SAFE_FLAGS);
 
-		if (!rspamd_ucl_array_find_str(fname, languages_disable) ||
-			(languages_enable == NULL ||
-			 rspamd_ucl_array_find_str(fname, languages_enable))) {
-			rspamd_language_detector_read_file(cfg, ret, gl.gl_pathv[i],
-											   stop_words);
+		if (ucl_parser_add_file(parser, languages_pattern->str)) {
+			stop_words = ucl_parser_get_object(parser);
 		}
 		else {
-			msg_info_config("skip language file %s: disabled", fname);
+			msg_err_config("cannot read stop words from %s: %s",
+						   languages_pattern->str,
+						   ucl_parser_get_error(parser));
+		}
+
+		ucl_parser_free(parser);
+		kh_resize(rspamd_languages_hash, ret->languages, gl.gl_pathc);
+
+		/* Map from ngramm in ucs32 to GPtrArray of rspamd_language_elt */
+		for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+			ret->trigrams[i] = kh_init(rspamd_trigram_hash);
+		}
+
+		for (i = 0; i < gl.gl_pathc; i++) {
+			fname = g_path_get_basename(gl.gl_pathv[i]);
+
+			if (!rspamd_ucl_array_find_str(fname, languages_disable) ||
+				(languages_enable == NULL ||
+				 rspamd_ucl_array_find_str(fname, languages_enable))) {
+				rspamd_language_detector_read_file(cfg, ret, gl.gl_pathv[i],
+												   stop_words);
+			}
+			else {
+				msg_info_config("skip language file %s: disabled", fname);
+			}
+
+			g_free(fname);
 		}
 
-		g_free(fname);
+		for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+			kh_foreach_value(ret->trigrams[i], schain, {
+				chain = &schain;
+				rspamd_language_detector_process_chain(cfg, chain);
+			});
+
+			rspamd_language_detector_pack_trigrams(ret, i);
+
+			/* Chains are not needed after packing */
+			kh_destroy(rspamd_trigram_hash, ret->trigrams[i]);
+			ret->trigrams[i] = NULL;
+		}
+
+		if (stop_words) {
+			ucl_object_unref(stop_words);
+		}
 	}
 
 	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
 		GError *err = NULL;
 
-		kh_foreach_value(ret->trigrams[i], schain, {
-			chain = &schain;
-			rspamd_language_detector_process_chain(cfg, chain);
-		});
+		total += ret->packed_trigrams[i].ntrigrams;
+
+		if (for_compile) {
+			continue;
+		}
 
 		/* Compile with ACISM fallback, queue for async hyperscan via hs_helper */
 		if (!rspamd_multipattern_compile(ret->stop_words[i].mp, 0, &err)) {
@@ -935,24 +1532,25 @@ rspamd_language_detector_init(struct rspamd_config *cfg)
 			rspamd_multipattern_add_pending(ret->stop_words[i].mp, name);
 		}
 #endif
+	}
+
+	REF_INIT_RETAIN(ret, rspamd_language_detector_dtor);
 
-		total += kh_size(ret->trigrams[i]);
+	if (for_compile) {
+		goto end;
 	}
 
 	ret->fasttext_detector = rspamd_lang_detection_fasttext_init(cfg);
 	char *fasttext_status = rspamd_lang_detection_fasttext_show_info(ret->fasttext_detector);
 
 	msg_info_config("loaded %d languages, "
-					"%d trigrams; %s",
+					"%d trigrams from %s; %s",
 					(int) kh_size(ret->languages),
-					(int) total, fasttext_status);
+					(int) total,
+					ret->map ? compiled_path : languages_path,
+					fasttext_status);
 	g_free(fasttext_status);
 
-	if (stop_words) {
-		ucl_object_unref(stop_words);
-	}
-
-	REF_INIT_RETAIN(ret, rspamd_language_detector_dtor);
 	rspamd_mempool_add_destructor(cfg->cfg_pool,
 								  (rspamd_mempool_destruct_t) rspamd_language_detector_unref,
 								  ret);
@@ -967,6 +1565,173 @@ end:
 	return ret;
 }
 
+struct rspamd_lang_detector *
+rspamd_language_detector_init(struct rspamd_config *cfg)
+{
+	return rspamd_language_detector_init_internal(cfg, FALSE);
+}
+
+static void
+rspamd_languages_compiled_align(GByteArray *out)
+{
+	static const guint8 zeroes[RSPAMD_LANGUAGES_COMPILED_ALIGN] = {0};
+	gsize pad = (RSPAMD_LANGUAGES_COMPILED_ALIGN - out->len % RSPAMD_LANGUAGES_COMPILED_ALIGN) %
+				RSPAMD_LANGUAGES_COMPILED_ALIGN;
+
+	if (pad > 0) {
+		g_byte_array_append(out, zeroes, pad);
+	}
+}
+
+gboolean
+rspamd_language_detector_compile(struct rspamd_config *cfg,
+								 const char *output,
+								 GError **err)
+{
+	struct rspamd_languages_compiled_header hdr;
+	struct rspamd_languages_compiled_lang *langs;
+	struct rspamd_lang_detector *d;
+	struct ucl_parser *parser;
+	ucl_object_t *stop_words = NULL;
+	GByteArray *out;
+	char *stop_words_path;
+	unsigned int i, j, nlangs = 0;
+	gboolean ret = FALSE;
+
+	if (output == NULL) {
+		output = rspamd_language_detector_compiled_path(cfg, NULL);
+	}
+
+	d = rspamd_language_detector_init_internal(cfg, TRUE);
+
+	if (d == NULL) {
+		g_set_error(err, rspamd_language_detector_quark(), ENOENT,
+					"cannot load languages from %s",
+					rspamd_language_detector_languages_path(cfg));
+
+		return FALSE;
+	}
+
+	/* Raw stop words are not kept by the detector */
+	stop_words_path = g_build_filename(rspamd_language_detector_languages_path(cfg),
+									   "stop_words", NULL);
+	parser = ucl_parser_new(UCL_PARSER_SAFE_FLAGS);
+
+	if (ucl_parser_add_file(parser, stop_words_path)) {
+		stop_words = ucl_parser_get_object(parser);
+	}
+
+	ucl_parser_free(parser);
+	g_free(stop_words_path);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, RSPAMD_LANGUAGES_COMPILED_MAGIC, sizeof(hdr.magic));
+	hdr.version = RSPAMD_LANGUAGES_COMPILED_VERSION;
+	hdr.bom = RSPAMD_LANGUAGES_COMPILED_BOM;
+
+	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+		hdr.nlangs += d->packed_trigrams[i].nlangs;
+	}
+
+	/* Header and languages are filled at the end */
+	out = g_byte_array_new();
+	g_byte_array_set_size(out, sizeof(hdr));
+	rspamd_languages_compiled_align(out);
+	hdr.langs_off = out->len;
+	g_byte_array_set_size(out, out->len + sizeof(*langs) * hdr.nlangs);
+	langs = g_new0(struct rspamd_languages_compiled_lang, MAX(hdr.nlangs, 1));
+
+	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+		const struct rspamd_trigrams_packed *packed = &d->packed_trigrams[i];
+
+		hdr.categories[i].langs_base = nlangs;
+		hdr.categories[i].nlangs = packed->nlangs;
+
+		for (j = 0; j < packed->nlangs; j++) {
+			const struct rspamd_language_elt *elt = packed->langs[j];
+			struct rspamd_languages_compiled_lang *lang = &langs[nlangs++];
+			const ucl_object_t *specific_stop_words = NULL, *w;
+			ucl_object_iter_t it = NULL;
+
+			if (strlen(elt->name) >= sizeof(lang->name)) {
+				g_set_error(err, rspamd_language_detector_quark(), EINVAL,
+							"language name is too long: %s", elt->name);
+				goto end;
+			}
+
+			rspamd_strlcpy(lang->name, elt->name, sizeof(lang->name));
+			lang->flags = elt->flags;
+			lang->category = i;
+			lang->trigrams_words = elt->trigrams_words;
+			lang->mean = elt->mean;
+			lang->std = elt->std;
+			lang->stop_words_off = out->len;
+
+			if (stop_words) {
+				specific_stop_words = ucl_object_lookup(stop_words, elt->name);
+			}
+
+			while (specific_stop_words &&
+				   (w = ucl_object_iterate(specific_stop_words, &it, true)) != NULL) {
+				gsize wlen;
+				const char *word = ucl_object_tolstring(w, &wlen);
+
+				if (word && wlen > 0 && memchr(word, '\0', wlen) == NULL) {
+					g_byte_array_append(out, (const guint8 *) word, wlen + 1);
+					lang->nstop_words++;
+				}
+			}
+
+			lang->stop_words_len = out->len - lang->stop_words_off;
+		}
+	}
+
+	for (i = 0; i < RSPAMD_LANGUAGE_MAX; i++) {
+		const struct rspamd_trigrams_packed *packed = &d->packed_trigrams[i];
+		struct rspamd_languages_compiled_category *cat = &hdr.categories[i];
+
+		cat->nslots = packed->mask + 1;
+		cat->nelts = packed->nelts;
+		cat->ntrigrams = packed->ntrigrams;
+
+		rspamd_languages_compiled_align(out);
+		cat->slots_off = out->len;
+		g_byte_array_append(out, (const guint8 *) packed->slots,
+							sizeof(*packed->slots) * cat->nslots);
+		rspamd_languages_compiled_align(out);
+		cat->lang_idx_off = out->len;
+		g_byte_array_append(out, (const guint8 *) packed->lang_idx,
+							sizeof(*packed->lang_idx) * cat->nelts);
+		rspamd_languages_compiled_align(out);
+		cat->probs_off = out->len;
+		g_byte_array_append(out, (const guint8 *) packed->probs,
+							sizeof(*packed->probs) * cat->nelts);
+	}
+
+	memcpy(out->data, &hdr, sizeof(hdr));
+	memcpy(out->data + hdr.langs_off, langs, sizeof(*langs) * hdr.nlangs);
+
+	/* Written to a temporary file and renamed, so workers never see a partial file */
+	ret = g_file_set_contents(output, (const char *) out->data, out->len, err);
+
+	if (ret) {
+		msg_info_config("compiled %ud languages to %s: %ud bytes",
+						hdr.nlangs, output, out->len);
+	}
+
+end:
+	g_free(langs);
+	g_byte_array_free(out, TRUE);
+
+	if (stop_words) {
+		ucl_object_unref(stop_words);
+	}
+
+	rspamd_language_detector_unref(d);
+
+	return ret;
+}
+
 static void
 rspamd_language_detector_random_select(rspamd_words_t *ucs_tokens, unsigned int nwords,
 									   goffset *offsets_out,
@@ -1106,71 +1871,35 @@ rspamd_language_detector_next_ngramm(rspamd_stat_token_t *tok, UChar32 *window,
 /*
  * Do full guess for a specific ngramm, checking all languages defined
  */
-static void
-rspamd_language_detector_process_ngramm_full(struct rspamd_task *task,
-											 struct rspamd_lang_detector *d,
-											 UChar32 *window,
-											 khash_t(rspamd_candidates_hash) * candidates,
-											 khash_t(rspamd_trigram_hash) * trigrams)
+static inline void
+rspamd_language_detector_process_ngramm_full(const struct rspamd_trigrams_packed *trigrams,
+											 const UChar32 *window,
+											 double *scores,
+											 unsigned char *seen)
 {
+	const struct rspamd_trigram_slot *slot;
+	const uint16_t *idx;
+	const double *probs;
 	unsigned int i;
-	int ret;
-	struct rspamd_ngramm_chain *chain = NULL;
-	struct rspamd_ngramm_elt *elt;
-	struct rspamd_lang_detector_res *cand;
-	khiter_t k;
-	double prob;
-
-	k = kh_get(rspamd_trigram_hash, trigrams, window);
-	if (k != kh_end(trigrams)) {
-		chain = &kh_value(trigrams, k);
-	}
 
-	if (chain) {
-		PTR_ARRAY_FOREACH(chain->languages, i, elt)
-		{
-			prob = elt->prob;
+	slot = rspamd_language_detector_trigram_lookup(trigrams, window);
 
-			if (prob < chain->mean) {
-				continue;
-			}
+	if (slot) {
+		idx = trigrams->lang_idx + slot->start;
+		probs = trigrams->probs + slot->start;
 
-			k = kh_get(rspamd_candidates_hash, candidates, elt->elt->name);
-			if (k != kh_end(candidates)) {
-				cand = kh_value(candidates, k);
-			}
-			else {
-				cand = NULL;
-			}
-
-#ifdef NGRAMMS_DEBUG
-			msg_err("gramm: %s, lang: %s, prob: %.3f", chain->utf,
-					elt->elt->name, log2(elt->prob));
-#endif
-			if (cand == NULL) {
-				cand = rspamd_mempool_alloc(task->task_pool, sizeof(*cand));
-				cand->elt = elt->elt;
-				cand->lang = elt->elt->name;
-				cand->prob = prob;
-
-				k = kh_put(rspamd_candidates_hash, candidates, elt->elt->name,
-						   &ret);
-				kh_value(candidates, k) = cand;
-			}
-			else {
-				/* Update guess */
-				cand->prob += prob;
-			}
+		for (i = 0; i < slot->len; i++) {
+			scores[idx[i]] += probs[i];
+			seen[idx[i]] = 1;
 		}
 	}
 }
 
 static void
-rspamd_language_detector_detect_word(struct rspamd_task *task,
-									 struct rspamd_lang_detector *d,
-									 rspamd_stat_token_t *tok,
-									 khash_t(rspamd_candidates_hash) * candidates,
-									 khash_t(rspamd_trigram_hash) * trigrams)
+rspamd_language_detector_detect_word(rspamd_stat_token_t *tok,
+									 const struct rspamd_trigrams_packed *trigrams,
+									 double *scores,
+									 unsigned char *seen)
 {
 	const unsigned int wlen = 3;
 	UChar32 window[3];
@@ -1178,8 +1907,8 @@ rspamd_language_detector_detect_word(struct rspamd_task *task,
 
 	/* Split words */
 	while ((cur = rspamd_language_detector_next_ngramm(tok, window, wlen, cur)) != -1) {
-		rspamd_language_detector_process_ngramm_full(task,
-													 d, window, candidates, trigrams);
+		rspamd_language_detector_process_ngramm_full(trigrams, window,
+													 scores, seen);
 	}
 }
 
@@ -1261,26 +1990,50 @@ rspamd_language_detector_detect_type(struct rspamd_task *task,
 									 struct rspamd_mime_text_part *part)
 {
 	unsigned int nparts = MIN(kv_size(*words), nwords);
+	const struct rspamd_trigrams_packed *trigrams = &d->packed_trigrams[cat];
 	goffset *selected_words;
 	rspamd_stat_token_t *tok;
+	double *scores;
+	unsigned char *seen;
 	unsigned int i;
 	uint64_t seed;
 
 	/* Seed PRNG with part digest to provide some sort of determinism */
-	memcpy(&seed, part->mime_part->digest, sizeof(seed));
+	memcpy(&seed, rspamd_mime_part_get_digest(part->mime_part), sizeof(seed));
 	selected_words = g_new0(goffset, nparts);
 	rspamd_language_detector_random_select(words, nparts, selected_words, &seed);
 	msg_debug_lang_det("randomly selected %d words", nparts);
 
+	/* Scores are accumulated per language index and converted to candidates after all */
+	scores = g_malloc0(trigrams->nlangs * (sizeof(double) + 1) + 1);
+	seen = (unsigned char *) (scores + trigrams->nlangs);
+
 	for (i = 0; i < nparts; i++) {
 		tok = &kv_A(*words, selected_words[i]);
 
 		if (tok->unicode.len >= 3) {
-			rspamd_language_detector_detect_word(task, d, tok, candidates,
-												 d->trigrams[cat]);
+			rspamd_language_detector_detect_word(tok, trigrams, scores, seen);
 		}
 	}
 
+	for (i = 0; i < trigrams->nlangs; i++) {
+		if (seen[i]) {
+			struct rspamd_lang_detector_res *cand;
+			khiter_t k;
+			int ret;
+
+			cand = rspamd_mempool_alloc(task->task_pool, sizeof(*cand));
+			cand->elt = trigrams->langs[i];
+			cand->lang = trigrams->langs[i]->name;
+			cand->prob = scores[i];
+
+			k = kh_put(rspamd_candidates_hash, candidates, cand->lang, &ret);
+			kh_value(candidates, k) = cand;
+		}
+	}
+
+	g_free(scores);
+
 	/* Filter negligible candidates */
 	rspamd_language_detector_filter_negligible(task, candidates);
 	g_free(selected_words);
@@ -2155,3 +2908,44 @@ int rspamd_language_detector_elt_flags(const struct rspamd_language_elt *elt)
 
 	return 0;
 }
+
+double
+rspamd_language_detector_word_score_for_test(struct rspamd_lang_detector *d,
+											 const char *lang,
+											 const UChar32 *word, gsize len)
+{
+	const struct rspamd_trigrams_packed *packed;
+	struct rspamd_language_elt *elt;
+	rspamd_stat_token_t tok;
+	double *scores, res;
+	unsigned char *seen;
+	khiter_t k;
+
+	k = kh_get(rspamd_languages_hash, d->languages, lang);
+
+	if (k == kh_end(d->languages)) {
+		return -1;
+	}
+
+	elt = kh_value(d->languages, k);
+	packed = &d->packed_trigrams[elt->category];
+	scores = g_new0(double, packed->nlangs);
+	seen = g_new0(unsigned char, packed->nlangs);
+
+	memset(&tok, 0, sizeof(tok));
+	tok.unicode.begin = word;
+	tok.unicode.len = len;
+	rspamd_language_detector_detect_word(&tok, packed, scores, seen);
+	res = scores[elt->ngramm_idx];
+
+	g_free(scores);
+	g_free(seen);
+
+	return res;
+}
+
+gboolean
+rspamd_language_detector_is_compiled_for_test(struct rspamd_lang_detector *d)
+{
+	return d->map != NULL;
+}
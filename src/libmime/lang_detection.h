@@ -72,6 +72,18 @@ struct rspamd_lang_detector_res {
  */
 struct rspamd_lang_detector *rspamd_language_detector_init(struct rspamd_config *cfg);
 
+/**
+ * Compile languages data and stop words to a binary file that is mapped by
+ * rspamd_language_detector_init instead of loading json files
+ * @param cfg
+ * @param output output file, `compiled_languages` option if NULL
+ * @param err
+ * @return TRUE if the file has been written
+ */
+gboolean rspamd_language_detector_compile(struct rspamd_config *cfg,
+										  const char *output,
+										  GError **err);
+
 struct rspamd_lang_detector *rspamd_language_detector_ref(struct rspamd_lang_detector *d);
 
 void rspamd_language_detector_unref(struct rspamd_lang_detector *d);
@@ -103,6 +115,19 @@ gboolean rspamd_language_detector_is_stop_word(struct rspamd_lang_detector *d,
  * @return
  */
 int rspamd_language_detector_elt_flags(const struct rspamd_language_elt *elt);
+
+/*
+ * Test-only: sum of trigram probabilities of a language for a single word
+ * as it is scored by the detector, negative if the language is unknown
+ */
+double rspamd_language_detector_word_score_for_test(struct rspamd_lang_detector *d,
+													const char *lang,
+													const UChar32 *word, gsize len);
+
+/*
+ * Test-only: TRUE if the detector uses the compiled languages data
+ */
+gboolean rspamd_language_detector_is_compiled_for_test(struct rspamd_lang_detector *d);
 #ifdef __cplusplus
 }
 #endif
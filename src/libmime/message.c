@@ -1177,8 +1177,8 @@ rspamd_message_process_text_part_maybe(struct rspamd_task *task,
 	text_part->mime_part = mime_part;
 	text_part->raw.begin = mime_part->raw_data.begin;
 	text_part->raw.len = mime_part->raw_data.len;
-	text_part->parsed.begin = mime_part->parsed_data.begin;
-	text_part->parsed.len = mime_part->parsed_data.len;
+	memcpy(&text_part->parsed, rspamd_mime_part_get_content(mime_part),
+		   sizeof(text_part->parsed));
 	text_part->utf_stripped_text = (UText) UTEXT_INITIALIZER;
 	text_part->flags |= flags;
 
@@ -1436,7 +1436,6 @@ rspamd_message_from_data(struct rspamd_task *task, const unsigned char *start,
 												task->task_pool);
 
 	g_ptr_array_add(MESSAGE_FIELD(task, parts), part);
-	rspamd_mime_parser_calc_digest(part);
 
 	/* Generate message ID */
 	mid = rspamd_mime_message_id_generate("localhost.localdomain");
@@ -1517,27 +1516,128 @@ rspamd_message_new(struct rspamd_task *task)
 	return msg;
 }
 
-gboolean
-rspamd_message_parse(struct rspamd_task *task)
+/* Digest of the decoded parts and the subject, parts are decoded to compute it */
+static void
+rspamd_message_calc_digest(struct rspamd_message *msg)
 {
+	struct rspamd_mime_part *part;
 	const char *p;
-	gsize len;
 	unsigned int i;
-	GError *err = NULL;
 	uint64_t n[2], seed;
 
-	if (task->cfg) {
-		rspamd_mime_parser_init_shared(task->cfg);
+	/* Blake2b applied to string 'rspamd' */
+	static const unsigned char RSPAMD_ALIGNED(32) hash_key[] = {
+		0xef,
+		0x43,
+		0xae,
+		0x80,
+		0xcc,
+		0x8d,
+		0xc3,
+		0x4c,
+		0x6f,
+		0x1b,
+		0xd6,
+		0x18,
+		0x1b,
+		0xae,
+		0x87,
+		0x74,
+		0x0c,
+		0xca,
+		0xf7,
+		0x8e,
+		0x5f,
+		0x2e,
+		0x54,
+		0x32,
+		0xf6,
+		0x79,
+		0xb9,
+		0x27,
+		0x26,
+		0x96,
+		0x20,
+		0x92,
+		0x70,
+		0x07,
+		0x85,
+		0xeb,
+		0x83,
+		0xf7,
+		0x89,
+		0xe0,
+		0xd7,
+		0x32,
+		0x2a,
+		0xd2,
+		0x1a,
+		0x64,
+		0x41,
+		0xef,
+		0x49,
+		0xff,
+		0xc3,
+		0x8c,
+		0x54,
+		0xf9,
+		0x67,
+		0x74,
+		0x30,
+		0x1e,
+		0x70,
+		0x2e,
+		0xb7,
+		0x12,
+		0x09,
+		0xfe,
+	};
+
+	memcpy(&seed, hash_key, sizeof(seed));
+
+	PTR_ARRAY_FOREACH(msg->parts, i, part)
+	{
+		n[0] = t1ha2_atonce128(&n[1],
+							   rspamd_mime_part_get_digest(part),
+							   sizeof(part->digest),
+							   seed);
+
+		seed = n[0] ^ n[1];
 	}
 
-	if (RSPAMD_TASK_IS_EMPTY(task)) {
-		/* Don't do anything with empty task */
-		task->flags |= RSPAMD_TASK_FLAG_SKIP_PROCESS;
-		return TRUE;
+	memcpy(msg->digest, n, sizeof(n));
+
+	if (msg->subject) {
+		p = msg->subject;
+		n[0] = t1ha2_atonce128(&n[1],
+							   p, strlen(p),
+							   seed);
+		memcpy(msg->digest, n, sizeof(n));
 	}
 
-	p = task->msg.begin;
-	len = task->msg.len;
+	msg->digest_computed = TRUE;
+}
+
+const unsigned char *
+rspamd_message_get_digest(struct rspamd_message *msg)
+{
+	if (!msg->digest_computed) {
+		rspamd_message_calc_digest(msg);
+	}
+
+	return msg->digest;
+}
+
+/*
+ * Skips leading spaces and mailbox `From ` line, returns TRUE if the latter
+ * has been found
+ */
+static gboolean
+rspamd_message_skip_preamble(const char **pp, gsize *plen)
+{
+	const char *p = *pp;
+	gsize len = *plen;
+	gboolean mailbox = FALSE;
 
 	/* Skip any space characters to avoid some bad messages to be unparsed */
 	while (len > 0 && g_ascii_isspace(*p)) {
@@ -1554,7 +1654,7 @@ rspamd_message_parse(struct rspamd_task *task)
 	if (len > sizeof("From ") - 1) {
 		if (memcmp(p, "From ", sizeof("From ") - 1) == 0) {
 			/* Skip to CRLF */
-			msg_info_task("mailbox input detected, enable workaround");
+			mailbox = TRUE;
 			p += sizeof("From ") - 1;
 			len -= sizeof("From ") - 1;
 
@@ -1569,6 +1669,36 @@ rspamd_message_parse(struct rspamd_task *task)
 		}
 	}
 
+	*pp = p;
+	*plen = len;
+
+	return mailbox;
+}
+
+gboolean
+rspamd_message_parse(struct rspamd_task *task)
+{
+	const char *p;
+	gsize len;
+	GError *err = NULL;
+
+	if (task->cfg) {
+		rspamd_mime_parser_init_shared(task->cfg);
+	}
+
+	if (RSPAMD_TASK_IS_EMPTY(task)) {
+		/* Don't do anything with empty task */
+		task->flags |= RSPAMD_TASK_FLAG_SKIP_PROCESS;
+		return TRUE;
+	}
+
+	p = task->msg.begin;
+	len = task->msg.len;
+
+	if (rspamd_message_skip_preamble(&p, &len)) {
+		msg_info_task("mailbox input detected, enable workaround");
+	}
+
 	task->msg.begin = p;
 	task->msg.len = len;
 
@@ -1632,115 +1762,79 @@ rspamd_message_parse(struct rspamd_task *task)
 
 	rspamd_received_maybe_fix_task(task);
 
-	struct rspamd_mime_part *part;
+	/* Checksum is logged with the task as it needs the decoded parts */
+	if (task->queue_id) {
+		msg_info_task("loaded message; id: <%s>; queue-id: <%s>; size: %z",
+					  MESSAGE_FIELD(task, message_id), task->queue_id, task->msg.len);
+	}
+	else {
+		msg_info_task("loaded message; id: <%s>; size: %z",
+					  MESSAGE_FIELD(task, message_id), task->msg.len);
+	}
 
-	/* Blake2b applied to string 'rspamd' */
-	static const unsigned char RSPAMD_ALIGNED(32) hash_key[] = {
-		0xef,
-		0x43,
-		0xae,
-		0x80,
-		0xcc,
-		0x8d,
-		0xc3,
-		0x4c,
-		0x6f,
-		0x1b,
-		0xd6,
-		0x18,
-		0x1b,
-		0xae,
-		0x87,
-		0x74,
-		0x0c,
-		0xca,
-		0xf7,
-		0x8e,
-		0x5f,
-		0x2e,
-		0x54,
-		0x32,
-		0xf6,
-		0x79,
-		0xb9,
-		0x27,
-		0x26,
-		0x96,
-		0x20,
-		0x92,
-		0x70,
-		0x07,
-		0x85,
-		0xeb,
-		0x83,
-		0xf7,
-		0x89,
-		0xe0,
-		0xd7,
-		0x32,
-		0x2a,
-		0xd2,
-		0x1a,
-		0x64,
-		0x41,
-		0xef,
-		0x49,
-		0xff,
-		0xc3,
-		0x8c,
-		0x54,
-		0xf9,
-		0x67,
-		0x74,
-		0x30,
-		0x1e,
-		0x70,
-		0x2e,
-		0xb7,
-		0x12,
-		0x09,
-		0xfe,
-	};
+	return TRUE;
+}
 
-	memcpy(&seed, hash_key, sizeof(seed));
 
-	PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, parts), i, part)
-	{
-		n[0] = t1ha2_atonce128(&n[1],
-							   part->digest, sizeof(part->digest),
-							   seed);
+gboolean
+rspamd_message_parse_headers(struct rspamd_task *task,
+							 const char *p, gsize len)
+{
+	GString str;
+	goffset hdr_pos, body_pos = 0;
 
-		seed = n[0] ^ n[1];
+	if (!(task->flags & RSPAMD_TASK_FLAG_MIME)) {
+		return FALSE;
 	}
 
-	memcpy(MESSAGE_FIELD(task, digest), n, sizeof(n));
+	rspamd_message_skip_preamble(&p, &len);
 
-	if (MESSAGE_FIELD(task, subject)) {
-		p = MESSAGE_FIELD(task, subject);
-		len = strlen(p);
-		n[0] = t1ha2_atonce128(&n[1],
-							   p, len,
-							   seed);
-		memcpy(MESSAGE_FIELD(task, digest), n, sizeof(n));
+	if (len == 0) {
+		return FALSE;
 	}
 
-	if (task->queue_id) {
-		msg_info_task("loaded message; id: <%s>; queue-id: <%s>; size: %z; "
-					  "checksum: <%*xs>",
-					  MESSAGE_FIELD(task, message_id), task->queue_id, task->msg.len,
-					  (int) sizeof(MESSAGE_FIELD(task, digest)), MESSAGE_FIELD(task, digest));
+	str.str = (char *) p;
+	str.len = len;
+	hdr_pos = rspamd_string_find_eoh(&str, &body_pos);
+
+	/*
+	 * The end of headers could be guessed when the input is cut in the
+	 * middle of a folded header, so we also want some body after it
+	 */
+	if (hdr_pos <= 0 || body_pos + 2 >= (goffset) len) {
+		return FALSE;
 	}
-	else {
-		msg_info_task("loaded message; id: <%s>; size: %z; "
-					  "checksum: <%*xs>",
-					  MESSAGE_FIELD(task, message_id), task->msg.len,
-					  (int) sizeof(MESSAGE_FIELD(task, digest)), MESSAGE_FIELD(task, digest));
+
+	if (task->message) {
+		rspamd_message_unref(task->message);
+	}
+
+	task->message = rspamd_message_new(task);
+	MESSAGE_FIELD(task, raw_headers_content).begin = p;
+	MESSAGE_FIELD(task, raw_headers_content).len = hdr_pos;
+	MESSAGE_FIELD(task, raw_headers_content).body_start = p + body_pos;
+
+	rspamd_mime_headers_process(task,
+								MESSAGE_FIELD(task, raw_headers),
+								&MESSAGE_FIELD(task, headers_order),
+								p, hdr_pos,
+								TRUE);
+
+	/* Preserve the natural order */
+	if (MESSAGE_FIELD(task, headers_order)) {
+		LL_REVERSE2(MESSAGE_FIELD(task, headers_order), ord_next);
 	}
 
+	if (MESSAGE_FIELD(task, message_id) == NULL) {
+		MESSAGE_FIELD(task, message_id) = "undef";
+	}
+
+	msg_debug_task("parsed headers of length %d before the whole message is received",
+				   (int) hdr_pos);
+
 	return TRUE;
 }
 
-
 /*
  * A helper structure to store text parts positions, if it was C++, I could just use std::pair,
  * but here I have to make it all manually, sigh...
@@ -1784,6 +1878,7 @@ void rspamd_message_process(struct rspamd_task *task)
 		L = task->cfg->lua_state;
 	}
 
+	rspamd_mime_parser_detect_deferred(task);
 	rspamd_archives_process(task);
 
 	/* Second pass: fill detected_* for parts not decided during parsing */
@@ -1795,7 +1890,7 @@ void rspamd_message_process(struct rspamd_task *task)
 		PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, parts), j, pp)
 		{
 			gboolean needs_refine = FALSE;
-			if (pp->parsed_data.len > 0) {
+			if (rspamd_mime_part_has_content(pp)) {
 				if (pp->detected_type == NULL && pp->detected_ext == NULL) {
 					needs_refine = TRUE;
 				}
@@ -1893,7 +1988,7 @@ void rspamd_message_process(struct rspamd_task *task)
 		/* detected_* are already set by mime_parser; no extra lua_magic call here */
 
 		/* Now detect content */
-		if (content_func_pos != -1 && part->parsed_data.len > 0 &&
+		if (content_func_pos != -1 && rspamd_mime_part_has_content(part) &&
 			part->part_type == RSPAMD_MIME_PART_UNDEFINED) {
 			struct rspamd_mime_part **pmime;
 			struct rspamd_task **ptask;
@@ -1932,6 +2027,7 @@ void rspamd_message_process(struct rspamd_task *task)
 	}
 
 	uint16_t cur_url_order = 0;
+
 	g_array_sort(detected_text_parts, rspamd_mime_text_part_position_compare_func);
 	/* One more iteration to process text parts in a more specific order */
 	for (i = 0; i < detected_text_parts->len; i++) {
@@ -2132,7 +2228,7 @@ void rspamd_message_update_digest(struct rspamd_message *msg,
 	/* Sanity */
 	G_STATIC_ASSERT(sizeof(n) == sizeof(msg->digest));
 
-	memcpy(n, msg->digest, sizeof(msg->digest));
+	memcpy(n, rspamd_message_get_digest(msg), sizeof(msg->digest));
 	n[0] = t1ha2_atonce128(&n[1], input, len, n[0]);
 	memcpy(msg->digest, n, sizeof(msg->digest));
 }
@@ -38,6 +38,16 @@ enum rspamd_mime_part_flags {
 	RSPAMD_MIME_PART_MISSING_CTE = (1u << 5u),
 	RSPAMD_MIME_PART_NO_TEXT_EXTRACTION = (1u << 6u),
 	RSPAMD_MIME_PART_COMPUTED = (1u << 7u),
+	/* Content is not transfer-decoded yet, see rspamd_mime_part_get_content */
+	RSPAMD_MIME_PART_ENCODED = (1u << 8u),
+	/* parsed_data is a decoded copy owned by the part */
+	RSPAMD_MIME_PART_DECODED = (1u << 9u),
+	/* Decoded copy is mapped from a temporary file */
+	RSPAMD_MIME_PART_SPILLED = (1u << 10u),
+	/* digest is computed, see rspamd_mime_part_get_digest */
+	RSPAMD_MIME_PART_DIGEST = (1u << 11u),
+	/* Type detection waits for rspamd_message_process to keep the part encoded */
+	RSPAMD_MIME_PART_DETECT_DEFERRED = (1u << 12u),
 };
 
 enum rspamd_mime_part_type {
@@ -99,6 +109,10 @@ struct rspamd_mime_part {
 
 	char *raw_headers_str;
 	gsize raw_headers_len;
+	/* Directory for a decoded copy of a large part, NULL to keep it in memory */
+	const char *spill_dir;
+	/* Pool of the task that owns a decoded copy */
+	rspamd_mempool_t *pool;
 
 	enum rspamd_cte cte;
 	unsigned int flags;
@@ -113,6 +127,7 @@ struct rspamd_mime_part {
 		struct rspamd_lua_specific_part lua_specific;
 	} specific;
 
+	/* Computed on demand, use rspamd_mime_part_get_digest */
 	unsigned char digest[rspamd_cryptobox_HASHBYTES];
 };
 
@@ -199,7 +214,8 @@ struct rspamd_message {
 	struct rspamd_task *task;
 	GPtrArray *rcpt_mime;
 	GPtrArray *from_mime;
-	unsigned char digest[16];
+	unsigned char digest[16]; /**< computed on demand, use rspamd_message_get_digest	*/
+	gboolean digest_computed;
 	enum rspamd_newlines_type nlines_type; /**< type of newlines (detected on most of headers 	*/
 	ref_entry_t ref;
 };
@@ -214,6 +230,17 @@ struct rspamd_message {
  */
 gboolean rspamd_message_parse(struct rspamd_task *task);
 
+/**
+ * Parse headers of a message that is still being received, the message is
+ * replaced by `rspamd_message_parse` once the whole input is available
+ * @param task worker_task object
+ * @param p start of the received input
+ * @param len length of the received input
+ * @return TRUE if the header block is complete and has been parsed
+ */
+gboolean rspamd_message_parse_headers(struct rspamd_task *task,
+									  const char *p, gsize len);
+
 /**
  * Process content in task (e.g. HTML parsing)
  * @param task
@@ -244,12 +271,54 @@ enum rspamd_cte rspamd_cte_from_string(const char *str);
  */
 const char *rspamd_cte_to_string(enum rspamd_cte ct);
 
+/**
+ * Returns transfer-decoded content of a mime part. Parser only records
+ * the encoding of binary parts, so they are decoded on the first call
+ * @param part
+ * @return decoded content (parsed_data of the part)
+ */
+const rspamd_ftok_t *rspamd_mime_part_get_content(struct rspamd_mime_part *part);
+
+/**
+ * Returns the first `len` bytes of the decoded content, encoded parts are not
+ * decoded as a whole unless their encoding is broken
+ * @param part
+ * @param len maximum length of the prefix
+ * @param complete set to TRUE if the prefix is the whole content
+ * @return decoded prefix allocated in the pool of the part
+ */
+rspamd_ftok_t rspamd_mime_part_get_content_prefix(struct rspamd_mime_part *part,
+												  gsize len, gboolean *complete);
+
+/**
+ * Checks if a part has any content without decoding it
+ * @param part
+ * @return TRUE if the (raw, for encoded parts) content is not empty
+ */
+gboolean rspamd_mime_part_has_content(const struct rspamd_mime_part *part);
+
+/**
+ * Returns digest of the decoded content of a mime part, it is computed
+ * (and the part is decoded) on the first call
+ * @param part
+ * @return digest of rspamd_cryptobox_HASHBYTES length
+ */
+const unsigned char *rspamd_mime_part_get_digest(struct rspamd_mime_part *part);
+
 struct rspamd_message *rspamd_message_new(struct rspamd_task *task);
 
 struct rspamd_message *rspamd_message_ref(struct rspamd_message *msg);
 
 void rspamd_message_unref(struct rspamd_message *msg);
 
+/**
+ * Returns digest of the message, it is computed over the decoded parts (and
+ * so decodes them) on the first call
+ * @param msg
+ * @return digest of 16 bytes length
+ */
+const unsigned char *rspamd_message_get_digest(struct rspamd_message *msg);
+
 /**
  * Updates digest of the message if modified
  * @param msg
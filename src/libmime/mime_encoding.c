@@ -15,6 +15,7 @@
  */
 
 #include "config.h"
+#include "rspamd.h"
 #include "libutil/mem_pool.h"
 #include "libutil/regexp.h"
 #include "libutil/hash.h"
@@ -25,12 +26,15 @@
 #include "rspamd_simdutf.h"
 #include "contrib/google-ced/ced_c.h"
 #include <unicode/ucnv.h>
+#include <unicode/utf8.h>
+#include <unicode/utf16.h>
 #if U_ICU_VERSION_MAJOR_NUM >= 44
 #include <unicode/unorm2.h>
 #endif
 #include <math.h>
 
 #define UTF8_CHARSET "UTF-8"
+#define ASCII_CHARSET "US-ASCII"
 #define RSPAMD_BINARYENC_CHARSET "x-binaryenc"
 
 #define RSPAMD_CHARSET_FLAG_UTF (1 << 0)
@@ -53,6 +57,8 @@ struct rspamd_charset_substitution {
 #include "mime_encoding_list.h"
 
 static GHashTable *sub_hash = NULL;
+static uint64_t charset_detect_stat[RSPAMD_CHARSET_DETECT_MAX];
+static uint64_t charset_detect_reported[RSPAMD_CHARSET_DETECT_MAX];
 
 static const UChar iso_8859_16_map[] = {
 	0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x0085, 0x0086, 0x0087,
@@ -78,6 +84,11 @@ struct rspamd_charset_converter {
 		UConverter *conv;
 		const UChar *cnv_table;
 	} d;
+	/*
+	 * For ASCII compatible single byte charsets: UTF-8 sequences of all
+	 * 256 chars, 4 bytes each, the last byte is the length of a sequence
+	 */
+	unsigned char *utf8_table;
 	gboolean is_internal;
 };
 
@@ -96,6 +107,7 @@ rspamd_converter_dtor(gpointer p)
 		ucnv_close(c->d.conv);
 	}
 
+	g_free(c->utf8_table);
 	g_free(c->canon_name);
 	g_free(c);
 }
@@ -133,6 +145,94 @@ rspamd_converter_to_uchars(struct rspamd_charset_converter *cnv,
 	}
 }
 
+/*
+ * Single byte charsets that are compatible with ASCII (windows-125x, koi8,
+ * iso-8859-x and so on) are converted to UTF-8 by table, the table is
+ * filled from ICU once per converter
+ */
+static void
+rspamd_converter_maybe_init_table(struct rspamd_charset_converter *cnv)
+{
+	UChar high[128];
+	unsigned int i;
+
+	if (cnv->is_internal) {
+		memcpy(high, cnv->d.cnv_table, sizeof(high));
+	}
+	else {
+		if (ucnv_getMaxCharSize(cnv->d.conv) != 1) {
+			return;
+		}
+
+		for (i = 0; i < 256; i++) {
+			char c = (char) i;
+			UChar out[2];
+			UErrorCode uc_err = U_ZERO_ERROR;
+			int32_t r;
+
+			r = ucnv_toUChars(cnv->d.conv, out, G_N_ELEMENTS(out), &c, 1, &uc_err);
+
+			if (!U_SUCCESS(uc_err) || r != 1 || U16_IS_SURROGATE(out[0]) ||
+				(i < 128 && out[0] != i)) {
+				/* Not a plain single byte charset, use ICU for it */
+				ucnv_reset(cnv->d.conv);
+
+				return;
+			}
+
+			if (i >= 128) {
+				high[i - 128] = out[0];
+			}
+		}
+
+		ucnv_reset(cnv->d.conv);
+	}
+
+	cnv->utf8_table = g_malloc0(256 * 4);
+
+	for (i = 0; i < 256; i++) {
+		int32_t off = 0;
+
+		U8_APPEND_UNSAFE(&cnv->utf8_table[i * 4], off, i < 128 ? i : high[i - 128]);
+		cnv->utf8_table[i * 4 + 3] = off;
+	}
+}
+
+#define RSPAMD_TABLE_UTF8_LEN(len) ((len) * 3 + 3)
+
+/*
+ * Converts input using utf8 table, out must have space for
+ * RSPAMD_TABLE_UTF8_LEN(len) bytes
+ */
+static gsize
+rspamd_converter_table_to_utf8(struct rspamd_charset_converter *cnv,
+							   const unsigned char *in, gsize len,
+							   unsigned char *out)
+{
+	const unsigned char *p = in, *end = in + len, *blk_end, *seq;
+	unsigned char *o = out;
+	gsize span;
+
+	while (p < end) {
+		span = rspamd_fast_ascii_prefix_len(p, end - p);
+		memcpy(o, p, span);
+		o += span;
+		p += span;
+
+		/* Mixed block, likely followed by more 8 bit chars */
+		blk_end = p + MIN(end - p, 16);
+
+		while (p < blk_end) {
+			seq = &cnv->utf8_table[*p * 4];
+			/* Copy all 4 bytes and then advance by the real length */
+			memcpy(o, seq, 4);
+			o += seq[3];
+			p++;
+		}
+	}
+
+	return o - out;
+}
 
 struct rspamd_charset_converter *
 rspamd_mime_get_converter_cached(const char *enc,
@@ -185,6 +285,7 @@ rspamd_mime_get_converter_cached(const char *enc,
 									NULL,
 									NULL,
 									err);
+				rspamd_converter_maybe_init_table(conv);
 				rspamd_lru_hash_insert(cache, conv->canon_name, conv, 0, 0);
 			}
 			else {
@@ -198,6 +299,7 @@ rspamd_mime_get_converter_cached(const char *enc,
 			conv->is_internal = TRUE;
 			conv->d.cnv_table = iso_8859_16_map;
 			conv->canon_name = g_strdup(canon_name);
+			rspamd_converter_maybe_init_table(conv);
 
 			rspamd_lru_hash_insert(cache, conv->canon_name, conv, 0, 0);
 		}
@@ -361,6 +463,20 @@ rspamd_mime_text_to_utf8(rspamd_mempool_t *pool,
 		return NULL;
 	}
 
+	if (conv->utf8_table) {
+		d = rspamd_mempool_alloc(pool, RSPAMD_TABLE_UTF8_LEN(len));
+		r = rspamd_converter_table_to_utf8(conv, (const unsigned char *) input, len,
+										   (unsigned char *) d);
+		msg_debug_pool("converted from %s to UTF-8 by table inlen: %z, outlen: %d",
+					   in_enc, len, r);
+
+		if (olen) {
+			*olen = r;
+		}
+
+		return d;
+	}
+
 	tmp_buf = g_new(UChar, len + 1);
 	uc_err = U_ZERO_ERROR;
 	r = rspamd_converter_to_uchars(conv, tmp_buf, len + 1, input, len, &uc_err);
@@ -426,38 +542,47 @@ rspamd_mime_text_part_utf8_convert(struct rspamd_task *task,
 		return FALSE;
 	}
 
-	tmp_buf = g_new(UChar, input->len + 1);
-	uc_err = U_ZERO_ERROR;
-	uc_len = rspamd_converter_to_uchars(conv,
-										tmp_buf,
-										input->len + 1,
-										input->data,
-										input->len,
-										&uc_err);
-
-	if (!U_SUCCESS(uc_err)) {
-		g_set_error(err, rspamd_charset_conv_error_quark(), EINVAL,
-					"cannot convert data to unicode from %s: %s",
-					charset, u_errorName(uc_err));
-		g_free(tmp_buf);
-
-		return FALSE;
+	if (conv->utf8_table) {
+		/* Single byte charset, one UTF16 char per input byte */
+		uc_len = input->len;
+		d = rspamd_mempool_alloc(task->task_pool, RSPAMD_TABLE_UTF8_LEN(input->len));
+		r = rspamd_converter_table_to_utf8(conv, input->data, input->len,
+										   (unsigned char *) d);
 	}
+	else {
+		tmp_buf = g_new(UChar, input->len + 1);
+		uc_err = U_ZERO_ERROR;
+		uc_len = rspamd_converter_to_uchars(conv,
+											tmp_buf,
+											input->len + 1,
+											input->data,
+											input->len,
+											&uc_err);
+
+		if (!U_SUCCESS(uc_err)) {
+			g_set_error(err, rspamd_charset_conv_error_quark(), EINVAL,
+						"cannot convert data to unicode from %s: %s",
+						charset, u_errorName(uc_err));
+			g_free(tmp_buf);
 
-	/* Now, convert to utf8 */
-	clen = ucnv_getMaxCharSize(utf8_converter);
-	dlen = UCNV_GET_MAX_BYTES_FOR_STRING(uc_len, clen);
-	d = rspamd_mempool_alloc(task->task_pool, dlen);
-	r = ucnv_fromUChars(utf8_converter, d, dlen,
-						tmp_buf, uc_len, &uc_err);
+			return FALSE;
+		}
 
-	if (!U_SUCCESS(uc_err)) {
-		g_set_error(err, rspamd_charset_conv_error_quark(), EINVAL,
-					"cannot convert data from unicode from %s: %s",
-					charset, u_errorName(uc_err));
+		/* Now, convert to utf8 */
+		clen = ucnv_getMaxCharSize(utf8_converter);
+		dlen = UCNV_GET_MAX_BYTES_FOR_STRING(uc_len, clen);
+		d = rspamd_mempool_alloc(task->task_pool, dlen);
+		r = ucnv_fromUChars(utf8_converter, d, dlen,
+							tmp_buf, uc_len, &uc_err);
 		g_free(tmp_buf);
 
-		return FALSE;
+		if (!U_SUCCESS(uc_err)) {
+			g_set_error(err, rspamd_charset_conv_error_quark(), EINVAL,
+						"cannot convert data from unicode from %s: %s",
+						charset, u_errorName(uc_err));
+
+			return FALSE;
+		}
 	}
 
 	if (text_part->mime_part && text_part->mime_part->ct) {
@@ -474,7 +599,6 @@ rspamd_mime_text_part_utf8_convert(struct rspamd_task *task,
 													  sizeof(*text_part->utf_raw_content) + sizeof(gpointer) * 4);
 	text_part->utf_raw_content->data = d;
 	text_part->utf_raw_content->len = r;
-	g_free(tmp_buf);
 
 	return TRUE;
 }
@@ -527,6 +651,14 @@ rspamd_mime_to_utf8_byte_array(GByteArray *in,
 		return FALSE;
 	}
 
+	if (conv->utf8_table) {
+		g_byte_array_set_size(out, RSPAMD_TABLE_UTF8_LEN(in->len));
+		out->len = rspamd_converter_table_to_utf8(conv, in->data, in->len,
+												  out->data);
+
+		return TRUE;
+	}
+
 	tmp_buf = g_new(UChar, in->len + 1);
 	uc_err = U_ZERO_ERROR;
 	r = rspamd_converter_to_uchars(conv,
@@ -594,6 +726,42 @@ void rspamd_mime_charset_utf_enforce(char *in, gsize len)
 	}
 }
 
+const uint64_t *
+rspamd_mime_charset_detect_stat(void)
+{
+	return charset_detect_stat;
+}
+
+void rspamd_mime_charset_detect_report(struct rspamd_stat *stat)
+{
+	g_atomic_int_add(&stat->charset_detect_ascii,
+					 (int) (charset_detect_stat[RSPAMD_CHARSET_DETECT_ASCII] -
+							charset_detect_reported[RSPAMD_CHARSET_DETECT_ASCII]));
+	g_atomic_int_add(&stat->charset_detect_utf8,
+					 (int) (charset_detect_stat[RSPAMD_CHARSET_DETECT_UTF8] -
+							charset_detect_reported[RSPAMD_CHARSET_DETECT_UTF8]));
+	g_atomic_int_add(&stat->charset_detect_ced,
+					 (int) (charset_detect_stat[RSPAMD_CHARSET_DETECT_CED] -
+							charset_detect_reported[RSPAMD_CHARSET_DETECT_CED]));
+	memcpy(charset_detect_reported, charset_detect_stat,
+		   sizeof(charset_detect_reported));
+}
+
+/*
+ * 7 bit text that CED always detects as US-ASCII: printable characters and
+ * line breaks only. Control characters might start ISO-2022 sequences or
+ * indicate UTF-16/32, '+' and '~' might start UTF-7 or HZ sequences
+ */
+static gboolean
+rspamd_mime_charset_is_plain_ascii(const char *in, gsize inlen)
+{
+	static const char reject[] = "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x0b\x0c\x0e\x0f"
+								 "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+								 "\x7f+~";
+
+	return inlen > 0 && rspamd_memcspn(in, inlen, reject, sizeof(reject) - 1) == inlen;
+}
+
 const char *
 rspamd_mime_charset_find_by_content(const char *in, gsize inlen,
 									bool check_utf8)
@@ -601,14 +769,34 @@ rspamd_mime_charset_find_by_content(const char *in, gsize inlen,
 	int nconsumed;
 	bool is_reliable;
 	const char *ced_name;
+	gsize ascii_len;
+
+	/* Stage 1: 7 bit input */
+	ascii_len = rspamd_fast_ascii_prefix_len(in, inlen);
+
+	if (ascii_len == inlen) {
+		if (check_utf8) {
+			charset_detect_stat[RSPAMD_CHARSET_DETECT_ASCII]++;
 
-	if (check_utf8) {
-		if (rspamd_fast_utf8_validate(in, inlen) == 0) {
 			return UTF8_CHARSET;
 		}
+
+		if (rspamd_mime_charset_is_plain_ascii(in, inlen)) {
+			charset_detect_stat[RSPAMD_CHARSET_DETECT_ASCII]++;
+
+			return ASCII_CHARSET;
+		}
 	}
+	/* Stage 2: valid UTF-8, the ASCII prefix is already checked */
+	else if (check_utf8 &&
+			 rspamd_fast_utf8_validate(in + ascii_len, inlen - ascii_len) == 0) {
+		charset_detect_stat[RSPAMD_CHARSET_DETECT_UTF8]++;
 
+		return UTF8_CHARSET;
+	}
 
+	/* Stage 3: ambiguous input, ask CED */
+	charset_detect_stat[RSPAMD_CHARSET_DETECT_CED]++;
 	ced_name = ced_encoding_detect(in, inlen, NULL, NULL,
 								   NULL, 0, CED_EMAIL_CORPUS,
 								   false, &nconsumed, &is_reliable);
@@ -637,13 +825,13 @@ rspamd_mime_charset_find_by_content_maybe_split(const char *in, gsize inlen)
 												 RSPAMD_CHARSET_MAX_CONTENT, false);
 
 		/* 7bit stuff */
-		if (c1 && strcmp(c1, "US-ASCII") == 0) {
+		if (c1 && strcmp(c1, ASCII_CHARSET) == 0) {
 			c1 = NULL; /* Invalid - we have 8 bit there */
 		}
-		if (c2 && strcmp(c2, "US-ASCII") == 0) {
+		if (c2 && strcmp(c2, ASCII_CHARSET) == 0) {
 			c2 = NULL; /* Invalid - we have 8 bit there */
 		}
-		if (c3 && strcmp(c3, "US-ASCII") == 0) {
+		if (c3 && strcmp(c3, ASCII_CHARSET) == 0) {
 			c3 = NULL; /* Invalid - we have 8 bit there */
 		}
 
@@ -748,6 +936,7 @@ void rspamd_mime_text_part_maybe_convert(struct rspamd_task *task,
 	GByteArray *part_content;
 	rspamd_ftok_t charset_tok;
 	struct rspamd_mime_part *part = text_part->mime_part;
+	enum rspamd_charset_detect_stage detect_stage = RSPAMD_CHARSET_DETECT_CED;
 
 	if (rspamd_str_has_8bit(text_part->raw.begin, text_part->raw.len)) {
 		text_part->flags |= RSPAMD_MIME_TEXT_PART_FLAG_8BIT_RAW;
@@ -768,6 +957,7 @@ void rspamd_mime_text_part_maybe_convert(struct rspamd_task *task,
 			need_charset_heuristic = FALSE;
 			valid_utf8 = TRUE;
 			checked = TRUE;
+			detect_stage = RSPAMD_CHARSET_DETECT_UTF8;
 		}
 
 		text_part->flags |= RSPAMD_MIME_TEXT_PART_FLAG_8BIT_ENCODED;
@@ -777,6 +967,7 @@ void rspamd_mime_text_part_maybe_convert(struct rspamd_task *task,
 		need_charset_heuristic = FALSE;
 		valid_utf8 = TRUE;
 		checked = TRUE; /* Already valid utf, no need in further checks */
+		detect_stage = RSPAMD_CHARSET_DETECT_ASCII;
 	}
 
 	if (part->ct->charset.len == 0) {
@@ -796,6 +987,7 @@ void rspamd_mime_text_part_maybe_convert(struct rspamd_task *task,
 			text_part->real_charset = charset;
 		}
 		else if (valid_utf8) {
+			charset_detect_stat[detect_stage]++;
 			SET_PART_UTF(text_part);
 			text_part->utf_raw_content = part_content;
 			text_part->real_charset = UTF8_CHARSET;
@@ -822,6 +1014,7 @@ void rspamd_mime_text_part_maybe_convert(struct rspamd_task *task,
 			}
 			else if (valid_utf8) {
 				/* We already know that the input is valid utf, so skip heuristic */
+				charset_detect_stat[detect_stage]++;
 				text_part->real_charset = UTF8_CHARSET;
 			}
 		}
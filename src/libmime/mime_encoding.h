@@ -29,6 +29,7 @@ struct rspamd_task;
 struct rspamd_mime_part;
 struct rspamd_mime_text_part;
 struct rspamd_charset_converter;
+struct rspamd_stat;
 
 /**
  * Convert charset alias to a canonic charset name
@@ -141,6 +142,25 @@ rspamd_converter_to_uchars(struct rspamd_charset_converter *cnv,
 const char *rspamd_mime_charset_find_by_content(const char *in, gsize inlen,
 												bool check_utf8);
 
+enum rspamd_charset_detect_stage {
+	RSPAMD_CHARSET_DETECT_ASCII = 0,
+	RSPAMD_CHARSET_DETECT_UTF8,
+	RSPAMD_CHARSET_DETECT_CED,
+	RSPAMD_CHARSET_DETECT_MAX,
+};
+
+/**
+ * Returns array of RSPAMD_CHARSET_DETECT_MAX counters: how many times each
+ * stage of the content based charset detection has decided in this process
+ */
+const uint64_t *rspamd_mime_charset_detect_stat(void);
+
+/**
+ * Adds charsets detected by each stage since the previous report to the
+ * server stat
+ */
+void rspamd_mime_charset_detect_report(struct rspamd_stat *stat);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2181,18 +2181,22 @@ compare_subtype(struct rspamd_task *task, struct rspamd_content_type *ct,
 static gboolean
 compare_len(struct rspamd_mime_part *part, unsigned int min, unsigned int max)
 {
+	gsize len;
+
 	if (min == 0 && max == 0) {
 		return TRUE;
 	}
 
+	len = rspamd_mime_part_get_content(part)->len;
+
 	if (min == 0) {
-		return part->parsed_data.len <= max;
+		return len <= max;
 	}
 	else if (max == 0) {
-		return part->parsed_data.len >= min;
+		return len >= min;
 	}
 	else {
-		return part->parsed_data.len >= min && part->parsed_data.len <= max;
+		return len >= min && len <= max;
 	}
 }
 
@@ -2337,7 +2341,7 @@ rspamd_is_empty_body(struct rspamd_task *task,
 
 	PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, parts), i, part)
 	{
-		if (part->parsed_data.len > 0) {
+		if (rspamd_mime_part_get_content(part)->len > 0) {
 			return FALSE;
 		}
 	}
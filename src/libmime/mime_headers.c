@@ -182,6 +182,21 @@ rspamd_mime_header_add(struct rspamd_task *task,
 }
 
 
+/* Returns the first CR or LF character in the block or its end */
+static inline const char *
+rspamd_mime_headers_find_eol(const char *p, const char *end)
+{
+	for (;;) {
+		p += rspamd_str_line_span(p, end - p);
+
+		if (p == end || *p != '\0') {
+			return p;
+		}
+
+		p++;
+	}
+}
+
 /* Convert raw headers to a list of struct raw_header * */
 void rspamd_mime_headers_process(struct rspamd_task *task,
 								 struct rspamd_mime_headers_table *target,
@@ -193,6 +208,7 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 	const char *p, *c, *end;
 	char *tmp, *tp;
 	int state = 0, l, next_state = 100, err_state = 100, t_state;
+	gsize span;
 	gboolean valid_folding = FALSE, shift_by_one = FALSE;
 	unsigned int nlines_count[RSPAMD_TASK_NEWLINES_MAX];
 	unsigned int norder = 0;
@@ -220,6 +236,12 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 			break;
 		case 1:
 			/* We got something like header's name */
+			p += rspamd_str_header_name_span(p, end - p);
+
+			if (p == end) {
+				break;
+			}
+
 			if (*p == ':') {
 				nh = rspamd_mempool_alloc0(task->task_pool,
 										   sizeof(struct rspamd_mime_header));
@@ -234,7 +256,7 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 				state = 2;
 				c = p;
 			}
-			else if (g_ascii_isspace(*p)) {
+			else {
 				/* Not header but some garbage */
 				if (target == MESSAGE_FIELD(task, raw_headers)) {
 					/* Do not propagate flag from the attachments */
@@ -243,9 +265,6 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 				state = 100;
 				next_state = 0;
 			}
-			else {
-				p++;
-			}
 			break;
 		case 2:
 			/* We got header's name, so skip any \t or spaces */
@@ -297,7 +316,14 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 			}
 			break;
 		case 3:
-			if (*p == '\r' || *p == '\n') {
+			p = rspamd_mime_headers_find_eol(p, end);
+
+			if (p == end) {
+				/* The last value has no line end */
+				p--;
+				state = 4;
+			}
+			else {
 				/* Hold folding */
 				if (check_newlines) {
 					if (*p == '\n') {
@@ -314,12 +340,6 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 				next_state = 3;
 				err_state = 4;
 			}
-			else if (p + 1 == end) {
-				state = 4;
-			}
-			else {
-				p++;
-			}
 			break;
 		case 4:
 			/* Copy header's value */
@@ -333,22 +353,26 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 			tmp = rspamd_mempool_alloc(task->task_pool, l + 1);
 			tp = tmp;
 			t_state = 0;
-			while (l--) {
+			while (l > 0) {
 				if (t_state == 0) {
-					/* Before folding */
-					if (*c == '\n' || *c == '\r') {
+					/* Before folding, copy the rest of line in bulk */
+					span = rspamd_str_line_span(c, l);
+					memcpy(tp, c, span);
+					tp += span;
+					c += span;
+					l -= span;
+
+					if (l == 0) {
+						break;
+					}
+
+					if (*c != '\0') {
 						t_state = 1;
-						c++;
 						*tp++ = ' ';
 					}
-					else {
-						if (*c != '\0') {
-							*tp++ = *c++;
-						}
-						else {
-							c++;
-						}
-					}
+
+					c++;
+					l--;
 				}
 				else if (t_state == 1) {
 					/* Inside folding */
@@ -364,6 +388,8 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 							c++;
 						}
 					}
+
+					l--;
 				}
 			}
 			/* Strip last space that can be added by \r\n parsing */
@@ -452,8 +478,12 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 			break;
 		case 100:
 			/* Fail state, skip line */
+			p = rspamd_mime_headers_find_eol(p, end);
 
-			if (*p == '\r') {
+			if (p == end) {
+				state = next_state;
+			}
+			else if (*p == '\r') {
 				if (p + 1 < end && *(p + 1) == '\n') {
 					nlines_count[RSPAMD_TASK_NEWLINES_CRLF]++;
 					p++;
@@ -470,13 +500,6 @@ void rspamd_mime_headers_process(struct rspamd_task *task,
 				p++;
 				state = next_state;
 			}
-			else if (p + 1 == end) {
-				state = next_state;
-				p++;
-			}
-			else {
-				p++;
-			}
 			break;
 		}
 	}
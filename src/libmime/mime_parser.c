@@ -28,6 +28,7 @@
 #include <openssl/cms.h>
 #include <openssl/pkcs7.h>
 #include "rspamd_simdutf.h"
+#include "unix-std.h"
 
 struct rspamd_mime_parser_config {
 	struct rspamd_multipattern *mp_boundary;
@@ -117,6 +118,10 @@ static const unsigned int max_key_usages = 10000;
 														  rspamd_mime_log_id, "mime", task->task_pool->tag.uid, \
 														  RSPAMD_LOG_FUNC,                                      \
 														  __VA_ARGS__)
+#define msg_debug_mime_part(...) rspamd_conditional_debug_fast(NULL, NULL,                                     \
+															   rspamd_mime_log_id, "mime", part->pool->tag.uid, \
+															   RSPAMD_LOG_FUNC,                                 \
+															   __VA_ARGS__)
 
 INIT_LOG_MODULE_PUBLIC(mime)
 
@@ -721,11 +726,223 @@ void rspamd_mime_parser_calc_digest(struct rspamd_mime_part *part)
 		0xfe,
 	};
 
-	if (part->parsed_data.len > 0) {
+	const rspamd_ftok_t *content = rspamd_mime_part_get_content(part);
+
+	if (content->len > 0) {
 		rspamd_cryptobox_hash(part->digest,
-							  part->parsed_data.begin, part->parsed_data.len,
+							  content->begin, content->len,
 							  hash_key, sizeof(hash_key));
 	}
+
+	part->flags |= RSPAMD_MIME_PART_DIGEST;
+}
+
+const unsigned char *
+rspamd_mime_part_get_digest(struct rspamd_mime_part *part)
+{
+	if (!(part->flags & RSPAMD_MIME_PART_DIGEST)) {
+		rspamd_mime_parser_calc_digest(part);
+	}
+
+	return part->digest;
+}
+
+/* Size of the buffer for the decoded content, it depends on the encoding only */
+static gsize
+rspamd_mime_part_decoded_size(struct rspamd_mime_part *part)
+{
+	if (part->cte == RSPAMD_CTE_QP) {
+		return part->raw_data.len + 1;
+	}
+
+	return part->raw_data.len / 4 * 3 + 12;
+}
+
+static char *
+rspamd_mime_part_alloc_content(struct rspamd_mime_part *part, gsize len)
+{
+	char *out;
+
+	if (part->spill_dir) {
+		out = rspamd_tmpfile_xmap(part->spill_dir, len);
+
+		if (out != NULL) {
+			part->flags |= RSPAMD_MIME_PART_SPILLED;
+			msg_debug_mime_part("decode part of %z bytes in a temporary file", len);
+
+			return out;
+		}
+
+		msg_warn("cannot map temporary file in %s: %s, decode part in memory",
+				 part->spill_dir, strerror(errno));
+	}
+
+	return g_malloc(len);
+}
+
+static void
+rspamd_mime_part_release_content(struct rspamd_mime_part *part, char *out)
+{
+	if (part->flags & RSPAMD_MIME_PART_SPILLED) {
+		munmap(out, rspamd_mime_part_decoded_size(part));
+		part->flags &= ~RSPAMD_MIME_PART_SPILLED;
+	}
+	else {
+		g_free(out);
+	}
+}
+
+static void
+rspamd_mime_part_free_content(gpointer p)
+{
+	struct rspamd_mime_part *part = (struct rspamd_mime_part *) p;
+
+	if (part->flags & RSPAMD_MIME_PART_DECODED) {
+		rspamd_mime_part_release_content(part, (char *) part->parsed_data.begin);
+	}
+}
+
+const rspamd_ftok_t *
+rspamd_mime_part_get_content(struct rspamd_mime_part *part)
+{
+	char *out = NULL;
+	gsize olen;
+	gssize r = -1;
+
+	if (!(part->flags & RSPAMD_MIME_PART_ENCODED)) {
+		return &part->parsed_data;
+	}
+
+	part->flags &= ~RSPAMD_MIME_PART_ENCODED;
+	olen = rspamd_mime_part_decoded_size(part);
+	out = rspamd_mime_part_alloc_content(part, olen);
+
+	switch (part->cte) {
+	case RSPAMD_CTE_QP:
+		r = rspamd_decode_qp_buf(part->raw_data.begin, part->raw_data.len,
+								 out, olen);
+
+		if (r == -1) {
+			msg_err("invalid quoted-printable encoded part, assume 8bit");
+		}
+		break;
+	case RSPAMD_CTE_B64:
+		rspamd_cryptobox_base64_decode(part->raw_data.begin,
+									   part->raw_data.len,
+									   (unsigned char *) out, &olen);
+		r = olen;
+		break;
+	case RSPAMD_CTE_UUE:
+		r = rspamd_decode_uue_buf(part->raw_data.begin, part->raw_data.len,
+								  out, olen);
+
+		if (r == -1) {
+			msg_err("invalid uuencoding in encoded part, assume 8bit");
+		}
+		break;
+	default:
+		g_assert_not_reached();
+	}
+
+	if (r != -1) {
+		part->parsed_data.begin = out;
+		part->parsed_data.len = r;
+		part->flags |= RSPAMD_MIME_PART_DECODED;
+
+		if (!(part->flags & RSPAMD_MIME_PART_SPILLED)) {
+			rspamd_mempool_notify_alloc(part->pool, r);
+		}
+	}
+	else {
+		if (part->ct) {
+			part->ct->flags |= RSPAMD_CONTENT_TYPE_BROKEN;
+		}
+
+		rspamd_mime_part_release_content(part, out);
+		part->cte = RSPAMD_CTE_8BIT;
+		part->parsed_data.begin = part->raw_data.begin;
+		part->parsed_data.len = part->raw_data.len;
+	}
+
+	return &part->parsed_data;
+}
+
+rspamd_ftok_t
+rspamd_mime_part_get_content_prefix(struct rspamd_mime_part *part, gsize len,
+									gboolean *complete)
+{
+	const rspamd_ftok_t *content;
+	rspamd_ftok_t res;
+	gsize inlen, olen;
+	gssize r = -1;
+	char *out = NULL;
+
+	if ((part->flags & RSPAMD_MIME_PART_ENCODED) &&
+		(part->cte == RSPAMD_CTE_QP || part->cte == RSPAMD_CTE_B64)) {
+		/* Decoded data is at least a third (qp) or a half (base64 with newlines) of the encoded one */
+		inlen = part->cte == RSPAMD_CTE_QP ? len * 3 : (len + 2) / 3 * 4 * 2;
+
+		if (inlen < part->raw_data.len) {
+			gsize limit = inlen;
+
+			/* Stop at the end of a line to keep quads and escapes whole */
+			while (inlen > 0 && part->raw_data.begin[inlen - 1] != '\n') {
+				inlen--;
+			}
+
+			if (inlen == 0 && part->cte == RSPAMD_CTE_B64) {
+				/* Base64 in a single line */
+				inlen = limit - limit % 4;
+			}
+		}
+		else {
+			inlen = part->raw_data.len;
+		}
+
+		if (inlen > 0) {
+			if (part->cte == RSPAMD_CTE_QP) {
+				olen = inlen + 1;
+				out = rspamd_mempool_alloc(part->pool, olen);
+				r = rspamd_decode_qp_buf(part->raw_data.begin, inlen, out, olen);
+			}
+			else {
+				olen = inlen / 4 * 3 + 12;
+				out = rspamd_mempool_alloc(part->pool, olen);
+
+				if (rspamd_cryptobox_base64_decode(part->raw_data.begin, inlen,
+												   (unsigned char *) out, &olen)) {
+					r = olen;
+				}
+			}
+		}
+
+		if (r != -1) {
+			res.begin = out;
+			res.len = MIN((gsize) r, len);
+			*complete = inlen == part->raw_data.len && res.len == (gsize) r;
+
+			return res;
+		}
+
+		/* Broken encoding or too long lines, decode the whole part */
+	}
+
+	content = rspamd_mime_part_get_content(part);
+	res.begin = content->begin;
+	res.len = MIN(content->len, len);
+	*complete = res.len == content->len;
+
+	return res;
+}
+
+gboolean
+rspamd_mime_part_has_content(const struct rspamd_mime_part *part)
+{
+	if (part->flags & RSPAMD_MIME_PART_ENCODED) {
+		return part->raw_data.len > 0;
+	}
+
+	return part->parsed_data.len > 0;
 }
 
 static enum rspamd_mime_parse_error
@@ -735,9 +952,6 @@ rspamd_mime_parse_normal_part(struct rspamd_task *task,
 							  struct rspamd_content_type *ct,
 							  GError **err)
 {
-	rspamd_fstring_t *parsed;
-	gssize r;
-
 	g_assert(part != NULL);
 
 	rspamd_mime_part_get_cte(task, part, part->raw_headers, FALSE);
@@ -772,83 +986,36 @@ rspamd_mime_parse_normal_part(struct rspamd_task *task,
 			}
 		}
 
-		if (part->ct && (part->ct->flags & RSPAMD_CONTENT_TYPE_TEXT)) {
-			/* Need to copy text as we have couple of in-place change functions */
-			parsed = rspamd_fstring_sized_new(part->raw_data.len);
-			parsed->len = part->raw_data.len;
-			memcpy(parsed->str, part->raw_data.begin, parsed->len);
-			part->parsed_data.begin = parsed->str;
-			part->parsed_data.len = parsed->len;
-			rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
-			rspamd_mempool_add_destructor(task->task_pool,
-										  (rspamd_mempool_destruct_t) rspamd_fstring_free, parsed);
-		}
-		else {
-			part->parsed_data.begin = part->raw_data.begin;
-			part->parsed_data.len = part->raw_data.len;
-		}
+		/*
+		 * Identity encodings: the content is a slice of the message, text
+		 * conversion works on its own copy and nothing modifies parsed data
+		 */
+		part->parsed_data.begin = part->raw_data.begin;
+		part->parsed_data.len = part->raw_data.len;
 		break;
 	case RSPAMD_CTE_QP:
-		parsed = rspamd_fstring_sized_new(part->raw_data.len);
-		r = rspamd_decode_qp_buf(part->raw_data.begin, part->raw_data.len,
-								 parsed->str, parsed->allocated);
-		if (r != -1) {
-			parsed->len = r;
-			part->parsed_data.begin = parsed->str;
-			part->parsed_data.len = parsed->len;
-			rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
-			rspamd_mempool_add_destructor(task->task_pool,
-										  (rspamd_mempool_destruct_t) rspamd_fstring_free, parsed);
-		}
-		else {
-			msg_err_task("invalid quoted-printable encoded part, assume 8bit");
-			if (part->ct) {
-				part->ct->flags |= RSPAMD_CONTENT_TYPE_BROKEN;
-			}
-			part->cte = RSPAMD_CTE_8BIT;
-			memcpy(parsed->str, part->raw_data.begin, part->raw_data.len);
-			parsed->len = part->raw_data.len;
-			part->parsed_data.begin = parsed->str;
-			part->parsed_data.len = parsed->len;
-			rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
-			rspamd_mempool_add_destructor(task->task_pool,
-										  (rspamd_mempool_destruct_t) rspamd_fstring_free, parsed);
-		}
-		break;
 	case RSPAMD_CTE_B64:
-		parsed = rspamd_fstring_sized_new(part->raw_data.len / 4 * 3 + 12);
-		rspamd_cryptobox_base64_decode(part->raw_data.begin,
-									   part->raw_data.len,
-									   parsed->str, &parsed->len);
-		part->parsed_data.begin = parsed->str;
-		part->parsed_data.len = parsed->len;
-		rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
-		rspamd_mempool_add_destructor(task->task_pool,
-									  (rspamd_mempool_destruct_t) rspamd_fstring_free, parsed);
-		break;
 	case RSPAMD_CTE_UUE:
-		parsed = rspamd_fstring_sized_new(part->raw_data.len / 4 * 3 + 12);
-		r = rspamd_decode_uue_buf(part->raw_data.begin, part->raw_data.len,
-								  parsed->str, parsed->allocated);
-		rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
+		/*
+		 * Record just the encoding: binary attachments are decoded by the
+		 * first consumer of their content. Text, messages and signed data
+		 * are decoded right now as we need them for parsing anyway.
+		 */
+		part->flags |= RSPAMD_MIME_PART_ENCODED;
+		part->pool = task->task_pool;
 		rspamd_mempool_add_destructor(task->task_pool,
-									  (rspamd_mempool_destruct_t) rspamd_fstring_free, parsed);
-		if (r != -1) {
-			parsed->len = r;
-			part->parsed_data.begin = parsed->str;
-			part->parsed_data.len = parsed->len;
+									  rspamd_mime_part_free_content, part);
+
+		if (task->cfg && task->cfg->spill_size > 0 &&
+			part->raw_data.len > task->cfg->spill_size) {
+			/* Decoded content is a file mapping that the kernel can page out */
+			part->spill_dir = task->cfg->temp_dir;
 		}
-		else {
-			msg_err_task("invalid uuencoding in encoded part, assume 8bit");
-			if (part->ct) {
-				part->ct->flags |= RSPAMD_CONTENT_TYPE_BROKEN;
-			}
-			part->cte = RSPAMD_CTE_8BIT;
-			parsed->len = MIN(part->raw_data.len, parsed->allocated);
-			memcpy(parsed->str, part->raw_data.begin, parsed->len);
-			rspamd_mempool_notify_alloc(task->task_pool, parsed->len);
-			part->parsed_data.begin = parsed->str;
-			part->parsed_data.len = parsed->len;
+
+		if (part->ct == NULL ||
+			(part->ct->flags & (RSPAMD_CONTENT_TYPE_TEXT | RSPAMD_CONTENT_TYPE_MESSAGE)) ||
+			(ct && (ct->flags & RSPAMD_CONTENT_TYPE_SMIME))) {
+			rspamd_mime_part_get_content(part);
 		}
 		break;
 	default:
@@ -858,10 +1025,10 @@ rspamd_mime_parse_normal_part(struct rspamd_task *task,
 	part->part_number = MESSAGE_FIELD(task, parts)->len;
 	part->urls = g_ptr_array_new();
 	g_ptr_array_add(MESSAGE_FIELD(task, parts), part);
-	msg_debug_mime("parsed data part %T/%T of length %z (%z orig), %s cte",
+	msg_debug_mime("parsed data part %T/%T of length %z (%z orig), %s cte%s",
 				   &part->ct->type, &part->ct->subtype, part->parsed_data.len,
-				   part->raw_data.len, rspamd_cte_to_string(part->cte));
-	rspamd_mime_parser_calc_digest(part);
+				   part->raw_data.len, rspamd_cte_to_string(part->cte),
+				   (part->flags & RSPAMD_MIME_PART_ENCODED) ? ", not decoded" : "");
 
 	if (ct && (ct->flags & RSPAMD_CONTENT_TYPE_SMIME)) {
 		CMS_ContentInfo *cms;
@@ -929,18 +1096,15 @@ rspamd_mime_parse_normal_part(struct rspamd_task *task,
 	return RSPAMD_MIME_PARSE_OK;
 }
 
-/* Run lua_magic.detect_mime_part for a decoded normal part and maybe promote to message */
-static enum rspamd_mime_parse_error
-rspamd_mime_maybe_detect_type(struct rspamd_task *task,
-							  struct rspamd_mime_part *npart,
-							  struct rspamd_mime_parser_runtime *st,
-							  GError **err)
+/* Run lua_magic.detect_mime_part for a part, returns TRUE if it is a message */
+static gboolean
+rspamd_mime_part_detect_lua(struct rspamd_task *task,
+							struct rspamd_mime_part *npart)
 {
 	lua_State *L = NULL;
 	int old_top = -1, err_idx;
 	gboolean promote_to_message = FALSE;
 
-
 	if (task->cfg) {
 		L = task->cfg->lua_state;
 	}
@@ -1046,6 +1210,47 @@ rspamd_mime_maybe_detect_type(struct rspamd_task *task,
 					   npart->part_number, (void *) L, cbref);
 	}
 
+	return promote_to_message;
+}
+
+/* The same as the file name fallback of lua_magic.detect_mime_part */
+static gboolean
+rspamd_mime_part_has_eml_filename(struct rspamd_mime_part *npart)
+{
+	const rspamd_ftok_t *fname;
+
+	if (npart->cd == NULL) {
+		return FALSE;
+	}
+
+	fname = &npart->cd->filename;
+
+	return fname->len > 4 &&
+		   g_ascii_strncasecmp(fname->begin + fname->len - 4, ".eml", 4) == 0;
+}
+
+/* Detect type of a normal part and maybe promote it to message */
+static enum rspamd_mime_parse_error
+rspamd_mime_maybe_detect_type(struct rspamd_task *task,
+							  struct rspamd_mime_part *npart,
+							  struct rspamd_mime_parser_runtime *st,
+							  GError **err)
+{
+	gboolean promote_to_message;
+
+	if (npart->flags & RSPAMD_MIME_PART_ENCODED) {
+		/*
+		 * lua_magic needs the decoded content, so binary attachments are
+		 * detected by rspamd_mime_parser_detect_deferred; embedded messages
+		 * are recognised by their file name only
+		 */
+		npart->flags |= RSPAMD_MIME_PART_DETECT_DEFERRED;
+		promote_to_message = rspamd_mime_part_has_eml_filename(npart);
+	}
+	else {
+		promote_to_message = rspamd_mime_part_detect_lua(task, npart);
+	}
+
 	/* Fallback: if nothing detected but declared CT is text, set detected_type to text */
 	if (npart->detected_type == NULL && npart->ct &&
 		(npart->ct->flags & RSPAMD_CONTENT_TYPE_TEXT)) {
@@ -1054,15 +1259,32 @@ rspamd_mime_maybe_detect_type(struct rspamd_task *task,
 
 	if (promote_to_message) {
 		msg_debug_mime("treat part as embedded message (lua_magic)");
+		npart->flags &= ~RSPAMD_MIME_PART_DETECT_DEFERRED;
 		st->nesting++;
 		g_ptr_array_add(st->stack, npart);
 		npart->part_type = RSPAMD_MIME_PART_MESSAGE;
+		rspamd_mime_part_get_content(npart);
 		return rspamd_mime_parse_message(task, npart, st, err);
 	}
 
 	return RSPAMD_MIME_PARSE_OK;
 }
 
+void rspamd_mime_parser_detect_deferred(struct rspamd_task *task)
+{
+	struct rspamd_mime_part *part;
+	unsigned int i;
+
+	PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, parts), i, part)
+	{
+		if (part->flags & RSPAMD_MIME_PART_DETECT_DEFERRED) {
+			part->flags &= ~RSPAMD_MIME_PART_DETECT_DEFERRED;
+			/* Messages are promoted while parsing */
+			rspamd_mime_part_detect_lua(task, part);
+		}
+	}
+}
+
 struct rspamd_mime_multipart_cbdata {
 	struct rspamd_task *task;
 	struct rspamd_mime_part *multipart;
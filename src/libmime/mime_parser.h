@@ -49,6 +49,9 @@ enum rspamd_mime_parse_error rspamd_mime_parse_task(struct rspamd_task *task,
 
 void rspamd_mime_parser_calc_digest(struct rspamd_mime_part *part);
 
+/* Detects types of parts kept encoded by the parser, see RSPAMD_MIME_PART_DETECT_DEFERRED */
+void rspamd_mime_parser_detect_deferred(struct rspamd_task *task);
+
 /* Public logging support for mime module */
 EXTERN_LOG_MODULE_DEF(mime);
 #define msg_debug_mime(...) rspamd_conditional_debug_fast(NULL, task->from_addr,                                \
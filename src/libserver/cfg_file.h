@@ -320,6 +320,7 @@ struct rspamd_config_post_init_script {
 };
 
 struct rspamd_lang_detector;
+struct rspamd_keypair_shared_cache;
 struct rspamd_rcl_sections_map;
 
 enum rspamd_config_settings_policy {
@@ -394,8 +395,10 @@ struct rspamd_config {
 	gsize max_cores_count;       /**< maximum number of core files						*/
 	char *cores_dir;             /**< directory for core files							*/
 	gsize max_message;           /**< maximum size for messages							*/
+	gsize spill_size;            /**< messages and parts larger than this are kept in temporary files */
 	gsize max_pic_size;          /**< maximum size for a picture to process				*/
-	gsize images_cache_size;     /**< size of LRU cache for DCT data from images			*/
+	gsize images_cache_size;     /**< size of LRU cache for metadata and DCT data from images */
+	gsize archives_cache_size;   /**< size of LRU cache for archives listings				*/
 	double task_timeout;         /**< maximum message processing time					*/
 	int default_max_shots;       /**< default maximum count of symbols hits permitted (-1 for unlimited) */
 	int url_rewrite_fold_limit;  /**< line fold limit for URL rewrite MIME encoding (default 76) */
@@ -487,6 +490,7 @@ struct rspamd_config {
 	unsigned int words_decay;        /**< limit for words for starting adaptive ignoring		*/
 	unsigned int history_rows;       /**< number of history rows stored						*/
 	unsigned int max_sessions_cache; /**< maximum number of sessions cache elts				*/
+	unsigned int nm_cache_size;      /**< size of the shared keypairs cache (0 to disable)	*/
 	unsigned int lua_gc_step;        /**< lua gc step 										*/
 	unsigned int lua_gc_pause;       /**< lua gc pause										*/
 	unsigned int full_gc_iters;      /**< iterations between full gc cycle					*/
@@ -509,7 +513,8 @@ struct rspamd_config {
 	struct rspamd_re_cache *re_cache;                  /**< static regexp cache								*/
 	struct rspamd_mime_parser_config *mime_parser_cfg; /**< mime parser shared config */
 
-	GHashTable *trusted_keys; /**< list of trusted public keys						*/
+	GHashTable *trusted_keys;                     /**< list of trusted public keys						*/
+	struct rspamd_keypair_shared_cache *nm_cache; /**< keypairs cache shared between workers				*/
 
 	struct rspamd_config_cfg_lua_script *on_load_scripts;       /**< list of scripts executed on workers load			*/
 	struct rspamd_config_cfg_lua_script *post_init_scripts;     /**< list of scripts executed on config being fully loaded			*/
@@ -2306,6 +2306,12 @@ rspamd_rcl_config_init(struct rspamd_config *cfg, GHashTable *skip_sections)
 									   G_STRUCT_OFFSET(struct rspamd_config, max_message),
 									   RSPAMD_CL_FLAG_INT_SIZE,
 									   "Maximum size of the message to be scanned (50Mb by default)");
+		rspamd_rcl_add_default_handler(sub,
+									   "spill_size",
+									   rspamd_rcl_parse_struct_integer,
+									   G_STRUCT_OFFSET(struct rspamd_config, spill_size),
+									   RSPAMD_CL_FLAG_INT_SIZE,
+									   "Keep messages and decoded parts larger than this in memory mapped temporary files (disabled by default)");
 		rspamd_rcl_add_default_handler(sub,
 									   "max_pic",
 									   rspamd_rcl_parse_struct_integer,
@@ -2315,9 +2321,15 @@ rspamd_rcl_config_init(struct rspamd_config *cfg, GHashTable *skip_sections)
 		rspamd_rcl_add_default_handler(sub,
 									   "images_cache",
 									   rspamd_rcl_parse_struct_integer,
-									   G_STRUCT_OFFSET(struct rspamd_config, max_pic_size),
+									   G_STRUCT_OFFSET(struct rspamd_config, images_cache_size),
+									   RSPAMD_CL_FLAG_INT_SIZE,
+									   "Size of metadata and DCT data cache for images (256 elements by default)");
+		rspamd_rcl_add_default_handler(sub,
+									   "archives_cache",
+									   rspamd_rcl_parse_struct_integer,
+									   G_STRUCT_OFFSET(struct rspamd_config, archives_cache_size),
 									   RSPAMD_CL_FLAG_INT_SIZE,
-									   "Size of DCT data cache for images (256 elements by default)");
+									   "Size of archives listings cache (256 elements by default, 0 to disable)");
 		rspamd_rcl_add_default_handler(sub,
 									   "zstd_input_dictionary",
 									   rspamd_rcl_parse_struct_string,
@@ -2354,6 +2366,12 @@ rspamd_rcl_config_init(struct rspamd_config *cfg, GHashTable *skip_sections)
 									   G_STRUCT_OFFSET(struct rspamd_config, max_sessions_cache),
 									   0,
 									   "Maximum number of sessions in cache before warning (default: 100)");
+		rspamd_rcl_add_default_handler(sub,
+									   "shared_keypair_cache_size",
+									   rspamd_rcl_parse_struct_integer,
+									   G_STRUCT_OFFSET(struct rspamd_config, nm_cache_size),
+									   RSPAMD_CL_FLAG_UINT,
+									   "Size of the shared secrets cache shared by fuzzy and HTTP workers (default: 0 - disabled)");
 		rspamd_rcl_add_default_handler(sub,
 									   "task_timeout",
 									   rspamd_rcl_parse_struct_time,
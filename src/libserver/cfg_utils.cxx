@@ -34,6 +34,7 @@
 #include "monitored.h"
 #include "ref.h"
 #include "cryptobox.h"
+#include "keypairs_cache.h"
 #include "ssl_util.h"
 #include "contrib/libottery/ottery.h"
 #include "rspamd_simdutf.h"
@@ -352,6 +353,7 @@ rspamd_config_new(enum rspamd_config_init_flags flags)
 	cfg->max_message = DEFAULT_MAX_MESSAGE;
 	cfg->max_pic_size = DEFAULT_MAX_PIC;
 	cfg->images_cache_size = 256;
+	cfg->archives_cache_size = 256;
 	cfg->monitored_ctx = rspamd_monitored_ctx_init();
 	cfg->neighbours = ucl_object_typed_new(UCL_OBJECT);
 	cfg->redis_pool = rspamd_redis_pool_init();
@@ -1043,6 +1045,12 @@ rspamd_config_post_load(struct rspamd_config *cfg,
 			return FALSE;
 		}
 
+		if (cfg->nm_cache_size > 0 && cfg->nm_cache == nullptr) {
+			/* Must be allocated before fork to be shared between workers */
+			cfg->nm_cache = rspamd_keypair_shared_cache_new(cfg->cfg_pool,
+															cfg->nm_cache_size);
+		}
+
 		/* Load custom tokenizers using the new function */
 		GError *tokenizer_err = NULL;
 		if (!rspamd_config_load_custom_tokenizers(cfg, &tokenizer_err)) {
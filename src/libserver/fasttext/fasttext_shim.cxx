@@ -111,19 +111,27 @@ public:
 		return read_u8() != 0;
 	}
 
-	auto read_cstring() -> std::string
+	/* Returns a view of the string in the mapped data, it is not copied */
+	auto read_cstring() -> std::string_view
 	{
-		std::string result;
-		while (pos_ < size_) {
-			auto ch = data_[pos_++];
-			if (ch == 0) break;
-			result.push_back(static_cast<char>(ch));
-			if (result.size() > MAX_SANE_STRING) {
-				failed_ = true;
-				return {};
-			}
+		if (failed_) return {};
+		auto *start = data_ + pos_;
+		auto max_len = std::min(size_ - pos_, MAX_SANE_STRING + 1);
+		auto *end = static_cast<const unsigned char *>(std::memchr(start, 0, max_len));
+		if (end == nullptr) {
+			failed_ = true;
+			return {};
 		}
-		return result;
+		pos_ += end - start + 1;
+		return {reinterpret_cast<const char *>(start), static_cast<std::size_t>(end - start)};
+	}
+
+	auto read_bytes(std::size_t count) -> const std::uint8_t *
+	{
+		if (!ensure(count)) return nullptr;
+		auto ptr = data_ + pos_;
+		pos_ += count;
+		return ptr;
 	}
 
 	auto read_floats(std::size_t count) -> const float *
@@ -189,10 +197,9 @@ auto utf8_positions(std::string_view s) -> std::vector<std::size_t>
 
 /* --- Dictionary entry --- */
 struct dict_entry {
-	std::string word;
+	std::string_view word; /* points to the mapped model */
 	std::int64_t count = 0;
 	entry_type type = entry_type::word;
-	std::vector<std::int32_t> subwords; /* precomputed subword IDs */
 };
 
 /* --- Product Quantizer --- */
@@ -216,13 +223,14 @@ public:
 		if (!ptr) {
 			return false;
 		}
-		centroids_.assign(ptr, ptr + total_floats);
+		centroids_ = ptr;
+		ncentroids_ = total_floats;
 		return true;
 	}
 
 	void add_code(const std::uint8_t *codes, float *vec, std::int32_t dim, float alpha) const
 	{
-		if (centroids_.empty()) return;
+		if (ncentroids_ == 0) return;
 		std::int32_t offset = 0;
 
 		for (std::int32_t sq = 0; sq < nsubq_; sq++) {
@@ -231,7 +239,7 @@ public:
 			auto centroid_base = get_centroid_offset(sq, centroid_idx);
 
 			for (std::int32_t d = 0; d < sub_dim; d++) {
-				if (centroid_base + d < centroids_.size() && offset + d < dim) {
+				if (centroid_base + d < ncentroids_ && offset + d < dim) {
 					vec[offset + d] += alpha * centroids_[centroid_base + d];
 				}
 			}
@@ -241,7 +249,7 @@ public:
 
 	auto dot_code(const std::uint8_t *codes, const float *vec, std::int32_t dim, float alpha) const -> float
 	{
-		if (centroids_.empty()) return 0.0f;
+		if (ncentroids_ == 0) return 0.0f;
 		float result = 0.0f;
 		std::int32_t offset = 0;
 
@@ -251,7 +259,7 @@ public:
 			auto centroid_base = get_centroid_offset(sq, centroid_idx);
 
 			for (std::int32_t d = 0; d < sub_dim; d++) {
-				if (centroid_base + d < centroids_.size() && offset + d < dim) {
+				if (centroid_base + d < ncentroids_ && offset + d < dim) {
 					result += centroids_[centroid_base + d] * vec[offset + d];
 				}
 			}
@@ -269,7 +277,7 @@ public:
 	auto get_centroid_value(std::int32_t sq, std::uint8_t code) const -> float
 	{
 		auto offset = get_centroid_offset(sq, static_cast<std::size_t>(code));
-		if (offset < centroids_.size()) {
+		if (offset < ncentroids_) {
 			return centroids_[offset];
 		}
 		return 1.0f;
@@ -290,7 +298,9 @@ private:
 	std::int32_t nsubq_ = 0;
 	std::int32_t dsub_ = 0;
 	std::int32_t lastdsub_ = 0;
-	std::vector<float> centroids_;
+	/* Points to the mapped model */
+	const float *centroids_ = nullptr;
+	std::size_t ncentroids_ = 0;
 };
 
 /* --- Matrix interface --- */
@@ -303,22 +313,14 @@ public:
 	virtual auto cols() const -> std::int64_t = 0;
 };
 
-/* Dense matrix: pointer into mmap'd data or heap-owned */
+/* Dense matrix: pointer into mmap'd data, so pages are shared between processes */
 class dense_matrix final : public matrix_base {
 public:
-	/* Construct from mmap pointer (zero-copy, for input matrix) */
 	dense_matrix(const float *data, std::int64_t m, std::int64_t n)
 		: data_(data), m_(m), n_(n)
 	{
 	}
 
-	/* Construct from heap data (for output matrix) */
-	dense_matrix(std::vector<float> &&storage, std::int64_t m, std::int64_t n)
-		: storage_(std::move(storage)), m_(m), n_(n)
-	{
-		data_ = storage_.data();
-	}
-
 	void add_row_to_vec(float *vec, std::int32_t row, std::int32_t dim) const override
 	{
 		if (!data_ || row < 0 || row >= m_) return;
@@ -352,7 +354,6 @@ public:
 
 private:
 	const float *data_ = nullptr;
-	std::vector<float> storage_;
 	std::int64_t m_;
 	std::int64_t n_;
 };
@@ -360,14 +361,15 @@ private:
 /* Quantized matrix: codes + product quantizer */
 class quant_matrix final : public matrix_base {
 public:
+	/* Codes point to the mapped model */
 	quant_matrix(std::int64_t m, std::int64_t n, bool qnorm,
-				 std::vector<std::uint8_t> &&codes,
-				 std::vector<std::uint8_t> &&norm_codes,
+				 const std::uint8_t *codes, std::size_t ncodes,
+				 const std::uint8_t *norm_codes, std::size_t nnorm_codes,
 				 product_quantizer &&pq,
 				 product_quantizer &&npq)
 		: m_(m), n_(n), qnorm_(qnorm),
-		  codes_(std::move(codes)),
-		  norm_codes_(std::move(norm_codes)),
+		  codes_(codes), ncodes_(ncodes),
+		  norm_codes_(norm_codes), nnorm_codes_(nnorm_codes),
 		  pq_(std::move(pq)),
 		  npq_(std::move(npq))
 	{
@@ -379,9 +381,9 @@ public:
 		auto nsubq = pq_.get_nsubq();
 		if (nsubq <= 0) return;
 		auto offset = static_cast<std::size_t>(row) * nsubq;
-		if (offset + nsubq > codes_.size()) return;
+		if (offset + nsubq > ncodes_) return;
 		auto norm = get_norm(row);
-		pq_.add_code(codes_.data() + offset, vec, dim, norm);
+		pq_.add_code(codes_ + offset, vec, dim, norm);
 	}
 
 	auto dot_row(const float *vec, std::int32_t row, std::int32_t dim) const -> float override
@@ -390,9 +392,9 @@ public:
 		auto nsubq = pq_.get_nsubq();
 		if (nsubq <= 0) return 0.0f;
 		auto offset = static_cast<std::size_t>(row) * nsubq;
-		if (offset + nsubq > codes_.size()) return 0.0f;
+		if (offset + nsubq > ncodes_) return 0.0f;
 		auto norm = get_norm(row);
-		return pq_.dot_code(codes_.data() + offset, vec, dim, norm);
+		return pq_.dot_code(codes_ + offset, vec, dim, norm);
 	}
 
 	auto rows() const -> std::int64_t override
@@ -407,7 +409,7 @@ public:
 private:
 	auto get_norm(std::int32_t row) const -> float
 	{
-		if (qnorm_ && row >= 0 && static_cast<std::size_t>(row) < norm_codes_.size()) {
+		if (qnorm_ && row >= 0 && static_cast<std::size_t>(row) < nnorm_codes_) {
 			return npq_.get_centroid_value(0, norm_codes_[row]);
 		}
 		return 1.0f;
@@ -416,8 +418,10 @@ private:
 	std::int64_t m_;
 	std::int64_t n_;
 	bool qnorm_;
-	std::vector<std::uint8_t> codes_;
-	std::vector<std::uint8_t> norm_codes_;
+	const std::uint8_t *codes_;
+	std::size_t ncodes_;
+	const std::uint8_t *norm_codes_;
+	std::size_t nnorm_codes_;
 	product_quantizer pq_;
 	product_quantizer npq_;
 };
@@ -461,21 +465,10 @@ public:
 			word_map_[entries_[i].word] = i;
 		}
 
-		/* Precompute subwords for all known word entries */
 		bucket_ = args.bucket;
 		minn_ = args.minn;
 		maxn_ = args.maxn;
 		wordNgrams_ = args.wordNgrams;
-
-		if (maxn_ > 0) {
-			for (std::int32_t i = 0; i < nwords_; i++) {
-				auto &entry = entries_[i];
-				std::string wrapped = "<" + entry.word + ">";
-				compute_subwords(wrapped, entry.subwords);
-				/* The word's own ID is always the first element */
-				entry.subwords.insert(entry.subwords.begin(), i);
-			}
-		}
 	}
 
 	auto find(std::string_view word) const -> std::int32_t
@@ -624,22 +617,21 @@ public:
 
 		if (wid >= 0) {
 			auto *entry = dict.get_entry(wid);
-			if (entry && entry->type == entry_type::word) {
-				if (args.maxn <= 0) {
-					ngrams.push_back(wid);
-				}
-				else {
-					ngrams.insert(ngrams.end(),
-								  entry->subwords.begin(), entry->subwords.end());
-				}
+			if (!entry || entry->type != entry_type::word) {
+				return;
 			}
+			/* The word's own ID is always the first element */
+			ngrams.push_back(wid);
 		}
-		else {
-			/* OOV: compute subwords on the fly */
-			if (args.maxn > 0) {
-				std::string wrapped = "<" + std::string(word) + ">";
-				dict.compute_subwords(wrapped, ngrams);
-			}
+
+		/*
+		 * Subwords are computed on the fly for known words as well: keeping
+		 * them for every dictionary word costs more private memory per
+		 * process than the whole mapped model
+		 */
+		if (args.maxn > 0) {
+			std::string wrapped = "<" + std::string(word) + ">";
+			dict.compute_subwords(wrapped, ngrams);
 		}
 	}
 
@@ -866,7 +858,7 @@ public:
 };
 
 /* --- Load a dense matrix from binary data --- */
-static auto load_dense_matrix(binary_reader &reader, const unsigned char *mmap_base)
+static auto load_dense_matrix(binary_reader &reader)
 	-> std::unique_ptr<dense_matrix>
 {
 	auto m = reader.read_i64();
@@ -891,14 +883,8 @@ static auto load_dense_matrix(binary_reader &reader, const unsigned char *mmap_b
 		return nullptr;
 	}
 
-	/* Check if this pointer is inside the mmap region (zero-copy) or need to copy */
-	if (mmap_base != nullptr) {
-		return std::make_unique<dense_matrix>(data_ptr, m, n);
-	}
-	else {
-		std::vector<float> storage(data_ptr, data_ptr + float_count);
-		return std::make_unique<dense_matrix>(std::move(storage), m, n);
-	}
+	/* Zero-copy: the matrix points into the mmap region */
+	return std::make_unique<dense_matrix>(data_ptr, m, n);
 }
 
 /* --- Load a quantized matrix from binary data --- */
@@ -922,9 +908,9 @@ static auto load_quant_matrix(binary_reader &reader)
 	}
 
 	/* Read codes BEFORE PQ */
-	std::vector<std::uint8_t> codes(codesize);
-	for (std::int32_t i = 0; i < codesize; i++) {
-		codes[i] = reader.read_u8();
+	auto *codes = reader.read_bytes(codesize);
+	if (!codes) {
+		return nullptr;
 	}
 
 	/* Read PQ */
@@ -933,16 +919,15 @@ static auto load_quant_matrix(binary_reader &reader)
 		return nullptr;
 	}
 
-	std::vector<std::uint8_t> norm_codes;
+	const std::uint8_t *norm_codes = nullptr;
+	std::size_t nnorm_codes = 0;
 	product_quantizer npq;
 
 	if (qnorm) {
 		/* Read norm codes (one per row) then norm PQ */
-		norm_codes.resize(m);
-		for (std::int64_t i = 0; i < m; i++) {
-			norm_codes[i] = reader.read_u8();
-		}
-		if (!npq.load(reader)) {
+		norm_codes = reader.read_bytes(m);
+		nnorm_codes = m;
+		if (!norm_codes || !npq.load(reader)) {
 			return nullptr;
 		}
 	}
@@ -952,8 +937,8 @@ static auto load_quant_matrix(binary_reader &reader)
 	}
 
 	return std::make_unique<quant_matrix>(m, n, qnorm,
-										  std::move(codes),
-										  std::move(norm_codes),
+										  codes, codesize,
+										  norm_codes, nnorm_codes,
 										  std::move(pq), std::move(npq));
 }
 
@@ -1059,7 +1044,7 @@ auto fasttext_model::load(const char *path, std::int64_t offset) -> tl::expected
 	}
 	else {
 		/* Dense input matrix - pointer into mmap region (zero-copy) */
-		impl->input_matrix = load_dense_matrix(reader, base);
+		impl->input_matrix = load_dense_matrix(reader);
 	}
 
 	if (!impl->input_matrix || reader.fail()) {
@@ -1076,7 +1061,7 @@ auto fasttext_model::load(const char *path, std::int64_t offset) -> tl::expected
 		impl->output_matrix = load_quant_matrix(reader);
 	}
 	else {
-		impl->output_matrix = load_dense_matrix(reader, nullptr);
+		impl->output_matrix = load_dense_matrix(reader);
 	}
 
 	if (!impl->output_matrix || reader.fail()) {
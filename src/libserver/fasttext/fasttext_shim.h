@@ -74,7 +74,9 @@ class fasttext_model_impl;
 
 /**
  * Top-level FastText model facade.
- * Loads .bin/.ftz models using mmap for the large input matrix.
+ * Loads .bin/.ftz models using mmap: matrices, quantization codes and
+ * dictionary words are used from the mapping, so they are shared between
+ * processes that load the same model.
  * Thread-safe for concurrent read operations after construction.
  */
 class fasttext_model {
@@ -89,7 +91,8 @@ public:
 
 	/**
 	 * Load a FastText model from a .bin or .ftz file.
-	 * The large input matrix is mmap'd with MAP_SHARED for cross-process sharing.
+	 * The model is mmap'd with MAP_SHARED and used without copying for
+	 * cross-process sharing.
 	 * @param path path to the model file
 	 * @return loaded model or error
 	 */
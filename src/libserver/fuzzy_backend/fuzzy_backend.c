@@ -21,8 +21,10 @@
 #include "fuzzy_backend_noop.h"
 #include "cfg_file.h"
 #include "fuzzy_wire.h"
+#include "contrib/uthash/utlist.h"
 
 #define DEFAULT_EXPIRE 172800L
+#define DEFAULT_SQLITE_WRITE_BATCH 1024
 
 enum rspamd_fuzzy_backend_type {
 	RSPAMD_FUZZY_BACKEND_SQLITE = 0,
@@ -53,6 +55,7 @@ static void rspamd_fuzzy_backend_expire_sqlite(struct rspamd_fuzzy_backend *bk,
 											   void *subr_ud);
 static void rspamd_fuzzy_backend_close_sqlite(struct rspamd_fuzzy_backend *bk,
 											  void *subr_ud);
+static void rspamd_fuzzy_backend_sqlite_write_cb(EV_P_ ev_timer *w, int revents);
 
 struct rspamd_fuzzy_backend_subr {
 	void *(*init)(struct rspamd_fuzzy_backend *bk, const ucl_object_t *obj,
@@ -110,6 +113,22 @@ static const struct rspamd_fuzzy_backend_subr fuzzy_subrs[] = {
 		.close = rspamd_fuzzy_backend_close_noop,
 	}};
 
+/*
+ * Queued sqlite update: large queues are committed in chunks of `write_batch`
+ * commands, each in its own transaction, yielding to the event loop between
+ * chunks, so lookups are not stalled and always see committed data only
+ */
+struct rspamd_fuzzy_sqlite_update {
+	struct rspamd_fuzzy_backend_sqlite *sq;
+	GArray *updates;
+	char *src;
+	rspamd_fuzzy_update_cb cb;
+	void *ud;
+	unsigned int pos;
+	unsigned int nupdates, nadded, ndeleted, nextended, nignored;
+	struct rspamd_fuzzy_sqlite_update *prev, *next;
+};
+
 struct rspamd_fuzzy_backend {
 	enum rspamd_fuzzy_backend_type type;
 	double expire;
@@ -120,6 +139,9 @@ struct rspamd_fuzzy_backend {
 	const struct rspamd_fuzzy_backend_subr *subr;
 	void *subr_ud;
 	ev_timer periodic_event;
+	unsigned int write_batch;
+	struct rspamd_fuzzy_sqlite_update *sqlite_updates;
+	ev_timer write_event;
 };
 
 static GQuark
@@ -132,7 +154,7 @@ static void *
 rspamd_fuzzy_backend_init_sqlite(struct rspamd_fuzzy_backend *bk,
 								 const ucl_object_t *obj, struct rspamd_config *cfg, GError **err)
 {
-	const ucl_object_t *elt;
+	const ucl_object_t *elt, *batch;
 
 	elt = ucl_object_lookup_any(obj, "hashfile", "hash_file", "file",
 								"database", NULL);
@@ -143,6 +165,17 @@ rspamd_fuzzy_backend_init_sqlite(struct rspamd_fuzzy_backend *bk,
 		return NULL;
 	}
 
+	bk->write_batch = DEFAULT_SQLITE_WRITE_BATCH;
+	batch = ucl_object_lookup(obj, "write_batch");
+
+	if (batch != NULL && ucl_object_toint(batch) > 0) {
+		bk->write_batch = ucl_object_toint(batch);
+	}
+
+	bk->write_event.data = bk;
+	ev_timer_init(&bk->write_event, rspamd_fuzzy_backend_sqlite_write_cb,
+				  0.0, 0.0);
+
 	return rspamd_fuzzy_backend_sqlite_open(ucl_object_tostring(elt),
 											FALSE, err);
 }
@@ -164,61 +197,144 @@ rspamd_fuzzy_backend_check_sqlite(struct rspamd_fuzzy_backend *bk,
 	}
 }
 
-static void
-rspamd_fuzzy_backend_update_sqlite(struct rspamd_fuzzy_backend *bk,
-								   GArray *updates, const char *src,
-								   rspamd_fuzzy_update_cb cb, void *ud,
-								   void *subr_ud)
+/*
+ * Commits the next chunk of the update, returns TRUE if the update is done
+ */
+static gboolean
+rspamd_fuzzy_backend_sqlite_update_step(struct rspamd_fuzzy_backend *bk,
+										struct rspamd_fuzzy_sqlite_update *up,
+										gboolean *success)
 {
-	struct rspamd_fuzzy_backend_sqlite *sq = subr_ud;
-	gboolean success = FALSE;
-	unsigned int i;
+	unsigned int i, end, nchunk = 0;
 	struct fuzzy_peer_cmd *io_cmd;
 	struct rspamd_fuzzy_cmd *cmd;
 	gpointer ptr;
-	unsigned int nupdates = 0, nadded = 0, ndeleted = 0, nextended = 0, nignored = 0;
+	gboolean last;
 
-	if (rspamd_fuzzy_backend_sqlite_prepare_update(sq, src)) {
-		for (i = 0; i < updates->len; i++) {
-			io_cmd = &g_array_index(updates, struct fuzzy_peer_cmd, i);
+	end = MIN(up->pos + bk->write_batch, up->updates->len);
+	last = (end == up->updates->len);
 
-			if (io_cmd->is_shingle) {
-				cmd = &io_cmd->cmd.shingle.basic;
-				ptr = &io_cmd->cmd.shingle;
-			}
-			else {
-				cmd = &io_cmd->cmd.normal;
-				ptr = &io_cmd->cmd.normal;
-			}
+	if (!rspamd_fuzzy_backend_sqlite_prepare_update(up->sq, up->src)) {
+		*success = FALSE;
 
-			if (cmd->cmd == FUZZY_WRITE) {
-				rspamd_fuzzy_backend_sqlite_add(sq, ptr);
-				nadded++;
-				nupdates++;
-			}
-			else if (cmd->cmd == FUZZY_DEL) {
-				rspamd_fuzzy_backend_sqlite_del(sq, ptr);
-				ndeleted++;
-				nupdates++;
+		return TRUE;
+	}
+
+	for (i = up->pos; i < end; i++) {
+		io_cmd = &g_array_index(up->updates, struct fuzzy_peer_cmd, i);
+
+		if (io_cmd->is_shingle) {
+			cmd = &io_cmd->cmd.shingle.basic;
+			ptr = &io_cmd->cmd.shingle;
+		}
+		else {
+			cmd = &io_cmd->cmd.normal;
+			ptr = &io_cmd->cmd.normal;
+		}
+
+		if (cmd->cmd == FUZZY_WRITE) {
+			rspamd_fuzzy_backend_sqlite_add(up->sq, ptr);
+			up->nadded++;
+			nchunk++;
+		}
+		else if (cmd->cmd == FUZZY_DEL) {
+			rspamd_fuzzy_backend_sqlite_del(up->sq, ptr);
+			up->ndeleted++;
+			nchunk++;
+		}
+		else {
+			if (cmd->cmd == FUZZY_REFRESH) {
+				up->nextended++;
 			}
 			else {
-				if (cmd->cmd == FUZZY_REFRESH) {
-					nextended++;
-				}
-				else {
-					nignored++;
-				}
+				up->nignored++;
 			}
 		}
+	}
 
-		if (rspamd_fuzzy_backend_sqlite_finish_update(sq, src,
-													  nupdates > 0)) {
-			success = TRUE;
-		}
+	/* Source version is bumped once per update, with the last chunk */
+	if (!rspamd_fuzzy_backend_sqlite_finish_update(up->sq, up->src,
+												   last && up->nupdates + nchunk > 0)) {
+		*success = FALSE;
+
+		return TRUE;
 	}
 
-	if (cb) {
-		cb(success, nadded, ndeleted, nextended, nignored, ud);
+	up->nupdates += nchunk;
+	up->pos = end;
+
+	if (last) {
+		rspamd_fuzzy_backend_sqlite_checkpoint(up->sq);
+		*success = TRUE;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+rspamd_fuzzy_backend_sqlite_update_fin(struct rspamd_fuzzy_backend *bk,
+									   struct rspamd_fuzzy_sqlite_update *up,
+									   gboolean success)
+{
+	DL_DELETE(bk->sqlite_updates, up);
+
+	if (up->cb) {
+		/* On failure, committed chunks must not be retried by the caller */
+		up->cb(success, up->nadded, up->ndeleted, up->nextended, up->nignored,
+			   up->pos, up->ud);
+	}
+
+	g_free(up->src);
+	g_free(up);
+}
+
+static void
+rspamd_fuzzy_backend_sqlite_process_writes(struct rspamd_fuzzy_backend *bk)
+{
+	struct rspamd_fuzzy_sqlite_update *up = bk->sqlite_updates;
+	gboolean success;
+
+	if (up != NULL && rspamd_fuzzy_backend_sqlite_update_step(bk, up, &success)) {
+		rspamd_fuzzy_backend_sqlite_update_fin(bk, up, success);
+	}
+
+	if (bk->sqlite_updates != NULL && !ev_is_active(&bk->write_event)) {
+		/* Continue on the next loop iteration */
+		ev_timer_set(&bk->write_event, 0.0, 0.0);
+		ev_timer_start(bk->event_loop, &bk->write_event);
+	}
+}
+
+static void
+rspamd_fuzzy_backend_sqlite_write_cb(EV_P_ ev_timer *w, int revents)
+{
+	struct rspamd_fuzzy_backend *bk = (struct rspamd_fuzzy_backend *) w->data;
+
+	rspamd_fuzzy_backend_sqlite_process_writes(bk);
+}
+
+static void
+rspamd_fuzzy_backend_update_sqlite(struct rspamd_fuzzy_backend *bk,
+								   GArray *updates, const char *src,
+								   rspamd_fuzzy_update_cb cb, void *ud,
+								   void *subr_ud)
+{
+	struct rspamd_fuzzy_sqlite_update *up;
+	gboolean busy = (bk->sqlite_updates != NULL);
+
+	up = g_malloc0(sizeof(*up));
+	up->sq = subr_ud;
+	up->updates = updates;
+	up->src = g_strdup(src);
+	up->cb = cb;
+	up->ud = ud;
+	DL_APPEND(bk->sqlite_updates, up);
+
+	if (!busy) {
+		/* Small updates are committed immediately, as before */
+		rspamd_fuzzy_backend_sqlite_process_writes(bk);
 	}
 }
 
@@ -275,7 +391,17 @@ rspamd_fuzzy_backend_close_sqlite(struct rspamd_fuzzy_backend *bk,
 								  void *subr_ud)
 {
 	struct rspamd_fuzzy_backend_sqlite *sq = subr_ud;
+	struct rspamd_fuzzy_sqlite_update *up;
+	gboolean success;
+
+	/* Do not lose queued updates, commit them synchronously */
+	while ((up = bk->sqlite_updates) != NULL) {
+		if (rspamd_fuzzy_backend_sqlite_update_step(bk, up, &success)) {
+			rspamd_fuzzy_backend_sqlite_update_fin(bk, up, success);
+		}
+	}
 
+	ev_timer_stop(bk->event_loop, &bk->write_event);
 	rspamd_fuzzy_backend_sqlite_close(sq);
 }
 
@@ -455,7 +581,7 @@ void rspamd_fuzzy_backend_process_updates(struct rspamd_fuzzy_backend *bk,
 		bk->subr->update(bk, updates, src, cb, ud, bk->subr_ud);
 	}
 	else if (cb) {
-		cb(TRUE, 0, 0, 0, 0, ud);
+		cb(TRUE, 0, 0, 0, 0, 0, ud);
 	}
 }
 
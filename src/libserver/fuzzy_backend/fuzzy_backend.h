@@ -41,11 +41,16 @@ struct rspamd_fuzzy_multiflag_result {
  */
 typedef void (*rspamd_fuzzy_check_cb)(struct rspamd_fuzzy_multiflag_result *result, void *ud);
 
+/*
+ * `ncommitted` is the number of updates from the beginning of the queue that
+ * are stored even if `success` is FALSE (the whole queue on success)
+ */
 typedef void (*rspamd_fuzzy_update_cb)(gboolean success,
 									   unsigned int nadded,
 									   unsigned int ndeleted,
 									   unsigned int nextended,
 									   unsigned int nignored,
+									   unsigned int ncommitted,
 									   void *ud);
 
 typedef void (*rspamd_fuzzy_version_cb)(uint64_t rev, void *ud);
@@ -51,7 +51,7 @@ void rspamd_fuzzy_backend_update_noop(struct rspamd_fuzzy_backend *bk,
 									  void *subr_ud)
 {
 	if (cb) {
-		cb(TRUE, 0, 0, 0, 0, ud);
+		cb(TRUE, 0, 0, 0, 0, updates->len, ud);
 	}
 
 	return;
@@ -1129,6 +1129,7 @@ struct rspamd_fuzzy_lua_update_cbdata {
 	unsigned int ndeleted;
 	unsigned int nextended;
 	unsigned int nignored;
+	unsigned int nupdates;
 };
 
 /*
@@ -1154,6 +1155,7 @@ rspamd_fuzzy_redis_lua_update_cb(lua_State *L)
 				   cbdata->ndeleted,
 				   cbdata->nextended,
 				   cbdata->nignored,
+				   success ? cbdata->nupdates : 0,
 				   cbdata->ud);
 	}
 
@@ -1180,7 +1182,7 @@ void rspamd_fuzzy_backend_update_redis(struct rspamd_fuzzy_backend *bk,
 	if (backend->cbref_update == -1) {
 		msg_err("fuzzy redis update functor not initialized");
 		if (cb) {
-			cb(FALSE, 0, 0, 0, 0, ud);
+			cb(FALSE, 0, 0, 0, 0, 0, ud);
 		}
 		return;
 	}
@@ -1309,6 +1311,7 @@ void rspamd_fuzzy_backend_update_redis(struct rspamd_fuzzy_backend *bk,
 	cbdata->ndeleted = ndeleted;
 	cbdata->nextended = nextended;
 	cbdata->nignored = nignored;
+	cbdata->nupdates = updates->len;
 	REF_RETAIN(backend);
 	lua_pushlightuserdata(L, cbdata);
 	lua_pushcclosure(L, &rspamd_fuzzy_redis_lua_update_cb, 1);
@@ -1318,7 +1321,7 @@ void rspamd_fuzzy_backend_update_redis(struct rspamd_fuzzy_backend *bk,
 				lua_tostring(L, -1));
 
 		if (cb) {
-			cb(FALSE, 0, 0, 0, 0, ud);
+			cb(FALSE, 0, 0, 0, 0, 0, ud);
 		}
 
 		REF_RELEASE(backend);
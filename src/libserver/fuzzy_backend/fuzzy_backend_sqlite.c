@@ -91,7 +91,7 @@ enum rspamd_fuzzy_statement_idx {
 	RSPAMD_FUZZY_BACKEND_INSERT,
 	RSPAMD_FUZZY_BACKEND_UPDATE,
 	RSPAMD_FUZZY_BACKEND_UPDATE_FLAG,
-	RSPAMD_FUZZY_BACKEND_INSERT_SHINGLE,
+	RSPAMD_FUZZY_BACKEND_INSERT_SHINGLES,
 	RSPAMD_FUZZY_BACKEND_CHECK,
 	RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE,
 	RSPAMD_FUZZY_BACKEND_GET_DIGEST_BY_ID,
@@ -146,10 +146,18 @@ static struct rspamd_fuzzy_stmts {
 		 .args = "IID",
 		 .stmt = NULL,
 		 .result = SQLITE_DONE},
-		{.idx = RSPAMD_FUZZY_BACKEND_INSERT_SHINGLE,
-		 .sql = "INSERT OR REPLACE INTO shingles(value, number, digest_id) "
-				"VALUES (?1, ?2, ?3);",
-		 .args = "III",
+		/* All shingles of a digest are inserted by a single multi-row statement */
+		{.idx = RSPAMD_FUZZY_BACKEND_INSERT_SHINGLES,
+		 .sql = "INSERT OR REPLACE INTO shingles(value, number, digest_id) VALUES "
+				"(?1, 0, ?33), (?2, 1, ?33), (?3, 2, ?33), (?4, 3, ?33), "
+				"(?5, 4, ?33), (?6, 5, ?33), (?7, 6, ?33), (?8, 7, ?33), "
+				"(?9, 8, ?33), (?10, 9, ?33), (?11, 10, ?33), (?12, 11, ?33), "
+				"(?13, 12, ?33), (?14, 13, ?33), (?15, 14, ?33), (?16, 15, ?33), "
+				"(?17, 16, ?33), (?18, 17, ?33), (?19, 18, ?33), (?20, 19, ?33), "
+				"(?21, 20, ?33), (?22, 21, ?33), (?23, 22, ?33), (?24, 23, ?33), "
+				"(?25, 24, ?33), (?26, 25, ?33), (?27, 26, ?33), (?28, 27, ?33), "
+				"(?29, 28, ?33), (?30, 29, ?33), (?31, 30, ?33), (?32, 31, ?33);",
+		 .args = "HI",
 		 .stmt = NULL,
 		 .result = SQLITE_DONE},
 		{.idx = RSPAMD_FUZZY_BACKEND_CHECK,
@@ -209,6 +217,9 @@ static struct rspamd_fuzzy_stmts {
 		 .result = SQLITE_DONE},
 };
 
+/* RSPAMD_FUZZY_BACKEND_INSERT_SHINGLES binds exactly 32 shingles */
+G_STATIC_ASSERT(RSPAMD_SHINGLE_SIZE == 32);
+
 static GQuark
 rspamd_fuzzy_backend_sqlite_quark(void)
 {
@@ -265,8 +276,9 @@ rspamd_fuzzy_backend_sqlite_run_stmt(struct rspamd_fuzzy_backend_sqlite *backend
 	int retcode;
 	va_list ap;
 	sqlite3_stmt *stmt;
-	int i;
+	int i, j, pos;
 	const char *argtypes;
+	const uint64_t *hashes;
 	unsigned int retries = 0;
 	struct timespec ts;
 
@@ -296,23 +308,31 @@ rspamd_fuzzy_backend_sqlite_run_stmt(struct rspamd_fuzzy_backend_sqlite *backend
 	sqlite3_reset(stmt);
 	va_start(ap, idx);
 
-	for (i = 0; argtypes[i] != '\0'; i++) {
+	for (i = 0, pos = 1; argtypes[i] != '\0'; i++) {
 		switch (argtypes[i]) {
 		case 'T':
-			sqlite3_bind_text(stmt, i + 1, va_arg(ap, const char *), -1,
+			sqlite3_bind_text(stmt, pos++, va_arg(ap, const char *), -1,
 							  SQLITE_STATIC);
 			break;
 		case 'I':
-			sqlite3_bind_int64(stmt, i + 1, va_arg(ap, int64_t));
+			sqlite3_bind_int64(stmt, pos++, va_arg(ap, int64_t));
 			break;
 		case 'S':
-			sqlite3_bind_int(stmt, i + 1, va_arg(ap, int));
+			sqlite3_bind_int(stmt, pos++, va_arg(ap, int));
 			break;
 		case 'D':
 			/* Special case for digests variable */
-			sqlite3_bind_text(stmt, i + 1, va_arg(ap, const char *), 64,
+			sqlite3_bind_text(stmt, pos++, va_arg(ap, const char *), 64,
 							  SQLITE_STATIC);
 			break;
+		case 'H':
+			/* Array of shingles, occupies RSPAMD_SHINGLE_SIZE positions */
+			hashes = va_arg(ap, const uint64_t *);
+
+			for (j = 0; j < RSPAMD_SHINGLE_SIZE; j++) {
+				sqlite3_bind_int64(stmt, pos++, hashes[j]);
+			}
+			break;
 		}
 	}
 
@@ -629,7 +649,7 @@ gboolean
 rspamd_fuzzy_backend_sqlite_add(struct rspamd_fuzzy_backend_sqlite *backend,
 								const struct rspamd_fuzzy_cmd *cmd)
 {
-	int rc, i;
+	int rc;
 	int64_t id, flag;
 	const struct rspamd_fuzzy_shingle_cmd *shcmd;
 
@@ -693,22 +713,17 @@ rspamd_fuzzy_backend_sqlite_add(struct rspamd_fuzzy_backend_sqlite *backend,
 				id = sqlite3_last_insert_rowid(backend->db);
 				shcmd = (const struct rspamd_fuzzy_shingle_cmd *) cmd;
 
-				for (i = 0; i < RSPAMD_SHINGLE_SIZE; i++) {
-					rc = rspamd_fuzzy_backend_sqlite_run_stmt(backend, TRUE,
-															  RSPAMD_FUZZY_BACKEND_INSERT_SHINGLE,
-															  shcmd->sgl.hashes[i], (int64_t) i, id);
-					msg_debug_fuzzy_backend("add shingle %d -> %L: %L",
-											i,
-											shcmd->sgl.hashes[i],
-											id);
-
-					if (rc != SQLITE_OK) {
-						msg_warn_fuzzy_backend("cannot add shingle %d -> "
-											   "%L: %L: %s",
-											   i,
-											   shcmd->sgl.hashes[i],
-											   id, sqlite3_errmsg(backend->db));
-					}
+				rc = rspamd_fuzzy_backend_sqlite_run_stmt(backend, TRUE,
+														  RSPAMD_FUZZY_BACKEND_INSERT_SHINGLES,
+														  shcmd->sgl.hashes, id);
+				msg_debug_fuzzy_backend("add %d shingles -> %L",
+										RSPAMD_SHINGLE_SIZE,
+										id);
+
+				if (rc != SQLITE_OK) {
+					msg_warn_fuzzy_backend("cannot add shingles -> "
+										   "%L: %s",
+										   id, sqlite3_errmsg(backend->db));
 				}
 			}
 		}
@@ -731,7 +746,7 @@ gboolean
 rspamd_fuzzy_backend_sqlite_finish_update(struct rspamd_fuzzy_backend_sqlite *backend,
 										  const char *source, gboolean version_bump)
 {
-	int rc = SQLITE_OK, wal_frames, wal_checkpointed, ver;
+	int rc = SQLITE_OK, ver;
 
 	/* Get and update version */
 	if (version_bump) {
@@ -754,17 +769,6 @@ rspamd_fuzzy_backend_sqlite_finish_update(struct rspamd_fuzzy_backend_sqlite *ba
 												 RSPAMD_FUZZY_BACKEND_TRANSACTION_ROLLBACK);
 			return FALSE;
 		}
-		else {
-			if (!rspamd_sqlite3_sync(backend->db, &wal_frames, &wal_checkpointed)) {
-				msg_warn_fuzzy_backend("cannot commit checkpoint: %s",
-									   sqlite3_errmsg(backend->db));
-			}
-			else if (wal_checkpointed > 0) {
-				msg_info_fuzzy_backend("total number of frames in the wal file: "
-									   "%d, checkpointed: %d",
-									   wal_frames, wal_checkpointed);
-			}
-		}
 	}
 	else {
 		msg_warn_fuzzy_backend("cannot update version for %s: %s", source,
@@ -777,6 +781,25 @@ rspamd_fuzzy_backend_sqlite_finish_update(struct rspamd_fuzzy_backend_sqlite *ba
 	return TRUE;
 }
 
+void rspamd_fuzzy_backend_sqlite_checkpoint(struct rspamd_fuzzy_backend_sqlite *backend)
+{
+	int wal_frames, wal_checkpointed;
+
+	if (backend == NULL) {
+		return;
+	}
+
+	if (!rspamd_sqlite3_sync(backend->db, &wal_frames, &wal_checkpointed)) {
+		msg_warn_fuzzy_backend("cannot commit checkpoint: %s",
+							   sqlite3_errmsg(backend->db));
+	}
+	else if (wal_checkpointed > 0) {
+		msg_info_fuzzy_backend("total number of frames in the wal file: "
+							   "%d, checkpointed: %d",
+							   wal_frames, wal_checkpointed);
+	}
+}
+
 gboolean
 rspamd_fuzzy_backend_sqlite_del(struct rspamd_fuzzy_backend_sqlite *backend,
 								const struct rspamd_fuzzy_cmd *cmd)
@@ -77,6 +77,11 @@ gboolean rspamd_fuzzy_backend_sqlite_del(
 gboolean rspamd_fuzzy_backend_sqlite_finish_update(struct rspamd_fuzzy_backend_sqlite *backend,
 												   const char *source, gboolean version_bump);
 
+/**
+ * Checkpoint WAL file to the main database (might be slow)
+ */
+void rspamd_fuzzy_backend_sqlite_checkpoint(struct rspamd_fuzzy_backend_sqlite *backend);
+
 /**
  * Sync storage
  * @param backend
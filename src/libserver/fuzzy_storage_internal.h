@@ -42,6 +42,7 @@ struct rspamd_hash_map_helper;
 struct rspamd_keypair_cache;
 struct rspamd_http_context;
 struct rspamd_fuzzy_backend;
+struct rspamd_fuzzy_replication;
 
 struct rspamd_cryptobox_keypair;
 struct rspamd_cryptobox_pubkey;
@@ -201,6 +202,17 @@ struct rspamd_fuzzy_storage_ctx {
 	struct rspamd_lua_fuzzy_script *lua_blacklist_handlers;
 	khash_t(fuzzy_key_ids_set) * default_forbidden_ids;
 	khash_t(fuzzy_key_ids_set) * weak_ids;
+
+	/* Replication log */
+	char *replication_log;
+	gsize replication_log_size;
+	char *replication_bind;
+	char *replication_master;
+	char *replication_state;
+	unsigned int replication_batch;
+	const ucl_object_t *replication_allow_map;
+	struct rspamd_radix_map_helper *replication_allow_ips;
+	struct rspamd_fuzzy_replication *replication;
 };
 
 enum fuzzy_cmd_type {
@@ -329,6 +341,35 @@ ucl_object_t *rspamd_leaky_bucket_to_ucl(struct rspamd_leaky_bucket_elt *p_elt);
 void rspamd_fuzzy_maybe_load_ratelimits(struct rspamd_fuzzy_storage_ctx *ctx);
 void rspamd_fuzzy_maybe_save_ratelimits(struct rspamd_fuzzy_storage_ctx *ctx);
 
+/* Replication */
+#define RSPAMD_FUZZY_REPLICATION_PORT 11336
+
+/* Sends queued updates to the backend, see rspamd_fuzzy_process_updates_queue */
+typedef gboolean (*rspamd_fuzzy_replication_flush_t)(struct rspamd_fuzzy_storage_ctx *ctx,
+													 const char *source, gboolean final);
+
+gboolean rspamd_fuzzy_replication_init(struct rspamd_fuzzy_storage_ctx *ctx,
+									   struct rspamd_worker *worker,
+									   rspamd_fuzzy_replication_flush_t flush);
+/* Starts streaming the log to an accepted replica connection */
+void rspamd_fuzzy_replication_add_peer(struct rspamd_fuzzy_storage_ctx *ctx,
+									   int fd, rspamd_inet_addr_t *addr);
+/* Last sequence received from the primary (0 if not a replica) */
+uint64_t rspamd_fuzzy_replication_received(struct rspamd_fuzzy_storage_ctx *ctx);
+/* Called when updates are committed to the backend */
+void rspamd_fuzzy_replication_committed(struct rspamd_fuzzy_storage_ctx *ctx,
+										GArray *updates,
+										uint64_t received_seq);
+/*
+ * Called when updates cannot be committed after all retries; returns TRUE if
+ * they include records from the primary that must be retried, not discarded
+ */
+gboolean rspamd_fuzzy_replication_hold(struct rspamd_fuzzy_storage_ctx *ctx,
+									   uint64_t received_seq,
+									   gboolean terminating);
+ucl_object_t *rspamd_fuzzy_replication_stat(struct rspamd_fuzzy_storage_ctx *ctx);
+void rspamd_fuzzy_replication_destroy(struct rspamd_fuzzy_storage_ctx *ctx);
+
 /* Stats / controller */
 ucl_object_t *rspamd_fuzzy_storage_stat_key(const struct fuzzy_key_stat *key_stat);
 void rspamd_fuzzy_key_stat_iter(const unsigned char *pk_iter,
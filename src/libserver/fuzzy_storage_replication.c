@@ -0,0 +1,1512 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Rspamd fuzzy storage server: binary replication log
+ *
+ * Worker 0 appends every committed update to an append-only log file. Each
+ * record has a monotonic sequence number that is used as a resumable offset.
+ * Replicas connect over TCP, send the last sequence they have applied and
+ * then receive all newer records followed by a live tail of new updates.
+ *
+ * When the log grows over its limit it is compacted in background, a few
+ * thousands records per event loop iteration: records that are fully
+ * overridden by a later record for the same digest are dropped, so replicas
+ * at any offset still converge to the same state. Records that are not
+ * overridden are never dropped, as adds are not idempotent and cannot be
+ * merged, so the compacted log holds the live state of all digests and it
+ * can stay over the limit; the next compaction starts when it doubles then.
+ * A replica that asks for a dropped offset receives RESET and then the
+ * retained log from its beginning: everything it has missed is overridden
+ * by the retained records, so it converges as well.
+ */
+
+#include "config.h"
+
+#include "fuzzy_storage_internal.h"
+
+#include "libserver/maps/map_helpers.h"
+#include "libutil/addr.h"
+#include "libutil/util.h"
+#include "libcryptobox/cryptobox.h"
+#include "contrib/uthash/utlist.h"
+#include "unix-std.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define msg_debug_fuzzy_replication(...) rspamd_conditional_debug_fast(NULL, NULL,                                               \
+																	   rspamd_fuzzy_replication_log_id, "fuzzy_replication", NULL, \
+																	   RSPAMD_LOG_FUNC,                                          \
+																	   __VA_ARGS__)
+INIT_LOG_MODULE(fuzzy_replication)
+
+#define RSPAMD_REPLOG_MAGIC "rfzrlog"
+#define RSPAMD_REPLOG_VERSION 1
+#define RSPAMD_REPLOG_REQ_MAGIC 0x7266726cU /* rfrl */
+#define RSPAMD_REPLOG_HEARTBEAT_INTERVAL 10.0
+#define RSPAMD_REPLOG_RECONNECT_INTERVAL 5.0
+#define RSPAMD_REPLOG_IO_BUF 65536
+/* Records processed by compaction per event loop iteration */
+#define RSPAMD_REPLOG_COMPACT_STEP 4096
+
+enum rspamd_replog_record_type {
+	RSPAMD_REPLOG_RECORD = 1,
+	/* Sent when a peer is in sync, `seq` is the last sequence in the log */
+	RSPAMD_REPLOG_HEARTBEAT = 2,
+	/* Requested offset is compacted away, `seq` is where stream continues */
+	RSPAMD_REPLOG_RESET = 3,
+};
+
+RSPAMD_PACKED(rspamd_replog_file_hdr)
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t base_seq; /* all sequences up to this one are compacted away */
+};
+
+RSPAMD_PACKED(rspamd_replog_record_hdr)
+{
+	uint64_t seq;
+	uint32_t len;
+	uint16_t type;
+	uint16_t reserved;
+	uint64_t cksum; /* fast hash of the payload */
+};
+
+/* All records have the same size, so the log can be searched by index */
+#define RSPAMD_REPLOG_RECORD_LEN (sizeof(struct rspamd_replog_record_hdr) + \
+								  sizeof(struct fuzzy_peer_cmd))
+
+RSPAMD_PACKED(rspamd_replog_request)
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t from_seq; /* last sequence applied by replica */
+};
+
+/* Replica connected to us */
+struct rspamd_replog_peer {
+	struct rspamd_fuzzy_replication *repl;
+	rspamd_inet_addr_t *addr;
+	int fd;
+	ev_io io;
+	gboolean streaming;
+	gboolean reset_pending; /* RESET must be sent before the next records */
+	uint64_t sent_seq;
+	off_t pos; /* position of the next record to send in the log file */
+	gsize req_len;
+	struct rspamd_replog_request req;
+	unsigned char *wbuf;
+	gsize wbuf_len;
+	gsize wbuf_off;
+	struct rspamd_replog_peer *prev, *next;
+};
+
+/* Our connection to the primary node */
+struct rspamd_replog_client {
+	rspamd_inet_addr_t *addr;
+	int fd;
+	ev_io io;
+	ev_timer tm;
+	gboolean connected;
+	gboolean paused; /* local backend cannot commit what we have received */
+	uint64_t received_seq;
+	uint64_t committed_seq;
+	unsigned int uncommitted;
+	unsigned int resets;
+	gsize rbuf_len;
+	unsigned char rbuf[RSPAMD_REPLOG_IO_BUF];
+};
+
+enum rspamd_replog_compact_phase {
+	RSPAMD_REPLOG_COMPACT_SCAN = 0, /* find the last delete and touch for each digest */
+	RSPAMD_REPLOG_COMPACT_WRITE,    /* write survivors to the new log */
+	RSPAMD_REPLOG_COMPACT_TAIL,     /* copy records appended while compacting */
+};
+
+struct rspamd_replog_compaction {
+	enum rspamd_replog_compact_phase phase;
+	GHashTable *digests;
+	off_t pos;
+	off_t end; /* log size when compaction has started */
+	off_t npos;
+	uint64_t nfirst;
+	uint64_t ndropped;
+	int nfd;
+	ev_timer ev;
+	char tmp_path[PATH_MAX];
+};
+
+struct rspamd_fuzzy_replication {
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	rspamd_fuzzy_replication_flush_t flush;
+	/* Log */
+	int log_fd;
+	off_t log_size;
+	off_t compact_size; /* log size that starts the next compaction */
+	uint64_t base_seq;
+	uint64_t first_seq;
+	uint64_t last_seq;
+	struct rspamd_replog_compaction *compaction;
+	/* Primary side */
+	int listen_fd;
+	ev_io accept_ev;
+	ev_timer heartbeat_ev;
+	struct rspamd_replog_peer *peers;
+	/* Replica side */
+	struct rspamd_replog_client *client;
+};
+
+static uint64_t
+rspamd_replog_cksum(const unsigned char *data, gsize len)
+{
+	return rspamd_cryptobox_fast_hash(data, len, 0x8e1c2d3b9a7f4e65ULL);
+}
+
+static gboolean
+rspamd_replog_read_hdr(int fd, off_t pos, struct rspamd_replog_record_hdr *hdr)
+{
+	return pread(fd, hdr, sizeof(*hdr), pos) == (gssize) sizeof(*hdr);
+}
+
+static gboolean
+rspamd_replog_read_record(int fd, off_t pos, struct rspamd_replog_record_hdr *hdr,
+						  struct fuzzy_peer_cmd *cmd)
+{
+	struct iovec iov[2];
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(*hdr);
+	iov[1].iov_base = cmd;
+	iov[1].iov_len = sizeof(*cmd);
+
+	return preadv(fd, iov, G_N_ELEMENTS(iov), pos) == (gssize) RSPAMD_REPLOG_RECORD_LEN;
+}
+
+/*
+ * Scan log from the beginning, find first and last sequences and truncate
+ * a partially written tail (e.g. after crash)
+ */
+static gboolean
+rspamd_replog_open(struct rspamd_fuzzy_replication *repl, const char *path)
+{
+	struct rspamd_replog_file_hdr fhdr;
+	struct rspamd_replog_record_hdr hdr;
+	struct fuzzy_peer_cmd cmd;
+	struct stat st;
+	off_t pos;
+
+	repl->log_fd = rspamd_file_xopen(path, O_RDWR | O_CREAT, 00644, FALSE);
+
+	if (repl->log_fd == -1) {
+		msg_err("cannot open replication log %s: %s", path, strerror(errno));
+		return FALSE;
+	}
+
+	if (fstat(repl->log_fd, &st) == -1) {
+		msg_err("cannot stat replication log %s: %s", path, strerror(errno));
+		close(repl->log_fd);
+		repl->log_fd = -1;
+
+		return FALSE;
+	}
+
+	if (st.st_size == 0) {
+		memset(&fhdr, 0, sizeof(fhdr));
+		memcpy(fhdr.magic, RSPAMD_REPLOG_MAGIC, sizeof(RSPAMD_REPLOG_MAGIC));
+		fhdr.version = RSPAMD_REPLOG_VERSION;
+
+		if (write(repl->log_fd, &fhdr, sizeof(fhdr)) != sizeof(fhdr)) {
+			msg_err("cannot write replication log header %s: %s", path,
+					strerror(errno));
+			close(repl->log_fd);
+			repl->log_fd = -1;
+
+			return FALSE;
+		}
+
+		repl->log_size = sizeof(fhdr);
+
+		return TRUE;
+	}
+
+	if (pread(repl->log_fd, &fhdr, sizeof(fhdr), 0) != sizeof(fhdr) ||
+		memcmp(fhdr.magic, RSPAMD_REPLOG_MAGIC, sizeof(RSPAMD_REPLOG_MAGIC)) != 0 ||
+		fhdr.version != RSPAMD_REPLOG_VERSION) {
+		msg_err("replication log %s is corrupted or has unsupported version", path);
+		close(repl->log_fd);
+		repl->log_fd = -1;
+
+		return FALSE;
+	}
+
+	pos = sizeof(fhdr);
+	repl->base_seq = fhdr.base_seq;
+	repl->last_seq = fhdr.base_seq;
+
+	while (rspamd_replog_read_hdr(repl->log_fd, pos, &hdr)) {
+		if (hdr.type != RSPAMD_REPLOG_RECORD || hdr.len != sizeof(cmd) ||
+			pread(repl->log_fd, &cmd, sizeof(cmd), pos + sizeof(hdr)) != sizeof(cmd) ||
+			rspamd_replog_cksum((const unsigned char *) &cmd, sizeof(cmd)) != hdr.cksum) {
+			break;
+		}
+
+		if (repl->first_seq == 0) {
+			repl->first_seq = hdr.seq;
+		}
+
+		repl->last_seq = hdr.seq;
+		pos += sizeof(hdr) + hdr.len;
+	}
+
+	if (pos != st.st_size) {
+		msg_warn("truncate replication log %s from %uz to %uz bytes: broken tail",
+				 path, (gsize) st.st_size, (gsize) pos);
+
+		if (ftruncate(repl->log_fd, pos) == -1) {
+			msg_err("cannot truncate replication log %s: %s", path, strerror(errno));
+		}
+	}
+
+	repl->log_size = pos;
+	msg_info("opened replication log %s: sequences %uL-%uL, %uz bytes",
+			 path, repl->first_seq, repl->last_seq, (gsize) pos);
+
+	return TRUE;
+}
+
+/*
+ * Returns position of the first record with sequence greater than `seq`
+ */
+static off_t
+rspamd_replog_find(struct rspamd_fuzzy_replication *repl, uint64_t seq)
+{
+	struct rspamd_replog_record_hdr hdr;
+	off_t lo = 0, hi, mid;
+
+	hi = (repl->log_size - sizeof(struct rspamd_replog_file_hdr)) / RSPAMD_REPLOG_RECORD_LEN;
+
+	/* Sequences are monotonic, so use binary search */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (!rspamd_replog_read_hdr(repl->log_fd,
+									sizeof(struct rspamd_replog_file_hdr) + mid * RSPAMD_REPLOG_RECORD_LEN,
+									&hdr)) {
+			break;
+		}
+
+		if (hdr.seq > seq) {
+			hi = mid;
+		}
+		else {
+			lo = mid + 1;
+		}
+	}
+
+	return sizeof(struct rspamd_replog_file_hdr) + lo * RSPAMD_REPLOG_RECORD_LEN;
+}
+
+struct rspamd_replog_digest_elt {
+	uint64_t last_del;
+	uint64_t last_touch;
+	gboolean del_shingle;
+};
+
+static unsigned int
+rspamd_replog_digest_hash(gconstpointer p)
+{
+	return (unsigned int) rspamd_cryptobox_fast_hash(p, rspamd_cryptobox_HASHBYTES,
+													  rspamd_hash_seed());
+}
+
+static gboolean
+rspamd_replog_digest_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, rspamd_cryptobox_HASHBYTES) == 0;
+}
+
+static gboolean
+rspamd_replog_is_overridden(GHashTable *digests, const struct fuzzy_peer_cmd *cmd,
+							uint64_t seq)
+{
+	const struct rspamd_replog_digest_elt *elt;
+
+	elt = g_hash_table_lookup(digests, cmd->cmd.normal.digest);
+
+	if (elt == NULL) {
+		return FALSE;
+	}
+
+	/* Delete removes everything written before, shingles need shingle delete */
+	if (elt->last_del > seq && (elt->del_shingle || !cmd->is_shingle)) {
+		return TRUE;
+	}
+
+	/* Any later write or refresh updates expire as well */
+	if (cmd->cmd.normal.cmd == FUZZY_REFRESH && elt->last_touch > seq) {
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void rspamd_replog_peer_start_write(struct rspamd_replog_peer *peer);
+
+static void
+rspamd_replog_compact_free(struct rspamd_fuzzy_replication *repl, gboolean failed)
+{
+	struct rspamd_replog_compaction *comp = repl->compaction;
+
+	if (failed) {
+		msg_err("cannot compact replication log to %s: %s", comp->tmp_path,
+				strerror(errno));
+	}
+
+	ev_timer_stop(repl->ctx->event_loop, &comp->ev);
+
+	if (comp->nfd != -1) {
+		close(comp->nfd);
+		unlink(comp->tmp_path);
+	}
+
+	g_hash_table_unref(comp->digests);
+	g_free(comp);
+	repl->compaction = NULL;
+}
+
+static void
+rspamd_replog_compact_scan(struct rspamd_replog_compaction *comp,
+						   const struct rspamd_replog_record_hdr *hdr,
+						   const struct fuzzy_peer_cmd *cmd)
+{
+	struct rspamd_replog_digest_elt *elt;
+
+	elt = g_hash_table_lookup(comp->digests, cmd->cmd.normal.digest);
+
+	if (elt == NULL) {
+		unsigned char *digest = g_malloc(sizeof(cmd->cmd.normal.digest));
+
+		memcpy(digest, cmd->cmd.normal.digest, sizeof(cmd->cmd.normal.digest));
+		elt = g_malloc0(sizeof(*elt));
+		g_hash_table_insert(comp->digests, digest, elt);
+	}
+
+	if (cmd->cmd.normal.cmd == FUZZY_DEL) {
+		elt->last_del = hdr->seq;
+		elt->del_shingle = cmd->is_shingle;
+	}
+	else {
+		elt->last_touch = hdr->seq;
+	}
+}
+
+static gboolean
+rspamd_replog_compact_write(struct rspamd_replog_compaction *comp,
+							struct rspamd_replog_record_hdr *hdr,
+							struct fuzzy_peer_cmd *cmd)
+{
+	struct iovec iov[2];
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(*hdr);
+	iov[1].iov_base = cmd;
+	iov[1].iov_len = sizeof(*cmd);
+
+	if (pwritev(comp->nfd, iov, G_N_ELEMENTS(iov), comp->npos) !=
+		(gssize) RSPAMD_REPLOG_RECORD_LEN) {
+		return FALSE;
+	}
+
+	if (comp->nfirst == 0) {
+		comp->nfirst = hdr->seq;
+	}
+
+	comp->npos += RSPAMD_REPLOG_RECORD_LEN;
+
+	return TRUE;
+}
+
+/*
+ * Replace the log with the compacted one; called when nothing is left to copy
+ */
+static void
+rspamd_replog_compact_finish(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx = repl->ctx;
+	struct rspamd_replog_compaction *comp = repl->compaction;
+	struct rspamd_replog_file_hdr fhdr;
+	struct rspamd_replog_peer *peer;
+
+	memset(&fhdr, 0, sizeof(fhdr));
+	memcpy(fhdr.magic, RSPAMD_REPLOG_MAGIC, sizeof(RSPAMD_REPLOG_MAGIC));
+	fhdr.version = RSPAMD_REPLOG_VERSION;
+	/* If everything has been dropped, the next record continues numbering */
+	fhdr.base_seq = comp->nfirst > 0 ? comp->nfirst - 1 : repl->last_seq;
+
+	if (pwrite(comp->nfd, &fhdr, sizeof(fhdr), 0) != sizeof(fhdr) ||
+		fsync(comp->nfd) == -1 || rename(comp->tmp_path, ctx->replication_log) == -1) {
+		rspamd_replog_compact_free(repl, TRUE);
+
+		return;
+	}
+
+	close(repl->log_fd);
+	repl->log_fd = comp->nfd;
+	repl->log_size = comp->npos;
+	repl->base_seq = fhdr.base_seq;
+	repl->first_seq = comp->nfirst;
+	comp->nfd = -1;
+
+	msg_info("compacted replication log %s: %uL records dropped, %uz bytes left",
+			 ctx->replication_log, comp->ndropped, (gsize) repl->log_size);
+
+	/* Live records are never dropped, so do not compact them over and over */
+	repl->compact_size = MAX((off_t) ctx->replication_log_size, repl->log_size * 2);
+
+	if (repl->log_size > (off_t) ctx->replication_log_size) {
+		msg_warn("replication log %s holds %uz bytes of live records, that is "
+				 "over its limit of %uz bytes",
+				 ctx->replication_log, (gsize) repl->log_size,
+				 ctx->replication_log_size);
+	}
+
+	rspamd_replog_compact_free(repl, FALSE);
+
+	/* Positions are invalid now, so locate peers again */
+	DL_FOREACH(repl->peers, peer)
+	{
+		if (!peer->streaming) {
+			continue;
+		}
+
+		if (peer->sent_seq < repl->base_seq) {
+			/* Records this replica has not received yet are overridden */
+			msg_info("replica %s has received sequences up to %uL but log is "
+					 "compacted up to %uL; reset it",
+					 rspamd_inet_address_to_string_pretty(peer->addr),
+					 peer->sent_seq, repl->base_seq);
+			peer->sent_seq = repl->base_seq;
+			peer->reset_pending = TRUE;
+		}
+
+		peer->pos = rspamd_replog_find(repl, peer->sent_seq);
+
+		if (peer->wbuf_len == 0) {
+			rspamd_replog_peer_start_write(peer);
+		}
+	}
+}
+
+static void
+rspamd_replog_compact_cb(EV_P_ ev_timer *w, int revents)
+{
+	struct rspamd_fuzzy_replication *repl = (struct rspamd_fuzzy_replication *) w->data;
+	struct rspamd_replog_compaction *comp = repl->compaction;
+	struct rspamd_replog_record_hdr hdr;
+	struct fuzzy_peer_cmd cmd;
+	off_t end;
+	unsigned int n;
+
+	for (n = 0; n < RSPAMD_REPLOG_COMPACT_STEP; n++) {
+		end = comp->phase == RSPAMD_REPLOG_COMPACT_TAIL ? repl->log_size : comp->end;
+
+		if (comp->pos >= end) {
+			comp->pos = sizeof(struct rspamd_replog_file_hdr);
+
+			if (comp->phase == RSPAMD_REPLOG_COMPACT_TAIL) {
+				/* Nothing can be appended until we return to the event loop */
+				rspamd_replog_compact_finish(repl);
+
+				return;
+			}
+			else if (comp->phase == RSPAMD_REPLOG_COMPACT_WRITE) {
+				comp->pos = comp->end;
+			}
+
+			comp->phase++;
+			continue;
+		}
+
+		if (!rspamd_replog_read_record(repl->log_fd, comp->pos, &hdr, &cmd)) {
+			rspamd_replog_compact_free(repl, TRUE);
+
+			return;
+		}
+
+		comp->pos += RSPAMD_REPLOG_RECORD_LEN;
+
+		switch (comp->phase) {
+		case RSPAMD_REPLOG_COMPACT_SCAN:
+			rspamd_replog_compact_scan(comp, &hdr, &cmd);
+			break;
+		case RSPAMD_REPLOG_COMPACT_WRITE:
+			if (rspamd_replog_is_overridden(comp->digests, &cmd, hdr.seq)) {
+				comp->ndropped++;
+				break;
+			}
+
+			if (!rspamd_replog_compact_write(comp, &hdr, &cmd)) {
+				rspamd_replog_compact_free(repl, TRUE);
+
+				return;
+			}
+			break;
+		case RSPAMD_REPLOG_COMPACT_TAIL:
+			/* Appended after scan, so we know nothing about overrides */
+			if (!rspamd_replog_compact_write(comp, &hdr, &cmd)) {
+				rspamd_replog_compact_free(repl, TRUE);
+
+				return;
+			}
+			break;
+		}
+	}
+
+	/* Let other events run and continue on the next loop iteration */
+	ev_timer_start(EV_A_ w);
+}
+
+static void
+rspamd_replog_compact_start(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx = repl->ctx;
+	struct rspamd_replog_compaction *comp;
+
+	comp = g_malloc0(sizeof(*comp));
+	rspamd_snprintf(comp->tmp_path, sizeof(comp->tmp_path), "%s.new",
+					ctx->replication_log);
+	comp->nfd = rspamd_file_xopen(comp->tmp_path, O_RDWR | O_CREAT | O_TRUNC,
+								  00644, FALSE);
+
+	if (comp->nfd == -1) {
+		msg_err("cannot create %s to compact replication log: %s", comp->tmp_path,
+				strerror(errno));
+		g_free(comp);
+
+		return;
+	}
+
+	comp->digests = g_hash_table_new_full(rspamd_replog_digest_hash,
+										  rspamd_replog_digest_equal, g_free, g_free);
+	comp->phase = RSPAMD_REPLOG_COMPACT_SCAN;
+	comp->pos = sizeof(struct rspamd_replog_file_hdr);
+	comp->end = repl->log_size;
+	/* Header is written when we know the base */
+	comp->npos = sizeof(struct rspamd_replog_file_hdr);
+	comp->ev.data = repl;
+	ev_timer_init(&comp->ev, rspamd_replog_compact_cb, 0.0, 0.0);
+	ev_timer_start(ctx->event_loop, &comp->ev);
+	repl->compaction = comp;
+
+	msg_info("start compaction of replication log %s: %uz bytes",
+			 ctx->replication_log, (gsize) repl->log_size);
+}
+
+static void
+rspamd_replog_append(struct rspamd_fuzzy_replication *repl, GArray *updates)
+{
+	struct rspamd_replog_record_hdr hdr;
+	struct fuzzy_peer_cmd *cmd;
+	struct rspamd_replog_peer *peer;
+	struct iovec iov[2];
+	unsigned int i;
+
+	for (i = 0; i < updates->len; i++) {
+		cmd = &g_array_index(updates, struct fuzzy_peer_cmd, i);
+
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.seq = ++repl->last_seq;
+		hdr.len = sizeof(*cmd);
+		hdr.type = RSPAMD_REPLOG_RECORD;
+		hdr.cksum = rspamd_replog_cksum((const unsigned char *) cmd, sizeof(*cmd));
+
+		iov[0].iov_base = &hdr;
+		iov[0].iov_len = sizeof(hdr);
+		iov[1].iov_base = cmd;
+		iov[1].iov_len = sizeof(*cmd);
+
+		if (pwritev(repl->log_fd, iov, G_N_ELEMENTS(iov), repl->log_size) !=
+			(gssize) (sizeof(hdr) + sizeof(*cmd))) {
+			msg_err("cannot append to replication log %s: %s",
+					repl->ctx->replication_log, strerror(errno));
+			repl->last_seq--;
+
+			/* Do not leave a partial record, it would be truncated on restart */
+			if (ftruncate(repl->log_fd, repl->log_size) == -1) {
+				msg_err("cannot truncate replication log: %s", strerror(errno));
+			}
+
+			break;
+		}
+
+		if (repl->first_seq == 0) {
+			repl->first_seq = hdr.seq;
+		}
+
+		repl->log_size += sizeof(hdr) + sizeof(*cmd);
+	}
+
+	if (repl->log_size > repl->compact_size &&
+		repl->compaction == NULL) {
+		rspamd_replog_compact_start(repl);
+	}
+
+	/* Wake up peers waiting for the new data */
+	DL_FOREACH(repl->peers, peer)
+	{
+		if (peer->streaming && peer->wbuf_len == 0) {
+			rspamd_replog_peer_start_write(peer);
+		}
+	}
+}
+
+static void
+rspamd_replog_peer_free(struct rspamd_replog_peer *peer)
+{
+	struct rspamd_fuzzy_replication *repl = peer->repl;
+
+	msg_info("replica %s disconnected, last sent sequence: %uL",
+			 rspamd_inet_address_to_string_pretty(peer->addr), peer->sent_seq);
+	ev_io_stop(repl->ctx->event_loop, &peer->io);
+	close(peer->fd);
+	DL_DELETE(repl->peers, peer);
+	rspamd_inet_address_free(peer->addr);
+	g_free(peer->wbuf);
+	g_free(peer);
+}
+
+static void
+rspamd_replog_peer_queue_hdr(struct rspamd_replog_peer *peer, uint64_t seq,
+							 enum rspamd_replog_record_type type)
+{
+	struct rspamd_replog_record_hdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.seq = seq;
+	hdr.type = type;
+	memcpy(peer->wbuf + peer->wbuf_len, &hdr, sizeof(hdr));
+	peer->wbuf_len += sizeof(hdr);
+}
+
+/*
+ * Fill write buffer with the next chunk of records from the log
+ */
+static void
+rspamd_replog_peer_fill(struct rspamd_replog_peer *peer)
+{
+	struct rspamd_fuzzy_replication *repl = peer->repl;
+	struct rspamd_replog_record_hdr hdr;
+	gssize r;
+	gsize avail, off = 0;
+
+	peer->wbuf_len = 0;
+	peer->wbuf_off = 0;
+
+	if (peer->reset_pending) {
+		/* Tell replica where the stream continues before the records */
+		rspamd_replog_peer_queue_hdr(peer, peer->sent_seq, RSPAMD_REPLOG_RESET);
+		peer->reset_pending = FALSE;
+	}
+
+	if (peer->pos >= repl->log_size) {
+		return;
+	}
+
+	avail = MIN(RSPAMD_REPLOG_IO_BUF - peer->wbuf_len, repl->log_size - peer->pos);
+	r = pread(repl->log_fd, peer->wbuf + peer->wbuf_len, avail, peer->pos);
+
+	if (r <= 0) {
+		return;
+	}
+
+	/* Send whole records only, so we always know the last sent sequence */
+	while (off + sizeof(hdr) <= (gsize) r) {
+		memcpy(&hdr, peer->wbuf + peer->wbuf_len + off, sizeof(hdr));
+
+		if (off + sizeof(hdr) + hdr.len > (gsize) r) {
+			break;
+		}
+
+		off += sizeof(hdr) + hdr.len;
+		peer->sent_seq = hdr.seq;
+	}
+
+	peer->wbuf_len += off;
+	peer->pos += off;
+}
+
+static void
+rspamd_replog_peer_io(EV_P_ ev_io *w, int revents)
+{
+	struct rspamd_replog_peer *peer = (struct rspamd_replog_peer *) w->data;
+	struct rspamd_fuzzy_replication *repl = peer->repl;
+	gssize r;
+
+	if (!peer->streaming) {
+		/* Read request */
+		r = read(peer->fd, ((unsigned char *) &peer->req) + peer->req_len,
+				 sizeof(peer->req) - peer->req_len);
+
+		if (r == -1 && (errno == EAGAIN || errno == EINTR)) {
+			return;
+		}
+
+		if (r <= 0) {
+			rspamd_replog_peer_free(peer);
+			return;
+		}
+
+		peer->req_len += r;
+
+		if (peer->req_len < sizeof(peer->req)) {
+			return;
+		}
+
+		if (peer->req.magic != RSPAMD_REPLOG_REQ_MAGIC ||
+			peer->req.version != RSPAMD_REPLOG_VERSION) {
+			msg_warn("invalid replication request from %s",
+					 rspamd_inet_address_to_string_pretty(peer->addr));
+			rspamd_replog_peer_free(peer);
+			return;
+		}
+
+		peer->streaming = TRUE;
+		peer->wbuf = g_malloc(RSPAMD_REPLOG_IO_BUF);
+		peer->sent_seq = peer->req.from_seq;
+
+		if (peer->req.from_seq > repl->last_seq) {
+			msg_warn("replica %s asks for sequence %uL but our last is %uL; "
+					 "restart from the beginning",
+					 rspamd_inet_address_to_string_pretty(peer->addr),
+					 peer->req.from_seq, repl->last_seq);
+			peer->sent_seq = 0;
+		}
+
+		if (peer->sent_seq < repl->base_seq) {
+			/* Requested records are not available anymore */
+			msg_warn("replica %s asks for sequence %uL but log is compacted up to %uL",
+					 rspamd_inet_address_to_string_pretty(peer->addr),
+					 peer->sent_seq, repl->base_seq);
+			peer->sent_seq = repl->base_seq;
+		}
+
+		if (peer->sent_seq != peer->req.from_seq) {
+			peer->reset_pending = TRUE;
+		}
+
+		peer->pos = rspamd_replog_find(repl, peer->sent_seq);
+		msg_info("replica %s starts streaming from sequence %uL",
+				 rspamd_inet_address_to_string_pretty(peer->addr), peer->sent_seq);
+		rspamd_replog_peer_start_write(peer);
+
+		return;
+	}
+
+	if (revents & EV_READ) {
+		unsigned char junk[64];
+
+		/* Replica sends nothing after request, so this is EOF or error */
+		r = read(peer->fd, junk, sizeof(junk));
+
+		if (r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR)) {
+			rspamd_replog_peer_free(peer);
+			return;
+		}
+	}
+
+	if (revents & EV_WRITE) {
+		while (peer->wbuf_off < peer->wbuf_len) {
+			r = write(peer->fd, peer->wbuf + peer->wbuf_off,
+					  peer->wbuf_len - peer->wbuf_off);
+
+			if (r == -1) {
+				if (errno == EAGAIN || errno == EINTR) {
+					return;
+				}
+
+				rspamd_replog_peer_free(peer);
+				return;
+			}
+
+			peer->wbuf_off += r;
+
+			if (peer->wbuf_off == peer->wbuf_len) {
+				rspamd_replog_peer_fill(peer);
+			}
+		}
+
+		/* Caught up, wait for the new records */
+		peer->wbuf_len = 0;
+		peer->wbuf_off = 0;
+		ev_io_stop(EV_A_ & peer->io);
+		ev_io_set(&peer->io, peer->fd, EV_READ);
+		ev_io_start(EV_A_ & peer->io);
+	}
+}
+
+static void
+rspamd_replog_peer_start_write(struct rspamd_replog_peer *peer)
+{
+	struct ev_loop *loop = peer->repl->ctx->event_loop;
+
+	if (peer->wbuf_len == 0) {
+		rspamd_replog_peer_fill(peer);
+	}
+
+	if (peer->wbuf_len > 0) {
+		ev_io_stop(loop, &peer->io);
+		ev_io_set(&peer->io, peer->fd, EV_READ | EV_WRITE);
+		ev_io_start(loop, &peer->io);
+	}
+}
+
+static void
+rspamd_replog_heartbeat(EV_P_ ev_timer *w, int revents)
+{
+	struct rspamd_fuzzy_replication *repl = (struct rspamd_fuzzy_replication *) w->data;
+	struct rspamd_replog_peer *peer;
+
+	DL_FOREACH(repl->peers, peer)
+	{
+		if (peer->streaming && peer->wbuf_len == 0 && !peer->reset_pending &&
+			peer->pos >= repl->log_size) {
+			rspamd_replog_peer_queue_hdr(peer, repl->last_seq, RSPAMD_REPLOG_HEARTBEAT);
+			rspamd_replog_peer_start_write(peer);
+		}
+	}
+
+	ev_timer_again(EV_A_ w);
+}
+
+static void
+rspamd_replog_accept(EV_P_ ev_io *w, int revents)
+{
+	struct rspamd_fuzzy_replication *repl = (struct rspamd_fuzzy_replication *) w->data;
+	struct rspamd_fuzzy_storage_ctx *ctx = repl->ctx;
+	rspamd_inet_addr_t *addr = NULL;
+	int nfd;
+
+	if ((nfd = rspamd_accept_from_socket(w->fd, &addr, NULL, NULL)) == -1) {
+		msg_warn("accept replica failed: %s", strerror(errno));
+		return;
+	}
+
+	/* Check for EAGAIN */
+	if (nfd == 0) {
+		rspamd_inet_address_free(addr);
+		return;
+	}
+
+	if (ctx->replication_allow_ips == NULL ||
+		rspamd_match_radix_map_addr(ctx->replication_allow_ips, addr) == NULL) {
+		if (!rspamd_inet_address_is_local(addr)) {
+			msg_warn("replication is not allowed for %s",
+					 rspamd_inet_address_to_string_pretty(addr));
+			rspamd_inet_address_free(addr);
+			close(nfd);
+
+			return;
+		}
+	}
+
+	msg_info("accepted replica connection from %s",
+			 rspamd_inet_address_to_string_pretty(addr));
+	rspamd_fuzzy_replication_add_peer(ctx, nfd, addr);
+}
+
+void rspamd_fuzzy_replication_add_peer(struct rspamd_fuzzy_storage_ctx *ctx,
+									   int fd, rspamd_inet_addr_t *addr)
+{
+	struct rspamd_fuzzy_replication *repl = ctx->replication;
+	struct rspamd_replog_peer *peer;
+
+	peer = g_malloc0(sizeof(*peer));
+	peer->repl = repl;
+	peer->fd = fd;
+	peer->addr = addr;
+	peer->io.data = peer;
+	ev_io_init(&peer->io, rspamd_replog_peer_io, fd, EV_READ);
+	ev_io_start(ctx->event_loop, &peer->io);
+	DL_APPEND(repl->peers, peer);
+}
+
+static void
+rspamd_replog_save_state(struct rspamd_fuzzy_storage_ctx *ctx, uint64_t seq)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	rspamd_snprintf(path, sizeof(path), "%s.new", ctx->replication_state);
+	fd = rspamd_file_xopen(path, O_WRONLY | O_CREAT | O_TRUNC, 00644, FALSE);
+
+	if (fd == -1) {
+		msg_err("cannot save replication state to %s: %s", path, strerror(errno));
+		return;
+	}
+
+	if (write(fd, &seq, sizeof(seq)) != sizeof(seq) || fsync(fd) == -1 ||
+		rename(path, ctx->replication_state) == -1) {
+		msg_err("cannot save replication state to %s: %s",
+				ctx->replication_state, strerror(errno));
+		unlink(path);
+	}
+
+	close(fd);
+}
+
+static uint64_t
+rspamd_replog_load_state(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	uint64_t seq = 0;
+	int fd;
+
+	fd = rspamd_file_xopen(ctx->replication_state, O_RDONLY, 0, FALSE);
+
+	if (fd != -1) {
+		if (read(fd, &seq, sizeof(seq)) != sizeof(seq)) {
+			msg_warn("cannot read replication state from %s, start from scratch",
+					 ctx->replication_state);
+			seq = 0;
+		}
+
+		close(fd);
+	}
+
+	return seq;
+}
+
+static void rspamd_replog_client_connect(struct rspamd_fuzzy_replication *repl);
+
+static void
+rspamd_replog_client_reset(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+	struct ev_loop *loop = repl->ctx->event_loop;
+
+	if (cl->fd != -1) {
+		ev_io_stop(loop, &cl->io);
+		close(cl->fd);
+		cl->fd = -1;
+	}
+
+	cl->connected = FALSE;
+	cl->rbuf_len = 0;
+	/*
+	 * Records received so far are queued for commit, so we continue after
+	 * them: asking for them again would apply them twice
+	 */
+
+	ev_timer_stop(loop, &cl->tm);
+	ev_timer_set(&cl->tm, RSPAMD_REPLOG_RECONNECT_INTERVAL, 0.0);
+	ev_timer_start(loop, &cl->tm);
+}
+
+static void
+rspamd_replog_client_flush(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+
+	if (cl->uncommitted >= repl->ctx->replication_batch) {
+		cl->uncommitted = 0;
+		repl->flush(repl->ctx, "local", FALSE);
+	}
+}
+
+/*
+ * Stop reading from primary until the local backend commits what we have
+ */
+static void
+rspamd_replog_client_pause(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+	struct ev_loop *loop = repl->ctx->event_loop;
+
+	cl->paused = TRUE;
+	ev_io_stop(loop, &cl->io);
+	ev_timer_stop(loop, &cl->tm);
+}
+
+static void
+rspamd_replog_client_resume(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+	struct ev_loop *loop = repl->ctx->event_loop;
+
+	cl->paused = FALSE;
+
+	if (cl->fd != -1) {
+		ev_io_start(loop, &cl->io);
+	}
+
+	if (cl->connected) {
+		ev_timer_set(&cl->tm, RSPAMD_REPLOG_HEARTBEAT_INTERVAL * 3,
+					 RSPAMD_REPLOG_HEARTBEAT_INTERVAL * 3);
+	}
+	else {
+		ev_timer_set(&cl->tm, RSPAMD_REPLOG_RECONNECT_INTERVAL, 0.0);
+	}
+
+	ev_timer_start(loop, &cl->tm);
+}
+
+static gboolean
+rspamd_replog_client_process(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+	struct rspamd_replog_record_hdr hdr;
+	struct fuzzy_peer_cmd cmd;
+	gsize off = 0;
+
+	while (off + sizeof(hdr) <= cl->rbuf_len) {
+		memcpy(&hdr, cl->rbuf + off, sizeof(hdr));
+
+		if (hdr.type == RSPAMD_REPLOG_HEARTBEAT) {
+			msg_debug_fuzzy_replication("heartbeat from primary, its last sequence: %uL, "
+										"ours: %uL",
+										hdr.seq, cl->received_seq);
+			off += sizeof(hdr);
+			continue;
+		}
+		else if (hdr.type == RSPAMD_REPLOG_RESET) {
+			/*
+			 * Primary drops merely overridden records when compacting, so
+			 * the records that follow override whatever we have missed
+			 */
+			msg_info("primary has compacted records after %uL, continue from %uL",
+					 cl->received_seq, hdr.seq);
+			cl->received_seq = hdr.seq;
+			cl->resets++;
+			off += sizeof(hdr);
+			continue;
+		}
+		else if (hdr.type != RSPAMD_REPLOG_RECORD || hdr.len != sizeof(cmd)) {
+			msg_err("invalid record from primary: type %d, length %d",
+					(int) hdr.type, (int) hdr.len);
+			return FALSE;
+		}
+
+		if (off + sizeof(hdr) + hdr.len > cl->rbuf_len) {
+			break;
+		}
+
+		memcpy(&cmd, cl->rbuf + off + sizeof(hdr), sizeof(cmd));
+
+		if (rspamd_replog_cksum((const unsigned char *) &cmd, sizeof(cmd)) != hdr.cksum) {
+			msg_err("checksum mismatch for record %uL from primary", hdr.seq);
+			return FALSE;
+		}
+
+		if (hdr.seq > cl->received_seq) {
+			g_array_append_val(repl->ctx->updates_pending, cmd);
+			cl->received_seq = hdr.seq;
+			cl->uncommitted++;
+		}
+
+		off += sizeof(hdr) + hdr.len;
+	}
+
+	if (off > 0) {
+		memmove(cl->rbuf, cl->rbuf + off, cl->rbuf_len - off);
+		cl->rbuf_len -= off;
+	}
+
+	rspamd_replog_client_flush(repl);
+
+	return TRUE;
+}
+
+static void
+rspamd_replog_client_io(EV_P_ ev_io *w, int revents)
+{
+	struct rspamd_fuzzy_replication *repl = (struct rspamd_fuzzy_replication *) w->data;
+	struct rspamd_replog_client *cl = repl->client;
+	gssize r;
+
+	if (!cl->connected) {
+		struct rspamd_replog_request req;
+
+		/* Connection is established, send request */
+		memset(&req, 0, sizeof(req));
+		req.magic = RSPAMD_REPLOG_REQ_MAGIC;
+		req.version = RSPAMD_REPLOG_VERSION;
+		req.from_seq = cl->received_seq;
+
+		if (write(cl->fd, &req, sizeof(req)) != sizeof(req)) {
+			msg_err("cannot send replication request to %s: %s",
+					rspamd_inet_address_to_string_pretty(cl->addr), strerror(errno));
+			rspamd_replog_client_reset(repl);
+
+			return;
+		}
+
+		msg_info("connected to primary %s, request records after %uL",
+				 rspamd_inet_address_to_string_pretty(cl->addr), cl->received_seq);
+		cl->connected = TRUE;
+		ev_io_stop(EV_A_ w);
+		ev_io_set(w, cl->fd, EV_READ);
+		ev_io_start(EV_A_ w);
+		/* Primary sends heartbeats, so silence means a dead link */
+		ev_timer_stop(EV_A_ & cl->tm);
+		ev_timer_set(&cl->tm, RSPAMD_REPLOG_HEARTBEAT_INTERVAL * 3,
+					 RSPAMD_REPLOG_HEARTBEAT_INTERVAL * 3);
+		ev_timer_start(EV_A_ & cl->tm);
+
+		return;
+	}
+
+	r = read(cl->fd, cl->rbuf + cl->rbuf_len, sizeof(cl->rbuf) - cl->rbuf_len);
+
+	if (r == -1 && (errno == EAGAIN || errno == EINTR)) {
+		return;
+	}
+
+	if (r <= 0) {
+		msg_warn("connection to primary %s is lost: %s",
+				 rspamd_inet_address_to_string_pretty(cl->addr),
+				 r == 0 ? "EOF" : strerror(errno));
+		rspamd_replog_client_reset(repl);
+
+		return;
+	}
+
+	cl->rbuf_len += r;
+	ev_timer_again(EV_A_ & cl->tm);
+
+	if (!rspamd_replog_client_process(repl)) {
+		rspamd_replog_client_reset(repl);
+	}
+}
+
+static void
+rspamd_replog_client_timer(EV_P_ ev_timer *w, int revents)
+{
+	struct rspamd_fuzzy_replication *repl = (struct rspamd_fuzzy_replication *) w->data;
+	struct rspamd_replog_client *cl = repl->client;
+
+	if (cl->fd != -1) {
+		msg_warn("timeout while talking to primary %s",
+				 rspamd_inet_address_to_string_pretty(cl->addr));
+		rspamd_replog_client_reset(repl);
+
+		return;
+	}
+
+	rspamd_replog_client_connect(repl);
+}
+
+static void
+rspamd_replog_client_connect(struct rspamd_fuzzy_replication *repl)
+{
+	struct rspamd_replog_client *cl = repl->client;
+	struct ev_loop *loop = repl->ctx->event_loop;
+
+	cl->fd = rspamd_inet_address_connect(cl->addr, SOCK_STREAM, TRUE);
+
+	if (cl->fd == -1) {
+		msg_warn("cannot connect to primary %s: %s",
+				 rspamd_inet_address_to_string_pretty(cl->addr), strerror(errno));
+		rspamd_replog_client_reset(repl);
+
+		return;
+	}
+
+	ev_io_init(&cl->io, rspamd_replog_client_io, cl->fd, EV_WRITE);
+	cl->io.data = repl;
+	ev_io_start(loop, &cl->io);
+	ev_timer_stop(loop, &cl->tm);
+	ev_timer_set(&cl->tm, RSPAMD_REPLOG_RECONNECT_INTERVAL, 0.0);
+	ev_timer_start(loop, &cl->tm);
+}
+
+static rspamd_inet_addr_t *
+rspamd_replog_parse_addr(const char *str, gboolean listen)
+{
+	GPtrArray *addrs = NULL;
+	rspamd_inet_addr_t *addr;
+
+	if (rspamd_parse_host_port_priority(str, &addrs, NULL, NULL,
+										RSPAMD_FUZZY_REPLICATION_PORT, listen,
+										NULL) == RSPAMD_PARSE_ADDR_FAIL ||
+		addrs == NULL || addrs->len == 0) {
+		if (addrs) {
+			g_ptr_array_free(addrs, TRUE);
+		}
+
+		return NULL;
+	}
+
+	addr = rspamd_inet_address_copy(g_ptr_array_index(addrs, 0), NULL);
+	g_ptr_array_free(addrs, TRUE);
+
+	return addr;
+}
+
+gboolean
+rspamd_fuzzy_replication_init(struct rspamd_fuzzy_storage_ctx *ctx,
+							  struct rspamd_worker *worker,
+							  rspamd_fuzzy_replication_flush_t flush)
+{
+	struct rspamd_fuzzy_replication *repl;
+
+	if (ctx->replication_log == NULL && ctx->replication_master == NULL) {
+		return TRUE;
+	}
+
+	repl = g_malloc0(sizeof(*repl));
+	repl->ctx = ctx;
+	repl->flush = flush;
+	repl->log_fd = -1;
+	repl->listen_fd = -1;
+	repl->compact_size = ctx->replication_log_size;
+
+	if (ctx->replication_allow_map != NULL) {
+		rspamd_config_radix_from_ucl(ctx->cfg, ctx->replication_allow_map,
+									 "Allow fuzzy replication to specified addresses",
+									 &ctx->replication_allow_ips, NULL, worker,
+									 "fuzzy replication");
+	}
+
+	if (ctx->replication_log) {
+		if (!rspamd_replog_open(repl, ctx->replication_log)) {
+			g_free(repl);
+			return FALSE;
+		}
+	}
+
+	if (ctx->replication_bind) {
+		rspamd_inet_addr_t *addr;
+
+		if (repl->log_fd == -1) {
+			msg_err("cannot serve replicas without replication log");
+		}
+		else if ((addr = rspamd_replog_parse_addr(ctx->replication_bind, TRUE)) == NULL) {
+			msg_err("cannot parse replication bind address: %s", ctx->replication_bind);
+		}
+		else {
+			repl->listen_fd = rspamd_inet_address_listen(addr, SOCK_STREAM,
+														 RSPAMD_INET_ADDRESS_LISTEN_ASYNC,
+														 -1);
+
+			if (repl->listen_fd == -1) {
+				msg_err("cannot listen for replicas on %s: %s",
+						rspamd_inet_address_to_string_pretty(addr), strerror(errno));
+			}
+			else {
+				msg_info("serving replication log on %s",
+						 rspamd_inet_address_to_string_pretty(addr));
+				repl->accept_ev.data = repl;
+				ev_io_init(&repl->accept_ev, rspamd_replog_accept, repl->listen_fd,
+						   EV_READ);
+				ev_io_start(ctx->event_loop, &repl->accept_ev);
+				repl->heartbeat_ev.data = repl;
+				ev_timer_init(&repl->heartbeat_ev, rspamd_replog_heartbeat,
+							  RSPAMD_REPLOG_HEARTBEAT_INTERVAL,
+							  RSPAMD_REPLOG_HEARTBEAT_INTERVAL);
+				ev_timer_start(ctx->event_loop, &repl->heartbeat_ev);
+			}
+
+			rspamd_inet_address_free(addr);
+		}
+	}
+
+	if (ctx->replication_master) {
+		struct rspamd_replog_client *cl;
+
+		cl = g_malloc0(sizeof(*cl));
+		cl->fd = -1;
+		cl->addr = rspamd_replog_parse_addr(ctx->replication_master, FALSE);
+
+		if (cl->addr == NULL) {
+			msg_err("cannot parse replication primary address: %s",
+					ctx->replication_master);
+			g_free(cl);
+		}
+		else {
+			repl->client = cl;
+			cl->committed_seq = rspamd_replog_load_state(ctx);
+			cl->received_seq = cl->committed_seq;
+			cl->tm.data = repl;
+			ev_timer_init(&cl->tm, rspamd_replog_client_timer, 0.0, 0.0);
+			rspamd_replog_client_connect(repl);
+		}
+	}
+
+	ctx->replication = repl;
+
+	return TRUE;
+}
+
+uint64_t
+rspamd_fuzzy_replication_received(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	if (ctx->replication && ctx->replication->client) {
+		return ctx->replication->client->received_seq;
+	}
+
+	return 0;
+}
+
+void rspamd_fuzzy_replication_committed(struct rspamd_fuzzy_storage_ctx *ctx,
+										GArray *updates,
+										uint64_t received_seq)
+{
+	struct rspamd_fuzzy_replication *repl = ctx->replication;
+
+	if (repl == NULL) {
+		return;
+	}
+
+	if (repl->log_fd != -1 && updates->len > 0) {
+		rspamd_replog_append(repl, updates);
+	}
+
+	if (repl->client) {
+		if (received_seq > repl->client->committed_seq) {
+			repl->client->committed_seq = received_seq;
+			rspamd_replog_save_state(ctx, received_seq);
+		}
+
+		if (repl->client->paused && received_seq > 0) {
+			msg_info("updates are committed again, continue receiving from primary");
+			rspamd_replog_client_resume(repl);
+		}
+	}
+}
+
+gboolean
+rspamd_fuzzy_replication_hold(struct rspamd_fuzzy_storage_ctx *ctx,
+							  uint64_t received_seq,
+							  gboolean terminating)
+{
+	struct rspamd_fuzzy_replication *repl = ctx->replication;
+
+	if (repl == NULL || repl->client == NULL || terminating ||
+		received_seq <= repl->client->committed_seq) {
+		return FALSE;
+	}
+
+	if (!repl->client->paused) {
+		msg_err("cannot commit updates received from primary up to sequence %uL; "
+				"stop receiving until they are committed",
+				received_seq);
+		rspamd_replog_client_pause(repl);
+	}
+
+	return TRUE;
+}
+
+ucl_object_t *
+rspamd_fuzzy_replication_stat(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	struct rspamd_fuzzy_replication *repl = ctx->replication;
+	struct rspamd_replog_peer *peer;
+	ucl_object_t *obj, *peers;
+
+	if (repl == NULL) {
+		return NULL;
+	}
+
+	obj = ucl_object_typed_new(UCL_OBJECT);
+
+	if (repl->log_fd != -1) {
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->first_seq),
+							  "first_seq", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->last_seq),
+							  "last_seq", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->log_size),
+							  "log_size", 0, false);
+		ucl_object_insert_key(obj, ucl_object_frombool(repl->compaction != NULL),
+							  "compacting", 0, false);
+		peers = ucl_object_typed_new(UCL_OBJECT);
+
+		DL_FOREACH(repl->peers, peer)
+		{
+			ucl_object_insert_key(peers, ucl_object_fromint(peer->sent_seq),
+								  rspamd_inet_address_to_string_pretty(peer->addr),
+								  0, true);
+		}
+
+		ucl_object_insert_key(obj, peers, "replicas", 0, false);
+	}
+
+	if (repl->client) {
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->client->received_seq),
+							  "received_seq", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->client->committed_seq),
+							  "committed_seq", 0, false);
+		ucl_object_insert_key(obj, ucl_object_frombool(repl->client->connected),
+							  "connected", 0, false);
+		ucl_object_insert_key(obj, ucl_object_frombool(repl->client->paused),
+							  "paused", 0, false);
+		ucl_object_insert_key(obj, ucl_object_fromint(repl->client->resets),
+							  "resets", 0, false);
+	}
+
+	return obj;
+}
+
+void rspamd_fuzzy_replication_destroy(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	struct rspamd_fuzzy_replication *repl = ctx->replication;
+	struct rspamd_replog_peer *peer, *tmp;
+
+	if (repl == NULL) {
+		return;
+	}
+
+	DL_FOREACH_SAFE(repl->peers, peer, tmp)
+	{
+		rspamd_replog_peer_free(peer);
+	}
+
+	if (repl->listen_fd != -1) {
+		ev_io_stop(ctx->event_loop, &repl->accept_ev);
+		ev_timer_stop(ctx->event_loop, &repl->heartbeat_ev);
+		close(repl->listen_fd);
+	}
+
+	if (repl->client) {
+		if (repl->client->fd != -1) {
+			ev_io_stop(ctx->event_loop, &repl->client->io);
+			close(repl->client->fd);
+		}
+
+		ev_timer_stop(ctx->event_loop, &repl->client->tm);
+		rspamd_inet_address_free(repl->client->addr);
+		g_free(repl->client);
+	}
+
+	if (repl->compaction) {
+		/* Unfinished compaction is started again on the next append */
+		rspamd_replog_compact_free(repl, FALSE);
+	}
+
+	if (repl->log_fd != -1) {
+		fsync(repl->log_fd);
+		close(repl->log_fd);
+	}
+
+	g_free(repl);
+	ctx->replication = NULL;
+}
@@ -23,6 +23,7 @@
 #include "fuzzy_storage_internal.h"
 #include "fuzzy_wire.h"
 #include "libcryptobox/keypair.h"
+#include "libcryptobox/keypairs_cache.h"
 #include "unix-std.h"
 
 #include <errno.h>
@@ -159,6 +160,16 @@ rspamd_fuzzy_stat_to_ucl(struct rspamd_fuzzy_storage_ctx *ctx, gboolean ip_stat)
 						  0,
 						  false);
 
+	if (ctx->cfg && ctx->cfg->nm_cache) {
+		uint64_t nm_hits, nm_misses;
+
+		rspamd_keypair_shared_cache_stat(ctx->cfg->nm_cache, &nm_hits, &nm_misses);
+		elt = ucl_object_typed_new(UCL_OBJECT);
+		ucl_object_insert_key(elt, ucl_object_fromint(nm_hits), "hits", 0, false);
+		ucl_object_insert_key(elt, ucl_object_fromint(nm_misses), "misses", 0, false);
+		ucl_object_insert_key(obj, elt, "shared_keypair_cache", 0, false);
+	}
+
 	if (ctx->errors_ips && ip_stat) {
 		gpointer k, v;
 		int i = 0;
@@ -177,6 +188,12 @@ rspamd_fuzzy_stat_to_ucl(struct rspamd_fuzzy_storage_ctx *ctx, gboolean ip_stat)
 							  false);
 	}
 
+	elt = rspamd_fuzzy_replication_stat(ctx);
+
+	if (elt) {
+		ucl_object_insert_key(obj, elt, "replication", 0, false);
+	}
+
 	/* Checked by epoch */
 	elt = ucl_object_typed_new(UCL_ARRAY);
 
@@ -407,7 +407,24 @@ rspamd_http_on_headers_complete(http_parser *parser)
 			return -1;
 		}
 
-		if (!rspamd_http_message_set_body(msg, NULL, parser->content_length)) {
+		gboolean spilled = FALSE;
+
+		if (conn->spill_size > 0 && parser->content_length > conn->spill_size &&
+			conn->spill_dir != NULL) {
+			spilled = rspamd_http_message_set_body_tmpfile(msg, conn->spill_dir,
+														   parser->content_length);
+
+			if (spilled) {
+				msg_debug("keep body of length %z in a temporary file",
+						  (gsize) parser->content_length);
+			}
+			else {
+				msg_warn("cannot create temporary file in %s: %s, keep body in memory",
+						 conn->spill_dir, strerror(errno));
+			}
+		}
+
+		if (!spilled && !rspamd_http_message_set_body(msg, NULL, parser->content_length)) {
 			return -1;
 		}
 	}
@@ -670,8 +687,11 @@ rspamd_http_on_message_complete(http_parser *parser)
 		return -1;
 	}
 
-	if ((conn->opts & RSPAMD_HTTP_BODY_PARTIAL) == 0 && IS_CONN_ENCRYPTED(priv)) {
-
+	if (IS_CONN_ENCRYPTED(priv)) {
+		/*
+		 * Portions of encrypted body are never passed to the body handler,
+		 * so it is called once with the whole decrypted body in both modes
+		 */
 		if (priv->local_key == NULL || priv->msg->peer_key == NULL ||
 			priv->msg->body_buf.len < crypto_box_noncebytes() +
 										  crypto_box_macbytes()) {
@@ -2642,6 +2662,13 @@ void rspamd_http_connection_set_max_size(struct rspamd_http_connection *conn,
 	conn->max_size = sz;
 }
 
+void rspamd_http_connection_set_spill(struct rspamd_http_connection *conn,
+									  gsize sz, const char *dir)
+{
+	conn->spill_size = sz;
+	conn->spill_dir = dir;
+}
+
 void rspamd_http_connection_set_key(struct rspamd_http_connection *conn,
 									struct rspamd_cryptobox_keypair *key)
 {
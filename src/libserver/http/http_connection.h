@@ -91,7 +91,7 @@ struct rspamd_storage_shmem {
  * Options for HTTP connection
  */
 enum rspamd_http_options {
-	RSPAMD_HTTP_BODY_PARTIAL = 1,           /**< Call body handler on all body data portions */
+	RSPAMD_HTTP_BODY_PARTIAL = 1,           /**< Call body handler on all body data portions (once for encrypted body) */
 	RSPAMD_HTTP_CLIENT_SIMPLE = 1u << 1,    /**< Read HTTP client reply automatically */
 	RSPAMD_HTTP_CLIENT_ENCRYPTED = 1u << 2, /**< Encrypt data for client */
 	RSPAMD_HTTP_CLIENT_SHARED = 1u << 3,    /**< Store reply in shared memory */
@@ -124,6 +124,9 @@ struct rspamd_http_connection {
 	/* Used for keepalive */
 	struct rspamd_keepalive_hash_key *keepalive_hash_key;
 	gsize max_size;
+	/* Bodies larger than spill_size are kept in temporary files in spill_dir */
+	gsize spill_size;
+	const char *spill_dir;
 	unsigned opts;
 	enum rspamd_http_connection_type type;
 	gboolean finished;
@@ -343,6 +346,14 @@ void rspamd_http_connection_reset(struct rspamd_http_connection *conn);
 void rspamd_http_connection_set_max_size(struct rspamd_http_connection *conn,
 										 gsize sz);
 
+/**
+ * Keeps bodies of known length larger than `sz` in memory mapped temporary files
+ * @param sz size threshold, 0 to disable
+ * @param dir directory for temporary files
+ */
+void rspamd_http_connection_set_spill(struct rspamd_http_connection *conn,
+									  gsize sz, const char *dir);
+
 void rspamd_http_connection_disable_encryption(struct rspamd_http_connection *conn);
 
 /**
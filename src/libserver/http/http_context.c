@@ -349,6 +349,14 @@ rspamd_http_context_create(struct rspamd_config *cfg,
 
 	rspamd_http_context_init(ctx);
 
+	if (ctx->server_kp_cache && cfg->nm_cache) {
+		/*
+		 * Client keypairs are rotated and differ per worker, so only server
+		 * side benefits from sharing
+		 */
+		rspamd_keypair_cache_set_shared(ctx->server_kp_cache, cfg->nm_cache);
+	}
+
 	return ctx;
 }
 
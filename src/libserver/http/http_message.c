@@ -314,6 +314,48 @@ rspamd_http_message_set_body_from_fd(struct rspamd_http_message *msg,
 	return TRUE;
 }
 
+gboolean
+rspamd_http_message_set_body_tmpfile(struct rspamd_http_message *msg,
+									 const char *dir, gsize len)
+{
+	union _rspamd_storage_u *storage;
+
+	rspamd_http_message_storage_cleanup(msg);
+
+	storage = &msg->body_buf.c;
+	/* Unnamed segment: it is grown and released as a shared one */
+	msg->flags |= RSPAMD_HTTP_FLAG_SHMEM;
+	storage->shared.name = NULL;
+	storage->shared.shm_fd = rspamd_tmpfile_open(dir);
+	msg->body_buf.str = MAP_FAILED;
+
+	if (storage->shared.shm_fd == -1 || ftruncate(storage->shared.shm_fd, len) == -1) {
+		goto err;
+	}
+
+	msg->body_buf.str = mmap(NULL, len,
+							 PROT_WRITE | PROT_READ, MAP_SHARED,
+							 storage->shared.shm_fd, 0);
+
+	if (msg->body_buf.str == MAP_FAILED) {
+		goto err;
+	}
+
+	msg->body_buf.begin = msg->body_buf.str;
+	msg->body_buf.allocated_len = len;
+	msg->body_buf.len = 0;
+	msg->flags |= RSPAMD_HTTP_FLAG_HAS_BODY;
+
+	return TRUE;
+
+err:
+	rspamd_http_message_storage_cleanup(msg);
+	msg->flags &= ~RSPAMD_HTTP_FLAG_SHMEM;
+	msg->body_buf.c.normal = NULL;
+
+	return FALSE;
+}
+
 gboolean
 rspamd_http_message_set_body_from_fstring_steal(struct rspamd_http_message *msg,
 												rspamd_fstring_t *fstr)
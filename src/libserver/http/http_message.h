@@ -122,6 +122,16 @@ void rspamd_http_message_set_method(struct rspamd_http_message *msg,
 gboolean rspamd_http_message_set_body_from_fd(struct rspamd_http_message *msg,
 											  int fd);
 
+/**
+ * Allocates message's body in an unlinked temporary file mapping
+ * @param msg
+ * @param dir directory for the temporary file
+ * @param len expected length of the body
+ * @return TRUE if a message's body has been set, the message has no body otherwise
+ */
+gboolean rspamd_http_message_set_body_tmpfile(struct rspamd_http_message *msg,
+											  const char *dir, gsize len);
+
 /**
  * Uses rspamd_fstring_t as message's body, string is consumed by this operation
  * @param msg
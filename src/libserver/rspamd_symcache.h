@@ -60,6 +60,7 @@ enum rspamd_symbol_type {
 	SYMBOL_TYPE_IGNORE_PASSTHROUGH = (1u << 17u), /* Symbol ignores passthrough result */
 	SYMBOL_TYPE_EXPLICIT_ENABLE = (1u << 18u),    /* Symbol should be enabled explicitly only */
 	SYMBOL_TYPE_USE_CORO = (1u << 19u),           /* Symbol uses lua coroutines */
+	SYMBOL_TYPE_HEADERS_ONLY = (1u << 20u),       /* Prefilter needs merely message headers */
 };
 
 /**
@@ -211,6 +212,17 @@ gboolean rspamd_symcache_process_symbols(struct rspamd_task *task,
 										 struct rspamd_symcache *cache,
 										 unsigned int stage);
 
+/**
+ * Call prefilters marked with SYMBOL_TYPE_HEADERS_ONLY, these are called
+ * before the whole message is received; they are skipped in the prefilters
+ * stage afterwards
+ * @param task task object
+ * @param cache symbols cache
+ * @return TRUE if all such prefilters are finished
+ */
+gboolean rspamd_symcache_process_headers_prefilters(struct rspamd_task *task,
+													struct rspamd_symcache *cache);
+
 /**
  * Return statistics about the cache as ucl object (array of objects one per item)
  * @param cache
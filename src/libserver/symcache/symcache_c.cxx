@@ -726,6 +726,20 @@ rspamd_symcache_process_symbols(struct rspamd_task *task,
 	return cache_runtime->process_symbols(task, *real_cache, stage);
 }
 
+gboolean
+rspamd_symcache_process_headers_prefilters(struct rspamd_task *task,
+										   struct rspamd_symcache *cache)
+{
+	auto *real_cache = C_API_SYMCACHE(cache);
+
+	if (task->symcache_runtime == nullptr) {
+		task->symcache_runtime = rspamd::symcache::symcache_runtime::create(task, *real_cache);
+	}
+
+	auto *cache_runtime = C_API_SYMCACHE_RUNTIME(task->symcache_runtime);
+	return cache_runtime->process_headers_prefilters(task, *real_cache);
+}
+
 void rspamd_symcache_finalize_item(struct rspamd_task *task,
 								   struct rspamd_symcache_dynamic_item *item)
 {
@@ -439,6 +439,47 @@ auto symcache_runtime::process_pre_postfilters(struct rspamd_task *task,
 	return all_done;
 }
 
+auto symcache_runtime::process_headers_prefilters(struct rspamd_task *task, symcache &cache) -> bool
+{
+	auto all_done = true;
+	auto log_func = RSPAMD_LOG_FUNC;
+
+	if (RSPAMD_TASK_IS_SKIPPED(task)) {
+		return true;
+	}
+
+	if (check_process_status(task) == check_status::passthrough) {
+		msg_debug_cache_task("task has already the passthrough result being set, ignore headers prefilters");
+
+		return true;
+	}
+
+	cache.prefilters_foreach([&](cache_item *item) {
+		auto dyn_item = get_dynamic_item(item->id);
+
+		/*
+		 * Prefilters with dependencies are left for the prefilters stage, as
+		 * their dependencies might need the whole message
+		 */
+		if (!(item->flags & SYMBOL_TYPE_HEADERS_ONLY) || !item->deps.empty() ||
+			dyn_item->status != cache_item_status::not_started) {
+			return true;
+		}
+
+		msg_debug_cache_task_lambda("process headers prefilter %s(%d)",
+									item->symbol.c_str(), item->id);
+
+		if (!process_symbol(task, cache, item, dyn_item)) {
+			all_done = false;
+		}
+
+		/* Continue processing */
+		return true;
+	});
+
+	return all_done;
+}
+
 auto symcache_runtime::process_filters(struct rspamd_task *task, symcache &cache, int start_events) -> bool
 {
 	auto all_done = true;
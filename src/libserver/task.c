@@ -23,11 +23,13 @@
 #include "email_addr.h"
 #include "src/libserver/composites/composites.h"
 #include "stat_api.h"
+#include "tokenizers/tokenizers.h"
 #include "unix-std.h"
 #include "utlist.h"
 #include "libserver/mempool_vars_internal.h"
 #include "libserver/cfg_file_private.h"
 #include "libmime/lang_detection.h"
+#include "libmime/mime_encoding.h"
 #include "libmime/scan_result_private.h"
 #include "lua/lua_classnames.h"
 
@@ -57,6 +59,8 @@ KHASH_SET_INIT_INT(rspamd_task_set);
 static khash_t(rspamd_task_set) *task_registry = NULL;
 
 #define TASK_REGISTRY_INITIAL_SIZE 16
+/* Maximum length of input to look for the message headers in streaming mode */
+#define TASK_HEADERS_MAX_LEN (1024 * 1024)
 
 /*
  * Mix 64-bit pointer to 32-bit hash using Fibonacci hashing.
@@ -261,6 +265,13 @@ void rspamd_task_free(struct rspamd_task *task)
 
 		debug_task("free pointer %p", task);
 
+		if (task->worker && task->worker->srv) {
+			/* Words are also normalised and stemmed by tokenizers called from lua */
+			rspamd_words_cache_report(task->worker->srv->stat);
+			/* Charsets are also detected when parsing headers and archives */
+			rspamd_mime_charset_detect_report(task->worker->srv->stat);
+		}
+
 		if (task->rcpt_envelope) {
 			for (i = 0; i < task->rcpt_envelope->len; i++) {
 				addr = g_ptr_array_index(task->rcpt_envelope, i);
@@ -712,6 +723,48 @@ rspamd_task_load_message(struct rspamd_task *task,
 	return TRUE;
 }
 
+gboolean
+rspamd_task_process_headers(struct rspamd_task *task,
+							struct rspamd_http_message *msg,
+							const char *start, gsize len)
+{
+	if (!(task->flags & RSPAMD_TASK_FLAG_MESSAGE_PENDING) ||
+		RSPAMD_TASK_IS_SKIPPED(task) ||
+		task->message != NULL ||
+		!(task->processed_stages & RSPAMD_TASK_STAGE_CONNFILTERS)) {
+		return FALSE;
+	}
+
+	/* Do not rescan the input over and over if it has no header block */
+	if (len > TASK_HEADERS_MAX_LEN) {
+		return FALSE;
+	}
+
+	/* Message is not passed in the body as is */
+	if (rspamd_task_get_request_header(task, "shm") ||
+		rspamd_task_get_request_header(task, "file") ||
+		rspamd_task_get_request_header(task, "path") ||
+		rspamd_task_get_request_header(task, COMPRESSION_HEADER) ||
+		rspamd_task_get_request_header(task, CONTENT_ENCODING_HEADER)) {
+		return FALSE;
+	}
+
+	/* Body is reallocated while being received unless its length is known */
+	if (rspamd_http_message_find_header(msg, "Content-Length") == NULL) {
+		return FALSE;
+	}
+
+	if (!rspamd_message_parse_headers(task, start, len)) {
+		return FALSE;
+	}
+
+	task->flags |= RSPAMD_TASK_FLAG_PROCESSING;
+	rspamd_symcache_process_headers_prefilters(task, task->cfg->cache);
+	task->flags &= ~RSPAMD_TASK_FLAG_PROCESSING;
+
+	return TRUE;
+}
+
 static unsigned int
 rspamd_task_select_processing_stage(struct rspamd_task *task, unsigned int stages)
 {
@@ -763,6 +816,15 @@ rspamd_task_process(struct rspamd_task *task, unsigned int stages)
 
 	st = rspamd_task_select_processing_stage(task, stages);
 
+	if ((task->flags & RSPAMD_TASK_FLAG_MESSAGE_PENDING) &&
+		st >= RSPAMD_TASK_STAGE_READ_MESSAGE) {
+		/* Processing is resumed when the whole message is received */
+		msg_debug_task("wait for the message to be received on stage %d", st);
+		task->flags &= ~RSPAMD_TASK_FLAG_PROCESSING;
+
+		return TRUE;
+	}
+
 	switch (st) {
 	case RSPAMD_TASK_STAGE_CONNFILTERS:
 		all_done = rspamd_symcache_process_symbols(task, task->cfg->cache, st);
@@ -1577,7 +1639,7 @@ rspamd_task_log_variable(struct rspamd_task *task,
 		if (task->message) {
 			var.len = rspamd_snprintf(numbuf, sizeof(numbuf), "%*xs",
 									  (int) sizeof(MESSAGE_FIELD(task, digest)),
-									  MESSAGE_FIELD(task, digest));
+									  rspamd_message_get_digest(task->message));
 			var.begin = numbuf;
 		}
 		else {
@@ -1993,7 +2055,32 @@ void rspamd_task_timeout(EV_P_ ev_timer *w, int revents)
 {
 	struct rspamd_task *task = (struct rspamd_task *) w->data;
 
-	if (!(task->processed_stages & RSPAMD_TASK_STAGE_FILTERS)) {
+	if (task->flags & RSPAMD_TASK_FLAG_MESSAGE_PENDING) {
+		/*
+		 * Message is still being received (streaming mode), so there is
+		 * nothing to process: abort early filters and reply with an error
+		 */
+		ev_now_update_if_cheap(task->event_loop);
+		msg_info_task("receiving of message time out: %.1fs spent; %.1fs limit; "
+					  "abort processing",
+					  ev_now(task->event_loop) - task->task_timestamp,
+					  w->repeat);
+		rspamd_task_timeout_log_state(task);
+
+		ev_timer_stop(EV_A_ w);
+		task->flags &= ~RSPAMD_TASK_FLAG_MESSAGE_PENDING;
+		task->flags |= RSPAMD_TASK_FLAG_SKIP;
+
+		if (task->err == NULL) {
+			g_set_error(&task->err, rspamd_task_quark(), RSPAMD_NETWORK_ERROR,
+						"timeout while receiving message");
+		}
+
+		task->processed_stages |= RSPAMD_TASK_STAGE_DONE;
+		rspamd_session_cleanup(task->s, true);
+		rspamd_session_pending(task->s);
+	}
+	else if (!(task->processed_stages & RSPAMD_TASK_STAGE_FILTERS)) {
 		ev_now_update_if_cheap(task->event_loop);
 		msg_info_task("processing of task time out: %.1fs spent; %.1fs limit; "
 					  "forced processing",
@@ -115,7 +115,9 @@ enum rspamd_task_stage {
 #define RSPAMD_TASK_FLAG_SSL (1u << 22u)
 #define RSPAMD_TASK_FLAG_BAD_UNICODE (1u << 23u)
 #define RSPAMD_TASK_FLAG_MESSAGE_REWRITE (1u << 24u)
-#define RSPAMD_TASK_FLAG_MAX_SHIFT (25u)
+/* Message body is still being received */
+#define RSPAMD_TASK_FLAG_MESSAGE_PENDING (1u << 26u)
+#define RSPAMD_TASK_FLAG_MAX_SHIFT (26u)
 
 /* Request has been done by a local client */
 #define RSPAMD_TASK_PROTOCOL_FLAG_LOCAL_CLIENT (1u << 1u)
@@ -263,6 +265,19 @@ gboolean rspamd_task_load_message(struct rspamd_task *task,
 								  struct rspamd_http_message *msg,
 								  const char *start, gsize len);
 
+/**
+ * Parse headers of a message that is still being received in `msg` and run
+ * header-only prefilters for them, this is done once per task
+ * @param task
+ * @param msg
+ * @param start start of the received part of the body
+ * @param len length of the received part of the body
+ * @return TRUE if headers have been parsed
+ */
+gboolean rspamd_task_process_headers(struct rspamd_task *task,
+									 struct rspamd_http_message *msg,
+									 const char *start, gsize len);
+
 /**
  * Process task
  * @param task task to process
@@ -2744,6 +2744,21 @@ rspamd_worker_metrics_object(struct rspamd_config *cfg, struct rspamd_stat *stat
 	ucl_object_insert_key(top,
 						  ucl_object_fromint(stat->control_connections_count),
 						  "control_connections", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->words_cache_hits),
+						  "words_cache_hits", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->words_cache_misses),
+						  "words_cache_misses", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_ascii),
+						  "charset_detect_ascii", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_utf8),
+						  "charset_detect_utf8", 0, false);
+	ucl_object_insert_key(top,
+						  ucl_object_fromint(stat->charset_detect_ced),
+						  "charset_detect_ced", 0, false);
 
 	ucl_object_insert_key(top,
 						  ucl_object_fromint(mem_st.pools_allocated), "pools_allocated", 0,
@@ -2834,6 +2849,31 @@ rspamd_metrics_to_prometheus_string(const ucl_object_t *top)
 							   "gauge",
 							   "Control connections.",
 							   "control_connections");
+	rspamd_metrics_add_integer(&output, top,
+							   "rspamd_words_cache_hits_total",
+							   "counter",
+							   "Normalised and stemmed words cache hits.",
+							   "words_cache_hits");
+	rspamd_metrics_add_integer(&output, top,
+							   "rspamd_words_cache_misses_total",
+							   "counter",
+							   "Normalised and stemmed words cache misses.",
+							   "words_cache_misses");
+	rspamd_metrics_add_integer(&output, top,
+							   "rspamd_charset_detect_ascii_total",
+							   "counter",
+							   "Charsets detected as 7 bit without CED.",
+							   "charset_detect_ascii");
+	rspamd_metrics_add_integer(&output, top,
+							   "rspamd_charset_detect_utf8_total",
+							   "counter",
+							   "Charsets detected as valid UTF-8 without CED.",
+							   "charset_detect_utf8");
+	rspamd_metrics_add_integer(&output, top,
+							   "rspamd_charset_detect_ced_total",
+							   "counter",
+							   "Charsets detected by CED.",
+							   "charset_detect_ced");
 	rspamd_metrics_add_integer(&output, top,
 							   "rspamd_pools_allocated",
 							   "gauge",
@@ -115,6 +115,7 @@ struct rspamd_stat_backend {
 	void rspamd_##name##_close(gpointer ctx)
 
 RSPAMD_STAT_BACKEND_DEF(mmaped_file);
+RSPAMD_STAT_BACKEND_DEF(shared_mmap);
 RSPAMD_STAT_BACKEND_DEF(sqlite3);
 RSPAMD_STAT_BACKEND_DEF(cdb);
 RSPAMD_STAT_BACKEND_DEF(redis);
@@ -16,6 +16,11 @@
 
 /*
  * CDB read only statistics backend
+ *
+ * Snapshots are built by `rspamadm statistics_dump snapshot`: tokens are
+ * 8 bytes keys with counters for all classes listed in the `_labels` key,
+ * stored either as floats or as quantized 16 bit numbers. When a snapshot is
+ * replaced on disk, workers remap it and reload the learns counters.
  */
 
 #include "config.h"
@@ -26,10 +31,15 @@
 #include <memory>
 #include <string>
 #include <optional>
+#include <string_view>
+#include <cmath>
 #include "contrib/expected/expected.hpp"
 #include "contrib/ankerl/unordered_dense.h"
 #include "contrib/fmt/include/fmt/base.h"
 
+/* How often to check if a snapshot has been replaced on disk */
+#define CDB_SNAPSHOT_CHECK_TIME 10.0
+
 namespace rspamd::stat::cdb {
 
 /*
@@ -58,6 +68,7 @@ public:
 	{
 		auto ret = cdb_element_t(new struct cdb, cdb_deleter());
 		memset(ret.get(), 0, sizeof(struct cdb));
+		ret->cdb_fd = -1;
 		return ret;
 	}
 	/* Enclose cdb into storage */
@@ -97,6 +108,12 @@ private:
 		void operator()(struct cdb *c) const
 		{
 			cdb_free(c);
+
+			if (c->cdb_fd != -1) {
+				close(c->cdb_fd);
+			}
+
+			g_free(c->filename);
 			delete c;
 		}
 	};
@@ -121,8 +138,13 @@ public:
 		std::swap(st, other.st);
 		std::swap(db, other.db);
 		std::swap(loaded, other.loaded);
-		std::swap(learns_spam, other.learns_spam);
-		std::swap(learns_ham, other.learns_ham);
+		std::swap(learns, other.learns);
+		std::swap(class_idx, other.class_idx);
+		std::swap(nclasses, other.nclasses);
+		std::swap(snapshot_mem, other.snapshot_mem);
+		std::swap(snapshot_size, other.snapshot_size);
+		std::swap(snapshot_mtime, other.snapshot_mtime);
+		std::swap(snapshot_ino, other.snapshot_ino);
 
 		return *this;
 	}
@@ -131,33 +153,82 @@ public:
 	}
 
 	auto load_cdb() -> tl::expected<bool, std::string>;
-	auto process_token(const rspamd_token_t *tok) const -> std::optional<float>;
-	constexpr auto is_spam() const -> bool
-	{
-		return st->stcf->is_spam;
-	}
-	auto get_learns() const -> std::uint64_t
-	{
-		if (is_spam()) {
-			return learns_spam;
-		}
-		else {
-			return learns_ham;
-		}
-	}
-	auto get_total_learns() const -> std::uint64_t
+	auto process_token(const rspamd_token_t *tok) -> std::optional<float>;
+	auto get_learns() -> std::uint64_t
 	{
-		return learns_spam + learns_ham;
+		maybe_reload();
+
+		return learns;
 	}
 
 private:
 	struct rspamd_statfile *st;
 	cdb_shared_storage::cdb_element_t db;
 	bool loaded = false;
-	std::uint64_t learns_spam = 0;
-	std::uint64_t learns_ham = 0;
+	std::uint64_t learns = 0;
+	/* Position of this statfile counter in the values stored */
+	unsigned int class_idx = 0;
+	unsigned int nclasses = 0;
+	/*
+	 * Identity of the snapshot loaded, cdb is remapped when replaced on disk;
+	 * snapshots are renamed into place, so the inode changes even if the new
+	 * file has the same size and mtime and is mapped at the same address
+	 */
+	const unsigned char *snapshot_mem = nullptr;
+	unsigned int snapshot_size = 0;
+	time_t snapshot_mtime = 0;
+	ino_t snapshot_ino = 0;
+
+	auto maybe_reload() -> void;
 };
 
+/*
+ * Quantized snapshots store counts as 16 bit numbers: values below 0x8000 are
+ * exact, larger ones keep 11 significant bits as (1024 + mantissa) << exponent
+ */
+static inline auto
+cdb_dequantize(std::uint16_t q) -> float
+{
+	if (q & 0x8000u) {
+		auto exponent = (q >> 10) & 0x1fu;
+		auto mantissa = q & 0x3ffu;
+
+		return std::ldexp((float) (1024u + mantissa), exponent);
+	}
+
+	return (float) q;
+}
+
+/*
+ * Returns the label used for the statfile in snapshots, the same as the
+ * field name used for the statfile in redis
+ */
+static auto
+cdb_class_label(const struct rspamd_statfile_config *stcf) -> std::string_view
+{
+	if (stcf->clcf && stcf->class_name) {
+		const auto *label = rspamd_config_get_class_label(stcf->clcf, stcf->class_name);
+
+		if (label) {
+			return label;
+		}
+	}
+
+	if (stcf->class_name) {
+		if (strcmp(stcf->class_name, "spam") == 0) {
+			return "S";
+		}
+		if (strcmp(stcf->class_name, "ham") == 0) {
+			return "H";
+		}
+		if (!stcf->is_spam_converted) {
+			return stcf->class_name;
+		}
+	}
+
+	return stcf->is_spam ? "S" : "H";
+}
+
 template<typename T>
 static inline auto
 cdb_get_key_as_int64(struct cdb *cdb, T key) -> std::optional<std::int64_t>
@@ -179,68 +250,101 @@ cdb_get_key_as_int64(struct cdb *cdb, T key) -> std::optional<std::int64_t>
 	return std::nullopt;
 }
 
-template<typename T>
 static inline auto
-cdb_get_key_as_float_pair(struct cdb *cdb, T key) -> std::optional<std::pair<float, float>>
+cdb_get_key_as_string(struct cdb *cdb, std::string_view key) -> std::optional<std::string_view>
 {
-	auto pos = cdb_find(cdb, (void *) &key, sizeof(key));
+	auto pos = cdb_find(cdb, (void *) key.data(), key.size());
 
 	if (pos > 0) {
-		auto vpos = cdb_datapos(cdb);
-		auto vlen = cdb_datalen(cdb);
+		const auto *data = cdb_getdata(cdb);
 
-		if (vlen == sizeof(float) * 2) {
-			union {
-				struct {
-					float v1;
-					float v2;
-				} d;
-				char c[sizeof(float) * 2];
-			} u;
-			cdb_read(cdb, (void *) u.c, vlen, vpos);
-
-			return std::make_pair(u.d.v1, u.d.v2);
+		if (data) {
+			return std::string_view{(const char *) data, cdb_datalen(cdb)};
 		}
 	}
 
 	return std::nullopt;
 }
 
-
 auto ro_backend::load_cdb() -> tl::expected<bool, std::string>
 {
 	if (!db) {
 		return tl::make_unexpected("no database loaded");
 	}
 
+	loaded = false;
+	snapshot_mem = db->cdb_mem;
+	snapshot_size = db->cdb_fsize;
+	snapshot_mtime = db->mtime;
+	snapshot_ino = db->ino;
+
+	if (!db->cdb_mem) {
+		return tl::make_unexpected("no database loaded");
+	}
+
 	/* Now get number of learns */
 	std::int64_t cdb_key;
 	static const char learn_spam_key[9] = "_lrnspam", learn_ham_key[9] = "_lrnham_";
 
-	auto check_key = [&](const char *key, std::uint64_t &target) -> tl::expected<bool, std::string> {
-		memcpy((void *) &cdb_key, key, sizeof(cdb_key));
+	memcpy((void *) &cdb_key, learn_spam_key, sizeof(cdb_key));
 
+	if (cdb_get_key_as_int64(db.get(), cdb_key)) {
+		/* Legacy binary layout: spam and ham counts as a pair of floats */
+		const auto *key = st->stcf->is_spam ? learn_spam_key : learn_ham_key;
+
+		memcpy((void *) &cdb_key, key, sizeof(cdb_key));
 		auto maybe_value = cdb_get_key_as_int64(db.get(), cdb_key);
 
 		if (!maybe_value) {
 			return tl::make_unexpected(fmt::format("missing {} key", key));
 		}
 
-		target = (std::uint64_t) maybe_value.value();
+		learns = (std::uint64_t) maybe_value.value();
+		class_idx = st->stcf->is_spam ? 0 : 1;
+		nclasses = 2;
+	}
+	else {
+		/* Snapshot layout: `_labels` lists classes in order of the counters */
+		auto maybe_labels = cdb_get_key_as_string(db.get(), "_labels");
 
-		return true;
-	};
+		if (!maybe_labels) {
+			return tl::make_unexpected("missing _labels and _lrnspam keys");
+		}
 
-	auto res = check_key(learn_spam_key, learns_spam);
+		auto label = cdb_class_label(st->stcf);
+		auto labels = maybe_labels.value();
+		bool found = false;
 
-	if (!res) {
-		return res;
-	}
+		nclasses = 0;
 
-	res = check_key(learn_ham_key, learns_ham);
+		while (!labels.empty()) {
+			auto sep = labels.find(',');
+			auto cur = labels.substr(0, sep);
 
-	if (!res) {
-		return res;
+			if (cur == label) {
+				class_idx = nclasses;
+				found = true;
+			}
+
+			nclasses++;
+			labels = sep == std::string_view::npos ? std::string_view{} : labels.substr(sep + 1);
+		}
+
+		if (!found) {
+			return tl::make_unexpected(fmt::format("class {} is not in the snapshot",
+												   label));
+		}
+
+		auto learns_key = fmt::format("_lrn{:<4}", label);
+		auto maybe_learns = cdb_get_key_as_string(db.get(), learns_key);
+
+		if (!maybe_learns || maybe_learns->size() != sizeof(std::int64_t)) {
+			return tl::make_unexpected(fmt::format("missing {} key", learns_key));
+		}
+
+		std::int64_t nlearns;
+		memcpy(&nlearns, maybe_learns->data(), sizeof(nlearns));
+		learns = (std::uint64_t) nlearns;
 	}
 
 	loaded = true;
@@ -248,29 +352,60 @@ auto ro_backend::load_cdb() -> tl::expected<bool, std::string>
 	return true;// expected
 }
 
-auto ro_backend::process_token(const rspamd_token_t *tok) const -> std::optional<float>
+auto ro_backend::maybe_reload() -> void
 {
+	if (db->cdb_mem != snapshot_mem || db->cdb_fsize != snapshot_size ||
+		db->mtime != snapshot_mtime || db->ino != snapshot_ino) {
+		/* Snapshot has been replaced on disk and remapped */
+		auto res = load_cdb();
+
+		if (!res) {
+			msg_err("cannot reload cdb snapshot %s: %s", db->filename,
+					res.error().c_str());
+		}
+		else {
+			msg_info("reloaded cdb snapshot %s for %s: %L learns", db->filename,
+					 st->stcf->symbol, (int64_t) learns);
+		}
+	}
+}
+
+auto ro_backend::process_token(const rspamd_token_t *tok) -> std::optional<float>
+{
+	maybe_reload();
+
 	if (!loaded) {
 		return std::nullopt;
 	}
 
-	auto maybe_value = cdb_get_key_as_float_pair(db.get(), tok->data);
+	auto pos = cdb_find(db.get(), (void *) &tok->data, sizeof(tok->data));
 
-	if (maybe_value) {
-		auto [spam_count, ham_count] = maybe_value.value();
+	if (pos > 0) {
+		const auto *data = (const unsigned char *) cdb_getdata(db.get());
+		auto vlen = cdb_datalen(db.get());
 
-		if (is_spam()) {
-			return spam_count;
+		if (data == nullptr) {
+			return std::nullopt;
 		}
-		else {
-			return ham_count;
+
+		if (vlen == sizeof(float) * nclasses) {
+			float value;
+			memcpy(&value, data + sizeof(float) * class_idx, sizeof(value));
+
+			return value;
+		}
+		else if (vlen == sizeof(std::uint16_t) * nclasses) {
+			std::uint16_t value;
+			memcpy(&value, data + sizeof(std::uint16_t) * class_idx, sizeof(value));
+
+			return cdb_dequantize(value);
 		}
 	}
 
 	return std::nullopt;
 }
 
-auto open_cdb(struct rspamd_statfile *st) -> tl::expected<ro_backend, std::string>
+auto open_cdb(struct rspamd_statfile *st, struct ev_loop *event_loop) -> tl::expected<ro_backend, std::string>
 {
 	const char *path = nullptr;
 	const auto *stf = st->stcf;
@@ -327,9 +462,14 @@ auto open_cdb(struct rspamd_statfile *st) -> tl::expected<ro_backend, std::strin
 												   path, strerror(errno)));
 		}
 
-		cdbp = cdb_shared_storage.push_cdb(path, cdbp);
+		/* Keep fd open: cdb owns it and reopens the file when it is replaced */
+		cdbp->filename = g_strdup(path);
+
+		if (event_loop) {
+			cdb_add_timer(cdbp.get(), event_loop, CDB_SNAPSHOT_CHECK_TIME);
+		}
 
-		close(fd);
+		cdbp = cdb_shared_storage.push_cdb(path, cdbp);
 	}
 	else {
 		cdbp = cached_cdb_maybe.value();
@@ -361,7 +501,7 @@ rspamd_cdb_init(struct rspamd_stat_ctx *ctx,
 				struct rspamd_config *cfg,
 				struct rspamd_statfile *st)
 {
-	auto maybe_backend = rspamd::stat::cdb::open_cdb(st);
+	auto maybe_backend = rspamd::stat::cdb::open_cdb(st, ctx->event_loop);
 
 	if (maybe_backend) {
 		/* Move into a new pointer */
@@ -441,7 +581,7 @@ gulong rspamd_cdb_total_learns(struct rspamd_task *task,
 							   gpointer ctx)
 {
 	auto *cdbp = CDB_FROM_RAW(ctx);
-	return cdbp->get_total_learns();
+	return cdbp->get_learns();
 }
 gulong
 rspamd_cdb_inc_learns(struct rspamd_task *task,
@@ -22,10 +22,14 @@
 #include "stat_internal.h"
 #include "upstream.h"
 #include "libserver/mempool_vars_internal.h"
+#include "libcryptobox/cryptobox.h"
+#include "redis_token_cache.hxx"
+#include "redis_learn_batch.hxx"
 #include "contrib/fmt/include/fmt/base.h"
 
 #include "libutil/cxx/error.hxx"
 #include <map>
+#include <unordered_map>
 
 #include <string>
 #include <cstdint>
@@ -47,6 +51,13 @@ INIT_LOG_MODULE(stat_redis)
 #define REDIS_DEFAULT_TIMEOUT 0.5
 #define REDIS_STAT_TIMEOUT 30
 #define REDIS_MAX_USERS 1000
+#define REDIS_DEFAULT_TOKEN_CACHE_TTL 60
+#define REDIS_LEARNS_CACHE_SIZE 1024
+#define REDIS_DEFAULT_LEARN_BATCH_SIZE 10000
+#define REDIS_LEARN_BATCH_DRAIN_TIMEOUT 5.0
+
+struct redis_stat_ctx;
+static void rspamd_redis_learn_batch_drain(struct redis_stat_ctx *ctx);
 
 struct redis_stat_ctx {
 	lua_State *L;
@@ -59,9 +70,26 @@ struct redis_stat_ctx {
 
 	int cbref_classify = -1;
 	int cbref_learn = -1;
+	int cbref_learn_batch = -1;
+	const char *cookie = nullptr;
 
 	ucl_object_t *cur_stat = nullptr;
 
+	rspamd_lru_hash_t *token_cache = nullptr;
+	rspamd_lru_hash_t *learns_cache = nullptr;
+	unsigned int token_cache_ttl = REDIS_DEFAULT_TOKEN_CACHE_TTL;
+	std::uint64_t token_cache_hits = 0;
+	std::uint64_t token_cache_misses = 0;
+
+	/* Learns are coalesced when learn_batch_timeout is set */
+	struct ev_loop *event_loop = nullptr;
+	ev_timer learn_batch_ev;
+	double learn_batch_timeout = 0.0;
+	unsigned int learn_batch_size = REDIS_DEFAULT_LEARN_BATCH_SIZE;
+	std::uint64_t learn_batch_id = 0;
+	std::map<std::string, std::unique_ptr<redis_learn_batch>> learn_batches;
+	std::map<std::uint64_t, std::unique_ptr<redis_learn_batch>> learn_batches_inflight;
+
 	explicit redis_stat_ctx(lua_State *_L)
 		: L(_L)
 	{
@@ -69,6 +97,10 @@ struct redis_stat_ctx {
 
 	~redis_stat_ctx()
 	{
+		if (cbref_learn_batch != -1) {
+			rspamd_redis_learn_batch_drain(this);
+		}
+
 		if (cbref_user != -1) {
 			luaL_unref(L, LUA_REGISTRYINDEX, cbref_user);
 		}
@@ -80,6 +112,18 @@ struct redis_stat_ctx {
 		if (cbref_learn != -1) {
 			luaL_unref(L, LUA_REGISTRYINDEX, cbref_learn);
 		}
+
+		if (cbref_learn_batch != -1) {
+			luaL_unref(L, LUA_REGISTRYINDEX, cbref_learn_batch);
+		}
+
+		if (token_cache) {
+			rspamd_lru_hash_destroy(token_cache);
+		}
+
+		if (learns_cache) {
+			rspamd_lru_hash_destroy(learns_cache);
+		}
 	}
 };
 
@@ -96,6 +140,12 @@ struct redis_stat_runtime {
 	std::vector<std::pair<int, T>> *results = nullptr;
 	bool need_redis_call = true;
 	std::optional<rspamd::util::error> err;
+	/* Token cache state of the runtime that calls redis */
+	bool use_token_cache = false;
+	std::uint64_t obj_hash = 0;
+	std::vector<const char *> class_labels;
+	std::vector<int> sent_tokens;
+	std::vector<std::vector<std::pair<int, T>>> cached_results;
 
 	using result_type = std::vector<std::pair<int, T>>;
 
@@ -574,8 +624,39 @@ rspamd_redis_parse_classifier_opts(struct redis_stat_ctx *backend,
 	else {
 		backend->enable_signatures = FALSE;
 	}
+
+	elt = ucl_object_lookup(classifier_obj, "token_cache_size");
+	if (elt && ucl_object_toint(elt) > 0) {
+		auto cache_size = ucl_object_toint(elt);
+
+		backend->token_cache = redis_token_cache_new(cache_size);
+		backend->learns_cache = redis_token_cache_new(REDIS_LEARNS_CACHE_SIZE);
+
+		elt = ucl_object_lookup(classifier_obj, "token_cache_ttl");
+		if (elt && ucl_object_todouble(elt) > 0) {
+			backend->token_cache_ttl = ucl_object_todouble(elt);
+		}
+
+		msg_debug_bayes_cfg("enabled token cache: %L elements, %ud seconds ttl",
+							cache_size, backend->token_cache_ttl);
+	}
+
+	elt = ucl_object_lookup(classifier_obj, "learn_batch_timeout");
+	if (elt && ucl_object_todouble(elt) > 0) {
+		backend->learn_batch_timeout = ucl_object_todouble(elt);
+
+		elt = ucl_object_lookup(classifier_obj, "learn_batch_size");
+		if (elt && ucl_object_toint(elt) > 0) {
+			backend->learn_batch_size = ucl_object_toint(elt);
+		}
+
+		msg_debug_bayes_cfg("enabled learn batching: %.2f seconds, %ud tokens",
+							backend->learn_batch_timeout, backend->learn_batch_size);
+	}
 }
 
+static void rspamd_redis_learn_batch_timer_cb(EV_P_ ev_timer *w, int revents);
+
 gpointer
 rspamd_redis_init(struct rspamd_stat_ctx *ctx,
 				  struct rspamd_config *cfg, struct rspamd_statfile *st)
@@ -622,11 +703,12 @@ rspamd_redis_init(struct rspamd_stat_ctx *ctx,
 	rspamd_random_hex(cookie, 16);
 	cookie[15] = '\0';
 	rspamd_mempool_set_variable(cfg->cfg_pool, cookie, backend.get(), nullptr);
+	backend->cookie = cookie;
 	/* Callback + 1 upvalue */
 	lua_pushstring(L, cookie);
 	lua_pushcclosure(L, &rspamd_redis_stat_cb, 1);
 
-	if (lua_pcall(L, 6, 2, err_idx) != 0) {
+	if (lua_pcall(L, 6, 3, err_idx) != 0) {
 		msg_err("call to lua_bayes_init_classifier "
 				"script failed: %s",
 				lua_tostring(L, -1));
@@ -636,16 +718,27 @@ rspamd_redis_init(struct rspamd_stat_ctx *ctx,
 	}
 
 	/* Results are in the stack:
-	 * top - 1 - classifier function (idx = -2)
-	 * top - learn function (idx = -1)
+	 * top - 2 - classifier function (idx = -3)
+	 * top - 1 - learn function (idx = -2)
+	 * top - batched learn function or nil (idx = -1)
 	 */
 
-	lua_pushvalue(L, -2);
+	lua_pushvalue(L, -3);
 	backend->cbref_classify = luaL_ref(L, LUA_REGISTRYINDEX);
 
-	lua_pushvalue(L, -1);
+	lua_pushvalue(L, -2);
 	backend->cbref_learn = luaL_ref(L, LUA_REGISTRYINDEX);
 
+	if (backend->learn_batch_timeout > 0 && ctx->event_loop &&
+		lua_type(L, -1) == LUA_TFUNCTION) {
+		lua_pushvalue(L, -1);
+		backend->cbref_learn_batch = luaL_ref(L, LUA_REGISTRYINDEX);
+		backend->event_loop = ctx->event_loop;
+		ev_timer_init(&backend->learn_batch_ev, rspamd_redis_learn_batch_timer_cb,
+					  backend->learn_batch_timeout, 0.0);
+		backend->learn_batch_ev.data = backend.get();
+	}
+
 	lua_settop(L, err_idx - 1);
 
 	return backend.release();
@@ -918,6 +1011,278 @@ rspamd_redis_serialize_text_tokens(struct rspamd_task *task, GPtrArray *tokens,
 	return buf;
 }
 
+/*
+ * Class labels in the order used by the classify script (nullptr for classes
+ * with no label)
+ */
+static auto
+rspamd_redis_class_labels(struct rspamd_statfile_config *stcf) -> std::vector<const char *>
+{
+	std::vector<const char *> labels;
+
+	if (stcf->clcf && stcf->clcf->class_names &&
+		stcf->clcf->class_names->len > 0) {
+		/* Multi-class: deterministic class_names order */
+		labels.reserve(stcf->clcf->class_names->len);
+
+		for (unsigned int i = 0; i < stcf->clcf->class_names->len; i++) {
+			const char *class_name = (const char *) g_ptr_array_index(stcf->clcf->class_names, i);
+			const char *class_label = nullptr;
+
+			/* Find the class label for this class name from any statfile with this class */
+			GList *cur = stcf->clcf->statfiles;
+			while (cur) {
+				auto *sf = (struct rspamd_statfile_config *) cur->data;
+				if (sf->class_name && strcmp(sf->class_name, class_name) == 0) {
+					class_label = get_class_label(sf);
+					break;
+				}
+				cur = g_list_next(cur);
+			}
+
+			labels.push_back(class_label);
+		}
+	}
+	else if (stcf->clcf && stcf->clcf->statfiles) {
+		/* Binary classification: statfiles order to match parsing order */
+		GList *cur = stcf->clcf->statfiles;
+
+		while (cur) {
+			auto *sf = (struct rspamd_statfile_config *) cur->data;
+			labels.push_back(get_class_label(sf));
+			cur = g_list_next(cur);
+		}
+	}
+	else {
+		/* Fallback to the legacy order if statfiles are not available */
+		labels.push_back("H");
+		labels.push_back("S");
+	}
+
+	return labels;
+}
+
+/*
+ * Runtimes of all classes in the order of class labels
+ */
+static auto
+rspamd_redis_class_runtimes(redis_stat_runtime<float> *rt) -> std::vector<redis_stat_runtime<float> *>
+{
+	std::vector<redis_stat_runtime<float> *> res;
+
+	res.reserve(rt->class_labels.size());
+
+	for (const auto *label: rt->class_labels) {
+		redis_stat_runtime<float> *class_rt = nullptr;
+
+		if (label) {
+			auto maybe_rt = redis_stat_runtime<float>::maybe_recover_from_mempool(rt->task,
+																				  rt->redis_object_expanded,
+																				  label);
+			if (maybe_rt) {
+				class_rt = maybe_rt.value();
+			}
+		}
+
+		res.push_back(class_rt);
+	}
+
+	return res;
+}
+
+/*
+ * Calls f for redis contexts of all statfiles in the classifier
+ */
+template<typename F>
+static void
+rspamd_redis_foreach_classifier_ctx(struct rspamd_classifier_config *clcf, F &&f)
+{
+	auto *st_ctx = rspamd_stat_get_ctx();
+
+	for (unsigned int i = 0; i < st_ctx->statfiles->len; i++) {
+		auto *st = (struct rspamd_statfile *) g_ptr_array_index(st_ctx->statfiles, i);
+
+		if (st->stcf->clcf == clcf && st->bkcf != nullptr) {
+			f(REDIS_CTX(st->bkcf));
+		}
+	}
+}
+
+static void
+rspamd_redis_merge_cached_results(redis_stat_runtime<float> *rt,
+								  const std::vector<redis_stat_runtime<float> *> &class_rts)
+{
+	for (auto c = 0u; c < class_rts.size() && c < rt->cached_results.size(); c++) {
+		auto *class_rt = class_rts[c];
+
+		if (class_rt == nullptr) {
+			continue;
+		}
+
+		if (class_rt->results == nullptr) {
+			class_rt->set_results(new redis_stat_runtime<float>::result_type());
+		}
+
+		class_rt->results->insert(class_rt->results->end(),
+								  rt->cached_results[c].begin(), rt->cached_results[c].end());
+	}
+}
+
+/*
+ * Collects cached counts for all tokens; only tokens that are missing in the
+ * cache are left in `sent_tokens`. Returns true if redis is not needed at all,
+ * in this case the results are already propagated to the tokens
+ */
+static auto
+rspamd_redis_token_cache_lookup(redis_stat_runtime<float> *rt, GPtrArray *tokens) -> bool
+{
+	auto *ctx = rt->ctx;
+	auto *task = rt->task;
+	auto now = (time_t) task->task_timestamp;
+	auto nclasses = rt->class_labels.size();
+	rspamd_token_t *tok;
+	int i;
+
+	rt->use_token_cache = true;
+	rt->obj_hash = rspamd_cryptobox_fast_hash(rt->redis_object_expanded,
+											  strlen(rt->redis_object_expanded),
+											  rspamd_hash_seed());
+	rt->cached_results.assign(nclasses, {});
+	rt->sent_tokens.clear();
+
+	PTR_ARRAY_FOREACH(tokens, i, tok)
+	{
+		const auto *elt = redis_token_cache_lookup(ctx->token_cache, rt->obj_hash, tok->data, now);
+
+		if (elt && elt->counts.size() == nclasses) {
+			for (auto c = 0u; c < nclasses; c++) {
+				if (elt->counts[c] > 0) {
+					rt->cached_results[c].emplace_back(i + 1, elt->counts[c]);
+				}
+			}
+
+			ctx->token_cache_hits++;
+		}
+		else {
+			rt->sent_tokens.push_back(i);
+			ctx->token_cache_misses++;
+		}
+	}
+
+	msg_debug_bayes("token cache: found %uz of %ud tokens",
+					(gsize) tokens->len - rt->sent_tokens.size(), tokens->len);
+
+	if (!rt->sent_tokens.empty()) {
+		return false;
+	}
+
+	const auto *learns = redis_token_cache_lookup(ctx->learns_cache, rt->obj_hash, 0, now);
+
+	if (learns == nullptr || learns->counts.size() != nclasses) {
+		return false;
+	}
+
+	/* Apply cached data as if it has been received from redis */
+	auto class_rts = rspamd_redis_class_runtimes(rt);
+
+	for (auto c = 0u; c < nclasses; c++) {
+		if (class_rts[c]) {
+			class_rts[c]->learned = (std::uint64_t) learns->counts[c];
+		}
+	}
+
+	rspamd_redis_merge_cached_results(rt, class_rts);
+
+	for (auto *class_rt: class_rts) {
+		if (class_rt) {
+			class_rt->process_tokens(tokens);
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Stores counts received from redis in the cache and merges them with
+ * the cached ones; indexes of the received tokens are translated back to
+ * the original tokens array
+ */
+static void
+rspamd_redis_token_cache_update(redis_stat_runtime<float> *rt)
+{
+	auto *ctx = rt->ctx;
+	auto *task = rt->task;
+	auto now = (time_t) task->task_timestamp;
+	auto nclasses = rt->class_labels.size();
+	auto nsent = rt->sent_tokens.size();
+	auto class_rts = rspamd_redis_class_runtimes(rt);
+	std::vector<std::vector<double>> counts(nsent, std::vector<double>(nclasses, 0.0));
+	std::vector<double> learns(nclasses, 0.0);
+	bool has_learns = false;
+
+	for (auto c = 0u; c < nclasses; c++) {
+		auto *class_rt = class_rts[c];
+
+		if (class_rt == nullptr) {
+			continue;
+		}
+
+		learns[c] = class_rt->learned;
+		has_learns = has_learns || class_rt->learned > 0;
+
+		if (class_rt->results) {
+			for (auto &res: *class_rt->results) {
+				if (res.first >= 1 && (gsize) res.first <= nsent) {
+					counts[res.first - 1][c] = res.second;
+					res.first = rt->sent_tokens[res.first - 1] + 1;
+				}
+			}
+		}
+	}
+
+	/* Redis does not return token counts if nothing has been learned */
+	if (has_learns && rt->tokens) {
+		for (auto i = 0u; i < nsent; i++) {
+			auto *tok = (rspamd_token_t *) g_ptr_array_index(rt->tokens, rt->sent_tokens[i]);
+
+			redis_token_cache_insert(ctx->token_cache, rt->obj_hash, tok->data,
+									 std::move(counts[i]), now, ctx->token_cache_ttl);
+		}
+
+		redis_token_cache_insert(ctx->learns_cache, rt->obj_hash, 0,
+								 std::move(learns), now, ctx->token_cache_ttl);
+	}
+
+	rspamd_redis_merge_cached_results(rt, class_rts);
+}
+
+/*
+ * Learned tokens are removed from the caches of all statfiles in the classifier
+ */
+static void
+rspamd_redis_token_cache_invalidate(redis_stat_runtime<float> *rt, GPtrArray *tokens)
+{
+	auto obj_hash = rspamd_cryptobox_fast_hash(rt->redis_object_expanded,
+											   strlen(rt->redis_object_expanded),
+											   rspamd_hash_seed());
+
+	rspamd_redis_foreach_classifier_ctx(rt->stcf->clcf, [&](struct redis_stat_ctx *ctx) {
+		rspamd_token_t *tok;
+		int i;
+
+		if (ctx->token_cache == nullptr) {
+			return;
+		}
+
+		PTR_ARRAY_FOREACH(tokens, i, tok)
+		{
+			redis_token_cache_remove(ctx->token_cache, obj_hash, tok->data);
+		}
+
+		redis_token_cache_remove(ctx->learns_cache, obj_hash, 0);
+	});
+}
+
 static int
 rspamd_redis_classified(lua_State *L)
 {
@@ -1191,6 +1556,10 @@ rspamd_redis_classified(lua_State *L)
 		/* Clean up stack */
 		lua_pop(L, 2); /* Pop learned_counts and token_results */
 
+		if (rt->use_token_cache) {
+			rspamd_redis_token_cache_update(rt);
+		}
+
 		/* Process tokens for all runtimes */
 		g_assert(rt->tokens != nullptr);
 
@@ -1262,9 +1631,33 @@ rspamd_redis_process_tokens(struct rspamd_task *task,
 		return TRUE;
 	}
 
-	gsize tokens_len;
-	char *tokens_buf = rspamd_redis_serialize_tokens(task, rt->redis_object_expanded, tokens, &tokens_len);
 	rt->id = id;
+	rt->class_labels = rspamd_redis_class_labels(rt->stcf);
+
+	GPtrArray *query_tokens = tokens;
+
+	if (rt->ctx->token_cache) {
+		if (rspamd_redis_token_cache_lookup(rt, tokens)) {
+			/* Everything has been found in the cache */
+			rt->tokens = g_ptr_array_ref(tokens);
+
+			return TRUE;
+		}
+
+		/* Query only tokens that are missing in the cache */
+		query_tokens = g_ptr_array_sized_new(rt->sent_tokens.size());
+
+		for (auto idx: rt->sent_tokens) {
+			g_ptr_array_add(query_tokens, g_ptr_array_index(tokens, idx));
+		}
+	}
+
+	gsize tokens_len;
+	char *tokens_buf = rspamd_redis_serialize_tokens(task, rt->redis_object_expanded, query_tokens, &tokens_len);
+
+	if (query_tokens != tokens) {
+		g_ptr_array_free(query_tokens, TRUE);
+	}
 
 	lua_pushcfunction(L, &rspamd_lua_traceback);
 	int err_idx = lua_gettop(L);
@@ -1276,52 +1669,12 @@ rspamd_redis_process_tokens(struct rspamd_task *task,
 	lua_pushinteger(L, id);
 
 	/* Send all class labels for multi-class support */
-	if (rt->stcf->clcf && rt->stcf->clcf->class_names &&
-		rt->stcf->clcf->class_names->len > 0) {
-		/* Multi-class: send array of class labels in deterministic order */
-		lua_createtable(L, rt->stcf->clcf->class_names->len, 0);
-		for (unsigned int i = 0; i < rt->stcf->clcf->class_names->len; i++) {
-			const char *class_name = (const char *) g_ptr_array_index(rt->stcf->clcf->class_names, i);
-			const char *class_label = nullptr;
-
-			/* Find the class label for this class name from any statfile with this class */
-			GList *cur = rt->stcf->clcf->statfiles;
-			while (cur) {
-				auto *stcf = (struct rspamd_statfile_config *) cur->data;
-				if (stcf->class_name && strcmp(stcf->class_name, class_name) == 0) {
-					class_label = get_class_label(stcf);
-					break;
-				}
-				cur = g_list_next(cur);
-			}
-
-			if (class_label) {
-				lua_pushstring(L, class_label);
-				lua_rawseti(L, -2, i + 1); /* Lua arrays are 1-indexed */
-			}
-		}
-	}
-	else {
-		/* Binary classification: send labels in statfiles order to match parsing order */
-		if (rt->stcf->clcf && rt->stcf->clcf->statfiles) {
-			lua_createtable(L, 0, 0);
-			GList *cur = rt->stcf->clcf->statfiles;
-			int lbl_idx = 1;
+	lua_createtable(L, rt->class_labels.size(), 0);
 
-			while (cur) {
-				auto *sf = (struct rspamd_statfile_config *) cur->data;
-				lua_pushstring(L, get_class_label(sf));
-				lua_rawseti(L, -2, lbl_idx++);
-				cur = g_list_next(cur);
-			}
-		}
-		else {
-			/* Fallback to the legacy order if statfiles are not available */
-			lua_createtable(L, 2, 0);
-			lua_pushstring(L, "H"); /* ham */
-			lua_rawseti(L, -2, 1);
-			lua_pushstring(L, "S"); /* spam */
-			lua_rawseti(L, -2, 2);
+	for (auto i = 0u; i < rt->class_labels.size(); i++) {
+		if (rt->class_labels[i]) {
+			lua_pushstring(L, rt->class_labels[i]);
+			lua_rawseti(L, -2, i + 1); /* Lua arrays are 1-indexed */
 		}
 	}
 
@@ -1409,6 +1762,295 @@ rspamd_redis_learned(lua_State *L)
 	return 0;
 }
 
+static void
+rspamd_redis_learn_waiter_fin(gpointer ud)
+{
+	auto *waiter = (struct redis_learn_waiter *) ud;
+
+	/* Task is being destroyed, do not touch it when the batch is written */
+	waiter->task = nullptr;
+}
+
+static void
+rspamd_redis_learn_batch_finish(struct redis_learn_batch *batch, const char *err_msg)
+{
+	for (auto &waiter: batch->waiters) {
+		auto *task = waiter->task;
+
+		if (task == nullptr) {
+			continue;
+		}
+
+		if (err_msg) {
+			*waiter->err = rspamd::util::error(std::string{err_msg}, 500);
+			msg_err_task("cannot learn task: %s", err_msg);
+		}
+		else {
+			*waiter->err = std::nullopt;
+		}
+
+		/* Task might be finalised here */
+		rspamd_session_remove_event(task->s, rspamd_redis_learn_waiter_fin, waiter.get());
+	}
+}
+
+static int
+rspamd_redis_learned_batch(lua_State *L)
+{
+	const auto *cookie = lua_tostring(L, lua_upvalueindex(1));
+	auto batch_id = (std::uint64_t) lua_tointeger(L, lua_upvalueindex(2));
+	auto *cfg = lua_check_config(L, 1);
+	auto *backend = REDIS_CTX(rspamd_mempool_get_variable(cfg->cfg_pool, cookie));
+
+	if (backend == nullptr) {
+		msg_err("internal error: cookie %s is not found", cookie);
+
+		return 0;
+	}
+
+	auto it = backend->learn_batches_inflight.find(batch_id);
+
+	if (it == backend->learn_batches_inflight.end()) {
+		msg_err_config("internal error: learn batch %uL is not found", batch_id);
+
+		return 0;
+	}
+
+	auto batch = std::move(it->second);
+	backend->learn_batches_inflight.erase(it);
+
+	if (lua_toboolean(L, 2)) {
+		msg_debug_bayes_cfg("learned batch of %z tokens (%L learns, %z tasks) in Redis for symbol %s",
+							batch->deltas.size(), (int64_t) batch->learns.delta, batch->waiters.size(),
+							backend->stcf->symbol);
+		rspamd_redis_learn_batch_finish(batch.get(), nullptr);
+	}
+	else {
+		const char *err_msg = "unknown Redis script error";
+
+		if (lua_gettop(L) >= 3 && lua_isstring(L, 3)) {
+			err_msg = lua_tostring(L, 3);
+		}
+
+		rspamd_redis_learn_batch_finish(batch.get(), err_msg);
+	}
+
+	return 0;
+}
+
+/*
+ * Sends the accumulated deltas and floors with a single script call; tasks
+ * that have contributed to the batch wait for its result, so a failed write
+ * is reported to all of them
+ */
+static void
+rspamd_redis_learn_batch_flush(struct redis_stat_ctx *ctx,
+							   std::unique_ptr<redis_learn_batch> &&batch)
+{
+	auto *L = ctx->L;
+	std::uint32_t ntokens = 0;
+
+	for (const auto &[token, delta]: batch->deltas) {
+		if (!delta.is_noop()) {
+			ntokens++;
+		}
+	}
+
+	/* All are msgpack arrays with 32 bit length */
+	std::string tokens_buf, deltas_buf, floors_buf;
+	const auto array_hdr = [ntokens](std::string &out) {
+		out.push_back((char) 0xdd);
+		out.push_back((char) ((ntokens >> 24) & 0xff));
+		out.push_back((char) ((ntokens >> 16) & 0xff));
+		out.push_back((char) ((ntokens >> 8) & 0xff));
+		out.push_back((char) (ntokens & 0xff));
+	};
+
+	auto numbuf_len = sizeof("18446744073709551615") + batch->object.size() + 1;
+	auto *numbuf = (char *) g_alloca(numbuf_len);
+	auto *packbuf = (char *) g_alloca(msgpack_str_len(numbuf_len));
+
+	tokens_buf.reserve(5 + ntokens * msgpack_str_len(numbuf_len));
+	deltas_buf.reserve(5 + ntokens * (1 + sizeof(std::uint64_t)));
+	floors_buf.reserve(5 + ntokens * (1 + sizeof(std::uint64_t)));
+	array_hdr(tokens_buf);
+	array_hdr(deltas_buf);
+	array_hdr(floors_buf);
+
+	/* int64 */
+	const auto emit_int = [](std::string &out, std::int64_t v) {
+		auto be = GUINT64_TO_BE((std::uint64_t) v);
+		out.push_back((char) 0xd3);
+		out.append((const char *) &be, sizeof(be));
+	};
+
+	for (const auto &[token, delta]: batch->deltas) {
+		if (delta.is_noop()) {
+			continue;
+		}
+
+		std::size_t r = rspamd_snprintf(numbuf, numbuf_len, "%s_%uL",
+										batch->object.c_str(), token);
+		tokens_buf.append(packbuf, msgpack_emit_str({numbuf, r}, packbuf));
+
+		emit_int(deltas_buf, delta.delta);
+		emit_int(floors_buf, delta.floor);
+	}
+
+	auto batch_id = ++ctx->learn_batch_id;
+
+	lua_pushcfunction(L, &rspamd_lua_traceback);
+	int err_idx = lua_gettop(L);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->cbref_learn_batch);
+	lua_pushstring(L, batch->object.c_str());
+	lua_pushstring(L, get_class_label(ctx->stcf));
+	lua_pushstring(L, ctx->stcf->symbol);
+	lua_pushinteger(L, batch->learns.delta);
+	lua_pushinteger(L, batch->learns.floor);
+	lua_pushlstring(L, tokens_buf.data(), tokens_buf.size());
+	lua_pushlstring(L, deltas_buf.data(), deltas_buf.size());
+	lua_pushlstring(L, floors_buf.data(), floors_buf.size());
+	/* Callback + 2 upvalues */
+	lua_pushstring(L, ctx->cookie);
+	lua_pushinteger(L, batch_id);
+	lua_pushcclosure(L, &rspamd_redis_learned_batch, 2);
+
+	auto *pbatch = batch.get();
+	ctx->learn_batches_inflight.emplace(batch_id, std::move(batch));
+
+	if (lua_pcall(L, 9, 0, err_idx) != 0) {
+		auto *err_msg = lua_tostring(L, -1);
+
+		msg_err("call to learn batch script failed: %s", err_msg);
+
+		auto it = ctx->learn_batches_inflight.find(batch_id);
+
+		if (it != ctx->learn_batches_inflight.end() && it->second.get() == pbatch) {
+			auto failed = std::move(it->second);
+			ctx->learn_batches_inflight.erase(it);
+			rspamd_redis_learn_batch_finish(failed.get(), err_msg);
+		}
+	}
+
+	lua_settop(L, err_idx - 1);
+}
+
+static void
+rspamd_redis_learn_batch_timer_cb(EV_P_ ev_timer *w, int revents)
+{
+	auto *ctx = REDIS_CTX(w->data);
+	auto batches = std::move(ctx->learn_batches);
+
+	ctx->learn_batches.clear();
+
+	for (auto &[object, batch]: batches) {
+		rspamd_redis_learn_batch_flush(ctx, std::move(batch));
+	}
+}
+
+static void
+rspamd_redis_learn_batch_drain_timeout_cb(EV_P_ ev_timer *w, int revents)
+{
+	*((bool *) w->data) = true;
+}
+
+/*
+ * Writes pending batches on shutdown and waits for the inflight ones for a
+ * limited time, so learns already accepted are not lost
+ */
+static void
+rspamd_redis_learn_batch_drain(struct redis_stat_ctx *ctx)
+{
+	if (ctx->event_loop == nullptr) {
+		return;
+	}
+
+	ev_timer_stop(ctx->event_loop, &ctx->learn_batch_ev);
+
+	auto batches = std::move(ctx->learn_batches);
+	ctx->learn_batches.clear();
+
+	for (auto &[object, batch]: batches) {
+		rspamd_redis_learn_batch_flush(ctx, std::move(batch));
+	}
+
+	if (!ctx->learn_batches_inflight.empty()) {
+		ev_timer deadline;
+		bool expired = false;
+
+		ev_timer_init(&deadline, rspamd_redis_learn_batch_drain_timeout_cb,
+					  REDIS_LEARN_BATCH_DRAIN_TIMEOUT, 0.0);
+		deadline.data = &expired;
+		ev_timer_start(ctx->event_loop, &deadline);
+
+		while (!ctx->learn_batches_inflight.empty() && !expired) {
+			ev_run(ctx->event_loop, EVRUN_ONCE);
+		}
+
+		ev_timer_stop(ctx->event_loop, &deadline);
+	}
+
+	for (auto &[batch_id, batch]: ctx->learn_batches_inflight) {
+		msg_err("learn batch of %z tokens for symbol %s has not been written on shutdown",
+				batch->deltas.size(), ctx->stcf->symbol);
+		rspamd_redis_learn_batch_finish(batch.get(), "learn batch has not been written on shutdown");
+	}
+
+	ctx->learn_batches_inflight.clear();
+}
+
+static gboolean
+rspamd_redis_learn_tokens_batched(struct rspamd_task *task,
+								  struct redis_stat_runtime<float> *rt,
+								  GPtrArray *tokens,
+								  int id)
+{
+	auto *ctx = rt->ctx;
+	auto &batch = ctx->learn_batches[rt->redis_object_expanded];
+
+	if (!batch) {
+		batch = std::make_unique<redis_learn_batch>();
+		batch->object = rt->redis_object_expanded;
+	}
+
+	/* Detect unlearn */
+	auto *first_tok = (rspamd_token_t *) g_ptr_array_index(task->tokens, 0);
+	std::int64_t delta = first_tok->values[id] > 0 ? 1 : -1;
+	rspamd_token_t *tok;
+	unsigned int i;
+
+	PTR_ARRAY_FOREACH(tokens, i, tok)
+	{
+		batch->deltas[tok->data].add(delta);
+	}
+
+	batch->learns.add(delta);
+
+	auto *waiter = new redis_learn_waiter{task, &rt->err};
+	batch->waiters.emplace_back(waiter);
+	rspamd_session_add_event(task->s, rspamd_redis_learn_waiter_fin, waiter, M);
+
+	msg_debug_bayes("added %d tokens to learn batch for %s (%z tokens pending)",
+					(int) tokens->len, rt->stcf->symbol, batch->deltas.size());
+
+	if (batch->deltas.size() >= ctx->learn_batch_size) {
+		/*
+		 * Flush from the event loop rather than here: a failed write finishes
+		 * the waiting tasks, and this one is still in its learn stage
+		 */
+		ev_timer_stop(ctx->event_loop, &ctx->learn_batch_ev);
+		ev_timer_set(&ctx->learn_batch_ev, 0.0, 0.0);
+		ev_timer_start(ctx->event_loop, &ctx->learn_batch_ev);
+	}
+	else if (!ev_is_active(&ctx->learn_batch_ev)) {
+		ev_timer_set(&ctx->learn_batch_ev, ctx->learn_batch_timeout, 0.0);
+		ev_timer_start(ctx->event_loop, &ctx->learn_batch_ev);
+	}
+
+	return TRUE;
+}
+
 gboolean
 rspamd_redis_learn_tokens(struct rspamd_task *task,
 						  GPtrArray *tokens,
@@ -1425,11 +2067,21 @@ rspamd_redis_learn_tokens(struct rspamd_task *task,
 		return FALSE;
 	}
 
+	rt->id = id;
+
+	if (rt->ctx->token_cache) {
+		rspamd_redis_token_cache_invalidate(rt, tokens);
+	}
+
+	if (rt->ctx->cbref_learn_batch != -1 && !rt->ctx->store_tokens) {
+		rt->tokens = g_ptr_array_ref(tokens);
+
+		return rspamd_redis_learn_tokens_batched(task, rt, tokens, id);
+	}
+
 	gsize tokens_len;
 	char *tokens_buf = rspamd_redis_serialize_tokens(task, rt->redis_object_expanded, tokens, &tokens_len);
 
-	rt->id = id;
-
 	gsize text_tokens_len = 0;
 	char *text_tokens_buf = nullptr;
 
@@ -1548,6 +2200,23 @@ rspamd_redis_get_stat(gpointer runtime,
 {
 	auto *rt = REDIS_RUNTIME(runtime);
 
+	if (rt->ctx->cur_stat && rt->ctx->token_cache) {
+		std::uint64_t hits = 0, misses = 0;
+
+		rspamd_redis_foreach_classifier_ctx(rt->stcf->clcf, [&](struct redis_stat_ctx *ctx) {
+			hits += ctx->token_cache_hits;
+			misses += ctx->token_cache_misses;
+		});
+
+		ucl_object_replace_key(rt->ctx->cur_stat, ucl_object_fromint(hits),
+							   "token_cache_hits", 0, false);
+		ucl_object_replace_key(rt->ctx->cur_stat, ucl_object_fromint(misses),
+							   "token_cache_misses", 0, false);
+		ucl_object_replace_key(rt->ctx->cur_stat,
+							   ucl_object_fromint(rspamd_lru_hash_size(rt->ctx->token_cache)),
+							   "token_cache_size", 0, false);
+	}
+
 	return ucl_object_ref(rt->ctx->cur_stat);
 }
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef RSPAMD_REDIS_LEARN_BATCH_HXX
+#define RSPAMD_REDIS_LEARN_BATCH_HXX
+
+#pragma once
+
+#include "config.h"
+#include "libutil/cxx/error.hxx"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct rspamd_task;
+
+/*
+ * Learn and unlearn never take a counter below zero: each of them is
+ * x -> max(x + d, 0). A sequence of such updates is x -> max(x + delta, floor)
+ * for a non-negative x, so the batch keeps both values and the script
+ * gives the same result as the updates applied one by one
+ */
+struct redis_learn_delta {
+	std::int64_t delta = 0;
+	std::int64_t floor = 0;
+
+	void add(std::int64_t d)
+	{
+		delta += d;
+		floor = std::max<std::int64_t>(floor + d, 0);
+	}
+
+	auto apply(std::int64_t x) const -> std::int64_t
+	{
+		return std::max(x + delta, floor);
+	}
+
+	auto is_noop() const -> bool
+	{
+		return delta == 0 && floor == 0;
+	}
+};
+
+/* Learn of a single task waiting for its batch to be written */
+struct redis_learn_waiter {
+	struct rspamd_task *task;
+	std::optional<rspamd::util::error> *err;
+};
+
+/* Token deltas accumulated for a single redis object (e.g. a per user prefix) */
+struct redis_learn_batch {
+	std::string object;
+	redis_learn_delta learns;
+	std::unordered_map<std::uint64_t, redis_learn_delta> deltas;
+	std::vector<std::unique_ptr<redis_learn_waiter>> waiters;
+};
+
+#endif
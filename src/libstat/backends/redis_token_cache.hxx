@@ -0,0 +1,101 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef RSPAMD_REDIS_TOKEN_CACHE_HXX
+#define RSPAMD_REDIS_TOKEN_CACHE_HXX
+
+#pragma once
+
+#include "config.h"
+#include "libutil/hash.h"
+#include "libcryptobox/cryptobox.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+ * Per-worker cache of token counts: the key is a pair of the expanded redis
+ * object hash and the token, the value has counts for all classes in the
+ * same order as class labels sent to the classify script
+ */
+struct redis_token_cache_key {
+	std::uint64_t obj;
+	std::uint64_t token;
+};
+
+struct redis_token_cache_elt {
+	redis_token_cache_key key;
+	std::vector<double> counts;
+};
+
+static inline unsigned int
+redis_token_cache_hash(gconstpointer p)
+{
+	return rspamd_cryptobox_fast_hash(p, sizeof(redis_token_cache_key),
+									  rspamd_hash_seed());
+}
+
+static inline gboolean
+redis_token_cache_equal(gconstpointer a, gconstpointer b)
+{
+	return memcmp(a, b, sizeof(redis_token_cache_key)) == 0;
+}
+
+static inline void
+redis_token_cache_dtor(gpointer p)
+{
+	delete reinterpret_cast<redis_token_cache_elt *>(p);
+}
+
+static inline auto
+redis_token_cache_new(int maxsize) -> rspamd_lru_hash_t *
+{
+	return rspamd_lru_hash_new_full(maxsize,
+									nullptr, redis_token_cache_dtor,
+									redis_token_cache_hash, redis_token_cache_equal);
+}
+
+static inline auto
+redis_token_cache_lookup(rspamd_lru_hash_t *cache, std::uint64_t obj,
+						 std::uint64_t token, time_t now) -> const redis_token_cache_elt *
+{
+	redis_token_cache_key key{obj, token};
+
+	return reinterpret_cast<const redis_token_cache_elt *>(rspamd_lru_hash_lookup(cache, &key, now));
+}
+
+static inline void
+redis_token_cache_insert(rspamd_lru_hash_t *cache, std::uint64_t obj,
+						 std::uint64_t token, std::vector<double> &&counts,
+						 time_t now, unsigned int ttl)
+{
+	auto *elt = new redis_token_cache_elt{{obj, token}, std::move(counts)};
+
+	/* Key is owned by the value, so the old element must be removed first */
+	rspamd_lru_hash_remove(cache, &elt->key);
+	rspamd_lru_hash_insert(cache, &elt->key, elt, now, ttl);
+}
+
+static inline void
+redis_token_cache_remove(rspamd_lru_hash_t *cache, std::uint64_t obj,
+						 std::uint64_t token)
+{
+	redis_token_cache_key key{obj, token};
+
+	rspamd_lru_hash_remove(cache, &key);
+}
+
+#endif
@@ -0,0 +1,859 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Statistics backend that keeps tokens of all classes of a classifier in a
+ * single memory mapped file shared by all workers.
+ *
+ * The file is an open addressing table (linear probing) of slots, each slot
+ * has a token and a counter per class. Classification reads the table with
+ * no locks at all. Learning uses atomic operations: slots are claimed with
+ * CAS and counters are updated with atomic increments. Learners (including
+ * updates of the learns counters) hold a shared file lock, so the table can be
+ * resized by a learner holding an exclusive lock: it rehashes tokens to a new
+ * file, atomically renames it over the old one and marks the old one as moved,
+ * so other processes reopen the table.
+ *
+ * The immutable part of the header is protected by a checksum and new files
+ * are always written aside and renamed, so a crash never leaves a partially
+ * written table in place.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "stat_internal.h"
+#include "unix-std.h"
+#include "cryptobox.h"
+
+#define SHARED_MMAP_MAGIC "rsdshmt"
+#define SHARED_MMAP_VERSION 2
+#define SHARED_MMAP_MAX_CLASSES 64
+#define SHARED_MMAP_HEADER_SIZE 4096
+#define SHARED_MMAP_DEFAULT_SLOTS (1u << 16)
+#define SHARED_MMAP_MAX_PROBES 128
+/* Resize when the table is more than 3/4 full */
+#define SHARED_MMAP_MAX_LOAD(nslots) ((nslots) / 4 * 3)
+/*
+ * Seed for slots and header hashing; it is a part of the file format, so it is
+ * stored in the header and must never depend on the process
+ */
+#define SHARED_MMAP_HASH_SEED 0x5348524d4d415031ULL
+
+#define msg_debug_shared_mmap(...) rspamd_conditional_debug_fast(NULL, NULL,                                  \
+																 rspamd_stat_shared_mmap_log_id, "shared_mmap", \
+																 "", G_STRFUNC,                                 \
+																 __VA_ARGS__)
+
+INIT_LOG_MODULE(stat_shared_mmap)
+
+struct shared_mmap_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nclasses;
+	uint64_t nslots;
+	uint64_t slot_size;
+	uint64_t seed; /* seed of the slots hash */
+	uint64_t class_ids[SHARED_MMAP_MAX_CLASSES]; /* hashes of statfiles symbols */
+	uint64_t checksum;                           /* of all fields above */
+	/* Mutable fields, updated atomically */
+	uint64_t used;
+	uint64_t moved; /* set when the table has been replaced by a resized one */
+	uint64_t learns[SHARED_MMAP_MAX_CLASSES];
+};
+
+G_STATIC_ASSERT(sizeof(struct shared_mmap_header) <= SHARED_MMAP_HEADER_SIZE);
+
+/*
+ * Slot is a token followed by `nclasses` uint32_t counters, token 0 means
+ * an empty slot
+ */
+#define SHARED_MMAP_SLOT(tbl, i) \
+	((uint64_t *) ((u_char *) (tbl)->map + SHARED_MMAP_HEADER_SIZE + (i) * (tbl)->hdr->slot_size))
+#define SHARED_MMAP_COUNTERS(slot) ((uint32_t *) ((slot) + 1))
+#define SHARED_MMAP_KEY(tok) ((tok) != 0 ? (tok) : 1)
+
+struct shared_mmap_table {
+	char *fname;
+	int fd;
+	void *map;
+	gsize len;
+	struct shared_mmap_header *hdr;
+	unsigned int nclasses;
+	uint64_t class_ids[SHARED_MMAP_MAX_CLASSES];
+	uint64_t initial_slots;
+	ref_entry_t ref;
+};
+
+struct shared_mmap_ctx {
+	struct shared_mmap_table *tbl;
+	struct rspamd_statfile_config *stcf;
+	unsigned int class_idx;
+};
+
+/* Tables opened by this process: file name -> struct shared_mmap_table */
+static GHashTable *shared_mmap_tables = NULL;
+
+static uint64_t
+shared_mmap_header_checksum(const struct shared_mmap_header *hdr)
+{
+	return rspamd_cryptobox_fast_hash(hdr, G_STRUCT_OFFSET(struct shared_mmap_header, checksum),
+									  SHARED_MMAP_HASH_SEED);
+}
+
+static uint64_t
+shared_mmap_slot_size(unsigned int nclasses)
+{
+	uint64_t sz = sizeof(uint64_t) + sizeof(uint32_t) * nclasses;
+
+	return (sz + 7) & ~((uint64_t) 7);
+}
+
+static gboolean
+shared_mmap_check(struct shared_mmap_table *tbl, const char *fname,
+				  void *map, gsize len)
+{
+	const struct shared_mmap_header *hdr = map;
+
+	if (len < SHARED_MMAP_HEADER_SIZE) {
+		msg_err("file %s is too short to be a shared statistics table: %z",
+				fname, len);
+		return FALSE;
+	}
+
+	if (memcmp(hdr->magic, SHARED_MMAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+		hdr->version != SHARED_MMAP_VERSION) {
+		msg_err("file %s is not a shared statistics table of version %d",
+				fname, SHARED_MMAP_VERSION);
+		return FALSE;
+	}
+
+	if (hdr->checksum != shared_mmap_header_checksum(hdr)) {
+		msg_err("file %s has corrupted header", fname);
+		return FALSE;
+	}
+
+	if (hdr->nslots == 0 || (hdr->nslots & (hdr->nslots - 1)) != 0 ||
+		hdr->slot_size != shared_mmap_slot_size(hdr->nclasses) ||
+		len != SHARED_MMAP_HEADER_SIZE + hdr->nslots * hdr->slot_size) {
+		msg_err("file %s is truncated or has invalid geometry", fname);
+		return FALSE;
+	}
+
+	if (hdr->nclasses != tbl->nclasses ||
+		memcmp(hdr->class_ids, tbl->class_ids,
+			   sizeof(uint64_t) * tbl->nclasses) != 0) {
+		msg_err("file %s has been created for a different set of statfiles",
+				fname);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Writes a new empty table to a temporary file and returns its fd, the file
+ * name is stored in `tmpname`
+ */
+static int
+shared_mmap_create_tmp(struct shared_mmap_table *tbl, uint64_t nslots,
+					   char *tmpname, gsize tmplen)
+{
+	struct shared_mmap_header hdr;
+	int fd;
+
+	rspamd_snprintf(tmpname, tmplen, "%s.XXXXXX", tbl->fname);
+	fd = mkstemp(tmpname);
+
+	if (fd == -1) {
+		msg_err("cannot create temporary file %s: %s", tmpname, strerror(errno));
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SHARED_MMAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = SHARED_MMAP_VERSION;
+	hdr.nclasses = tbl->nclasses;
+	hdr.nslots = nslots;
+	hdr.slot_size = shared_mmap_slot_size(tbl->nclasses);
+	hdr.seed = SHARED_MMAP_HASH_SEED;
+	memcpy(hdr.class_ids, tbl->class_ids, sizeof(uint64_t) * tbl->nclasses);
+	hdr.checksum = shared_mmap_header_checksum(&hdr);
+
+	if (ftruncate(fd, SHARED_MMAP_HEADER_SIZE + nslots * hdr.slot_size) == -1 ||
+		write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		msg_err("cannot write temporary file %s: %s", tmpname, strerror(errno));
+		close(fd);
+		unlink(tmpname);
+
+		return -1;
+	}
+
+	return fd;
+}
+
+static gboolean
+shared_mmap_map(struct shared_mmap_table *tbl, int fd)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(fd, &st) == -1) {
+		msg_err("cannot stat %s: %s", tbl->fname, strerror(errno));
+		return FALSE;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED) {
+		msg_err("cannot mmap %s: %s", tbl->fname, strerror(errno));
+		return FALSE;
+	}
+
+	if (!shared_mmap_check(tbl, tbl->fname, map, st.st_size)) {
+		munmap(map, st.st_size);
+		return FALSE;
+	}
+
+	if (tbl->map) {
+		munmap(tbl->map, tbl->len);
+	}
+
+	if (tbl->fd != -1) {
+		close(tbl->fd);
+	}
+
+	tbl->fd = fd;
+	tbl->map = map;
+	tbl->len = st.st_size;
+	tbl->hdr = map;
+
+	return TRUE;
+}
+
+/*
+ * Opens the current table file, creating it if needed
+ */
+static gboolean
+shared_mmap_open(struct shared_mmap_table *tbl)
+{
+	char tmpname[PATH_MAX];
+	int fd;
+
+	for (;;) {
+		fd = open(tbl->fname, O_RDWR);
+
+		if (fd != -1) {
+			break;
+		}
+
+		if (errno != ENOENT) {
+			msg_err("cannot open %s: %s", tbl->fname, strerror(errno));
+			return FALSE;
+		}
+
+		fd = shared_mmap_create_tmp(tbl, tbl->initial_slots, tmpname,
+									sizeof(tmpname));
+
+		if (fd == -1) {
+			return FALSE;
+		}
+
+		/* Fails if another process has created the table meanwhile */
+		if (link(tmpname, tbl->fname) == -1 && errno != EEXIST) {
+			msg_err("cannot link %s to %s: %s", tmpname, tbl->fname,
+					strerror(errno));
+			close(fd);
+			unlink(tmpname);
+
+			return FALSE;
+		}
+
+		close(fd);
+		unlink(tmpname);
+	}
+
+	if (!shared_mmap_map(tbl, fd)) {
+		close(fd);
+
+		return FALSE;
+	}
+
+	msg_debug_shared_mmap("opened %s: %uL slots, %uL used",
+						  tbl->fname, tbl->hdr->nslots,
+						  __atomic_load_n(&tbl->hdr->used, __ATOMIC_RELAXED));
+
+	return TRUE;
+}
+
+static inline void
+shared_mmap_maybe_reopen(struct shared_mmap_table *tbl)
+{
+	if (tbl->hdr && __atomic_load_n(&tbl->hdr->moved, __ATOMIC_ACQUIRE)) {
+		msg_debug_shared_mmap("table %s has been resized, reopen it", tbl->fname);
+		shared_mmap_open(tbl);
+	}
+}
+
+/*
+ * Takes a shared lock on the current table, reopening it if it has been resized
+ */
+static gboolean
+shared_mmap_lock_shared(struct shared_mmap_table *tbl)
+{
+	for (;;) {
+		if (flock(tbl->fd, LOCK_SH) == -1) {
+			msg_err("cannot lock %s: %s", tbl->fname, strerror(errno));
+			return FALSE;
+		}
+
+		if (!__atomic_load_n(&tbl->hdr->moved, __ATOMIC_ACQUIRE)) {
+			return TRUE;
+		}
+
+		/* Resized after we have checked it */
+		flock(tbl->fd, LOCK_UN);
+
+		if (!shared_mmap_open(tbl)) {
+			return FALSE;
+		}
+	}
+}
+
+static inline uint64_t
+shared_mmap_slot_idx(struct shared_mmap_table *tbl, uint64_t key)
+{
+	return rspamd_cryptobox_fast_hash(&key, sizeof(key), tbl->hdr->seed) &
+		   (tbl->hdr->nslots - 1);
+}
+
+static const uint32_t *
+shared_mmap_lookup(struct shared_mmap_table *tbl, uint64_t token)
+{
+	uint64_t key = SHARED_MMAP_KEY(token), mask = tbl->hdr->nslots - 1, i, cur;
+	uint64_t *slot;
+	unsigned int probe;
+
+	i = shared_mmap_slot_idx(tbl, key);
+
+	for (probe = 0; probe < SHARED_MMAP_MAX_PROBES; probe++, i = (i + 1) & mask) {
+		slot = SHARED_MMAP_SLOT(tbl, i);
+		cur = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+		if (cur == key) {
+			return SHARED_MMAP_COUNTERS(slot);
+		}
+		else if (cur == 0) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns counters for a token, claiming an empty slot if needed; NULL means
+ * that the probe sequence is full
+ */
+static uint32_t *
+shared_mmap_lookup_or_insert(struct shared_mmap_table *tbl, uint64_t token)
+{
+	uint64_t key = SHARED_MMAP_KEY(token), mask = tbl->hdr->nslots - 1, i, cur;
+	uint64_t *slot;
+	unsigned int probe;
+
+	i = shared_mmap_slot_idx(tbl, key);
+
+	for (probe = 0; probe < SHARED_MMAP_MAX_PROBES; probe++, i = (i + 1) & mask) {
+		slot = SHARED_MMAP_SLOT(tbl, i);
+		cur = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+		if (cur == 0) {
+			if (__atomic_compare_exchange_n(slot, &cur, key, FALSE,
+											__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				__atomic_add_fetch(&tbl->hdr->used, 1, __ATOMIC_RELAXED);
+
+				return SHARED_MMAP_COUNTERS(slot);
+			}
+			/* Lost the race, cur has the winner's key now */
+		}
+
+		if (cur == key) {
+			return SHARED_MMAP_COUNTERS(slot);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+shared_mmap_add(uint32_t *counter, int delta)
+{
+	uint32_t cur;
+
+	if (delta >= 0) {
+		__atomic_add_fetch(counter, (uint32_t) delta, __ATOMIC_RELAXED);
+	}
+	else {
+		/* Never go below zero */
+		cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+		while (!__atomic_compare_exchange_n(counter, &cur,
+											cur > (uint32_t) -delta ? cur + delta : 0,
+											FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+	}
+}
+
+/*
+ * Doubles the table; must be called with no shared lock held by this process
+ */
+static gboolean
+shared_mmap_resize(struct shared_mmap_table *tbl)
+{
+	char tmpname[PATH_MAX];
+	struct shared_mmap_table ntbl;
+	uint64_t i, nslots, *slot;
+	uint32_t *dst;
+	unsigned int c, nclasses = tbl->nclasses;
+	int fd;
+
+	if (flock(tbl->fd, LOCK_EX) == -1) {
+		msg_err("cannot lock %s: %s", tbl->fname, strerror(errno));
+		return FALSE;
+	}
+
+	if (__atomic_load_n(&tbl->hdr->moved, __ATOMIC_ACQUIRE)) {
+		/* Somebody else has resized it */
+		flock(tbl->fd, LOCK_UN);
+
+		return shared_mmap_open(tbl);
+	}
+
+	nslots = tbl->hdr->nslots * 2;
+	fd = shared_mmap_create_tmp(tbl, nslots, tmpname, sizeof(tmpname));
+
+	if (fd == -1) {
+		flock(tbl->fd, LOCK_UN);
+
+		return FALSE;
+	}
+
+	memset(&ntbl, 0, sizeof(ntbl));
+	ntbl.fname = tmpname;
+	ntbl.fd = -1;
+	ntbl.nclasses = nclasses;
+	memcpy(ntbl.class_ids, tbl->class_ids, sizeof(tbl->class_ids));
+
+	if (!shared_mmap_map(&ntbl, fd)) {
+		close(fd);
+		unlink(tmpname);
+		flock(tbl->fd, LOCK_UN);
+
+		return FALSE;
+	}
+
+	memcpy(ntbl.hdr->learns, tbl->hdr->learns, sizeof(tbl->hdr->learns));
+
+	for (i = 0; i < tbl->hdr->nslots; i++) {
+		slot = SHARED_MMAP_SLOT(tbl, i);
+
+		if (*slot == 0) {
+			continue;
+		}
+
+		dst = shared_mmap_lookup_or_insert(&ntbl, *slot);
+
+		if (dst == NULL) {
+			msg_err("cannot rehash token %uL to %s", *slot, tmpname);
+			goto out;
+		}
+
+		for (c = 0; c < nclasses; c++) {
+			dst[c] = SHARED_MMAP_COUNTERS(slot)[c];
+		}
+	}
+
+	if (msync(ntbl.map, ntbl.len, MS_SYNC) == -1 || fsync(ntbl.fd) == -1 ||
+		rename(tmpname, tbl->fname) == -1) {
+		msg_err("cannot replace %s with %s: %s", tbl->fname, tmpname,
+				strerror(errno));
+		goto out;
+	}
+
+	msg_info("resized shared statistics table %s: %uL -> %uL slots, %uL used",
+			 tbl->fname, tbl->hdr->nslots, nslots, ntbl.hdr->used);
+	__atomic_store_n(&tbl->hdr->moved, 1, __ATOMIC_RELEASE);
+	flock(tbl->fd, LOCK_UN);
+
+	/* Switch to the new table */
+	munmap(tbl->map, tbl->len);
+	close(tbl->fd);
+	tbl->fd = ntbl.fd;
+	tbl->map = ntbl.map;
+	tbl->len = ntbl.len;
+	tbl->hdr = ntbl.hdr;
+
+	return TRUE;
+
+out:
+	munmap(ntbl.map, ntbl.len);
+	close(ntbl.fd);
+	unlink(tmpname);
+	flock(tbl->fd, LOCK_UN);
+
+	return FALSE;
+}
+
+static void
+shared_mmap_table_dtor(struct shared_mmap_table *tbl)
+{
+	if (shared_mmap_tables) {
+		g_hash_table_remove(shared_mmap_tables, tbl->fname);
+	}
+
+	if (tbl->map) {
+		msync(tbl->map, tbl->len, MS_ASYNC);
+		munmap(tbl->map, tbl->len);
+	}
+
+	if (tbl->fd != -1) {
+		close(tbl->fd);
+	}
+
+	g_free(tbl->fname);
+	g_free(tbl);
+}
+
+gpointer
+rspamd_shared_mmap_init(struct rspamd_stat_ctx *ctx,
+						struct rspamd_config *cfg, struct rspamd_statfile *st)
+{
+	struct rspamd_statfile_config *stf = st->stcf;
+	struct rspamd_classifier_config *clcf = stf->clcf;
+	struct shared_mmap_table *tbl;
+	struct shared_mmap_ctx *bk;
+	const ucl_object_t *filenameo, *slotso;
+	unsigned int nclasses = 0, class_idx = 0;
+	GList *cur;
+
+	filenameo = ucl_object_lookup_any(clcf->opts, "filename", "path", NULL);
+
+	if (filenameo == NULL || ucl_object_type(filenameo) != UCL_STRING) {
+		msg_err_config("classifier %s has no filename defined",
+					   clcf->name ? clcf->name : "default");
+		return NULL;
+	}
+
+	/* Class of a statfile is its position in the classifier */
+	for (cur = clcf->statfiles; cur != NULL; cur = g_list_next(cur)) {
+		if (cur->data == stf) {
+			class_idx = nclasses;
+		}
+
+		nclasses++;
+	}
+
+	if (nclasses > SHARED_MMAP_MAX_CLASSES) {
+		msg_err_config("classifier %s has too many statfiles: %ud, %d max",
+					   clcf->name ? clcf->name : "default",
+					   nclasses, SHARED_MMAP_MAX_CLASSES);
+		return NULL;
+	}
+
+	if (shared_mmap_tables == NULL) {
+		shared_mmap_tables = g_hash_table_new(g_str_hash, g_str_equal);
+	}
+
+	tbl = g_hash_table_lookup(shared_mmap_tables, ucl_object_tostring(filenameo));
+
+	if (tbl == NULL) {
+		tbl = g_malloc0(sizeof(*tbl));
+		tbl->fname = g_strdup(ucl_object_tostring(filenameo));
+		tbl->fd = -1;
+		tbl->nclasses = nclasses;
+		tbl->initial_slots = SHARED_MMAP_DEFAULT_SLOTS;
+		REF_INIT_RETAIN(tbl, shared_mmap_table_dtor);
+
+		slotso = ucl_object_lookup(clcf->opts, "slots");
+
+		if (slotso != NULL && ucl_object_toint(slotso) > 0) {
+			/* Must be a power of two */
+			while (tbl->initial_slots < (uint64_t) ucl_object_toint(slotso)) {
+				tbl->initial_slots <<= 1;
+			}
+		}
+
+		nclasses = 0;
+
+		for (cur = clcf->statfiles; cur != NULL; cur = g_list_next(cur)) {
+			struct rspamd_statfile_config *cl_stf = cur->data;
+
+			tbl->class_ids[nclasses++] = rspamd_cryptobox_fast_hash(cl_stf->symbol,
+																	strlen(cl_stf->symbol), 0);
+		}
+
+		if (!shared_mmap_open(tbl)) {
+			g_free(tbl->fname);
+			g_free(tbl);
+
+			return NULL;
+		}
+
+		g_hash_table_insert(shared_mmap_tables, tbl->fname, tbl);
+	}
+	else {
+		REF_RETAIN(tbl);
+	}
+
+	/* Learns pass deltas, so they can be applied atomically */
+	clcf->flags |= RSPAMD_FLAG_CLASSIFIER_INCREMENTING_BACKEND;
+
+	bk = g_malloc0(sizeof(*bk));
+	bk->tbl = tbl;
+	bk->stcf = stf;
+	bk->class_idx = class_idx;
+
+	return bk;
+}
+
+void rspamd_shared_mmap_close(gpointer p)
+{
+	struct shared_mmap_ctx *bk = p;
+
+	if (bk) {
+		REF_RELEASE(bk->tbl);
+		g_free(bk);
+	}
+}
+
+gpointer
+rspamd_shared_mmap_runtime(struct rspamd_task *task,
+						   struct rspamd_statfile_config *stcf,
+						   gboolean learn,
+						   gpointer p,
+						   int _id)
+{
+	return p;
+}
+
+gboolean
+rspamd_shared_mmap_process_tokens(struct rspamd_task *task, GPtrArray *tokens,
+								  int id,
+								  gpointer p)
+{
+	struct shared_mmap_ctx *bk = p;
+	struct shared_mmap_table *tbl;
+	const uint32_t *counters;
+	rspamd_token_t *tok;
+	unsigned int i;
+
+	g_assert(tokens != NULL);
+	g_assert(p != NULL);
+
+	tbl = bk->tbl;
+	shared_mmap_maybe_reopen(tbl);
+
+	for (i = 0; i < tokens->len; i++) {
+		tok = g_ptr_array_index(tokens, i);
+		counters = shared_mmap_lookup(tbl, tok->data);
+		tok->values[id] = counters ? __atomic_load_n(&counters[bk->class_idx], __ATOMIC_RELAXED) : 0;
+	}
+
+	return TRUE;
+}
+
+gboolean
+rspamd_shared_mmap_learn_tokens(struct rspamd_task *task, GPtrArray *tokens,
+								int id,
+								gpointer p)
+{
+	struct shared_mmap_ctx *bk = p;
+	struct shared_mmap_table *tbl;
+	uint32_t *counters;
+	rspamd_token_t *tok;
+	unsigned int i, nfailed = 0;
+
+	g_assert(tokens != NULL);
+	g_assert(p != NULL);
+
+	tbl = bk->tbl;
+	shared_mmap_maybe_reopen(tbl);
+
+	if (__atomic_load_n(&tbl->hdr->used, __ATOMIC_RELAXED) + tokens->len >
+		SHARED_MMAP_MAX_LOAD(tbl->hdr->nslots)) {
+		shared_mmap_resize(tbl);
+	}
+
+	if (!shared_mmap_lock_shared(tbl)) {
+		return FALSE;
+	}
+
+	for (i = 0; i < tokens->len; i++) {
+		tok = g_ptr_array_index(tokens, i);
+
+		if (tok->values[id] == 0) {
+			continue;
+		}
+
+		counters = shared_mmap_lookup_or_insert(tbl, tok->data);
+
+		if (counters == NULL) {
+			nfailed++;
+			continue;
+		}
+
+		shared_mmap_add(&counters[bk->class_idx], (int) tok->values[id]);
+	}
+
+	flock(tbl->fd, LOCK_UN);
+
+	if (nfailed > 0) {
+		msg_warn_task("cannot store %ud tokens in %s: too many collisions",
+					  nfailed, tbl->fname);
+	}
+
+	return TRUE;
+}
+
+gulong
+rspamd_shared_mmap_total_learns(struct rspamd_task *task, gpointer runtime,
+								gpointer ctx)
+{
+	struct shared_mmap_ctx *bk = runtime;
+
+	if (bk == NULL) {
+		return 0;
+	}
+
+	shared_mmap_maybe_reopen(bk->tbl);
+
+	return __atomic_load_n(&bk->tbl->hdr->learns[bk->class_idx], __ATOMIC_RELAXED);
+}
+
+gulong
+rspamd_shared_mmap_inc_learns(struct rspamd_task *task, gpointer runtime,
+							  gpointer ctx)
+{
+	struct shared_mmap_ctx *bk = runtime;
+	uint64_t res;
+
+	if (bk == NULL) {
+		return 0;
+	}
+
+	/* Resize copies learns under the exclusive lock */
+	if (!shared_mmap_lock_shared(bk->tbl)) {
+		return __atomic_load_n(&bk->tbl->hdr->learns[bk->class_idx], __ATOMIC_RELAXED);
+	}
+
+	res = __atomic_add_fetch(&bk->tbl->hdr->learns[bk->class_idx], 1,
+							 __ATOMIC_RELAXED);
+	flock(bk->tbl->fd, LOCK_UN);
+
+	return res;
+}
+
+gulong
+rspamd_shared_mmap_dec_learns(struct rspamd_task *task, gpointer runtime,
+							  gpointer ctx)
+{
+	struct shared_mmap_ctx *bk = runtime;
+	uint64_t cur;
+
+	if (bk == NULL) {
+		return 0;
+	}
+
+	if (!shared_mmap_lock_shared(bk->tbl)) {
+		return __atomic_load_n(&bk->tbl->hdr->learns[bk->class_idx], __ATOMIC_RELAXED);
+	}
+
+	cur = __atomic_load_n(&bk->tbl->hdr->learns[bk->class_idx], __ATOMIC_RELAXED);
+
+	while (cur > 0 &&
+		   !__atomic_compare_exchange_n(&bk->tbl->hdr->learns[bk->class_idx],
+										&cur, cur - 1, FALSE,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+	flock(bk->tbl->fd, LOCK_UN);
+
+	return cur > 0 ? cur - 1 : 0;
+}
+
+ucl_object_t *
+rspamd_shared_mmap_get_stat(gpointer runtime,
+							gpointer ctx)
+{
+	ucl_object_t *res = NULL;
+	struct shared_mmap_ctx *bk = runtime;
+	struct shared_mmap_table *tbl;
+
+	if (bk != NULL) {
+		tbl = bk->tbl;
+		shared_mmap_maybe_reopen(tbl);
+		res = ucl_object_typed_new(UCL_OBJECT);
+		ucl_object_insert_key(res,
+							  ucl_object_fromint(tbl->hdr->learns[bk->class_idx]),
+							  "revision", 0, false);
+		ucl_object_insert_key(res, ucl_object_fromint(tbl->len), "size",
+							  0, false);
+		ucl_object_insert_key(res, ucl_object_fromint(tbl->hdr->nslots), "total",
+							  0, false);
+		ucl_object_insert_key(res, ucl_object_fromint(tbl->hdr->used), "used",
+							  0, false);
+		ucl_object_insert_key(res, ucl_object_fromstring(bk->stcf->symbol),
+							  "symbol", 0, false);
+		ucl_object_insert_key(res, ucl_object_fromstring("shared_mmap"),
+							  "type", 0, false);
+		ucl_object_insert_key(res, ucl_object_fromint(0),
+							  "languages", 0, false);
+		ucl_object_insert_key(res, ucl_object_fromint(0),
+							  "users", 0, false);
+
+		if (bk->stcf->label) {
+			ucl_object_insert_key(res, ucl_object_fromstring(bk->stcf->label),
+								  "label", 0, false);
+		}
+	}
+
+	return res;
+}
+
+gboolean
+rspamd_shared_mmap_finalize_learn(struct rspamd_task *task, gpointer runtime,
+								  gpointer ctx, GError **err)
+{
+	struct shared_mmap_ctx *bk = runtime;
+
+	if (bk != NULL) {
+		msync(bk->tbl->map, bk->tbl->len, MS_ASYNC);
+	}
+
+	return TRUE;
+}
+
+gboolean
+rspamd_shared_mmap_finalize_process(struct rspamd_task *task, gpointer runtime,
+									gpointer ctx)
+{
+	return TRUE;
+}
+
+gpointer
+rspamd_shared_mmap_load_tokenizer_config(gpointer runtime,
+										 gsize *len)
+{
+	return NULL;
+}
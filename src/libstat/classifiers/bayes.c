@@ -324,60 +324,168 @@ bayes_classify_token(struct rspamd_classifier *ctx,
 }
 
 /*
- * Multinomial token classification for multi-class Bayes
+ * Token statistics for multi-class Bayes gathered as structure of arrays:
+ * per class frequencies are contiguous, so that the per class accumulation
+ * below is a branchless loop the compiler can vectorise
  */
-static void
-bayes_classify_token_multiclass(struct rspamd_classifier *ctx,
-								rspamd_token_t *tok,
-								struct bayes_multiclass_closure *cl)
+struct bayes_multiclass_tokens {
+	unsigned int ntokens;
+	double *totals;  /* Total hits of each token */
+	double *weights; /* Feature weight of each token */
+	double *freqs;   /* num_classes arrays of ntokens class frequencies */
+};
+
+#define BAYES_ACCUMULATE_LANES 8
+/* Each probability is either zero or larger than 1e-22, so 8 products cannot underflow */
+#define BAYES_ACCUMULATE_RENORM 8
+
+/*
+ * Returns sum of log(PROB_COMBINE(freq, total, weight, prior)) for all tokens
+ * whose combined probability differs from the prior at least by min_strength.
+ * Probabilities are multiplied in independent lanes and renormalised by frexp,
+ * so log is called once per lane and not once per token; the result matches
+ * the per token sum of logarithms within the rounding error (1e-12 relative).
+ */
+double
+rspamd_bayes_accumulate_log_probs(const double *freqs, const double *totals,
+								  const double *weights, unsigned int ntokens,
+								  double prior, double min_strength)
 {
-	unsigned int i, j;
-	int id;
-	struct rspamd_statfile *st;
-	struct rspamd_task *task;
-	double val, fw, w;
-	guint64 *class_counts;
-	guint64 total_count = 0;
+	double lanes[BAYES_ACCUMULATE_LANES];
+	int exps[BAYES_ACCUMULATE_LANES];
+	unsigned int i, l, nblocks = 0;
+	double ret = 0;
+
+	for (l = 0; l < BAYES_ACCUMULATE_LANES; l++) {
+		lanes[l] = 1.0;
+		exps[l] = 0;
+	}
 
-	task = cl->task;
+	for (i = 0; i + BAYES_ACCUMULATE_LANES <= ntokens; i += BAYES_ACCUMULATE_LANES) {
+		for (l = 0; l < BAYES_ACCUMULATE_LANES; l++) {
+			double w = weights[i + l], t = totals[i + l];
+			double prob = PROB_COMBINE(freqs[i + l], t, w, prior);
 
-	/* Skip meta tokens probabilistically if configured */
-	if (tok->flags & RSPAMD_STAT_TOKEN_FLAG_META && cl->meta_skip_prob > 0) {
-		val = rspamd_random_double_fast();
-		if (val <= cl->meta_skip_prob) {
-			return;
+			prob = MAX(0.0, MIN(1.0, prob));
+			lanes[l] *= fabs(prob - prior) >= min_strength ? prob : 1.0;
+		}
+
+		if (++nblocks == BAYES_ACCUMULATE_RENORM) {
+			for (l = 0; l < BAYES_ACCUMULATE_LANES; l++) {
+				int e;
+
+				lanes[l] = frexp(lanes[l], &e);
+				exps[l] += e;
+			}
+
+			nblocks = 0;
+		}
+	}
+
+	for (l = 0; i < ntokens; i++, l++) {
+		double prob = PROB_COMBINE(freqs[i], totals[i], weights[i], prior);
+
+		prob = MAX(0.0, MIN(1.0, prob));
+
+		if (fabs(prob - prior) >= min_strength) {
+			/* Less than a block is left, so it cannot underflow a lane */
+			lanes[l] *= prob;
 		}
 	}
 
-	/* Allocate array for class counts */
-	class_counts = g_alloca(cl->num_classes * sizeof(guint64));
-	memset(class_counts, 0, cl->num_classes * sizeof(guint64));
+	for (l = 0; l < BAYES_ACCUMULATE_LANES; l++) {
+		ret += log(lanes[l]) + exps[l] * M_LN2;
+	}
+
+	return ret;
+}
+
+/*
+ * Collects class frequencies of tokens that have enough hits
+ */
+static void
+bayes_multiclass_gather(struct rspamd_classifier *ctx,
+						GPtrArray *tokens,
+						struct bayes_multiclass_closure *cl,
+						struct bayes_multiclass_tokens *mt)
+{
+	unsigned int i, j, nstatfiles = 0;
+	int id;
+	struct rspamd_statfile *st;
+	struct rspamd_task *task = cl->task;
+	rspamd_token_t *tok;
+	double val, fw;
+	int *ids, *class_idxs;
+	uint64_t *class_counts;
+	double *inv_learns;
+
+	/* Statfile to class mapping is the same for all tokens */
+	ids = g_alloca(ctx->statfiles_ids->len * sizeof(int));
+	class_idxs = g_alloca(ctx->statfiles_ids->len * sizeof(int));
 
-	/* Collect counts for each class */
 	for (i = 0; i < ctx->statfiles_ids->len; i++) {
 		id = g_array_index(ctx->statfiles_ids, int, i);
 		st = g_ptr_array_index(ctx->ctx->statfiles, id);
 		g_assert(st != NULL);
-		val = tok->values[id];
 
-		if (val > 0) {
-			/* Direct O(1) class index lookup instead of O(N) string comparison */
-			if (st->stcf->class_name && st->stcf->class_index < cl->num_classes) {
-				unsigned int class_idx = st->stcf->class_index;
-				class_counts[class_idx] += val;
-				total_count += val;
-				cl->total_hits += val;
+		if (st->stcf->class_name && st->stcf->class_index < cl->num_classes) {
+			ids[nstatfiles] = id;
+			class_idxs[nstatfiles] = st->stcf->class_index;
+			nstatfiles++;
+		}
+		else {
+			msg_debug_bayes("invalid class_index %ud >= %ud for statfile %s",
+							st->stcf->class_index, cl->num_classes, st->stcf->symbol);
+		}
+	}
+
+	class_counts = g_alloca(cl->num_classes * sizeof(uint64_t));
+	inv_learns = g_alloca(cl->num_classes * sizeof(double));
+
+	for (j = 0; j < cl->num_classes; j++) {
+		inv_learns[j] = 1.0 / MAX(1.0, (double) cl->class_learns[j]);
+	}
+
+	mt->ntokens = 0;
+	mt->totals = rspamd_mempool_alloc(task->task_pool, tokens->len * sizeof(double));
+	mt->weights = rspamd_mempool_alloc(task->task_pool, tokens->len * sizeof(double));
+	mt->freqs = rspamd_mempool_alloc(task->task_pool,
+									 (gsize) tokens->len * cl->num_classes * sizeof(double));
+
+	PTR_ARRAY_FOREACH(tokens, i, tok)
+	{
+		uint64_t total_count = 0;
+
+		/* Skip meta tokens probabilistically if configured */
+		if (tok->flags & RSPAMD_STAT_TOKEN_FLAG_META && cl->meta_skip_prob > 0) {
+			val = rspamd_random_double_fast();
+			if (val <= cl->meta_skip_prob) {
+				continue;
 			}
-			else {
-				msg_debug_bayes("invalid class_index %ud >= %ud for statfile %s",
-								st->stcf->class_index, cl->num_classes, st->stcf->symbol);
+		}
+
+		memset(class_counts, 0, cl->num_classes * sizeof(uint64_t));
+
+		for (j = 0; j < nstatfiles; j++) {
+			val = tok->values[ids[j]];
+
+			if (val > 0) {
+				class_counts[class_idxs[j]] += val;
+				total_count += val;
 			}
 		}
-	}
 
-	/* Calculate multinomial probability for this token */
-	if (total_count >= ctx->cfg->min_token_hits) {
-		/* Feature weight calculation */
+		cl->total_hits += total_count;
+
+		if (total_count < ctx->cfg->min_token_hits) {
+			continue;
+		}
+
+		cl->processed_tokens++;
+		if (!(tok->flags & RSPAMD_STAT_TOKEN_FLAG_META)) {
+			cl->text_tokens++;
+		}
+
 		if (tok->flags & RSPAMD_STAT_TOKEN_FLAG_UNIGRAM) {
 			fw = 1.0;
 		}
@@ -385,60 +493,30 @@ bayes_classify_token_multiclass(struct rspamd_classifier *ctx,
 			fw = feature_weight[tok->window_idx % G_N_ELEMENTS(feature_weight)];
 		}
 
-		w = (fw * total_count) / (1.0 + fw * total_count);
+		unsigned int k = mt->ntokens;
 
 		if (cl->num_classes == 2) {
 			/* Binary-compatible path: normalize per-token probabilities across the two classes */
-			double f0 = (double) class_counts[0] / MAX(1.0, (double) cl->class_learns[0]);
-			double f1 = (double) class_counts[1] / MAX(1.0, (double) cl->class_learns[1]);
+			double f0 = (double) class_counts[0] * inv_learns[0];
+			double f1 = (double) class_counts[1] * inv_learns[1];
 			double denom = f0 + f1;
 
-			if (denom > 0.0) {
-				double p0 = f0 / denom;
-				double p1 = f1 / denom;
-				double bp0 = PROB_COMBINE(p0, total_count, w, 0.5);
-				double bp1 = PROB_COMBINE(p1, total_count, w, 0.5);
-
-				/* Bound and apply min strength (relative to 0.5 for binary) */
-				bp0 = MAX(0.0, MIN(1.0, bp0));
-				bp1 = MAX(0.0, MIN(1.0, bp1));
-
-				if (fabs(bp0 - 0.5) >= ctx->cfg->min_prob_strength) {
-					cl->class_log_probs[0] += log(bp0);
-				}
-				if (fabs(bp1 - 0.5) >= ctx->cfg->min_prob_strength) {
-					cl->class_log_probs[1] += log(bp1);
-				}
+			if (!(denom > 0.0)) {
+				continue;
 			}
+
+			mt->freqs[k] = f0 / denom;
+			mt->freqs[tokens->len + k] = f1 / denom;
 		}
 		else {
-			/* General multinomial model for N>2 classes */
 			for (j = 0; j < cl->num_classes; j++) {
-				/* Skip classes with insufficient learns */
-				if (ctx->cfg->min_learns > 0 && cl->class_learns[j] < ctx->cfg->min_learns) {
-					continue;
-				}
-
-				double class_freq = (double) class_counts[j] / MAX(1.0, (double) cl->class_learns[j]);
-				double class_prob = PROB_COMBINE(class_freq, total_count, w, 1.0 / cl->num_classes);
-
-				/* Ensure probability is properly bounded [0, 1] */
-				class_prob = MAX(0.0, MIN(1.0, class_prob));
-
-				/* Skip probabilities too close to uniform (1/num_classes) */
-				double uniform_prior = 1.0 / cl->num_classes;
-				if (fabs(class_prob - uniform_prior) < ctx->cfg->min_prob_strength) {
-					continue;
-				}
-
-				cl->class_log_probs[j] += log(class_prob);
+				mt->freqs[(gsize) j * tokens->len + k] = (double) class_counts[j] * inv_learns[j];
 			}
 		}
 
-		cl->processed_tokens++;
-		if (!(tok->flags & RSPAMD_STAT_TOKEN_FLAG_META)) {
-			cl->text_tokens++;
-		}
+		mt->totals[k] = total_count;
+		mt->weights[k] = (fw * total_count) / (1.0 + fw * total_count);
+		mt->ntokens++;
 	}
 }
 
@@ -451,6 +529,7 @@ bayes_classify_multiclass(struct rspamd_classifier *ctx,
 						  struct rspamd_task *task)
 {
 	struct bayes_multiclass_closure cl;
+	struct bayes_multiclass_tokens mt;
 	rspamd_token_t *tok;
 	unsigned int i, j, text_tokens = 0;
 	int id;
@@ -568,9 +647,20 @@ bayes_classify_multiclass(struct rspamd_classifier *ctx,
 	}
 
 	/* Process all tokens */
-	for (i = 0; i < tokens->len; i++) {
-		tok = g_ptr_array_index(tokens, i);
-		bayes_classify_token_multiclass(ctx, tok, &cl);
+	bayes_multiclass_gather(ctx, tokens, &cl, &mt);
+
+	for (j = 0; j < cl.num_classes; j++) {
+		double prior = cl.num_classes == 2 ? 0.5 : 1.0 / cl.num_classes;
+
+		/* Skip classes with insufficient learns */
+		if (cl.num_classes > 2 && ctx->cfg->min_learns > 0 &&
+			cl.class_learns[j] < ctx->cfg->min_learns) {
+			continue;
+		}
+
+		cl.class_log_probs[j] += rspamd_bayes_accumulate_log_probs(
+			mt.freqs + (gsize) j * tokens->len, mt.totals, mt.weights, mt.ntokens,
+			prior, ctx->cfg->min_prob_strength);
 	}
 
 	if (cl.processed_tokens == 0) {
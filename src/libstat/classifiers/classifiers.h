@@ -89,6 +89,14 @@ gboolean bayes_learn_class(struct rspamd_classifier *ctx,
 
 void bayes_fin(struct rspamd_classifier *);
 
+/*
+ * Sum of logarithms of the combined token probabilities used by multi-class
+ * Bayes, exported for tests
+ */
+double rspamd_bayes_accumulate_log_probs(const double *freqs, const double *totals,
+										 const double *weights, unsigned int ntokens,
+										 double prior, double min_strength);
+
 /* Generic lua classifier */
 gboolean lua_classifier_init(struct rspamd_config *cfg,
 							 struct ev_loop *ev_base,
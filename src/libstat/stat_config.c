@@ -90,6 +90,7 @@ static struct rspamd_stat_tokenizer stat_tokenizers[] = {
 
 static struct rspamd_stat_backend stat_backends[] = {
 	RSPAMD_STAT_BACKEND_ELT(mmap, mmaped_file),
+	RSPAMD_STAT_BACKEND_ELT(shared_mmap, shared_mmap),
 	RSPAMD_STAT_BACKEND_ELT(sqlite3, sqlite3),
 	RSPAMD_STAT_BACKEND_ELT_READONLY(cdb, cdb),
 	RSPAMD_STAT_BACKEND_ELT(redis, redis)};
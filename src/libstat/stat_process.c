@@ -24,6 +24,7 @@
 #include "lua/lua_classnames.h"
 #include "libserver/mempool_vars_internal.h"
 #include "utlist.h"
+#include "khash.h"
 #include <math.h>
 
 #define RSPAMD_CLASSIFY_OP 0
@@ -32,6 +33,8 @@
 
 static const double similarity_threshold = 80.0;
 
+KHASH_SET_INIT_INT64(rspamd_stat_tokens_set);
+
 void rspamd_task_set_multiclass_result(struct rspamd_task *task,
 									   rspamd_multiclass_result_t *result,
 									   const char *classifier_name)
@@ -205,8 +208,10 @@ void rspamd_stat_process_tokenize(struct rspamd_stat_ctx *st_ctx,
 	struct rspamd_mime_text_part *part;
 	rspamd_cryptobox_hash_state_t hst;
 	rspamd_token_t *st_tok;
-	unsigned int i, reserved_len = 0;
+	unsigned int i, reserved_len = 0, ntokenized = 0;
 	double *pdiff;
+	uint64_t *parts_hashes;
+	khash_t(rspamd_stat_tokens_set) *seen_tokens = NULL;
 	unsigned char hout[rspamd_cryptobox_HASHBYTES];
 	char *b32_hout;
 
@@ -230,13 +235,84 @@ void rspamd_stat_process_tokenize(struct rspamd_stat_ctx *st_ctx,
 								  rspamd_ptr_array_free_hard, task->tokens);
 	rspamd_mempool_notify_alloc(task->task_pool, reserved_len * sizeof(gpointer));
 	pdiff = rspamd_mempool_get_variable(task->task_pool, "parts_distance");
+	parts_hashes = g_alloca(sizeof(*parts_hashes) * (MESSAGE_FIELD(task, text_parts)->len + 1));
 
 	PTR_ARRAY_FOREACH(MESSAGE_FIELD(task, text_parts), i, part)
 	{
 		if (!IS_TEXT_PART_EMPTY(part) && part->utf_words.a) {
+			uint64_t part_hash = 0;
+			unsigned int j, start = task->tokens->len, ndups = 0;
+			gboolean identical = FALSE;
+
+			if (part->utf_stripped_content && part->utf_stripped_content->len > 0) {
+				part_hash = rspamd_cryptobox_fast_hash(part->utf_stripped_content->data,
+													   part->utf_stripped_content->len,
+													   rspamd_hash_seed());
+
+				for (j = 0; j < ntokenized; j++) {
+					if (parts_hashes[j] == part_hash) {
+						identical = TRUE;
+						break;
+					}
+				}
+			}
+
+			if (identical) {
+				msg_debug_bayes("skip text part %ud as it is identical to a previous one", i);
+				continue;
+			}
+
 			st_ctx->tokenizer->tokenize_func(st_ctx, task,
 											 &part->utf_words, IS_TEXT_PART_UTF(part),
 											 NULL, task->tokens);
+
+			/*
+			 * Alternative parts usually share most of their text, so tokens
+			 * that have been already produced by previous parts are dropped
+			 */
+			if (ntokenized > 0) {
+				int ret;
+
+				if (seen_tokens == NULL) {
+					seen_tokens = kh_init(rspamd_stat_tokens_set);
+					kh_resize(rspamd_stat_tokens_set, seen_tokens, task->tokens->len);
+
+					for (j = 0; j < start; j++) {
+						st_tok = g_ptr_array_index(task->tokens, j);
+						kh_put(rspamd_stat_tokens_set, seen_tokens, st_tok->data, &ret);
+					}
+				}
+
+				unsigned int last = start;
+
+				/* Repeats within this part are kept, so it is only checked against previous parts */
+				for (j = start; j < task->tokens->len; j++) {
+					st_tok = g_ptr_array_index(task->tokens, j);
+
+					if (kh_get(rspamd_stat_tokens_set, seen_tokens, st_tok->data) !=
+						kh_end(seen_tokens)) {
+						ndups++;
+					}
+					else {
+						g_ptr_array_index(task->tokens, last++) = st_tok;
+					}
+				}
+
+				g_ptr_array_set_size(task->tokens, last);
+
+				for (j = start; j < last; j++) {
+					st_tok = g_ptr_array_index(task->tokens, j);
+					kh_put(rspamd_stat_tokens_set, seen_tokens, st_tok->data, &ret);
+				}
+
+				if (ndups > 0) {
+					msg_debug_bayes("removed %ud tokens of text part %ud that are "
+									"duplicated in previous parts",
+									ndups, i);
+				}
+			}
+
+			parts_hashes[ntokenized++] = part_hash;
 		}
 
 
@@ -247,6 +323,10 @@ void rspamd_stat_process_tokenize(struct rspamd_stat_ctx *st_ctx,
 		}
 	}
 
+	if (seen_tokens) {
+		kh_destroy(rspamd_stat_tokens_set, seen_tokens);
+	}
+
 	if (task->meta_words.a) {
 		st_ctx->tokenizer->tokenize_func(st_ctx,
 										 task,
@@ -262,10 +262,62 @@ rspamd_tokenizer_osb_is_compat (struct rspamd_tokenizer_runtime *rt)
 }
 #endif
 
-struct token_pipe_entry {
-	uint64_t h;
-	rspamd_stat_token_t *t;
-};
+/* Number of words which pairs are hashed at once */
+#define OSB_PAIRS_BLOCK 64
+
+void rspamd_tokenizer_osb_hash_pairs(const uint64_t *hashes, gsize n,
+									 unsigned int window_size, gboolean compat,
+									 uint64_t *out)
+{
+	unsigned int i;
+	gsize k;
+
+	/*
+	 * Each distance is a separate loop over contiguous arrays with no
+	 * dependencies between iterations, so it is vectorized by a compiler
+	 */
+	for (i = 1; i < window_size; i++) {
+		const uint64_t *prev = hashes - i;
+		uint64_t *dst = out + (gsize) (i - 1) * n;
+
+		if (compat) {
+			const uint32_t p1 = primes[0], p2 = primes[1],
+						   p3 = primes[i << 1], p4 = primes[(i << 1) - 1];
+
+			for (k = 0; k < n; k++) {
+				uint32_t hh[2];
+
+				hh[0] = ((uint32_t) hashes[k]) * p1 + ((uint32_t) prev[k]) * p3;
+				hh[1] = ((uint32_t) hashes[k]) * p2 + ((uint32_t) prev[k]) * p4;
+				memcpy(&dst[k], hh, sizeof(hh));
+			}
+		}
+		else {
+			const uint64_t p1 = primes[0], p2 = primes[i << 1];
+
+			for (k = 0; k < n; k++) {
+				dst[k] = hashes[k] * p1 + prev[k] * p2;
+			}
+		}
+	}
+}
+
+static inline void
+rspamd_tokenizer_osb_add(struct rspamd_task *task, GPtrArray *result,
+						 gsize token_size, unsigned int flags,
+						 rspamd_stat_token_t *t1, rspamd_stat_token_t *t2,
+						 uint64_t data, unsigned int window_idx)
+{
+	rspamd_token_t *new_tok;
+
+	new_tok = rspamd_mempool_alloc0(task->task_pool, token_size);
+	new_tok->flags = flags;
+	new_tok->t1 = t1;
+	new_tok->t2 = t2;
+	new_tok->data = data;
+	new_tok->window_idx = window_idx;
+	g_ptr_array_add(result, new_tok);
+}
 
 int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 						 struct rspamd_task *task,
@@ -274,14 +326,13 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 						 const char *prefix,
 						 GPtrArray *result)
 {
-	rspamd_token_t *new_tok = NULL;
-	rspamd_stat_token_t *token;
+	rspamd_stat_token_t *token, **used_words, **pair_words;
 	struct rspamd_osb_tokenizer_config *osb_cf;
-	uint64_t cur, seed;
-	struct token_pipe_entry *hashpipe;
-	uint32_t h1, h2;
-	gsize token_size;
-	unsigned int processed = 0, i, w, window_size, token_flags = 0;
+	uint64_t cur, seed, *used_hashes, *pair_hashes, *pairs;
+	gsize token_size, nwords, nused = 0, npairs = 0, k, e,
+						  block_start = 0, block_len = 0;
+	unsigned int i, w, window_size, token_flags = 0;
+	gboolean compat;
 
 	if (words == NULL || !words->a) {
 		return FALSE;
@@ -289,6 +340,7 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 
 	osb_cf = ctx->tkcf;
 	window_size = osb_cf->window_size;
+	compat = osb_cf->ht == RSPAMD_OSB_HASH_COMPAT;
 
 	if (prefix) {
 		seed = rspamd_cryptobox_fast_hash_specific(RSPAMD_CRYPTOBOX_XXHASH64,
@@ -298,16 +350,24 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 		seed = osb_cf->seed;
 	}
 
-	hashpipe = g_alloca(window_size * sizeof(hashpipe[0]));
-	for (i = 0; i < window_size; i++) {
-		hashpipe[i].h = 0xfe;
-		hashpipe[i].t = NULL;
-	}
 	token_size = sizeof(rspamd_token_t) +
 				 sizeof(RSPAMD_TOKEN_VALUE_TYPE) * ctx->statfiles->len;
 	g_assert(token_size > 0);
 
-	for (w = 0; w < kv_size(*words); w++) {
+	nwords = kv_size(*words);
+
+	if (nwords == 0) {
+		return TRUE;
+	}
+
+	/* Words in order and the subset of them that is combined in pairs */
+	used_words = g_malloc(nwords * sizeof(*used_words));
+	used_hashes = g_malloc(nwords * sizeof(*used_hashes));
+	pair_words = g_malloc(nwords * sizeof(*pair_words));
+	pair_hashes = g_malloc(nwords * sizeof(*pair_hashes));
+	pairs = g_alloca(OSB_PAIRS_BLOCK * window_size * sizeof(*pairs));
+
+	for (w = 0; w < nwords; w++) {
 		token = &kv_A(*words, w);
 		token_flags = token->flags;
 		const char *begin;
@@ -328,7 +388,7 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 			len = token->original.len;
 		}
 
-		if (osb_cf->ht == RSPAMD_OSB_HASH_COMPAT) {
+		if (compat) {
 			rspamd_ftok_t ftok;
 
 			ftok.begin = begin;
@@ -351,74 +411,62 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 			}
 		}
 
-		if (token_flags & RSPAMD_STAT_TOKEN_FLAG_UNIGRAM) {
-			new_tok = rspamd_mempool_alloc0(task->task_pool, token_size);
-			new_tok->flags = token_flags;
-			new_tok->t1 = token;
-			new_tok->t2 = token;
-			new_tok->data = cur;
-			new_tok->window_idx = 0;
-			g_ptr_array_add(result, new_tok);
+		used_words[nused] = token;
+		used_hashes[nused++] = cur;
 
-			continue;
+		if (!(token_flags & RSPAMD_STAT_TOKEN_FLAG_UNIGRAM)) {
+			pair_words[npairs] = token;
+			pair_hashes[npairs++] = cur;
 		}
+	}
 
-#define ADD_TOKEN                                                                       \
-	do {                                                                                \
-		new_tok = rspamd_mempool_alloc0(task->task_pool, token_size);                   \
-		new_tok->flags = token_flags;                                                   \
-		new_tok->t1 = hashpipe[0].t;                                                    \
-		new_tok->t2 = hashpipe[i].t;                                                    \
-		if (osb_cf->ht == RSPAMD_OSB_HASH_COMPAT) {                                     \
-			h1 = ((uint32_t) hashpipe[0].h) * primes[0] +                               \
-				 ((uint32_t) hashpipe[i].h) * primes[i << 1];                           \
-			h2 = ((uint32_t) hashpipe[0].h) * primes[1] +                               \
-				 ((uint32_t) hashpipe[i].h) * primes[(i << 1) - 1];                     \
-			memcpy((unsigned char *) &new_tok->data, &h1, sizeof(h1));                  \
-			memcpy(((unsigned char *) &new_tok->data) + sizeof(h1), &h2, sizeof(h2));   \
-		}                                                                               \
-		else {                                                                          \
-			new_tok->data = hashpipe[0].h * primes[0] + hashpipe[i].h * primes[i << 1]; \
-		}                                                                               \
-		new_tok->window_idx = i;                                                        \
-		g_ptr_array_add(result, new_tok);                                               \
-	} while (0)
-
-		if (processed < window_size) {
-			/* Just fill a hashpipe */
-			++processed;
-			hashpipe[window_size - processed].h = cur;
-			hashpipe[window_size - processed].t = token;
+	for (e = 0, k = 0; e < nused; e++) {
+		token = used_words[e];
+
+		if (token->flags & RSPAMD_STAT_TOKEN_FLAG_UNIGRAM) {
+			rspamd_tokenizer_osb_add(task, result, token_size, token->flags,
+									 token, token, used_hashes[e], 0);
+			continue;
 		}
-		else {
-			/* Shift hashpipe */
-			for (i = window_size - 1; i > 0; i--) {
-				hashpipe[i] = hashpipe[i - 1];
-			}
-			hashpipe[0].h = cur;
-			hashpipe[0].t = token;
 
-			processed++;
+		/* The first `window_size` words just fill the window */
+		if (k >= window_size) {
+			if (k >= block_start + block_len) {
+				block_start = k;
+				block_len = MIN(OSB_PAIRS_BLOCK, npairs - k);
+				rspamd_tokenizer_osb_hash_pairs(&pair_hashes[k], block_len,
+												window_size, compat, pairs);
+			}
 
 			for (i = 1; i < window_size; i++) {
-				if (!(hashpipe[i].t->flags & RSPAMD_STAT_TOKEN_FLAG_EXCEPTION)) {
-					ADD_TOKEN;
+				if (!(pair_words[k - i]->flags & RSPAMD_STAT_TOKEN_FLAG_EXCEPTION)) {
+					rspamd_tokenizer_osb_add(task, result, token_size, token->flags,
+											 token, pair_words[k - i],
+											 pairs[(i - 1) * block_len + k - block_start],
+											 i);
 				}
 			}
 		}
+
+		k++;
 	}
 
-	if (processed > 1 && processed <= window_size) {
-		processed--;
-		memmove(hashpipe, &hashpipe[window_size - processed],
-				processed * sizeof(hashpipe[0]));
+	if (npairs > 1 && npairs <= window_size) {
+		/* Short text: pairs of the last but one word with the preceding ones */
+		k = npairs - 2;
+		rspamd_tokenizer_osb_hash_pairs(&pair_hashes[k], 1, k + 1, compat, pairs);
 
-		for (i = 1; i < processed; i++) {
-			ADD_TOKEN;
+		for (i = 1; i <= k; i++) {
+			rspamd_tokenizer_osb_add(task, result, token_size, token_flags,
+									 pair_words[k], pair_words[k - i],
+									 pairs[i - 1], i);
 		}
 	}
 
-#undef ADD_TOKEN
+	g_free(used_words);
+	g_free(used_hashes);
+	g_free(pair_words);
+	g_free(pair_hashes);
 
 	return TRUE;
 }
@@ -25,6 +25,8 @@
 #include "libstemmer.h"
 #define RSPAMD_TOKENIZER_INTERNAL
 #include "custom_tokenizer.h"
+#include "rspamd_simdutf.h"
+#include "khash.h"
 
 #include <unicode/utf8.h>
 #include <unicode/uchar.h>
@@ -284,6 +286,352 @@ exception_error:
 }
 
 
+/*
+ * Fast word boundaries for texts that contain Latin, Greek and Cyrillic
+ * letters, digits and common punctuation only. These scripts need no
+ * dictionary, so the rules of UAX #29 are applied directly to the word break
+ * properties taken from ICU once; the result is the same as for ICU break
+ * iterator, but without UText and rules engine overhead. Any other character
+ * makes the whole text go through ICU.
+ */
+enum rspamd_fast_wb {
+	RSPAMD_FAST_WB_OTHER = 0,
+	RSPAMD_FAST_WB_CR,
+	RSPAMD_FAST_WB_LF,
+	RSPAMD_FAST_WB_NEWLINE,
+	RSPAMD_FAST_WB_EXTEND, /* Extend and Format */
+	RSPAMD_FAST_WB_ALETTER,
+	RSPAMD_FAST_WB_NUMERIC,
+	RSPAMD_FAST_WB_MIDLETTER,
+	RSPAMD_FAST_WB_MIDNUM,
+	RSPAMD_FAST_WB_MIDNUMLET,
+	RSPAMD_FAST_WB_SINGLE_QUOTE,
+	RSPAMD_FAST_WB_EXTENDNUMLET,
+	RSPAMD_FAST_WB_WSEGSPACE,
+	RSPAMD_FAST_WB_UNSUPPORTED,
+};
+
+/* Latin, Greek and Cyrillic blocks */
+#define RSPAMD_FAST_WB_LOW_MAX 0x530
+/* General punctuation, super/subscripts, currency symbols and combining marks for symbols */
+#define RSPAMD_FAST_WB_PUNCT_START 0x2000
+#define RSPAMD_FAST_WB_PUNCT_MAX 0x2100
+
+static unsigned char rspamd_fast_wb_low[RSPAMD_FAST_WB_LOW_MAX];
+static unsigned char rspamd_fast_wb_punct[RSPAMD_FAST_WB_PUNCT_MAX - RSPAMD_FAST_WB_PUNCT_START];
+static gboolean rspamd_fast_wb_initialized = FALSE;
+
+static unsigned char
+rspamd_fast_wb_from_icu(UChar32 c)
+{
+	switch (u_getIntPropertyValue(c, UCHAR_WORD_BREAK)) {
+	case U_WB_OTHER:
+	/* Double quote matters for Hebrew letters only */
+	case U_WB_DOUBLE_QUOTE:
+		return RSPAMD_FAST_WB_OTHER;
+	case U_WB_CR:
+		return RSPAMD_FAST_WB_CR;
+	case U_WB_LF:
+		return RSPAMD_FAST_WB_LF;
+	case U_WB_NEWLINE:
+		return RSPAMD_FAST_WB_NEWLINE;
+	case U_WB_EXTEND:
+	case U_WB_FORMAT:
+		return RSPAMD_FAST_WB_EXTEND;
+	case U_WB_ALETTER:
+		return RSPAMD_FAST_WB_ALETTER;
+	case U_WB_NUMERIC:
+		return RSPAMD_FAST_WB_NUMERIC;
+	case U_WB_MIDLETTER:
+		return RSPAMD_FAST_WB_MIDLETTER;
+	case U_WB_MIDNUM:
+		return RSPAMD_FAST_WB_MIDNUM;
+	case U_WB_MIDNUMLET:
+		return RSPAMD_FAST_WB_MIDNUMLET;
+	case U_WB_SINGLE_QUOTE:
+		return RSPAMD_FAST_WB_SINGLE_QUOTE;
+	case U_WB_EXTENDNUMLET:
+		return RSPAMD_FAST_WB_EXTENDNUMLET;
+#if U_ICU_VERSION_MAJOR_NUM >= 62
+	case U_WB_WSEGSPACE:
+		return RSPAMD_FAST_WB_WSEGSPACE;
+#endif
+	default:
+		/* ZWJ, Hebrew letters, Katakana, regional indicators and so on */
+		return RSPAMD_FAST_WB_UNSUPPORTED;
+	}
+}
+
+/* Returns number of segments ICU finds in the text of the given characters */
+static int
+rspamd_fast_wb_icu_segments(UBreakIterator *bi, const UChar32 *chars, int nchars)
+{
+	char buf[16];
+	int32_t len = 0, i;
+	int nsegments = 0;
+	UErrorCode uc_err = U_ZERO_ERROR;
+	UBool is_error = FALSE;
+	UText *utxt;
+
+	for (i = 0; i < nchars; i++) {
+		U8_APPEND(buf, len, sizeof(buf), chars[i], is_error);
+	}
+
+	utxt = utext_openUTF8(NULL, buf, len, &uc_err);
+	ubrk_setUText(bi, utxt, &uc_err);
+	ubrk_first(bi);
+
+	while (ubrk_next(bi) != UBRK_DONE) {
+		nsegments++;
+	}
+
+	utext_close(utxt);
+
+	return nsegments;
+}
+
+/*
+ * ICU rules are tailored for some punctuation (e.g. '@' is a letter and '.'
+ * joins numbers only), so the class of such characters is checked with the
+ * break iterator itself
+ */
+static unsigned char
+rspamd_fast_wb_tailor(UBreakIterator *bi, UChar32 c, unsigned char cls)
+{
+	const UChar32 letters[] = {'a', c, 'a'}, numbers[] = {'1', c, '1'};
+	gboolean joins_letters, joins_numbers;
+
+	switch (cls) {
+	case RSPAMD_FAST_WB_OTHER:
+		if (c <= 0x20 || c >= 0x7F) {
+			return cls;
+		}
+		break;
+	case RSPAMD_FAST_WB_MIDLETTER:
+	case RSPAMD_FAST_WB_MIDNUM:
+	case RSPAMD_FAST_WB_MIDNUMLET:
+	case RSPAMD_FAST_WB_SINGLE_QUOTE:
+		break;
+	default:
+		return cls;
+	}
+
+	if (rspamd_fast_wb_icu_segments(bi, letters, 2) == 1) {
+		return RSPAMD_FAST_WB_ALETTER;
+	}
+
+	joins_letters = rspamd_fast_wb_icu_segments(bi, letters, 3) == 1;
+	joins_numbers = rspamd_fast_wb_icu_segments(bi, numbers, 3) == 1;
+
+	if (joins_letters && joins_numbers) {
+		return cls == RSPAMD_FAST_WB_SINGLE_QUOTE ? cls : RSPAMD_FAST_WB_MIDNUMLET;
+	}
+	else if (joins_letters) {
+		return RSPAMD_FAST_WB_MIDLETTER;
+	}
+	else if (joins_numbers) {
+		return RSPAMD_FAST_WB_MIDNUM;
+	}
+
+	return RSPAMD_FAST_WB_OTHER;
+}
+
+static void
+rspamd_fast_wb_init(void)
+{
+	UErrorCode uc_err = U_ZERO_ERROR;
+	UBreakIterator *bi;
+	UChar32 c;
+
+	if (rspamd_fast_wb_initialized) {
+		return;
+	}
+
+	bi = ubrk_open(UBRK_WORD, NULL, NULL, 0, &uc_err);
+	g_assert(U_SUCCESS(uc_err));
+
+	for (c = 0; c < RSPAMD_FAST_WB_LOW_MAX; c++) {
+		rspamd_fast_wb_low[c] = rspamd_fast_wb_tailor(bi, c, rspamd_fast_wb_from_icu(c));
+	}
+
+	for (c = RSPAMD_FAST_WB_PUNCT_START; c < RSPAMD_FAST_WB_PUNCT_MAX; c++) {
+		rspamd_fast_wb_punct[c - RSPAMD_FAST_WB_PUNCT_START] =
+			rspamd_fast_wb_tailor(bi, c, rspamd_fast_wb_from_icu(c));
+	}
+
+	ubrk_close(bi);
+	rspamd_fast_wb_initialized = TRUE;
+}
+
+/*
+ * Decodes a character at p and returns its word break class, len is set to
+ * the length of the character
+ */
+static inline unsigned char
+rspamd_fast_wb_class(const unsigned char *p, const unsigned char *end, int *len)
+{
+	UChar32 c;
+
+	if (p[0] < 0x80) {
+		*len = 1;
+
+		return rspamd_fast_wb_low[p[0]];
+	}
+	else if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+		if (end - p < 2 || (p[1] & 0xC0) != 0x80) {
+			return RSPAMD_FAST_WB_UNSUPPORTED;
+		}
+
+		c = ((p[0] & 0x1F) << 6) | (p[1] & 0x3F);
+		*len = 2;
+
+		return c < RSPAMD_FAST_WB_LOW_MAX ? rspamd_fast_wb_low[c] : RSPAMD_FAST_WB_UNSUPPORTED;
+	}
+	else if (p[0] == 0xE2) {
+		if (end - p < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80) {
+			return RSPAMD_FAST_WB_UNSUPPORTED;
+		}
+
+		c = ((p[0] & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+		*len = 3;
+
+		return (c >= RSPAMD_FAST_WB_PUNCT_START && c < RSPAMD_FAST_WB_PUNCT_MAX) ? rspamd_fast_wb_punct[c - RSPAMD_FAST_WB_PUNCT_START] : RSPAMD_FAST_WB_UNSUPPORTED;
+	}
+
+	return RSPAMD_FAST_WB_UNSUPPORTED;
+}
+
+gboolean
+rspamd_tokenize_fast_supported(const char *text, gsize len)
+{
+	const unsigned char *p = (const unsigned char *) text, *end = p + len;
+	int clen;
+
+	rspamd_fast_wb_init();
+
+	while (p < end) {
+		/* All ASCII characters are supported */
+		p += rspamd_fast_ascii_prefix_len(p, end - p);
+
+		if (p >= end) {
+			break;
+		}
+
+		if (rspamd_fast_wb_class(p, end, &clen) == RSPAMD_FAST_WB_UNSUPPORTED) {
+			return FALSE;
+		}
+
+		p += clen;
+	}
+
+	return TRUE;
+}
+
+/* Skips Extend and Format characters (WB4) */
+static inline const unsigned char *
+rspamd_fast_wb_skip_extend(const unsigned char *p, const unsigned char *end,
+						   unsigned char *next_cls)
+{
+	int clen;
+
+	while (p < end) {
+		*next_cls = rspamd_fast_wb_class(p, end, &clen);
+
+		if (*next_cls != RSPAMD_FAST_WB_EXTEND) {
+			return p;
+		}
+
+		p += clen;
+	}
+
+	*next_cls = RSPAMD_FAST_WB_OTHER;
+
+	return p;
+}
+
+int32_t
+rspamd_tokenize_fast_next_break(const char *text, gsize len, int32_t pos)
+{
+	const unsigned char *p, *end = (const unsigned char *) text + len, *next;
+	unsigned char cls, next_cls, after_cls;
+	int clen;
+
+	if (pos < 0 || (gsize) pos >= len) {
+		return UBRK_DONE;
+	}
+
+	p = (const unsigned char *) text + pos;
+	cls = rspamd_fast_wb_class(p, end, &clen);
+	p += clen;
+
+	switch (cls) {
+	case RSPAMD_FAST_WB_CR:
+		/* WB3 */
+		if (p < end && *p == '\n') {
+			p++;
+		}
+		/* WB3a, WB3b */
+		return p - (const unsigned char *) text;
+	case RSPAMD_FAST_WB_LF:
+	case RSPAMD_FAST_WB_NEWLINE:
+		return p - (const unsigned char *) text;
+	case RSPAMD_FAST_WB_WSEGSPACE:
+		/* WB3d */
+		while (p < end && rspamd_fast_wb_class(p, end, &clen) == RSPAMD_FAST_WB_WSEGSPACE) {
+			p += clen;
+		}
+		break;
+	case RSPAMD_FAST_WB_EXTEND:
+		/* Extend at the beginning of the text is treated as Other */
+		cls = RSPAMD_FAST_WB_OTHER;
+		break;
+	default:
+		break;
+	}
+
+	p = rspamd_fast_wb_skip_extend(p, end, &next_cls);
+
+	while (p < end) {
+		switch (cls) {
+		case RSPAMD_FAST_WB_ALETTER:
+		case RSPAMD_FAST_WB_NUMERIC:
+		case RSPAMD_FAST_WB_EXTENDNUMLET:
+			break;
+		default:
+			/* WB999 */
+			return p - (const unsigned char *) text;
+		}
+
+		if (next_cls == RSPAMD_FAST_WB_ALETTER || next_cls == RSPAMD_FAST_WB_NUMERIC ||
+			next_cls == RSPAMD_FAST_WB_EXTENDNUMLET) {
+			/* WB5, WB8, WB9, WB10, WB13a, WB13b */
+			rspamd_fast_wb_class(p, end, &clen);
+			cls = next_cls;
+			p = rspamd_fast_wb_skip_extend(p + clen, end, &next_cls);
+			continue;
+		}
+		else if (cls != RSPAMD_FAST_WB_EXTENDNUMLET &&
+				 (next_cls == RSPAMD_FAST_WB_MIDNUMLET || next_cls == RSPAMD_FAST_WB_SINGLE_QUOTE ||
+				  (cls == RSPAMD_FAST_WB_ALETTER && next_cls == RSPAMD_FAST_WB_MIDLETTER) ||
+				  (cls == RSPAMD_FAST_WB_NUMERIC && next_cls == RSPAMD_FAST_WB_MIDNUM))) {
+			/* WB6, WB7, WB11, WB12: the character after the middle one must be the same class */
+			rspamd_fast_wb_class(p, end, &clen);
+			next = rspamd_fast_wb_skip_extend(p + clen, end, &after_cls);
+
+			if (next < end && after_cls == cls) {
+				rspamd_fast_wb_class(next, end, &clen);
+				p = rspamd_fast_wb_skip_extend(next + clen, end, &next_cls);
+				continue;
+			}
+		}
+
+		break;
+	}
+
+	return p - (const unsigned char *) text;
+}
+
+
 rspamd_words_t *
 rspamd_tokenize_text(const char *text, gsize len,
 					 const UText *utxt,
@@ -446,15 +794,25 @@ rspamd_tokenize_text(const char *text, gsize len,
 		UErrorCode uc_err = U_ZERO_ERROR;
 		int32_t last, p;
 		struct rspamd_process_exception *ex = NULL;
+		/* Latin, Greek and Cyrillic texts are segmented without ICU */
+		gboolean fast_wb = rspamd_tokenize_fast_supported(text, len);
 
-		if (bi == NULL) {
-			bi = ubrk_open(UBRK_WORD, NULL, NULL, 0, &uc_err);
+#define NEXT_BREAK(pos) (fast_wb ? rspamd_tokenize_fast_next_break(text, len, (pos)) : ubrk_next(bi))
 
-			g_assert(U_SUCCESS(uc_err));
+		if (fast_wb) {
+			last = 0;
+		}
+		else {
+			if (bi == NULL) {
+				bi = ubrk_open(UBRK_WORD, NULL, NULL, 0, &uc_err);
+
+				g_assert(U_SUCCESS(uc_err));
+			}
+
+			ubrk_setUText(bi, (UText *) utxt, &uc_err);
+			last = ubrk_first(bi);
 		}
 
-		ubrk_setUText(bi, (UText *) utxt, &uc_err);
-		last = ubrk_first(bi);
 		p = last;
 
 		if (cur) {
@@ -480,7 +838,7 @@ rspamd_tokenize_text(const char *text, gsize len,
 								/* Exception spread over the boundaries */
 								while (last > p && p != UBRK_DONE) {
 									int32_t old_p = p;
-									p = ubrk_next(bi);
+									p = NEXT_BREAK(p);
 
 									if (p != UBRK_DONE && p <= old_p) {
 										msg_warn_pool_check(
@@ -520,7 +878,7 @@ rspamd_tokenize_text(const char *text, gsize len,
 								/* Exception spread over the boundaries */
 								while (last > p && p != UBRK_DONE) {
 									int32_t old_p = p;
-									p = ubrk_next(bi);
+									p = NEXT_BREAK(p);
 									if (p != UBRK_DONE && p <= old_p) {
 										msg_warn_pool_check(
 											"tokenization reversed back on position %d,"
@@ -625,7 +983,7 @@ rspamd_tokenize_text(const char *text, gsize len,
 			}
 
 			last = p;
-			p = ubrk_next(bi);
+			p = NEXT_BREAK(p);
 
 			if (p != UBRK_DONE && p <= last) {
 				msg_warn_pool_check("tokenization reversed back on position %d,"
@@ -637,6 +995,7 @@ rspamd_tokenize_text(const char *text, gsize len,
 		}
 	}
 
+#undef NEXT_BREAK
 end:
 	if (!decay) {
 		hv = mum_hash_finish(hv);
@@ -928,14 +1287,375 @@ void rspamd_normalize_single_word(rspamd_word_t *tok, rspamd_mempool_t *pool)
 }
 
 
+/*
+ * Per process cache of normalised and stemmed words. Words repeat heavily
+ * both inside a message and between messages, so the results of ICU
+ * normalisation and snowball stemming are memorised in a bounded arena
+ * that is reused by all tasks of a worker. When the arena is full, the
+ * whole cache is dropped and filled from scratch.
+ */
+#define RSPAMD_WORDS_CACHE_ARENA_SIZE (4 * 1024 * 1024)
+#define RSPAMD_WORDS_CACHE_MAX_WORD 64
+#define RSPAMD_WORDS_CACHE_NORM_FLAGS (RSPAMD_STAT_TOKEN_FLAG_NORMALISED |       \
+									   RSPAMD_STAT_TOKEN_FLAG_INVISIBLE_SPACES | \
+									   RSPAMD_STAT_TOKEN_FLAG_EMOJI)
+
+KHASH_INIT(rspamd_words_cache, uint64_t, uint32_t, 1,
+		   kh_int64_hash_func, kh_int64_hash_equal);
+
+struct rspamd_words_cache_entry {
+	const void *owner; /* NULL for normalised words, stemmer for stems */
+	uint32_t flags;
+	uint16_t key_len;
+	uint16_t value_len;
+	uint32_t ulen;
+	uint32_t padding;
+	/* UChar32 unicode[ulen], char key[key_len], char value[value_len] */
+};
+
+static struct rspamd_words_cache {
+	khash_t(rspamd_words_cache) * entries;
+	unsigned char *arena;
+	gsize arena_used;
+	uint64_t hits;
+	uint64_t misses;
+	/* Counters already added to the server stat */
+	uint64_t reported_hits;
+	uint64_t reported_misses;
+} words_cache;
+
+static inline const char *
+rspamd_words_cache_entry_key(const struct rspamd_words_cache_entry *entry)
+{
+	return ((const char *) (entry + 1)) + entry->ulen * sizeof(UChar32);
+}
+
+static const struct rspamd_words_cache_entry *
+rspamd_words_cache_lookup(const void *owner, const char *key, gsize keylen)
+{
+	const struct rspamd_words_cache_entry *entry;
+	khiter_t k;
+
+	if (words_cache.entries == NULL || keylen == 0 ||
+		keylen > RSPAMD_WORDS_CACHE_MAX_WORD) {
+		return NULL;
+	}
+
+	k = kh_get(rspamd_words_cache, words_cache.entries,
+			   mum_hash(key, keylen, (uint64_t) (uintptr_t) owner));
+
+	if (k != kh_end(words_cache.entries)) {
+		entry = (const struct rspamd_words_cache_entry *) (words_cache.arena +
+														  kh_value(words_cache.entries, k));
+
+		if (entry->owner == owner && entry->key_len == keylen &&
+			memcmp(rspamd_words_cache_entry_key(entry), key, keylen) == 0) {
+			words_cache.hits++;
+
+			return entry;
+		}
+	}
+
+	words_cache.misses++;
+
+	return NULL;
+}
+
+static void
+rspamd_words_cache_insert(const void *owner, const char *key, gsize keylen,
+						  const UChar32 *unicode, gsize ulen,
+						  const char *value, gsize valuelen,
+						  uint32_t flags)
+{
+	struct rspamd_words_cache_entry *entry;
+	gsize entry_len;
+	khiter_t k;
+	int r;
+
+	if (keylen == 0 || keylen > RSPAMD_WORDS_CACHE_MAX_WORD ||
+		valuelen > G_MAXUINT16) {
+		return;
+	}
+
+	entry_len = sizeof(*entry) + ulen * sizeof(UChar32) + keylen + valuelen;
+	/* Keep entries aligned for the header and unicode arrays */
+	entry_len = (entry_len + 7) & ~((gsize) 7);
+
+	if (words_cache.entries == NULL) {
+		words_cache.entries = kh_init(rspamd_words_cache);
+		words_cache.arena = g_malloc(RSPAMD_WORDS_CACHE_ARENA_SIZE);
+		words_cache.arena_used = 0;
+	}
+
+	if (words_cache.arena_used + entry_len > RSPAMD_WORDS_CACHE_ARENA_SIZE) {
+		kh_clear(rspamd_words_cache, words_cache.entries);
+		words_cache.arena_used = 0;
+	}
+
+	entry = (struct rspamd_words_cache_entry *) (words_cache.arena +
+												 words_cache.arena_used);
+	entry->owner = owner;
+	entry->flags = flags;
+	entry->key_len = keylen;
+	entry->value_len = valuelen;
+	entry->ulen = ulen;
+	entry->padding = 0;
+
+	if (ulen > 0) {
+		memcpy(entry + 1, unicode, ulen * sizeof(UChar32));
+	}
+
+	memcpy((char *) rspamd_words_cache_entry_key(entry), key, keylen);
+
+	if (valuelen > 0) {
+		memcpy((char *) rspamd_words_cache_entry_key(entry) + keylen, value,
+			   valuelen);
+	}
+
+	k = kh_put(rspamd_words_cache, words_cache.entries,
+			   mum_hash(key, keylen, (uint64_t) (uintptr_t) owner), &r);
+	/* Collided entries are just overwritten */
+	kh_value(words_cache.entries, k) = words_cache.arena_used;
+	words_cache.arena_used += entry_len;
+}
+
+void rspamd_words_cache_stat(uint64_t *hits, uint64_t *misses)
+{
+	if (hits) {
+		*hits = words_cache.hits;
+	}
+	if (misses) {
+		*misses = words_cache.misses;
+	}
+}
+
+void rspamd_words_cache_report(struct rspamd_stat *stat)
+{
+	g_atomic_int_add(&stat->words_cache_hits,
+					 (int) (words_cache.hits - words_cache.reported_hits));
+	g_atomic_int_add(&stat->words_cache_misses,
+					 (int) (words_cache.misses - words_cache.reported_misses));
+	words_cache.reported_hits = words_cache.hits;
+	words_cache.reported_misses = words_cache.misses;
+}
+
+/*
+ * Fused normalisation for words built from Latin, Greek and Cyrillic letters
+ * and common punctuation (the same ranges as for the fast word boundaries).
+ * If every character of a word is a starter with NFKC quick check `yes`,
+ * the word is already normalised, so UTF-8 validation, lowercasing,
+ * filtering and encoding back to UTF-8 are done in a single pass without
+ * UTF-16 conversion, and both unicode and normalised forms share the same
+ * allocation. Other words are normalised by ICU.
+ */
+#define RSPAMD_FAST_NORM_MAX_WORD 256
+#define RSPAMD_FAST_NORM_SAFE (1u << 0u)
+#define RSPAMD_FAST_NORM_EMOJI (1u << 1u)
+#define RSPAMD_FAST_NORM_INVISIBLE (1u << 2u)
+
+struct rspamd_fast_norm_char {
+	int32_t lc; /* lowercased character or -1 if it is not copied */
+	uint32_t flags;
+};
+
+static struct rspamd_fast_norm_char rspamd_fast_norm_low[RSPAMD_FAST_WB_LOW_MAX];
+static struct rspamd_fast_norm_char rspamd_fast_norm_punct[RSPAMD_FAST_WB_PUNCT_MAX - RSPAMD_FAST_WB_PUNCT_START];
+static gboolean rspamd_fast_norm_initialized = FALSE;
+
+#if U_ICU_VERSION_MAJOR_NUM >= 44
+static void
+rspamd_fast_norm_fill(const UNormalizer2 *norm, UChar32 c,
+					  struct rspamd_fast_norm_char *nc)
+{
+	UErrorCode uc_err = U_ZERO_ERROR;
+	UChar buf[2];
+	int32_t len = 0;
+	UBool is_error = FALSE;
+
+	U16_APPEND(buf, len, G_N_ELEMENTS(buf), c, is_error);
+	nc->flags = 0;
+	nc->lc = -1;
+
+	if (unorm2_getCombiningClass(norm, c) == 0 &&
+		unorm2_quickCheck(norm, buf, len, &uc_err) == UNORM_YES &&
+		U_SUCCESS(uc_err)) {
+		nc->flags |= RSPAMD_FAST_NORM_SAFE;
+	}
+
+	/* Must be the same as in rspamd_uchars_to_ucs32 */
+	if (u_isgraph(c)) {
+		UCharCategory cat = u_charType(c);
+
+#if U_ICU_VERSION_MAJOR_NUM >= 57
+		if (u_hasBinaryProperty(c, UCHAR_EMOJI)) {
+			nc->flags |= RSPAMD_FAST_NORM_EMOJI;
+		}
+#endif
+
+		if ((cat >= U_UPPERCASE_LETTER && cat <= U_OTHER_NUMBER) ||
+			cat == U_CONNECTOR_PUNCTUATION ||
+			cat == U_MATH_SYMBOL ||
+			cat == U_CURRENCY_SYMBOL) {
+			nc->lc = u_tolower(c);
+		}
+	}
+	else {
+		nc->flags |= RSPAMD_FAST_NORM_INVISIBLE;
+	}
+}
+
+static void
+rspamd_fast_norm_init(void)
+{
+	const UNormalizer2 *norm;
+	UChar32 c;
+
+	if (rspamd_fast_norm_initialized) {
+		return;
+	}
+
+	norm = rspamd_get_unicode_normalizer();
+
+	for (c = 0; c < RSPAMD_FAST_WB_LOW_MAX; c++) {
+		rspamd_fast_norm_fill(norm, c, &rspamd_fast_norm_low[c]);
+	}
+
+	for (c = RSPAMD_FAST_WB_PUNCT_START; c < RSPAMD_FAST_WB_PUNCT_MAX; c++) {
+		rspamd_fast_norm_fill(norm, c,
+							  &rspamd_fast_norm_punct[c - RSPAMD_FAST_WB_PUNCT_START]);
+	}
+
+	rspamd_fast_norm_initialized = TRUE;
+}
+#endif
+
+gboolean
+rspamd_normalize_single_word_fast(rspamd_word_t *tok, rspamd_mempool_t *pool)
+{
+#if U_ICU_VERSION_MAJOR_NUM >= 44
+	const struct rspamd_fast_norm_char *nc;
+	UChar32 ubuf[RSPAMD_FAST_NORM_MAX_WORD], c;
+	/* Lowercasing can make a character one byte longer */
+	char obuf[RSPAMD_FAST_NORM_MAX_WORD * 3];
+	const uint8_t *src = (const uint8_t *) tok->original.begin;
+	int32_t i = 0, srclen = tok->original.len, olen = 0;
+	unsigned int ulen = 0, flags = 0;
+	unsigned char *dest;
+
+	if (!(tok->flags & RSPAMD_STAT_TOKEN_FLAG_UTF) ||
+		tok->original.len > RSPAMD_FAST_NORM_MAX_WORD) {
+		return FALSE;
+	}
+
+	rspamd_fast_norm_init();
+
+	while (i < srclen) {
+		U8_NEXT(src, i, srclen, c);
+
+		if (c < 0) {
+			/* Invalid utf8 */
+			return FALSE;
+		}
+		else if (c < RSPAMD_FAST_WB_LOW_MAX) {
+			nc = &rspamd_fast_norm_low[c];
+		}
+		else if (c >= RSPAMD_FAST_WB_PUNCT_START && c < RSPAMD_FAST_WB_PUNCT_MAX) {
+			nc = &rspamd_fast_norm_punct[c - RSPAMD_FAST_WB_PUNCT_START];
+		}
+		else {
+			return FALSE;
+		}
+
+		if (!(nc->flags & RSPAMD_FAST_NORM_SAFE)) {
+			return FALSE;
+		}
+
+		flags |= nc->flags;
+
+		if (nc->lc >= 0) {
+			ubuf[ulen++] = nc->lc;
+			U8_APPEND_UNSAFE(obuf, olen, nc->lc);
+		}
+	}
+
+	dest = rspamd_mempool_alloc(pool, ulen * sizeof(UChar32) + olen + 1);
+	memcpy(dest, ubuf, ulen * sizeof(UChar32));
+	tok->unicode.begin = (UChar32 *) dest;
+	tok->unicode.len = ulen;
+	dest += ulen * sizeof(UChar32);
+	memcpy(dest, obuf, olen);
+	dest[olen] = '\0';
+	tok->normalized.begin = (const char *) dest;
+	tok->normalized.len = olen;
+
+	if (flags & RSPAMD_FAST_NORM_EMOJI) {
+		tok->flags |= RSPAMD_STAT_TOKEN_FLAG_EMOJI;
+	}
+	if (flags & RSPAMD_FAST_NORM_INVISIBLE) {
+		tok->flags |= RSPAMD_STAT_TOKEN_FLAG_INVISIBLE_SPACES;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
 void rspamd_normalize_words(rspamd_words_t *words, rspamd_mempool_t *pool)
 {
+	const struct rspamd_words_cache_entry *entry;
 	rspamd_word_t *tok;
 	unsigned int i;
 
 	for (i = 0; i < kv_size(*words); i++) {
 		tok = &kv_A(*words, i);
-		rspamd_normalize_single_word(tok, pool);
+
+		if (!(tok->flags & RSPAMD_STAT_TOKEN_FLAG_UTF)) {
+			/* Lowercasing is cheaper than a cache lookup */
+			rspamd_normalize_single_word(tok, pool);
+			continue;
+		}
+
+		if (rspamd_normalize_single_word_fast(tok, pool)) {
+			continue;
+		}
+
+		entry = rspamd_words_cache_lookup(NULL, tok->original.begin,
+										  tok->original.len);
+
+		if (entry) {
+			UChar32 *unicode = NULL;
+			char *dest;
+
+			if (entry->ulen > 0) {
+				unicode = rspamd_mempool_alloc(pool,
+											   entry->ulen * sizeof(UChar32));
+				memcpy(unicode, entry + 1, entry->ulen * sizeof(UChar32));
+			}
+
+			dest = rspamd_mempool_alloc(pool, entry->value_len + 1);
+			memcpy(dest, rspamd_words_cache_entry_key(entry) + entry->key_len,
+				   entry->value_len);
+			dest[entry->value_len] = '\0';
+
+			tok->unicode.begin = unicode;
+			tok->unicode.len = entry->ulen;
+			tok->normalized.begin = dest;
+			tok->normalized.len = entry->value_len;
+			tok->flags |= entry->flags;
+		}
+		else {
+			rspamd_normalize_single_word(tok, pool);
+
+			if (!(tok->flags & RSPAMD_STAT_TOKEN_FLAG_BROKEN_UNICODE) &&
+				tok->normalized.begin != NULL) {
+				rspamd_words_cache_insert(NULL, tok->original.begin,
+										  tok->original.len,
+										  tok->unicode.begin, tok->unicode.len,
+										  tok->normalized.begin, tok->normalized.len,
+										  tok->flags & RSPAMD_WORDS_CACHE_NORM_FLAGS);
+			}
+		}
 	}
 }
 
@@ -995,12 +1715,25 @@ void rspamd_stem_words(rspamd_words_t *words, rspamd_mempool_t *pool,
 
 		if (tok->flags & RSPAMD_STAT_TOKEN_FLAG_UTF) {
 			if (stem) {
+				const struct rspamd_words_cache_entry *entry;
 				const char *stemmed = NULL;
 
-				stemmed = sb_stemmer_stem(stem,
-										  tok->normalized.begin, tok->normalized.len);
+				entry = rspamd_words_cache_lookup(stem, tok->normalized.begin,
+												  tok->normalized.len);
 
-				dlen = sb_stemmer_length(stem);
+				if (entry) {
+					stemmed = rspamd_words_cache_entry_key(entry) + entry->key_len;
+					dlen = entry->value_len;
+				}
+				else {
+					stemmed = sb_stemmer_stem(stem,
+											  tok->normalized.begin, tok->normalized.len);
+					dlen = stemmed != NULL ? sb_stemmer_length(stem) : 0;
+					/* Failed stems are cached as empty values */
+					rspamd_words_cache_insert(stem, tok->normalized.begin,
+											  tok->normalized.len, NULL, 0,
+											  stemmed, dlen, 0);
+				}
 
 				if (stemmed != NULL && dlen > 0) {
 					dest = rspamd_mempool_alloc(pool, dlen);
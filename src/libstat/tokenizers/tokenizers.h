@@ -70,6 +70,18 @@ rspamd_words_t *rspamd_tokenize_text(const char *text, gsize len,
 									 rspamd_words_t *output_kvec,
 									 rspamd_mempool_t *pool);
 
+/*
+ * Returns TRUE if word boundaries of the text can be found without ICU
+ * (Latin, Greek and Cyrillic letters, digits and common punctuation)
+ */
+gboolean rspamd_tokenize_fast_supported(const char *text, gsize len);
+
+/*
+ * Returns the next word boundary after pos like ubrk_next does, or UBRK_DONE;
+ * the text must be checked by rspamd_tokenize_fast_supported
+ */
+int32_t rspamd_tokenize_fast_next_break(const char *text, gsize len, int32_t pos);
+
 /* OSB tokenize function */
 int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 						 struct rspamd_task *task,
@@ -78,6 +90,15 @@ int rspamd_tokenizer_osb(struct rspamd_stat_ctx *ctx,
 						 const char *prefix,
 						 GPtrArray *result);
 
+/*
+ * Hashes OSB pairs of `n` words with each of `window_size - 1` preceding words,
+ * that must be stored just before `hashes`; the hash of a pair at distance `i`
+ * from the word `k` is stored in `out[(i - 1) * n + k]`
+ */
+void rspamd_tokenizer_osb_hash_pairs(const uint64_t *hashes, gsize n,
+									 unsigned int window_size, gboolean compat,
+									 uint64_t *out);
+
 gpointer rspamd_tokenizer_osb_get_config(rspamd_mempool_t *pool,
 										 struct rspamd_tokenizer_config *cf,
 										 gsize *len);
@@ -86,6 +107,13 @@ struct rspamd_lang_detector;
 
 void rspamd_normalize_single_word(rspamd_word_t *tok, rspamd_mempool_t *pool);
 
+/**
+ * Normalises a word that consists of characters that need no ICU
+ * normalisation in a single pass
+ * @return FALSE if the word must be normalised by rspamd_normalize_single_word
+ */
+gboolean rspamd_normalize_single_word_fast(rspamd_word_t *tok, rspamd_mempool_t *pool);
+
 /* Word processing functions */
 void rspamd_normalize_words(rspamd_words_t *words, rspamd_mempool_t *pool);
 void rspamd_stem_words(rspamd_words_t *words, rspamd_mempool_t *pool,
@@ -94,6 +122,18 @@ void rspamd_stem_words(rspamd_words_t *words, rspamd_mempool_t *pool,
 
 void rspamd_tokenize_meta_words(struct rspamd_task *task);
 
+/**
+ * Returns number of hits and misses of the per process cache of
+ * normalised and stemmed words
+ */
+void rspamd_words_cache_stat(uint64_t *hits, uint64_t *misses);
+
+/**
+ * Adds hits and misses of the words cache since the previous report to the
+ * server stat
+ */
+void rspamd_words_cache_report(struct rspamd_stat *stat);
+
 #ifdef __cplusplus
 }
 #endif
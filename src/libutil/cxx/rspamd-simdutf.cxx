@@ -61,6 +61,17 @@ off_t rspamd_fast_utf8_validate_ref(const unsigned char *data, size_t len)
 	return res.count + 1;// We need to return offset for the first invalid character
 }
 
+size_t rspamd_fast_ascii_prefix_len(const unsigned char *data, size_t len)
+{
+	auto res = impl->validate_ascii_with_errors((const char *) data, len);
+
+	if (res.error == simdutf::error_code::SUCCESS) {
+		return len;
+	}
+
+	return res.count;// Offset of the first non-ASCII character
+}
+
 const char *rspamd_fast_utf8_library_impl_name(void)
 {
 	static auto impl_name = std::string{};
@@ -28,6 +28,8 @@ void rspamd_fast_utf8_library_init(unsigned flags);
 const char *rspamd_fast_utf8_library_impl_name(void);
 off_t rspamd_fast_utf8_validate(const unsigned char *data, size_t len);
 off_t rspamd_fast_utf8_validate_ref(const unsigned char *data, size_t len);
+/* Returns length of the leading pure ASCII part of data */
+size_t rspamd_fast_ascii_prefix_len(const unsigned char *data, size_t len);
 
 #ifdef __cplusplus
 }
@@ -2623,7 +2623,7 @@ gssize
 rspamd_decode_qp_buf(const char *in, gsize inlen,
 					 char *out, gsize outlen)
 {
-	char *o, *end, *pos, c;
+	char *o, *end, c;
 	const char *p;
 	unsigned char ret;
 	gssize remain, processed;
@@ -2730,39 +2730,29 @@ rspamd_decode_qp_buf(const char *in, gsize inlen,
 		}
 		else {
 			if (end - o >= remain) {
-				if ((pos = memccpy(o, p, '=', remain)) == NULL) {
+				processed = rspamd_cryptobox_qp_span(p, remain, o, FALSE);
+				o += processed;
+
+				if (processed == remain) {
 					/* All copied */
-					o += remain;
 					break;
 				}
-				else {
-					processed = pos - o;
-					remain -= processed;
-					p += processed;
 
-					if (remain > 0) {
-						o = pos - 1;
-						/*
-						 * Skip comparison and jump inside decode branch,
-						 * as we know that we have found match
-						 */
-						goto decode;
-					}
-					else {
-						/* Last '=' character, bugon */
-						o = pos;
-
-						if (end - o > 0) {
-							*o = '=';
-						}
-						else {
-							/* Buffer overflow */
-							return (-1);
-						}
+				/* Skip '=' */
+				remain -= processed + 1;
+				p += processed + 1;
 
-						break;
-					}
+				if (remain > 0) {
+					/*
+					 * Skip comparison and jump inside decode branch,
+					 * as we know that we have found match
+					 */
+					goto decode;
 				}
+
+				/* Last '=' character, bugon */
+				*o++ = '=';
+				break;
 			}
 			else {
 				/* Buffer overflow */
@@ -3058,6 +3048,67 @@ gsize rspamd_memcspn(const void *data, gsize dlen, const void *reject, gsize rle
 	return p - s;
 }
 
+gsize rspamd_str_line_span(const char *s, gsize len)
+{
+	const char *p = s, *end = s + len;
+
+#ifdef __x86_64__
+	const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n'),
+				  zero = _mm_setzero_si128();
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+															   _mm_cmpeq_epi8(v, lf)),
+												  _mm_cmpeq_epi8(v, zero)));
+
+		if (mask != 0) {
+			return (p - s) + __builtin_ctz(mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (p < end && *p != '\r' && *p != '\n' && *p != '\0') {
+		p++;
+	}
+
+	return p - s;
+}
+
+gsize rspamd_str_header_name_span(const char *s, gsize len)
+{
+	const char *p = s, *end = s + len;
+
+#ifdef __x86_64__
+	const __m128i colon = _mm_set1_epi8(':'), space = _mm_set1_epi8(' '),
+				  tab = _mm_set1_epi8('\t'), ctl_range = _mm_set1_epi8(4);
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) p);
+		/* \t, \n, \v, \f and \r are 9..13, so v - 9 <= 4 as unsigned */
+		__m128i ctl = _mm_sub_epi8(v, tab);
+		__m128i is_ctl = _mm_cmpeq_epi8(_mm_min_epu8(ctl, ctl_range), ctl);
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, colon),
+															   _mm_cmpeq_epi8(v, space)),
+												  is_ctl));
+
+		if (mask != 0) {
+			return (p - s) + __builtin_ctz(mask);
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (p < end && *p != ':' && !g_ascii_isspace(*p)) {
+		p++;
+	}
+
+	return p - s;
+}
+
 gsize rspamd_memspn(const char *s, const char *e, gsize len)
 {
 	gsize byteset[32 / sizeof(gsize)];
@@ -3155,8 +3206,7 @@ rspamd_decode_qp2047_buf(const char *in, gsize inlen,
 		}
 		else {
 			if (end - o >= remain) {
-				processed = rspamd_memcspn(p, remain, "=_", 2);
-				memcpy(o, p, processed);
+				processed = rspamd_cryptobox_qp_span(p, remain, o, TRUE);
 				o += processed;
 
 				if (processed == remain) {
@@ -473,6 +473,24 @@ void *rspamd_memrchr(const void *m, int c, gsize len);
  */
 gsize rspamd_memcspn(const void *data, gsize dlen, const void *reject, gsize rlen);
 
+/**
+ * Return length of memory segment starting in `s` that contains no CR, LF or NUL
+ * characters
+ * @param s any input
+ * @param len length of `s`
+ * @return segment size
+ */
+gsize rspamd_str_line_span(const char *s, gsize len);
+
+/**
+ * Return length of memory segment starting in `s` that contains no ':' or
+ * whitespace characters, e.g. a header name
+ * @param s any input
+ * @param len length of `s`
+ * @return segment size
+ */
+gsize rspamd_str_header_name_span(const char *s, gsize len);
+
 /**
  * Return length of memory segment starting in `s` that contains only chars from `e`
  * @param s any input
@@ -2091,6 +2091,56 @@ rspamd_shmem_xmap(const char *fname, unsigned int mode,
 	return map;
 }
 
+int rspamd_tmpfile_open(const char *dir)
+{
+	char fpath[PATH_MAX];
+	int fd;
+
+	rspamd_snprintf(fpath, sizeof(fpath), "%s%c%s",
+					dir, G_DIR_SEPARATOR, "rspamd-spill-XXXXXXXXXX");
+	fd = g_mkstemp_full(fpath, O_RDWR, 0600);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	/* File is not visible anymore and is removed once the last fd/map is gone */
+	unlink(fpath);
+
+	return fd;
+}
+
+gpointer
+rspamd_tmpfile_xmap(const char *dir, gsize size)
+{
+	int fd;
+	gpointer map;
+
+	g_assert(dir != NULL);
+	g_assert(size > 0);
+
+	fd = rspamd_tmpfile_open(dir);
+
+	if (fd == -1) {
+		return NULL;
+	}
+
+	if (ftruncate(fd, size) == -1) {
+		close(fd);
+
+		return NULL;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	return map;
+}
+
 /*
  * A(x - 0.5)^4 + B(x - 0.5)^3 + C(x - 0.5)^2 + D(x - 0.5)
  * A = 32,
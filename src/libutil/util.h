@@ -466,6 +466,21 @@ gpointer rspamd_file_xmap(const char *fname, unsigned int mode, gsize *size,
 gpointer rspamd_shmem_xmap(const char *fname, unsigned int mode,
 						   gsize *size);
 
+/**
+ * Create an unlinked temporary file, so its pages could be written back to disk
+ * @param dir directory for the file
+ * @return fd or -1 in case of error
+ */
+int rspamd_tmpfile_open(const char *dir);
+
+/**
+ * Map an unlinked temporary file of the specified size for reading and writing
+ * @param dir directory for the file
+ * @param size target size (must be positive)
+ * @return pointer to memory (should be freed using munmap) or NULL in case of error
+ */
+gpointer rspamd_tmpfile_xmap(const char *dir, gsize size);
+
 /**
  * Normalize probabilities using polynomial function
  * @param x probability (bias .. 1)
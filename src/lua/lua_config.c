@@ -226,6 +226,8 @@ LUA_FUNCTION_DEF(config, get_classifier);
  *   + `trivial` symbol is trivial (e.g. no network requests)
  *   + `explicit_disable` requires explicit disabling (e.g. via settings)
  *   + `ignore_passthrough` executed even if passthrough result has been set
+ *   + `headers_only` prefilter that needs merely message headers, it could be
+ *     executed before the whole message is received (streaming mode)
  * - `parent`: id of parent symbol (useful for virtual symbols)
  * - `score`: default score of the symbol
  * - `description`: description of the symbol
@@ -971,6 +973,15 @@ LUA_FUNCTION_DEF(config, init_modules);
  */
 LUA_FUNCTION_DEF(config, init_subsystem);
 
+/***
+ * @method rspamd_config:compile_languages([path])
+ * Compiles languages data and stop words to a binary file used by the
+ * language detector instead of json files
+ * @param {string} path output file, `compiled_languages` option by default
+ * @return {boolean,string} true or false and error message
+ */
+LUA_FUNCTION_DEF(config, compile_languages);
+
 /***
  * @method rspamd_config:get_tld_path()
  * Returns path to TLD file
@@ -1102,6 +1113,7 @@ static const struct luaL_reg configlib_m[] = {
 	LUA_INTERFACE_DEF(config, parse_rcl),
 	LUA_INTERFACE_DEF(config, init_modules),
 	LUA_INTERFACE_DEF(config, init_subsystem),
+	LUA_INTERFACE_DEF(config, compile_languages),
 	LUA_INTERFACE_DEF(config, get_tld_path),
 	LUA_INTERFACE_DEF(config, get_dns_max_requests),
 	LUA_INTERFACE_DEF(config, get_dns_timeout),
@@ -1982,6 +1994,9 @@ lua_parse_symbol_flags(const char *str)
 		if (strstr(str, "coro") != NULL) {
 			ret |= SYMBOL_TYPE_USE_CORO;
 		}
+		if (strstr(str, "headers_only") != NULL) {
+			ret |= SYMBOL_TYPE_HEADERS_ONLY;
+		}
 	}
 
 	return ret;
@@ -2127,6 +2142,10 @@ lua_push_symbol_flags(lua_State *L, unsigned int flags, enum lua_push_symbol_fla
 	if (flags & SYMBOL_TYPE_COMPOSITE) {
 		LUA_OPTION_PUSH(composite);
 	}
+
+	if (flags & SYMBOL_TYPE_HEADERS_ONLY) {
+		LUA_OPTION_PUSH(headers_only);
+	}
 }
 
 static int
@@ -5208,6 +5227,34 @@ lua_config_register_re_selector(lua_State *L)
 	return 1;
 }
 
+static int
+lua_config_compile_languages(lua_State *L)
+{
+	LUA_TRACE_POINT;
+	struct rspamd_config *cfg = lua_check_config(L, 1);
+	const char *path = luaL_optstring(L, 2, NULL);
+	GError *err = NULL;
+
+	if (cfg == NULL) {
+		return luaL_error(L, "invalid arguments");
+	}
+
+	if (!rspamd_language_detector_compile(cfg, path, &err)) {
+		lua_pushboolean(L, false);
+		lua_pushstring(L, err ? err->message : "unknown error");
+
+		if (err) {
+			g_error_free(err);
+		}
+
+		return 2;
+	}
+
+	lua_pushboolean(L, true);
+
+	return 1;
+}
+
 static int
 lua_config_get_tld_path(lua_State *L)
 {
@@ -368,6 +368,13 @@ LUA_FUNCTION_DEF(mimepart, get_headers);
  * @return {text} opaque text object (zero-copy if not casted to lua string)
  */
 LUA_FUNCTION_DEF(mimepart, get_content);
+/***
+ * @method mime_part:get_content_prefix(len)
+ * Get the first `len` bytes of the parsed content, encoded parts are not decoded as a whole
+ * @param {number} len maximum length of the prefix
+ * @return {text,boolean} opaque text object and true if it is the whole content
+ */
+LUA_FUNCTION_DEF(mimepart, get_content_prefix);
 /***
  * @method mime_part:get_raw_content()
  * Get the raw content of part
@@ -598,8 +605,16 @@ LUA_FUNCTION_DEF(mimepart, get_urls);
  */
 LUA_FUNCTION_DEF(mimepart, is_injected);
 
+/***
+ * @method mime_part:is_decoded()
+ * Returns false if the transfer encoding of the part has not been decoded yet: binary attachments are decoded on the first access to their content
+ * @return {boolean} true if the content of the part is available without decoding
+ */
+LUA_FUNCTION_DEF(mimepart, is_decoded);
+
 static const struct luaL_reg mimepartlib_m[] = {
 	LUA_INTERFACE_DEF(mimepart, get_content),
+	LUA_INTERFACE_DEF(mimepart, get_content_prefix),
 	LUA_INTERFACE_DEF(mimepart, get_raw_content),
 	LUA_INTERFACE_DEF(mimepart, get_length),
 	LUA_INTERFACE_DEF(mimepart, get_type),
@@ -637,6 +652,7 @@ static const struct luaL_reg mimepartlib_m[] = {
 	LUA_INTERFACE_DEF(mimepart, set_specific),
 	LUA_INTERFACE_DEF(mimepart, is_specific),
 	LUA_INTERFACE_DEF(mimepart, is_injected),
+	LUA_INTERFACE_DEF(mimepart, is_decoded),
 	{"__tostring", rspamd_lua_class_tostring},
 	{NULL, NULL}};
 
@@ -1717,6 +1733,7 @@ lua_mimepart_get_content(lua_State *L)
 
 	t = lua_newuserdata(L, sizeof(*t));
 	rspamd_lua_setclass(L, rspamd_text_classname, -1);
+	rspamd_mime_part_get_content(part);
 	t->start = part->parsed_data.begin;
 	t->len = part->parsed_data.len;
 	t->flags = 0;
@@ -1728,6 +1745,36 @@ lua_mimepart_get_content(lua_State *L)
 	return 1;
 }
 
+static int
+lua_mimepart_get_content_prefix(lua_State *L)
+{
+	LUA_TRACE_POINT;
+	struct rspamd_mime_part *part = lua_check_mimepart(L);
+	struct rspamd_lua_text *t;
+	rspamd_ftok_t prefix;
+	gboolean complete;
+
+	if (part == NULL || !lua_isnumber(L, 2) || lua_tointeger(L, 2) < 0) {
+		return luaL_error(L, "invalid arguments");
+	}
+
+	prefix = rspamd_mime_part_get_content_prefix(part, lua_tointeger(L, 2),
+												 &complete);
+	t = lua_newuserdata(L, sizeof(*t));
+	rspamd_lua_setclass(L, rspamd_text_classname, -1);
+	t->start = prefix.begin;
+	t->len = prefix.len;
+	t->flags = 0;
+
+	if (lua_is_text_binary(t)) {
+		t->flags |= RSPAMD_TEXT_FLAG_BINARY;
+	}
+
+	lua_pushboolean(L, complete);
+
+	return 2;
+}
+
 static int
 lua_mimepart_get_raw_content(lua_State *L)
 {
@@ -1760,7 +1807,7 @@ lua_mimepart_get_length(lua_State *L)
 		return 1;
 	}
 
-	lua_pushinteger(L, part->parsed_data.len);
+	lua_pushinteger(L, rspamd_mime_part_get_content(part)->len);
 
 	return 1;
 }
@@ -2356,7 +2403,7 @@ lua_mimepart_get_digest(lua_State *L)
 	}
 
 	memset(digestbuf, 0, sizeof(digestbuf));
-	rspamd_encode_hex_buf(part->digest, sizeof(part->digest),
+	rspamd_encode_hex_buf(rspamd_mime_part_get_digest(part), sizeof(part->digest),
 						  digestbuf, sizeof(digestbuf));
 	lua_pushstring(L, digestbuf);
 
@@ -2552,6 +2599,21 @@ lua_mimepart_is_injected(lua_State *L)
 	return 1;
 }
 
+static int
+lua_mimepart_is_decoded(lua_State *L)
+{
+	LUA_TRACE_POINT;
+	struct rspamd_mime_part *part = lua_check_mimepart(L);
+
+	if (part == NULL) {
+		return luaL_error(L, "invalid arguments");
+	}
+
+	lua_pushboolean(L, !(part->flags & RSPAMD_MIME_PART_ENCODED));
+
+	return 1;
+}
+
 static int
 lua_mimepart_set_specific(lua_State *L)
 {
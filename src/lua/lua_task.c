@@ -2710,7 +2710,7 @@ lua_task_get_urls(lua_State *L)
 
 		sz = kh_size(MESSAGE_FIELD(task, urls));
 		sz = lua_url_adjust_skip_prob(task->task_timestamp,
-									  MESSAGE_FIELD(task, digest), &cb, sz);
+									  task->message, &cb, sz);
 
 		lua_createtable(L, sz, 0);
 
@@ -2778,7 +2778,7 @@ lua_task_get_urls_filtered(lua_State *L)
 
 		sz = kh_size(MESSAGE_FIELD(task, urls));
 		sz = lua_url_adjust_skip_prob(task->task_timestamp,
-									  MESSAGE_FIELD(task, digest), &cb, sz);
+									  task->message, &cb, sz);
 
 		lua_createtable(L, sz, 0);
 
@@ -3186,7 +3186,7 @@ lua_task_get_emails(lua_State *L)
 
 			sz = kh_size(MESSAGE_FIELD(task, urls));
 			sz = lua_url_adjust_skip_prob(task->task_timestamp,
-										  MESSAGE_FIELD(task, digest), &cb, sz);
+										  task->message, &cb, sz);
 
 			lua_createtable(L, sz, 0);
 
@@ -6358,7 +6358,7 @@ lua_task_get_digest(lua_State *L)
 
 	if (task) {
 		if (task->message) {
-			r = rspamd_encode_hex_buf(MESSAGE_FIELD(task, digest),
+			r = rspamd_encode_hex_buf(rspamd_message_get_digest(task->message),
 									  sizeof(MESSAGE_FIELD(task, digest)),
 									  hexbuf, sizeof(hexbuf) - 1);
 
@@ -1638,11 +1638,9 @@ lua_text_exclude_chars(lua_State *L)
 	unsigned int *plen;
 
 	if (t != NULL && pat && patlen > 0) {
-		if (lua_isboolean(L, 3)) {
-			copy = lua_toboolean(L, 3);
-		}
-		else if (t->flags & RSPAMD_TEXT_FLAG_OWN) {
-			copy = FALSE;
+		/* Texts that are not owned may point to the message itself */
+		if (t->flags & RSPAMD_TEXT_FLAG_OWN) {
+			copy = lua_isboolean(L, 3) ? lua_toboolean(L, 3) : FALSE;
 		}
 
 		if (!copy) {
@@ -1775,11 +1773,9 @@ lua_text_oneline(lua_State *L)
 	unsigned int *plen;
 
 	if (t != NULL) {
-		if (lua_isboolean(L, 2)) {
-			copy = lua_toboolean(L, 2);
-		}
-		else if (t->flags & RSPAMD_TEXT_FLAG_OWN) {
-			copy = FALSE;
+		/* Texts that are not owned may point to the message itself */
+		if (t->flags & RSPAMD_TEXT_FLAG_OWN) {
+			copy = lua_isboolean(L, 2) ? lua_toboolean(L, 2) : FALSE;
 		}
 
 		if (!copy) {
@@ -1946,6 +1942,22 @@ lua_text_normalize_newlines(lua_State *L)
 	return 1;
 }
 
+/*
+ * Texts that do not own their memory may point to the message or to mime
+ * parts content shared with it, so they are copied before in-place changes
+ */
+static void
+lua_text_detach(struct rspamd_lua_text *t)
+{
+	if (!(t->flags & RSPAMD_TEXT_FLAG_OWN) && t->len > 0) {
+		char *storage = g_malloc(t->len);
+
+		memcpy(storage, t->start, t->len);
+		t->start = storage;
+		t->flags = RSPAMD_TEXT_FLAG_OWN | (t->flags & RSPAMD_TEXT_FLAG_BINARY);
+	}
+}
+
 static int
 lua_text_lower(lua_State *L)
 {
@@ -1963,6 +1975,7 @@ lua_text_lower(lua_State *L)
 
 		if (is_inplace) {
 			nt = t;
+			lua_text_detach(nt);
 			lua_pushvalue(L, 1);
 		}
 		else {
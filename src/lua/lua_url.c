@@ -15,6 +15,7 @@
  */
 #include "lua_common.h"
 #include "lua_url.h"
+#include "message.h"
 
 
 /***
@@ -1577,7 +1578,7 @@ void lua_url_cbdata_dtor(struct lua_tree_cb_data *cbd)
 }
 
 gsize lua_url_adjust_skip_prob(float timestamp,
-							   unsigned char digest[16],
+							   struct rspamd_message *msg,
 							   struct lua_tree_cb_data *cb,
 							   gsize sz)
 {
@@ -1589,7 +1590,7 @@ gsize lua_url_adjust_skip_prob(float timestamp,
 		 * We use both digest and timestamp here to avoid attack surface
 		 * based just on digest.
 		 */
-		memcpy(&cb->random_seed, digest, 4);
+		memcpy(&cb->random_seed, rspamd_message_get_digest(msg), 4);
 		memcpy(((unsigned char *) &cb->random_seed) + 4, &timestamp, 4);
 		sz = cb->max_urls;
 	}
@@ -22,6 +22,8 @@
 extern "C" {
 #endif
 
+struct rspamd_message;
+
 struct lua_tree_cb_data {
 	lua_State *L;
 	int i;
@@ -69,14 +71,14 @@ void lua_url_cbdata_dtor(struct lua_tree_cb_data *cbd);
 /**
  * Adjust probabilistic skip of the urls
  * @param timestamp
- * @param digest
+ * @param msg message which digest seeds the skip, it is computed if needed
  * @param cb
  * @param sz
  * @param max_urls
  * @return
  */
 gsize lua_url_adjust_skip_prob(float timestamp,
-							   unsigned char digest[16],
+							   struct rspamd_message *msg,
 							   struct lua_tree_cb_data *cb,
 							   gsize sz);
 
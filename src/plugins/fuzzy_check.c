@@ -4095,7 +4095,7 @@ fuzzy_cmd_from_data_part(struct fuzzy_rule *rule,
 						 int flag,
 						 uint32_t weight,
 						 struct rspamd_task *task,
-						 unsigned char digest[rspamd_cryptobox_HASHBYTES],
+						 const unsigned char digest[rspamd_cryptobox_HASHBYTES],
 						 struct rspamd_mime_part *mp)
 {
 	struct rspamd_fuzzy_cmd *cmd;
@@ -4500,7 +4500,7 @@ fuzzy_insert_result(struct fuzzy_client_session *session,
 
 	if (io) {
 		if ((io->flags & FUZZY_CMD_FLAG_IMAGE)) {
-			if (!io->part || io->part->parsed_data.len <= short_image_limit) {
+			if (!io->part || rspamd_mime_part_get_content(io->part)->len <= short_image_limit) {
 				nval *= rspamd_normalize_probability(rep->v1.prob, 0.5);
 			}
 
@@ -5563,7 +5563,7 @@ fuzzy_generate_commands(struct rspamd_task *task, struct fuzzy_rule *rule,
 
 					io = fuzzy_cmd_from_data_part(rule, c, flag, value,
 												  task,
-												  image->parent->digest,
+												  rspamd_mime_part_get_digest(image->parent),
 												  mime_part);
 					io->flags |= FUZZY_CMD_FLAG_IMAGE;
 				}
@@ -5627,14 +5627,14 @@ fuzzy_generate_commands(struct rspamd_task *task, struct fuzzy_rule *rule,
 						io = fuzzy_cmd_from_data_part(rule, c,
 													  flag, value,
 													  task,
-													  mime_part->digest,
+													  rspamd_mime_part_get_digest(mime_part),
 													  mime_part);
 					}
 				}
 				else if (check_part) {
 					io = fuzzy_cmd_from_data_part(rule, c, flag, value,
 												  task,
-												  mime_part->digest, mime_part);
+												  rspamd_mime_part_get_digest(mime_part), mime_part);
 				}
 
 				if (io) {
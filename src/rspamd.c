@@ -1592,9 +1592,10 @@ int main(int argc, char **argv, char **env)
 	msg_info_main("cpu features: %s",
 				  rspamd_main->cfg->libs_ctx->crypto_ctx->cpu_extensions);
 	msg_info_main("cryptobox configuration: curve25519(libsodium), "
-				  "chacha20(%s), poly1305(libsodium), siphash(libsodium), blake2(libsodium), base64(%s)",
+				  "chacha20(%s), poly1305(libsodium), siphash(libsodium), blake2(libsodium), base64(%s), qp(%s)",
 				  rspamd_main->cfg->libs_ctx->crypto_ctx->chacha20_impl,
-				  rspamd_main->cfg->libs_ctx->crypto_ctx->base64_impl);
+				  rspamd_main->cfg->libs_ctx->crypto_ctx->base64_impl,
+				  rspamd_main->cfg->libs_ctx->crypto_ctx->qp_impl);
 	msg_info_main("libottery prf: %s", ottery_get_impl_name());
 	msg_info_main("simdutf implementation: %s", rspamd_fast_utf8_library_impl_name());
 
@@ -298,6 +298,11 @@ struct RSPAMD_ALIGNED(64) rspamd_stat {
 	unsigned int connections_count;               /**< total connections count						*/
 	unsigned int control_connections_count;       /**< connections count to control interface			*/
 	unsigned int messages_learned;                /**< messages learned								*/
+	unsigned int words_cache_hits;                /**< normalised and stemmed words cache hits			*/
+	unsigned int words_cache_misses;              /**< normalised and stemmed words cache misses		*/
+	unsigned int charset_detect_ascii;            /**< charsets detected as 7 bit by simdutf			*/
+	unsigned int charset_detect_utf8;             /**< charsets detected as valid UTF-8 by simdutf		*/
+	unsigned int charset_detect_ced;              /**< charsets detected by CED							*/
 	struct rspamd_avg_time avg_time;              /**< average time stats								*/
 };
 
@@ -103,12 +103,10 @@ reduce_tasks_count(gpointer arg)
 	}
 }
 
-static int
-rspamd_worker_body_handler(struct rspamd_http_connection *conn,
-						   struct rspamd_http_message *msg,
-						   const char *chunk, gsize len)
+static struct rspamd_task *
+rspamd_worker_task_new(struct rspamd_worker_session *session,
+					   struct rspamd_http_message *msg)
 {
-	struct rspamd_worker_session *session = (struct rspamd_worker_session *) conn->ud;
 	struct rspamd_task *task;
 	struct rspamd_worker_ctx *ctx;
 	const rspamd_ftok_t *hv_tok;
@@ -172,11 +170,44 @@ rspamd_worker_body_handler(struct rspamd_http_connection *conn,
 		msg_err_task("cannot handle request: %e", task->err);
 		task->flags |= RSPAMD_TASK_FLAG_SKIP;
 	}
-	else {
-		if (task->cmd == CMD_PING || task->cmd == CMD_METRICS) {
-			task->flags |= RSPAMD_TASK_FLAG_SKIP;
-		}
-		else if (task->cmd == CMD_CHECK_V3) {
+	else if (task->cmd == CMD_PING || task->cmd == CMD_METRICS) {
+		task->flags |= RSPAMD_TASK_FLAG_SKIP;
+	}
+
+	return task;
+}
+
+/*
+ * Sets global timeout for the task unless it is already set
+ */
+static void
+rspamd_worker_task_set_timeout(struct rspamd_worker_ctx *ctx,
+							   struct rspamd_task *task)
+{
+	if (!isnan(ctx->task_timeout) && ctx->task_timeout > 0.0 &&
+		task->timeout_ev.data == NULL) {
+		task->timeout_ev.data = task;
+		ev_timer_init(&task->timeout_ev, rspamd_task_timeout,
+					  ctx->task_timeout,
+					  ctx->task_timeout);
+		ev_set_priority(&task->timeout_ev, EV_MAXPRI);
+		ev_timer_start(task->event_loop, &task->timeout_ev);
+	}
+}
+
+/*
+ * Loads the message body and runs task processing till the end
+ */
+static void
+rspamd_worker_task_start(struct rspamd_worker_session *session,
+						 struct rspamd_task *task,
+						 struct rspamd_http_message *msg,
+						 const char *chunk, gsize len)
+{
+	struct rspamd_worker_ctx *ctx = session->ctx;
+
+	if (!(task->flags & RSPAMD_TASK_FLAG_SKIP)) {
+		if (task->cmd == CMD_CHECK_V3) {
 			if (!rspamd_protocol_handle_v3_request(task, msg, chunk, len)) {
 				msg_err_task("cannot handle v3 request: %e", task->err);
 				task->flags |= RSPAMD_TASK_FLAG_SKIP;
@@ -190,15 +221,7 @@ rspamd_worker_body_handler(struct rspamd_http_connection *conn,
 		}
 	}
 
-	/* Set global timeout for the task */
-	if (!isnan(ctx->task_timeout) && ctx->task_timeout > 0.0) {
-		task->timeout_ev.data = task;
-		ev_timer_init(&task->timeout_ev, rspamd_task_timeout,
-					  ctx->task_timeout,
-					  ctx->task_timeout);
-		ev_set_priority(&task->timeout_ev, EV_MAXPRI);
-		ev_timer_start(task->event_loop, &task->timeout_ev);
-	}
+	rspamd_worker_task_set_timeout(ctx, task);
 
 	/* Set socket guard */
 	task->guard_ev.data = task;
@@ -208,6 +231,52 @@ rspamd_worker_body_handler(struct rspamd_http_connection *conn,
 	ev_io_start(task->event_loop, &task->guard_ev);
 
 	rspamd_task_process(task, RSPAMD_TASK_PROCESS_ALL);
+}
+
+static int
+rspamd_worker_body_handler(struct rspamd_http_connection *conn,
+						   struct rspamd_http_message *msg,
+						   const char *chunk, gsize len)
+{
+	struct rspamd_worker_session *session = (struct rspamd_worker_session *) conn->ud;
+	struct rspamd_task *task;
+
+	if (session->ctx->streaming) {
+		/*
+		 * Body is passed in portions: request headers are already here, so
+		 * we can run connection filters while the rest of the message is
+		 * being received; the message is loaded by the finish handler
+		 */
+		if (session->task == NULL) {
+			task = rspamd_worker_task_new(session, msg);
+			task->flags |= RSPAMD_TASK_FLAG_MESSAGE_PENDING;
+
+			/*
+			 * Metadata of /checkv3 (ip, from, settings...) is a part of the
+			 * multipart body, so such a task waits for the whole body as if
+			 * streaming was disabled
+			 */
+			if (task->cmd != CMD_CHECK_V3) {
+				/* Early filters and a slow client are limited by the task timeout */
+				rspamd_worker_task_set_timeout(session->ctx, task);
+				rspamd_task_process(task, RSPAMD_TASK_PROCESS_ALL);
+			}
+		}
+		else {
+			task = session->task;
+		}
+
+		if (task->cmd != CMD_CHECK_V3) {
+			/* Header-only prefilters are started once the header block is here */
+			rspamd_task_process_headers(task, msg,
+										msg->body_buf.begin, msg->body_buf.len);
+		}
+
+		return 0;
+	}
+
+	task = rspamd_worker_task_new(session, msg);
+	rspamd_worker_task_start(session, task, msg, chunk, len);
 
 	return 0;
 }
@@ -308,6 +377,21 @@ rspamd_worker_finish_handler(struct rspamd_http_connection *conn,
 
 	if (session->magic == G_MAXINT64) {
 		task = session->task;
+
+		if (session->ctx->streaming && msg->method != HTTP_HEAD) {
+			if (task == NULL) {
+				/* Request without body */
+				task = rspamd_worker_task_new(session, msg);
+				task->flags |= RSPAMD_TASK_FLAG_MESSAGE_PENDING;
+			}
+
+			if (task->flags & RSPAMD_TASK_FLAG_MESSAGE_PENDING) {
+				/* The whole message has been received */
+				task->flags &= ~RSPAMD_TASK_FLAG_MESSAGE_PENDING;
+				rspamd_worker_task_start(session, task, msg,
+										 msg->body_buf.begin, msg->body_buf.len);
+			}
+		}
 	}
 	else {
 		task = (struct rspamd_task *) conn->ud;
@@ -383,6 +467,10 @@ accept_socket(EV_P_ ev_io *w, int revents)
 		http_opts = RSPAMD_HTTP_REQUIRE_ENCRYPTION;
 	}
 
+	if (ctx->streaming) {
+		http_opts |= RSPAMD_HTTP_BODY_PARTIAL;
+	}
+
 	session->http_conn = rspamd_http_connection_new_server(
 		ctx->http_ctx,
 		nfd,
@@ -394,6 +482,8 @@ accept_socket(EV_P_ ev_io *w, int revents)
 	worker->srv->stat->connections_count++;
 	rspamd_http_connection_set_max_size(session->http_conn,
 										ctx->cfg->max_message);
+	rspamd_http_connection_set_spill(session->http_conn,
+									 ctx->cfg->spill_size, ctx->cfg->temp_dir);
 
 	if (ctx->key) {
 		rspamd_http_connection_set_key(session->http_conn, ctx->key);
@@ -447,6 +537,15 @@ init_worker(struct rspamd_config *cfg)
 									  "Allow only encrypted connections");
 
 
+	rspamd_rcl_register_worker_option(cfg,
+									  type,
+									  "streaming",
+									  rspamd_rcl_parse_struct_boolean,
+									  ctx,
+									  G_STRUCT_OFFSET(struct rspamd_worker_ctx, streaming),
+									  0,
+									  "Start processing requests before the whole message is received");
+
 	rspamd_rcl_register_worker_option(cfg,
 									  type,
 									  "timeout",
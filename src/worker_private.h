@@ -45,6 +45,8 @@ struct rspamd_worker_ctx {
 	gboolean is_mime;
 	/* Allow encrypted requests only using network */
 	gboolean encrypted_only;
+	/* Run connection filters while the message is being received */
+	gboolean streaming;
 	/* Limit of tasks */
 	uint32_t max_tasks;
 	/* Maximum time for task processing */
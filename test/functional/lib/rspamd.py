@@ -632,6 +632,12 @@ def get_file_if_exists(file_path):
     return None
 
 
+def read_file_from(file_path, offset):
+    with open(file_path, 'rb') as myfile:
+        myfile.seek(int(offset))
+        return myfile.read().decode('utf-8', errors='ignore')
+
+
 def _merge_luacov_stats(statsfile, coverage):
     """
     Reads a coverage stats file written by luacov and merges coverage data to
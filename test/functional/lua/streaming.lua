@@ -0,0 +1,25 @@
+rspamd_config:register_symbol({
+  name = 'STREAMING_CONNFILTER',
+  type = 'connfilter',
+  score = 0.0,
+  callback = function(task)
+    -- Size of the loaded message and SMTP from seen by connection filters
+    local from = task:get_from('smtp')
+    local addr = (from and from[1] and from[1].addr ~= '') and from[1].addr or 'no_from'
+
+    return true, tostring(task:get_size()), addr
+  end
+})
+
+rspamd_config:register_symbol({
+  name = 'STREAMING_HEADERS_PREFILTER',
+  type = 'prefilter',
+  flags = 'headers_only',
+  score = 0.0,
+  callback = function(task)
+    -- Size of the loaded message and From header seen by header-only prefilters
+    local from = task:get_header('From') or 'no_from'
+
+    return true, tostring(task:get_size()), from
+  end
+})
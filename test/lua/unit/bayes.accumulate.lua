@@ -0,0 +1,111 @@
+-- Multi-class bayes probabilities accumulation tests
+
+context("Bayes log probabilities accumulation", function()
+  local ok, ffi = pcall(require, "ffi")
+  if not ok then
+    ffi = require("cffi")
+  end
+  local logger = require "rspamd_logger"
+
+  ffi.cdef [[
+    double rspamd_bayes_accumulate_log_probs(const double *freqs, const double *totals,
+      const double *weights, unsigned int ntokens, double prior, double min_strength);
+    double rspamd_get_ticks (int);
+  ]]
+
+  -- Relative tolerance of the accumulated sum
+  local tolerance = 1e-12
+
+  local function reference(freqs, totals, weights, n, prior, min_strength)
+    local sum = 0
+
+    for i = 0, n - 1 do
+      local w, t = weights[i], totals[i]
+      local prob = (w * prior + t * freqs[i]) / (w + t)
+      prob = math.max(0.0, math.min(1.0, prob))
+
+      if math.abs(prob - prior) >= min_strength then
+        sum = sum + math.log(prob)
+      end
+    end
+
+    return sum
+  end
+
+  local function random_tokens(n)
+    local freqs = ffi.new('double[?]', n)
+    local totals = ffi.new('double[?]', n)
+    local weights = ffi.new('double[?]', n)
+    local fws = { 0, 3125, 256, 27, 1 }
+
+    for i = 0, n - 1 do
+      local total = math.random(1, 1000)
+      local fw = fws[math.random(1, #fws)]
+      totals[i] = total
+      weights[i] = fw * total / (1.0 + fw * total)
+      freqs[i] = math.random()
+    end
+
+    return freqs, totals, weights
+  end
+
+  local cases = {
+    { 0, 0.5, 0.05 },
+    { 1, 0.5, 0.05 },
+    { 7, 0.5, 0.0 },
+    { 8, 0.5, 0.05 },
+    { 100, 0.5, 0.05 },
+    { 1000, 0.2, 0.05 },
+    { 10000, 1.0 / 7, 0.02 },
+  }
+
+  for _, c in ipairs(cases) do
+    local n, prior, min_strength = c[1], c[2], c[3]
+
+    test(string.format("Accumulate %d tokens, prior %.2f", n, prior), function()
+      local freqs, totals, weights = random_tokens(n)
+      local expected = reference(freqs, totals, weights, n, prior, min_strength)
+      local got = ffi.C.rspamd_bayes_accumulate_log_probs(freqs, totals, weights, n,
+          prior, min_strength)
+
+      assert_true(math.abs(got - expected) <= tolerance * math.max(1.0, math.abs(expected)),
+          string.format("got %.17g, expected %.17g", got, expected))
+    end)
+  end
+
+  test("Accumulate zero probabilities", function()
+    -- Weight 0 means that the probability is exactly the frequency
+    local n = 33
+    local freqs, totals, weights = random_tokens(n)
+    weights[17] = 0
+    freqs[17] = 0
+    local got = ffi.C.rspamd_bayes_accumulate_log_probs(freqs, totals, weights, n, 0.5, 0.05)
+
+    assert_equal(got, -math.huge)
+  end)
+
+  if os.getenv("RSPAMD_LUA_EXPENSIVE_TESTS") then
+    local speed_iters = 10000
+    local ntokens = 2000
+
+    test("Accumulate speed", function()
+      local freqs, totals, weights = random_tokens(ntokens)
+      local t1 = ffi.C.rspamd_get_ticks(1)
+
+      for _ = 1, speed_iters do
+        ffi.C.rspamd_bayes_accumulate_log_probs(freqs, totals, weights, ntokens, 0.2, 0.05)
+      end
+
+      local t2 = ffi.C.rspamd_get_ticks(1)
+
+      for _ = 1, speed_iters / 10 do
+        reference(freqs, totals, weights, ntokens, 0.2, 0.05)
+      end
+
+      local t3 = ffi.C.rspamd_get_ticks(1)
+      logger.messagex("Bayes accumulate: %s ticks per token, reference %s ticks per token",
+          (t2 - t1) / speed_iters / ntokens, (t3 - t2) / (speed_iters / 10) / ntokens)
+      assert_not_equal(t2 - t1, 0)
+    end)
+  end
+end)
@@ -0,0 +1,179 @@
+-- Binary attachments are decoded on demand
+
+context("MIME lazy decoding", function()
+  local rspamd_task = require "rspamd_task"
+  local rspamd_util = require "rspamd_util"
+
+  local payload = "\0\1\2binary attachment payload\255\254"
+
+  local msg = "From: sender@example.com\r\n" ..
+      "To: rcpt@example.com\r\n" ..
+      "Subject: lazy decoding\r\n" ..
+      "MIME-Version: 1.0\r\n" ..
+      "Content-Type: multipart/mixed; boundary=\"XXX\"\r\n" ..
+      "\r\n" ..
+      "--XXX\r\n" ..
+      "Content-Type: text/plain; charset=utf-8\r\n" ..
+      "Content-Transfer-Encoding: base64\r\n" ..
+      "\r\n" ..
+      tostring(rspamd_util.encode_base64("Hello world")) .. "\r\n" ..
+      "--XXX\r\n" ..
+      "Content-Type: application/x-custom-binary\r\n" ..
+      "Content-Disposition: attachment; filename=\"data.bin\"\r\n" ..
+      "Content-Transfer-Encoding: base64\r\n" ..
+      "\r\n" ..
+      tostring(rspamd_util.encode_base64(payload, 16)) .. "\r\n" ..
+      "--XXX\r\n" ..
+      "Content-Type: application/x-custom-binary\r\n" ..
+      "Content-Transfer-Encoding: quoted-printable\r\n" ..
+      "\r\n" ..
+      "abc=3Ddef=\r\n" ..
+      "ghi\r\n" ..
+      "--XXX--\r\n"
+
+  local function find_parts(task, ct)
+    local res = {}
+
+    for _, part in ipairs(task:get_parts()) do
+      local _, subtype = part:get_type()
+      if subtype == ct then
+        table.insert(res, part)
+      end
+    end
+
+    return res
+  end
+
+  test("Decoded content of attachments", function()
+    local res, task = rspamd_task.load_from_string(msg, rspamd_config)
+    assert_true(res, "failed to load message")
+    task:process_message()
+
+    local text = find_parts(task, 'plain')[1]
+    assert_equal(text:get_content():str(), "Hello world")
+
+    local parts = find_parts(task, 'x-custom-binary')
+    assert_equal(#parts, 2)
+    assert_equal(parts[1]:get_length(), #payload)
+    assert_equal(parts[1]:get_content():str(), payload)
+    assert_equal(parts[2]:get_content():str(), "abc=defghi")
+    assert_equal(parts[2]:get_length(), 10)
+
+    task:destroy()
+  end)
+
+  test("Attachments stay encoded after parsing", function()
+    local res, task = rspamd_task.load_from_string(msg, rspamd_config)
+    assert_true(res, "failed to load message")
+    -- Parse only
+    task:set_flag('skip_process')
+    task:process_message()
+
+    local text = find_parts(task, 'plain')[1]
+    assert_true(text:is_decoded())
+
+    local parts = find_parts(task, 'x-custom-binary')
+    assert_equal(#parts, 2)
+    assert_false(parts[1]:is_decoded())
+    assert_false(parts[2]:is_decoded())
+    assert_nil(parts[1]:get_detected_ext())
+
+    assert_equal(parts[1]:get_length(), #payload)
+    assert_true(parts[1]:is_decoded())
+    assert_false(parts[2]:is_decoded())
+    -- Digest is computed over the decoded content on demand
+    assert_not_equal(parts[2]:get_digest(), string.rep('0', #parts[2]:get_digest()))
+    assert_true(parts[2]:is_decoded())
+
+    task:destroy()
+  end)
+
+  test("Unused attachments stay encoded after processing", function()
+    -- Large enough for type detection to look at its beginning only
+    local elf = "\127ELF" .. string.rep("\2\1\1\0", 50000)
+    local elf_msg = "From: sender@example.com\r\n" ..
+        "To: rcpt@example.com\r\n" ..
+        "Subject: lazy decoding\r\n" ..
+        "MIME-Version: 1.0\r\n" ..
+        "Content-Type: multipart/mixed; boundary=\"XXX\"\r\n" ..
+        "\r\n" ..
+        "--XXX\r\n" ..
+        "Content-Type: text/plain\r\n" ..
+        "\r\n" ..
+        "Hello world\r\n" ..
+        "--XXX\r\n" ..
+        "Content-Type: application/octet-stream\r\n" ..
+        "Content-Disposition: attachment; filename=\"prog\"\r\n" ..
+        "Content-Transfer-Encoding: base64\r\n" ..
+        "\r\n" ..
+        tostring(rspamd_util.encode_base64(elf, 76)) .. "\r\n" ..
+        "--XXX--\r\n"
+
+    for _, m in ipairs({ msg, elf_msg }) do
+      local res, task = rspamd_task.load_from_string(m, rspamd_config)
+      assert_true(res, "failed to load message")
+      task:process_message()
+
+      for _, part in ipairs(find_parts(task, 'x-custom-binary')) do
+        assert_false(part:is_decoded())
+      end
+
+      local elf_part = find_parts(task, 'octet-stream')[1]
+
+      if elf_part then
+        assert_equal(elf_part:get_detected_ext(), 'elf')
+        assert_false(elf_part:is_decoded())
+        -- Message digest is computed over the decoded parts on demand
+        assert_not_nil(task:get_digest())
+        assert_true(elf_part:is_decoded())
+      end
+
+      task:destroy()
+    end
+  end)
+
+  test("Message digest does not depend on transfer encoding", function()
+    local function make_msg(cte, encoded)
+      return "From: sender@example.com\r\n" ..
+          "Subject: digest\r\n" ..
+          "MIME-Version: 1.0\r\n" ..
+          "Content-Type: multipart/mixed; boundary=\"XXX\"\r\n" ..
+          "\r\n" ..
+          "--XXX\r\n" ..
+          "Content-Type: application/x-custom-binary\r\n" ..
+          "Content-Transfer-Encoding: " .. cte .. "\r\n" ..
+          "\r\n" ..
+          encoded .. "\r\n" ..
+          "--XXX--\r\n"
+    end
+
+    local digests = {}
+
+    for _, m in ipairs({
+      make_msg('base64', tostring(rspamd_util.encode_base64("abc=defghi", 4))),
+      make_msg('base64', tostring(rspamd_util.encode_base64("abc=defghi"))),
+      make_msg('quoted-printable', "abc=3Ddef=\r\nghi"),
+    }) do
+      local res, task = rspamd_task.load_from_string(m, rspamd_config)
+      assert_true(res, "failed to load message")
+      task:process_message()
+      table.insert(digests, task:get_digest())
+      task:destroy()
+    end
+
+    assert_equal(digests[1], digests[2])
+    assert_equal(digests[1], digests[3])
+  end)
+
+  test("Digests of attachments", function()
+    local res, task = rspamd_task.load_from_string(msg, rspamd_config)
+    assert_true(res, "failed to load message")
+    task:process_message()
+
+    local parts = find_parts(task, 'x-custom-binary')
+    assert_not_equal(parts[1]:get_digest(), parts[2]:get_digest())
+    assert_not_equal(parts[1]:get_digest(), string.rep('0', #parts[1]:get_digest()))
+
+    task:destroy()
+  end)
+end)
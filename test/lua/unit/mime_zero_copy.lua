@@ -0,0 +1,69 @@
+-- Parts with identity transfer encodings refer to the message content
+
+context("MIME identity encodings", function()
+  local rspamd_task = require "rspamd_task"
+
+  local msg = "From: sender@example.com\r\n" ..
+      "To: rcpt@example.com\r\n" ..
+      "Subject: zero copy\r\n" ..
+      "MIME-Version: 1.0\r\n" ..
+      "Content-Type: multipart/mixed; boundary=\"XXX\"\r\n" ..
+      "\r\n" ..
+      "--XXX\r\n" ..
+      "Content-Type: text/plain; charset=utf-8\r\n" ..
+      "Content-Transfer-Encoding: 8bit\r\n" ..
+      "\r\n" ..
+      "Hello WORLD, Привет МИР\r\n" ..
+      "--XXX\r\n" ..
+      "Content-Type: text/plain; charset=utf-8\r\n" ..
+      "Content-Transfer-Encoding: quoted-printable\r\n" ..
+      "\r\n" ..
+      "Soft=\r\n" ..
+      " break =3D QP\r\n" ..
+      "--XXX--\r\n"
+
+  local function text_parts(task)
+    local res = {}
+
+    for _, part in ipairs(task:get_parts()) do
+      if part:is_text() then
+        table.insert(res, part)
+      end
+    end
+
+    return res
+  end
+
+  test("Identity and decoded content", function()
+    local res, task = rspamd_task.load_from_string(msg, rspamd_config)
+    assert_true(res, "failed to load message")
+    task:process_message()
+
+    local parts = text_parts(task)
+    assert_equal(#parts, 2)
+    assert_equal(parts[1]:get_content():str(), parts[1]:get_raw_content():str())
+    assert_equal(parts[1]:get_content():str(), "Hello WORLD, Привет МИР")
+    assert_equal(parts[2]:get_content():str(), "Soft break = QP")
+
+    task:destroy()
+  end)
+
+  test("In-place changes do not modify the message", function()
+    local res, task = rspamd_task.load_from_string(msg, rspamd_config)
+    assert_true(res, "failed to load message")
+    task:process_message()
+
+    local part = text_parts(task)[1]
+    local content = part:get_content()
+    local lowered = content:lower(true, true)
+    assert_equal(lowered:str(), "hello world, привет мир")
+
+    local stripped = part:get_content():exclude_chars('%s', false)
+    assert_equal(stripped:str(), "HelloWORLD,ПриветМИР")
+
+    assert_equal(part:get_content():str(), "Hello WORLD, Привет МИР")
+    assert_equal(task:get_content():str(), msg)
+
+    task:destroy()
+  end)
+end)
@@ -0,0 +1,102 @@
+-- OSB pairs hashing tests
+
+context("OSB pairs hashing", function()
+  local ok, ffi = pcall(require, "ffi")
+
+  -- Reference hashes rely on LuaJIT 64 bit integers arithmetic
+  if not ok then
+    test("Skipped: cffi-lua does not support 64 bit integers arithmetic", function()
+    end)
+    return
+  end
+
+  local logger = require "rspamd_logger"
+  ffi.cdef[[
+    void rspamd_tokenizer_osb_hash_pairs(const uint64_t *hashes, size_t n,
+      unsigned int window_size, int compat, uint64_t *out);
+    uint64_t ottery_rand_uint64(void);
+    double rspamd_get_ticks (int);
+  ]]
+
+  local primes = {
+    1, 7, 3, 13, 5, 29, 11, 51, 23, 101, 47, 203, 97, 407, 197, 817, 397, 1637, 797, 3277,
+  }
+
+  local function reference_hash(h0, hi, i, compat)
+    if compat then
+      local lo0 = ffi.cast('uint64_t', ffi.cast('uint32_t', h0))
+      local loi = ffi.cast('uint64_t', ffi.cast('uint32_t', hi))
+      local h1 = (lo0 * primes[1] + loi * primes[2 * i + 1]) % 0x100000000ULL
+      local h2 = (lo0 * primes[2] + loi * primes[2 * i]) % 0x100000000ULL
+
+      return h1 + h2 * 0x100000000ULL
+    end
+
+    return h0 * primes[1] + hi * primes[2 * i + 1]
+  end
+
+  local function random_hashes(n)
+    local hashes = ffi.new('uint64_t[?]', n)
+
+    for k = 0, n - 1 do
+      hashes[k] = ffi.C.ottery_rand_uint64()
+    end
+
+    return hashes
+  end
+
+  local cases = {
+    { 5, 1, false },
+    { 5, 64, false },
+    { 2, 17, false },
+    { 8, 100, false },
+    { 5, 64, true },
+    { 3, 9, true },
+  }
+
+  for _, c in ipairs(cases) do
+    local window, n, compat = c[1], c[2], c[3]
+
+    test(string.format("Pairs hashes window %d, %d words, compat: %s", window, n, compat), function()
+      local hashes = random_hashes(n + window)
+      local out = ffi.new('uint64_t[?]', n * (window - 1))
+      -- The first words are preceding ones
+      local words = hashes + window
+
+      ffi.C.rspamd_tokenizer_osb_hash_pairs(words, n, window, compat and 1 or 0, out)
+
+      for i = 1, window - 1 do
+        for k = 0, n - 1 do
+          local expected = reference_hash(words[k], words[k - i], i, compat)
+          local got = out[(i - 1) * n + k]
+          assert_equal(got, expected,
+              string.format("distance %d, word %d: %s, expected %s", i, k,
+                  tostring(got), tostring(expected)))
+        end
+      end
+    end)
+  end
+
+  if os.getenv("RSPAMD_LUA_EXPENSIVE_TESTS") then
+    local speed_iters = 100000
+    local nwords = 64
+
+    for _, window in ipairs({ 2, 5, 8 }) do
+      test(string.format("Pairs hashes speed window %d", window), function()
+        local hashes = random_hashes(nwords + window)
+        local out = ffi.new('uint64_t[?]', nwords * (window - 1))
+        local t1 = ffi.C.rspamd_get_ticks(1)
+
+        for _ = 1, speed_iters do
+          ffi.C.rspamd_tokenizer_osb_hash_pairs(hashes + window, nwords, window, 0, out)
+        end
+
+        local ticks = ffi.C.rspamd_get_ticks(1) - t1
+        logger.messagex("OSB pairs window %s: %s ticks per block of %s words, %s ticks per pair",
+            window, ticks / speed_iters, nwords,
+            ticks / speed_iters / (nwords * (window - 1)))
+        assert_not_equal(ticks, 0)
+      end)
+    end
+  end
+end)
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+#include "libstat/stat_internal.h"
+#include "contrib/cdb/cdb.h"
+#include "contrib/libev/ev.h"
+#include "unix-std.h"
+
+#include <sys/time.h>
+
+extern struct ev_loop *event_loop;
+
+/*
+ * Writes a snapshot with a single token aside and renames it over `path`,
+ * mtime is set to `mtime` if it is not zero
+ */
+static void
+test_cdb_write_snapshot(const char *path, int64_t learns, float spam, float ham,
+						time_t mtime)
+{
+	struct cdb_make cdbm;
+	uint64_t token = 42;
+	float values[2] = {spam, ham};
+	char *tmp = g_strconcat(path, ".new", NULL);
+	int fd;
+
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	g_assert(fd != -1);
+	g_assert(cdb_make_start(&cdbm, fd) == 0);
+	g_assert(cdb_make_add(&cdbm, "_labels", 7, "S,H", 3) == 0);
+	g_assert(cdb_make_add(&cdbm, "_lrnS   ", 8, &learns, sizeof(learns)) == 0);
+	g_assert(cdb_make_add(&cdbm, "_lrnH   ", 8, &learns, sizeof(learns)) == 0);
+	g_assert(cdb_make_add(&cdbm, &token, sizeof(token), values, sizeof(values)) == 0);
+	g_assert(cdb_make_finish(&cdbm) == 0);
+	close(fd);
+
+	if (mtime != 0) {
+		struct timeval tv[2];
+
+		tv[0].tv_sec = tv[1].tv_sec = mtime;
+		tv[0].tv_usec = tv[1].tv_usec = 0;
+		g_assert(utimes(tmp, tv) == 0);
+	}
+
+	g_assert(rename(tmp, path) == 0);
+	g_free(tmp);
+}
+
+static float
+test_cdb_get(gpointer bk, uint64_t token)
+{
+	GPtrArray *tokens = g_ptr_array_new_full(1, g_free);
+	rspamd_token_t *tok;
+	float res;
+
+	tok = g_malloc0(sizeof(*tok) + sizeof(tok->values[0]));
+	tok->data = token;
+	g_ptr_array_add(tokens, tok);
+	g_assert(rspamd_cdb_process_tokens(NULL, tokens, 0, bk));
+	res = tok->values[0];
+	g_ptr_array_free(tokens, TRUE);
+
+	return res;
+}
+
+void rspamd_cdb_backend_test_func(void)
+{
+	struct rspamd_classifier_config clcf;
+	struct rspamd_classifier cl;
+	struct rspamd_statfile_config stcf;
+	struct rspamd_statfile st;
+	struct stat sb;
+	gpointer bk;
+	char *dir, *path;
+	unsigned int i;
+
+	dir = g_dir_make_tmp("rspamd-cdb-XXXXXX", NULL);
+	g_assert(dir != NULL);
+	path = g_build_filename(dir, "bayes.cdb", NULL);
+	test_cdb_write_snapshot(path, 10, 1.0, 2.0, 0);
+	g_assert(stat(path, &sb) == 0);
+
+	memset(&clcf, 0, sizeof(clcf));
+	memset(&cl, 0, sizeof(cl));
+	memset(&stcf, 0, sizeof(stcf));
+	memset(&st, 0, sizeof(st));
+	clcf.opts = ucl_object_typed_new(UCL_OBJECT);
+	ucl_object_insert_key(clcf.opts, ucl_object_fromstring(path), "filename", 0, false);
+	cl.cfg = &clcf;
+	stcf.symbol = "BAYES_SPAM";
+	stcf.is_spam = TRUE;
+	stcf.clcf = &clcf;
+	st.stcf = &stcf;
+	st.classifier = &cl;
+
+	bk = rspamd_cdb_init(rspamd_stat_get_ctx(), NULL, &st);
+	g_assert(bk != NULL);
+	g_assert(rspamd_cdb_total_learns(NULL, bk, bk) == 10);
+	g_assert(test_cdb_get(bk, 42) == 1.0);
+	g_assert(test_cdb_get(bk, 43) == 0);
+
+	/*
+	 * Replacement of the same size within the same second: it is likely to
+	 * be mapped at the same address, so only the inode tells it apart
+	 */
+	test_cdb_write_snapshot(path, 20, 3.0, 4.0, sb.st_mtime);
+
+	for (i = 0; i < 1500 && rspamd_cdb_total_learns(NULL, bk, bk) != 20; i++) {
+		ev_run(event_loop, EVRUN_NOWAIT);
+		usleep(10000);
+	}
+
+	g_assert(rspamd_cdb_total_learns(NULL, bk, bk) == 20);
+	g_assert(test_cdb_get(bk, 42) == 3.0);
+
+	rspamd_cdb_close(bk);
+	ucl_object_unref(clcf.opts);
+	unlink(path);
+	rmdir(dir);
+	g_free(path);
+	g_free(dir);
+}
@@ -37,6 +37,16 @@
 #include "rspamd_cxx_unit_upstream_srv.hxx"
 #include "rspamd_cxx_unit_multipart.hxx"
 #include "rspamd_cxx_unit_settings_merge.hxx"
+#include "rspamd_cxx_unit_word_break.hxx"
+#include "rspamd_cxx_unit_normalize.hxx"
+#include "rspamd_cxx_unit_qp.hxx"
+#include "rspamd_cxx_unit_headers.hxx"
+#include "rspamd_cxx_unit_charsets.hxx"
+#include "rspamd_cxx_unit_redis_token_cache.hxx"
+#include "rspamd_cxx_unit_redis_learn_batch.hxx"
+#include "rspamd_cxx_unit_osb.hxx"
+#include "rspamd_cxx_unit_words_cache.hxx"
+#include "rspamd_cxx_unit_lang_detection.hxx"
 
 static gboolean verbose = false;
 static const GOptionEntry entries[] =
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Differential tests of the table based charsets conversion against ICU and of
+ * the staged charsets detection against CED */
+
+#ifndef RSPAMD_RSPAMD_CXX_UNIT_CHARSETS_HXX
+#define RSPAMD_RSPAMD_CXX_UNIT_CHARSETS_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "rspamd.h"
+#include "libutil/str_util.h"
+#include "libmime/mime_encoding.h"
+#include "contrib/google-ced/ced_c.h"
+
+#include <unicode/ucnv.h>
+
+namespace charsets_test {
+
+/* Conversion as it is done for multibyte charsets */
+static auto
+icu_to_utf8(const char *charset, const std::string &in) -> std::string
+{
+	UErrorCode uc_err = U_ZERO_ERROR;
+	auto *conv = ucnv_open(charset, &uc_err);
+
+	REQUIRE(conv != nullptr);
+	ucnv_setToUCallBack(conv, UCNV_TO_U_CALLBACK_SUBSTITUTE, nullptr, nullptr, nullptr, &uc_err);
+
+	std::vector<UChar> tmp(in.size() + 1);
+	auto r = ucnv_toUChars(conv, tmp.data(), tmp.size(), in.data(), in.size(), &uc_err);
+	REQUIRE(U_SUCCESS(uc_err));
+	ucnv_close(conv);
+
+	std::string res(r * 3 + 1, '\0');
+	r = ucnv_fromUChars(rspamd_get_utf8_converter(), res.data(), res.size(), tmp.data(), r, &uc_err);
+	REQUIRE(U_SUCCESS(uc_err));
+	res.resize(r);
+
+	return res;
+}
+
+static auto
+rspamd_to_utf8(rspamd_mempool_t *pool, const char *charset, std::string in) -> std::string
+{
+	gsize olen = 0;
+	GError *err = nullptr;
+	auto *res = rspamd_mime_text_to_utf8(pool, in.data(), in.size(), charset, &olen, &err);
+
+	REQUIRE(res != nullptr);
+
+	return std::string{res, olen};
+}
+
+static auto
+ced_detect(const std::string &in) -> std::string
+{
+	int nconsumed;
+	bool is_reliable;
+	const auto *res = ced_encoding_detect(in.data(), in.size(), nullptr, nullptr, nullptr, 0,
+										  CED_EMAIL_CORPUS, false, &nconsumed, &is_reliable);
+
+	return res ? res : "";
+}
+
+static auto
+detect_stage(const std::string &in, bool check_utf8) -> std::pair<std::string, int>
+{
+	const auto *stat = rspamd_mime_charset_detect_stat();
+	uint64_t before[RSPAMD_CHARSET_DETECT_MAX];
+
+	memcpy(before, stat, sizeof(before));
+	const auto *res = rspamd_mime_charset_find_by_content(in.data(), in.size(), check_utf8);
+
+	for (auto i = 0; i < RSPAMD_CHARSET_DETECT_MAX; i++) {
+		if (stat[i] != before[i]) {
+			return {res ? res : "", i};
+		}
+	}
+
+	return {res ? res : "", -1};
+}
+
+static const std::vector<const char *> charsets{
+	"windows-1250", "windows-1251", "windows-1252", "windows-1253", "windows-1255",
+	"windows-1256", "KOI8-R", "KOI8-U", "ISO-8859-1", "ISO-8859-2", "ISO-8859-5",
+	"ISO-8859-7", "ISO-8859-15", "macintosh", "IBM866", "Shift_JIS", "GBK"};
+
+}// namespace charsets_test
+
+TEST_SUITE("charsets conversion")
+{
+	using namespace charsets_test;
+
+	TEST_CASE("all chars")
+	{
+		rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "charsets", 0);
+		std::string all;
+
+		for (auto i = 0; i < 256; i++) {
+			all.push_back((char) i);
+		}
+
+		for (const auto *charset: charsets) {
+			CAPTURE(charset);
+			CHECK(rspamd_to_utf8(pool, charset, all) == icu_to_utf8(charset, all));
+		}
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("random text")
+	{
+		rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "charsets", 0);
+		std::mt19937 gen{42};
+		std::uniform_int_distribution<int> len(0, 200), kind(0, 2), ascii(0x20, 0x7e), high(0x80, 0xff);
+
+		for (const auto *charset: charsets) {
+			CAPTURE(charset);
+
+			for (auto i = 0; i < 1000; i++) {
+				std::string text;
+				auto n = len(gen);
+
+				for (auto j = 0; j < n; j++) {
+					/* Both long ASCII runs and runs of 8 bit chars */
+					text.push_back((char) (kind(gen) == 0 ? high(gen) : ascii(gen)));
+				}
+
+				CAPTURE(text);
+				REQUIRE(rspamd_to_utf8(pool, charset, text) == icu_to_utf8(charset, text));
+			}
+		}
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("detection stages")
+	{
+		using namespace std::string_literals;
+
+		CHECK(detect_stage("Hello, world\r\n", false) == std::make_pair("US-ASCII"s, (int) RSPAMD_CHARSET_DETECT_ASCII));
+		CHECK(detect_stage("Hello, world\r\n", true) == std::make_pair("UTF-8"s, (int) RSPAMD_CHARSET_DETECT_ASCII));
+		CHECK(detect_stage("", true) == std::make_pair("UTF-8"s, (int) RSPAMD_CHARSET_DETECT_ASCII));
+		CHECK(detect_stage("Привет, мир", true) == std::make_pair("UTF-8"s, (int) RSPAMD_CHARSET_DETECT_UTF8));
+		/* Possible 7 bit encodings */
+		CHECK(detect_stage("Hi +BB8EQAQ4BDIENQRC-", false).second == RSPAMD_CHARSET_DETECT_CED);
+		CHECK(detect_stage("\x1b$B$3$s$K$A$O\x1b(B", false).second == RSPAMD_CHARSET_DETECT_CED);
+		CHECK(detect_stage("", false).second == RSPAMD_CHARSET_DETECT_CED);
+		CHECK(detect_stage("\xcf\xf0\xe8\xe2\xe5\xf2, \xec\xe8\xf0", true).second == RSPAMD_CHARSET_DETECT_CED);
+	}
+
+	TEST_CASE("7 bit detection")
+	{
+		std::mt19937 gen{42};
+		std::uniform_int_distribution<int> len(1, 200), printable(0x20, 0x7e), crlf(0, 15);
+		int checked = 0;
+
+		for (auto i = 0; i < 2000; i++) {
+			std::string text;
+			auto n = len(gen);
+
+			for (auto j = 0; j < n; j++) {
+				text.push_back((char) (crlf(gen) == 0 ? '\n' : printable(gen)));
+			}
+
+			auto res = detect_stage(text, false);
+
+			if (res.second != RSPAMD_CHARSET_DETECT_ASCII) {
+				continue;
+			}
+
+			CAPTURE(text);
+			REQUIRE(res.first == ced_detect(text));
+			checked++;
+		}
+
+		CHECK(checked > 100);
+	}
+
+	TEST_CASE("detection stages report")
+	{
+		struct rspamd_stat stat;
+
+		memset(&stat, 0, sizeof(stat));
+		/* Everything detected by the previous tests */
+		rspamd_mime_charset_detect_report(&stat);
+		memset(&stat, 0, sizeof(stat));
+
+		detect_stage("Hello, world\r\n", false);
+		detect_stage("Hello, world\r\n", true);
+		detect_stage("Привет, мир", true);
+		detect_stage("Hi +BB8EQAQ4BDIENQRC-", false);
+		rspamd_mime_charset_detect_report(&stat);
+		CHECK(stat.charset_detect_ascii == 2);
+		CHECK(stat.charset_detect_utf8 == 1);
+		CHECK(stat.charset_detect_ced == 1);
+
+		/* Reported counters are not added again */
+		rspamd_mime_charset_detect_report(&stat);
+		CHECK(stat.charset_detect_ascii == 2);
+		CHECK(stat.charset_detect_utf8 == 1);
+		CHECK(stat.charset_detect_ced == 1);
+	}
+
+	TEST_CASE("speed" * doctest::skip())
+	{
+		std::string text;
+		const auto iters = 200;
+
+		for (auto i = 0; text.size() < 65536; i++) {
+			/* Cyrillic words in windows-1251 */
+			text += i % 5 == 0 ? "word, " : "\xef\xf0\xe8\xe2\xe5\xf2 ";
+		}
+
+		for (auto table: {false, true}) {
+			rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "charsets", 0);
+			gsize total = 0;
+			auto t1 = std::chrono::steady_clock::now();
+
+			for (auto i = 0; i < iters; i++) {
+				total += table ? rspamd_to_utf8(pool, "windows-1251", text).size()
+							   : icu_to_utf8("windows-1251", text).size();
+			}
+
+			auto t2 = std::chrono::steady_clock::now();
+			MESSAGE((table ? "table" : "icu") << ": "
+											  << std::chrono::duration<double, std::micro>(t2 - t1).count() / iters
+											  << " us per 64k");
+			CHECK(total > 0);
+			rspamd_mempool_delete(pool);
+		}
+	}
+}
+
+#endif
@@ -19,6 +19,8 @@
 #ifndef RSPAMD_RSPAMD_CXX_UNIT_CRYPTOBOX_HXX
 #define RSPAMD_RSPAMD_CXX_UNIT_CRYPTOBOX_HXX
 #include "libcryptobox/cryptobox.h"
+#include "libcryptobox/keypair.h"
+#include "libcryptobox/keypairs_cache.h"
 #include <string>
 #include <string_view>
 #include <vector>
@@ -464,6 +466,50 @@ TEST_SUITE("rspamd_cryptobox")
 		CHECK(memcmp(subkey, expected_subkey, sizeof(expected_subkey)) == 0);
 		CHECK(memcmp(mac_key, expected_mac_key, sizeof(expected_mac_key)) == 0);
 	}
+
+	TEST_CASE("rspamd_keypair_shared_cache")
+	{
+		auto *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "kp_cache", 0);
+		auto *local_kp = rspamd_keypair_new(RSPAMD_KEYPAIR_KEX);
+		auto *remote_kp = rspamd_keypair_new(RSPAMD_KEYPAIR_KEX);
+		unsigned int pklen;
+		const auto *raw_pk = rspamd_keypair_component(remote_kp, RSPAMD_KEYPAIR_COMPONENT_PK, &pklen);
+		auto *rk1 = rspamd_pubkey_from_bin(raw_pk, pklen, RSPAMD_KEYPAIR_KEX);
+		auto *rk2 = rspamd_pubkey_from_bin(raw_pk, pklen, RSPAMD_KEYPAIR_KEX);
+		auto *rk3 = rspamd_pubkey_from_bin(raw_pk, pklen, RSPAMD_KEYPAIR_KEX);
+
+		auto *sc = rspamd_keypair_shared_cache_new(pool, 16);
+		/* Emulate caches of two different workers */
+		auto *c1 = rspamd_keypair_cache_new(8);
+		auto *c2 = rspamd_keypair_cache_new(8);
+		rspamd_keypair_cache_set_shared(c1, sc);
+		rspamd_keypair_cache_set_shared(c2, sc);
+
+		rspamd_keypair_cache_process(c1, local_kp, rk1);
+		rspamd_keypair_cache_process(c2, local_kp, rk2);
+
+		uint64_t hits, misses;
+		rspamd_keypair_shared_cache_stat(sc, &hits, &misses);
+		CHECK(hits == 1);
+		CHECK(misses == 1);
+
+		const auto *nm1 = rspamd_pubkey_get_nm(rk1, local_kp);
+		const auto *nm2 = rspamd_pubkey_get_nm(rk2, local_kp);
+		const auto *nm3 = rspamd_pubkey_calculate_nm(rk3, local_kp);
+		REQUIRE(nm1 != nullptr);
+		REQUIRE(nm2 != nullptr);
+		CHECK(memcmp(nm1, nm2, rspamd_cryptobox_MAX_NMBYTES) == 0);
+		CHECK(memcmp(nm1, nm3, rspamd_cryptobox_MAX_NMBYTES) == 0);
+
+		rspamd_keypair_cache_destroy(c1);
+		rspamd_keypair_cache_destroy(c2);
+		rspamd_pubkey_unref(rk1);
+		rspamd_pubkey_unref(rk2);
+		rspamd_pubkey_unref(rk3);
+		rspamd_keypair_unref(local_kp);
+		rspamd_keypair_unref(remote_kp);
+		rspamd_mempool_delete(pool);
+	}
 }
 
 #endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tests of the vectorised header block scanning */
+
+#ifndef RSPAMD_RSPAMD_CXX_UNIT_HEADERS_HXX
+#define RSPAMD_RSPAMD_CXX_UNIT_HEADERS_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "libutil/str_util.h"
+#include "libmime/message.h"
+#include "libmime/mime_headers.h"
+#include "libserver/task.h"
+
+namespace headers_test {
+
+/* Byte by byte loops as they were in the headers parser */
+static auto
+scalar_line_span(const char *s, gsize len) -> gsize
+{
+	gsize i = 0;
+
+	while (i < len && s[i] != '\r' && s[i] != '\n' && s[i] != '\0') {
+		i++;
+	}
+
+	return i;
+}
+
+static auto
+scalar_name_span(const char *s, gsize len) -> gsize
+{
+	gsize i = 0;
+
+	while (i < len && s[i] != ':' && !g_ascii_isspace(s[i])) {
+		i++;
+	}
+
+	return i;
+}
+
+static auto
+headers_block() -> std::string
+{
+	std::string res;
+
+	for (auto i = 0; i < 300; i++) {
+		auto n = std::to_string(i);
+
+		res += "Received: from mail-" + n + ".example.com (mail-" + n + ".example.com [192.0.2.1])\r\n";
+		res += "\tby mx.example.org (Postfix) with ESMTPS id ABCDEF" + n + "\r\n";
+		res += "\tfor <user@example.org>; Tue, 1 Jan 2024 00:00:00 +0000\r\n";
+		res += "ARC-Seal: i=" + n + "; a=rsa-sha256; t=1700000000; cv=none; d=example.com;\r\n";
+		res += " b=" + std::string(64, 'A') + "\r\n";
+	}
+
+	return res;
+}
+
+static auto
+parse_headers(const std::string &block, gsize *nheaders = nullptr) -> std::vector<std::string>
+{
+	auto *task = rspamd_task_new(nullptr, nullptr, nullptr, nullptr, nullptr, FALSE);
+	task->message = rspamd_message_new(task);
+	struct rspamd_mime_header *order = nullptr, *cur;
+	std::vector<std::string> res;
+
+	rspamd_mime_headers_process(task, MESSAGE_FIELD(task, raw_headers), &order,
+								block.data(), block.size(), TRUE);
+
+	if (nheaders) {
+		*nheaders = rspamd_mime_headers_count(MESSAGE_FIELD(task, raw_headers));
+	}
+	else {
+		for (cur = order; cur != nullptr; cur = cur->ord_next) {
+			res.emplace_back(std::string{cur->name} + "=" + cur->value);
+		}
+	}
+
+	rspamd_task_free(task);
+
+	return res;
+}
+
+}// namespace headers_test
+
+TEST_SUITE("headers parsing")
+{
+	using namespace headers_test;
+
+	TEST_CASE("spans")
+	{
+		std::mt19937 gen{42};
+		using namespace std::string_literals;
+		const auto alphabet = "abcXYZ-_:; \t\r\n\v\f\0\x80\xff"s;
+		std::uniform_int_distribution<gsize> len(0, 100), idx(0, alphabet.size() - 1);
+		std::uniform_int_distribution<int> plain(0, 15);
+
+		for (int i = 0; i < 20000; i++) {
+			std::string text;
+			auto n = len(gen);
+
+			for (gsize j = 0; j < n; j++) {
+				/* Keep special characters rare to get long spans */
+				text.push_back(plain(gen) == 0 ? alphabet[idx(gen)] : 'a');
+			}
+
+			CAPTURE(text);
+			REQUIRE(rspamd_str_line_span(text.data(), text.size()) ==
+					scalar_line_span(text.data(), text.size()));
+			REQUIRE(rspamd_str_header_name_span(text.data(), text.size()) ==
+					scalar_name_span(text.data(), text.size()));
+		}
+	}
+
+	TEST_CASE("folding and garbage")
+	{
+		using namespace std::string_literals;
+		const auto block = "Subject: long\r\n\tfolded\r\n  value\r\n"
+						   "X-Tab:\tvalue\r\n"
+						   "garbage line without colon\r\n"
+						   "X-Empty:\r\n"
+						   "X-Nul: a\0b\r\n"
+						   "X-Last: final\r\n"s;
+		const std::vector<std::string> expected{
+			"Subject=long folded value",
+			"X-Tab=value",
+			"X-Empty=",
+			"X-Nul=ab",
+			"X-Last=final",
+		};
+
+		CHECK(parse_headers(block) == expected);
+	}
+
+	TEST_CASE("speed" * doctest::skip())
+	{
+		const auto block = headers_block();
+		const auto iters = 200;
+		gsize nheaders = 0, total = 0;
+
+		auto t1 = std::chrono::steady_clock::now();
+
+		for (auto i = 0; i < iters; i++) {
+			parse_headers(block, &nheaders);
+		}
+
+		auto t2 = std::chrono::steady_clock::now();
+		MESSAGE("parse: " << std::chrono::duration<double, std::nano>(t2 - t1).count() / iters / nheaders
+						  << " ns per header");
+
+		for (auto vector: {false, true}) {
+			t1 = std::chrono::steady_clock::now();
+
+			for (auto i = 0; i < iters * 10; i++) {
+				for (gsize pos = 0; pos < block.size(); pos++) {
+					auto span = vector ? rspamd_str_line_span(block.data() + pos, block.size() - pos)
+									   : scalar_line_span(block.data() + pos, block.size() - pos);
+					total += span;
+					pos += span;
+				}
+			}
+
+			t2 = std::chrono::steady_clock::now();
+			MESSAGE((vector ? "vector" : "scalar") << " lines scan: "
+												   << std::chrono::duration<double, std::micro>(t2 - t1).count() / (iters * 10)
+												   << " us per block");
+		}
+
+		CHECK(total > 0);
+	}
+}
+
+#endif
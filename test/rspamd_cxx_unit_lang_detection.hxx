@@ -0,0 +1,240 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unit tests for the packed trigrams and compiled data of the language detector */
+
+#ifndef RSPAMD_CXX_UNIT_LANG_DETECTION_HXX
+#define RSPAMD_CXX_UNIT_LANG_DETECTION_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include "libserver/cfg_file.h"
+#include "libmime/lang_detection.h"
+#include "unix-std.h"
+
+#include <sys/time.h>
+
+namespace lang_detection_test {
+
+/*
+ * Languages sharing the trigram "abc" with probabilities 0.1, 0.9, 0.9 and
+ * 0.1, each one has also its own trigram. The mean of the chain is 0.5, so
+ * only a2 and a3 score "abc" as they did before trigrams were packed
+ */
+static const struct {
+	const char *name;
+	const char *json;
+	double abc_score;
+} test_languages[] = {
+	{"a1", R"({"freq": {"abc": 1, "qqa": 9}, "n_words": [1, 1, 1], "type": "latin"})", 0.0},
+	{"a2", R"({"freq": {"abc": 9, "qqb": 1}, "n_words": [1, 1, 1], "type": "latin"})", 0.9},
+	{"a3", R"({"freq": {"abc": 9, "qqc": 1}, "n_words": [1, 1, 1], "type": "latin"})", 0.9},
+	{"a4", R"({"freq": {"abc": 1, "qqd": 9}, "n_words": [1, 1, 1], "type": "latin"})", 0.0},
+};
+
+struct lang_detection_fixture {
+	std::string dir;
+	std::vector<std::string> files;
+	struct rspamd_config *cfg = nullptr;
+
+	lang_detection_fixture()
+	{
+		auto *tmp = g_dir_make_tmp("rspamd-langdet-XXXXXX", nullptr);
+		REQUIRE(tmp != nullptr);
+		dir = tmp;
+		g_free(tmp);
+
+		for (const auto &lang: test_languages) {
+			write_file(std::string(lang.name) + ".json", lang.json);
+		}
+	}
+
+	~lang_detection_fixture()
+	{
+		if (cfg) {
+			rspamd_config_free(cfg);
+		}
+
+		for (const auto &f: files) {
+			unlink(f.c_str());
+		}
+
+		rmdir(dir.c_str());
+	}
+
+	void write_file(const std::string &name, const std::string &content)
+	{
+		auto path = dir + "/" + name;
+
+		REQUIRE(g_file_set_contents(path.c_str(), content.data(), content.size(), nullptr));
+		files.push_back(path);
+	}
+
+	auto config() -> struct rspamd_config *
+	{
+		auto *top = ucl_object_typed_new(UCL_OBJECT);
+		auto *section = ucl_object_typed_new(UCL_OBJECT);
+
+		if (cfg) {
+			rspamd_config_free(cfg);
+		}
+
+		cfg = rspamd_config_new(RSPAMD_CONFIG_INIT_DEFAULT);
+		ucl_object_insert_key(section, ucl_object_fromstring(dir.c_str()),
+							  "languages", 0, false);
+		ucl_object_insert_key(top, section, "lang_detection", 0, false);
+		cfg->cfg_ucl_obj = top;
+
+		return cfg;
+	}
+
+	auto detector() -> struct rspamd_lang_detector *
+	{
+		return rspamd_language_detector_init(config());
+	}
+
+	/* Compiles languages to the default path and returns its content */
+	auto compile() -> std::string
+	{
+		GError *err = nullptr;
+		char *data;
+		gsize len;
+
+		REQUIRE(rspamd_language_detector_compile(config(), nullptr, &err));
+		files.push_back(compiled_path());
+		REQUIRE(g_file_get_contents(compiled_path().c_str(), &data, &len, nullptr));
+		std::string res(data, len);
+		g_free(data);
+
+		return res;
+	}
+
+	auto compiled_path() const -> std::string
+	{
+		return dir + "/languages.bin";
+	}
+};
+
+static auto
+word_score(struct rspamd_lang_detector *d, const char *lang, const char *word) -> double
+{
+	std::vector<UChar32> ucs(word, word + strlen(word));
+
+	return rspamd_language_detector_word_score_for_test(d, lang, ucs.data(), ucs.size());
+}
+
+TEST_SUITE("lang_detection")
+{
+	TEST_CASE("trigrams below the chain mean are not scored")
+	{
+		lang_detection_fixture fx;
+		auto *d = fx.detector();
+
+		REQUIRE(d != nullptr);
+
+		for (const auto &lang: test_languages) {
+			CAPTURE(lang.name);
+			CHECK(word_score(d, lang.name, "abc") == doctest::Approx(lang.abc_score));
+		}
+
+		/* A trigram of a single language has its weight increased */
+		CHECK(word_score(d, "a1", "qqa") == doctest::Approx(0.9 * 4));
+		CHECK(word_score(d, "a2", "qqa") == doctest::Approx(0.0));
+		CHECK(word_score(d, "a5", "abc") < 0);
+	}
+
+	TEST_CASE("compiled languages round trip")
+	{
+		lang_detection_fixture fx;
+
+		fx.write_file("stop_words", R"({"a2": ["hello"]})");
+		fx.compile();
+
+		auto *d = fx.detector();
+		REQUIRE(d != nullptr);
+		CHECK(rspamd_language_detector_is_compiled_for_test(d));
+
+		for (const auto &lang: test_languages) {
+			CAPTURE(lang.name);
+			CHECK(word_score(d, lang.name, "abc") == doctest::Approx(lang.abc_score));
+		}
+
+		CHECK(word_score(d, "a1", "qqa") == doctest::Approx(0.9 * 4));
+		CHECK(rspamd_language_detector_is_stop_word(d, "hello", 5));
+		CHECK_FALSE(rspamd_language_detector_is_stop_word(d, "world", 5));
+	}
+
+	TEST_CASE("bad compiled languages fall back to json files")
+	{
+		lang_detection_fixture fx;
+		auto good = fx.compile();
+
+		/* Offsets of the header fields: magic[8], version, bom, nlangs */
+		auto bad_magic = good;
+		bad_magic[0] ^= 0xff;
+		auto bad_version = good;
+		bad_version[8] = 1;
+		auto bad_nlangs = good;
+		memset(&bad_nlangs[16], 0xff, 4);
+
+		const struct {
+			const char *name;
+			std::string data;
+		} broken[] = {
+			{"bad magic", bad_magic},
+			{"old version", bad_version},
+			{"languages out of bounds", bad_nlangs},
+			{"truncated header", good.substr(0, 8)},
+			{"truncated half", good.substr(0, good.size() / 2)},
+			{"truncated tail", good.substr(0, good.size() - 1)},
+			{"empty", ""},
+		};
+
+		for (const auto &b: broken) {
+			CAPTURE(b.name);
+			fx.write_file("languages.bin", b.data);
+
+			auto *d = fx.detector();
+			REQUIRE(d != nullptr);
+			CHECK_FALSE(rspamd_language_detector_is_compiled_for_test(d));
+			CHECK(word_score(d, "a2", "abc") == doctest::Approx(0.9));
+			CHECK(word_score(d, "a4", "abc") == doctest::Approx(0.0));
+		}
+	}
+
+	TEST_CASE("compiled languages older than json files are not used")
+	{
+		lang_detection_fixture fx;
+		struct timeval tv[2];
+
+		fx.compile();
+		tv[0].tv_sec = tv[1].tv_sec = time(nullptr) - 3600;
+		tv[0].tv_usec = tv[1].tv_usec = 0;
+		REQUIRE(utimes(fx.compiled_path().c_str(), tv) == 0);
+
+		auto *d = fx.detector();
+		REQUIRE(d != nullptr);
+		CHECK_FALSE(rspamd_language_detector_is_compiled_for_test(d));
+		CHECK(word_score(d, "a3", "abc") == doctest::Approx(0.9));
+	}
+}
+
+}// namespace lang_detection_test
+
+#endif
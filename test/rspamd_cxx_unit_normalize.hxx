@@ -0,0 +1,195 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Differential tests of the fused words normalisation against ICU one */
+
+#ifndef RSPAMD_RSPAMD_CXX_UNIT_NORMALIZE_HXX
+#define RSPAMD_RSPAMD_CXX_UNIT_NORMALIZE_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "libstat/tokenizers/tokenizers.h"
+
+#include <unicode/utf8.h>
+
+namespace normalize_test {
+
+static auto
+make_word(const std::string &text) -> rspamd_word_t
+{
+	rspamd_word_t w{};
+
+	w.original.begin = text.data();
+	w.original.len = text.size();
+	w.flags = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_UTF;
+
+	return w;
+}
+
+static auto
+same_words(const rspamd_word_t &a, const rspamd_word_t &b) -> bool
+{
+	return a.flags == b.flags &&
+		   a.unicode.len == b.unicode.len &&
+		   a.normalized.len == b.normalized.len &&
+		   memcmp(a.unicode.begin, b.unicode.begin, a.unicode.len * sizeof(UChar32)) == 0 &&
+		   memcmp(a.normalized.begin, b.normalized.begin, a.normalized.len) == 0;
+}
+
+static auto
+append_utf8(std::string &out, UChar32 c) -> void
+{
+	char buf[4];
+	int32_t len = 0;
+	UBool is_error = false;
+
+	U8_APPEND(buf, len, sizeof(buf), c, is_error);
+	out.append(buf, len);
+}
+
+}// namespace normalize_test
+
+TEST_SUITE("fused normalisation")
+{
+	using namespace normalize_test;
+
+	TEST_CASE("corpus")
+	{
+		rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "normalize", 0);
+		const std::vector<std::string> corpus{
+			"Hello", "WORLD", "don't", "foo_bar", "3.14", "€100", "©2024",
+			"Über", "STRASSE", "naïve", "İstanbul", "Ⱥ",
+			"Привет", "ЁЛКА", "Ελληνικά", "ΣΟΦΟΣ",
+			"soft\u00adhyphen", "word\u2060joiner"};
+
+		for (const auto &text: corpus) {
+			CAPTURE(text);
+			auto fast = make_word(text), icu = make_word(text);
+
+			REQUIRE(rspamd_normalize_single_word_fast(&fast, pool));
+			rspamd_normalize_single_word(&icu, pool);
+			CHECK(same_words(fast, icu));
+		}
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("words for ICU")
+	{
+		rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "normalize", 0);
+		const std::vector<std::string> corpus{
+			/* Combining marks and compatibility characters */
+			"e\u0301", "\u2126", "\ufb01le", "\u00aa", "\u00b2", "\u00a0", "\u00bd",
+			/* Other scripts */
+			"中文", "שלום", "👍",
+			/* Invalid utf8 */
+			"abc\xd0"};
+
+		for (const auto &text: corpus) {
+			CAPTURE(text);
+			auto fast = make_word(text);
+
+			CHECK(!rspamd_normalize_single_word_fast(&fast, pool));
+		}
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("random words")
+	{
+		rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "normalize", 0);
+		std::mt19937 gen{42};
+		const std::vector<UChar32> special{
+			'a', 'Z', '1', '_', '$', '\'', 0xa9, 0xad, 0xc9, 0xe9, 0xef, 0x130, 0x23a,
+			0x3a3, 0x3c2, 0x401, 0x419, 0x2060, 0x20ac, 0x2126};
+		std::uniform_int_distribution<int> kind(0, 3), nchars(1, 20);
+		std::uniform_int_distribution<UChar32> low(0, 0x52f), punct(0x2000, 0x20ff);
+		std::uniform_int_distribution<size_t> special_idx(0, special.size() - 1);
+		int checked = 0;
+
+		for (int i = 0; i < 20000; i++) {
+			std::string text;
+			auto n = nchars(gen);
+
+			for (auto j = 0; j < n; j++) {
+				switch (kind(gen)) {
+				case 0:
+					append_utf8(text, low(gen));
+					break;
+				case 1:
+					append_utf8(text, punct(gen));
+					break;
+				default:
+					append_utf8(text, special[special_idx(gen)]);
+					break;
+				}
+			}
+
+			auto fast = make_word(text), icu = make_word(text);
+
+			if (!rspamd_normalize_single_word_fast(&fast, pool)) {
+				continue;
+			}
+
+			CAPTURE(text);
+			rspamd_normalize_single_word(&icu, pool);
+			REQUIRE(same_words(fast, icu));
+			checked++;
+		}
+
+		CHECK(checked > 1000);
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("speed" * doctest::skip())
+	{
+		const std::vector<std::string> corpus{
+			"Hello", "world", "Привет", "мир", "Ελληνικά", "naïve", "café",
+			"résumé", "Straße", "don't", "e-mail", "123", "ÜBER", "СЪЕШЬ", "foo_bar"};
+		const auto iters = 100000;
+
+		for (auto fused: {false, true}) {
+			rspamd_mempool_t *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "normalize", 0);
+			auto t1 = std::chrono::steady_clock::now();
+
+			for (auto i = 0; i < iters; i++) {
+				auto w = make_word(corpus[i % corpus.size()]);
+
+				if (fused) {
+					rspamd_normalize_single_word_fast(&w, pool);
+				}
+				else {
+					rspamd_normalize_single_word(&w, pool);
+				}
+			}
+
+			auto t2 = std::chrono::steady_clock::now();
+			MESSAGE((fused ? "fused" : "icu") << ": "
+											  << std::chrono::duration<double, std::nano>(t2 - t1).count() / iters
+											  << " ns per word, "
+											  << (double) rspamd_mempool_get_used_size(pool) / iters
+											  << " bytes per word");
+			rspamd_mempool_delete(pool);
+		}
+	}
+}
+
+#endif
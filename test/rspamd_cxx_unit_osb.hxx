@@ -0,0 +1,325 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Differential tests of the batched OSB tokenizer against the scalar hash pipe */
+
+#ifndef RSPAMD_CXX_UNIT_OSB_HXX
+#define RSPAMD_CXX_UNIT_OSB_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include "libstat/stat_internal.h"
+#include "libstat/tokenizers/tokenizers.h"
+#include "libcryptobox/cryptobox.h"
+
+namespace osb_test {
+
+static const int primes[] = {
+	1, 7, 3, 13, 5, 29, 11, 51, 23, 101,
+	47, 203, 97, 407, 197, 817, 397, 1637, 797, 3277};
+
+/* Seed of the default tokenizer configuration */
+static constexpr std::uint64_t default_seed = 0xdeadbabe;
+
+struct osb_token {
+	std::uint64_t data;
+	unsigned int flags;
+	unsigned int window_idx;
+	const rspamd_word_t *t1;
+	const rspamd_word_t *t2;
+
+	bool operator==(const osb_token &o) const
+	{
+		return data == o.data && flags == o.flags && window_idx == o.window_idx &&
+			   t1 == o.t1 && t2 == o.t2;
+	}
+};
+
+static auto
+word_hash(const rspamd_word_t *w, bool compat) -> std::uint64_t
+{
+	const auto &tok = (w->flags & RSPAMD_STAT_TOKEN_FLAG_TEXT) ? w->stemmed : w->original;
+
+	if (compat) {
+		return rspamd_fstrhash_lc(&tok, TRUE);
+	}
+
+	return rspamd_cryptobox_fast_hash_specific(RSPAMD_CRYPTOBOX_XXHASH64,
+											   tok.begin, tok.len, default_seed);
+}
+
+/*
+ * The tokenizer as it was before pairs hashing was batched: a pipe of the
+ * last `window` words shifted on each word
+ */
+static auto
+scalar_osb(const rspamd_words_t &words, unsigned int window, bool compat) -> std::vector<osb_token>
+{
+	struct pipe_entry {
+		std::uint64_t h;
+		const rspamd_word_t *t;
+	};
+	std::vector<pipe_entry> hashpipe(window, pipe_entry{0xfe, nullptr});
+	std::vector<osb_token> res;
+	unsigned int processed = 0, token_flags = 0;
+
+	auto add_pair = [&](unsigned int i) {
+		osb_token tok{0, token_flags, i, hashpipe[0].t, hashpipe[i].t};
+
+		if (compat) {
+			std::uint32_t h1, h2;
+
+			h1 = ((std::uint32_t) hashpipe[0].h) * primes[0] +
+				 ((std::uint32_t) hashpipe[i].h) * primes[i << 1];
+			h2 = ((std::uint32_t) hashpipe[0].h) * primes[1] +
+				 ((std::uint32_t) hashpipe[i].h) * primes[(i << 1) - 1];
+			memcpy((unsigned char *) &tok.data, &h1, sizeof(h1));
+			memcpy(((unsigned char *) &tok.data) + sizeof(h1), &h2, sizeof(h2));
+		}
+		else {
+			tok.data = hashpipe[0].h * primes[0] + hashpipe[i].h * primes[i << 1];
+		}
+
+		res.push_back(tok);
+	};
+
+	for (auto w = 0u; w < kv_size(words); w++) {
+		const auto *token = &kv_A(words, w);
+		token_flags = token->flags;
+
+		if (token->flags &
+			(RSPAMD_STAT_TOKEN_FLAG_STOP_WORD | RSPAMD_STAT_TOKEN_FLAG_SKIPPED)) {
+			continue;
+		}
+
+		auto cur = word_hash(token, compat);
+
+		if (token_flags & RSPAMD_STAT_TOKEN_FLAG_UNIGRAM) {
+			res.push_back(osb_token{cur, token_flags, 0, token, token});
+			continue;
+		}
+
+		if (processed < window) {
+			++processed;
+			hashpipe[window - processed] = pipe_entry{cur, token};
+		}
+		else {
+			for (auto i = window - 1; i > 0; i--) {
+				hashpipe[i] = hashpipe[i - 1];
+			}
+
+			hashpipe[0] = pipe_entry{cur, token};
+			processed++;
+
+			for (auto i = 1u; i < window; i++) {
+				if (!(hashpipe[i].t->flags & RSPAMD_STAT_TOKEN_FLAG_EXCEPTION)) {
+					add_pair(i);
+				}
+			}
+		}
+	}
+
+	if (processed > 1 && processed <= window) {
+		processed--;
+		memmove(hashpipe.data(), &hashpipe[window - processed],
+				processed * sizeof(hashpipe[0]));
+
+		for (auto i = 1u; i < processed; i++) {
+			add_pair(i);
+		}
+	}
+
+	return res;
+}
+
+struct osb_fixture {
+	struct rspamd_task *task;
+	struct rspamd_stat_ctx ctx;
+	/* Words point to these strings, deque keeps them in place */
+	std::deque<std::string> storage;
+	rspamd_words_t words;
+
+	osb_fixture(unsigned int window, bool compat)
+	{
+		struct rspamd_tokenizer_config tkcf;
+		auto *opts = ucl_object_typed_new(UCL_OBJECT);
+
+		task = rspamd_task_new(nullptr, nullptr, nullptr, nullptr, nullptr, FALSE);
+		ucl_object_insert_key(opts, ucl_object_fromint(window), "window", 0, false);
+
+		if (compat) {
+			ucl_object_insert_key(opts, ucl_object_frombool(true), "compat", 0, false);
+		}
+
+		tkcf.opts = opts;
+		tkcf.name = "osb";
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.tkcf = rspamd_tokenizer_osb_get_config(task->task_pool, &tkcf, nullptr);
+		/* Only the number of statfiles matters for the tokenizer */
+		ctx.statfiles = g_ptr_array_new();
+		g_ptr_array_add(ctx.statfiles, nullptr);
+		g_ptr_array_add(ctx.statfiles, nullptr);
+		ucl_object_unref(opts);
+		kv_init(words);
+	}
+
+	~osb_fixture()
+	{
+		kv_destroy(words);
+		g_ptr_array_free(ctx.statfiles, TRUE);
+		rspamd_task_free(task);
+	}
+
+	void add_word(const std::string &original, const std::string &stemmed, unsigned int flags)
+	{
+		rspamd_word_t w;
+
+		memset(&w, 0, sizeof(w));
+		const auto &orig = storage.emplace_back(original);
+		const auto &st = storage.emplace_back(stemmed);
+		w.original.begin = orig.data();
+		w.original.len = orig.size();
+		w.stemmed.begin = st.data();
+		w.stemmed.len = st.size();
+		w.flags = flags;
+		kv_push(rspamd_word_t, words, w);
+	}
+
+	auto tokenize() -> std::vector<osb_token>
+	{
+		auto *result = g_ptr_array_new();
+		std::vector<osb_token> res;
+		rspamd_token_t *tok;
+		unsigned int i;
+
+		REQUIRE(rspamd_tokenizer_osb(&ctx, task, &words, TRUE, nullptr, result));
+
+		PTR_ARRAY_FOREACH(result, i, tok)
+		{
+			res.push_back(osb_token{tok->data, tok->flags, tok->window_idx, tok->t1, tok->t2});
+		}
+
+		g_ptr_array_free(result, TRUE);
+
+		return res;
+	}
+};
+
+/*
+ * Mixed input: text and meta words, unigrams, exceptions, stop and skipped
+ * words, repeated words
+ */
+static void
+fill_mixed_words(osb_fixture &fx, unsigned int nwords, std::mt19937 &gen)
+{
+	static const char *vocabulary[] = {
+		"hello", "world", "Viagra", "free", "money", "click", "here", "now",
+		"привет", "мир", "日本語", "offer", "unsubscribe", "the", "a", "of"};
+	std::uniform_int_distribution<unsigned int> word_dist(0, G_N_ELEMENTS(vocabulary) - 1);
+	std::uniform_int_distribution<unsigned int> kind_dist(0, 15);
+
+	for (auto i = 0u; i < nwords; i++) {
+		std::string original = vocabulary[word_dist(gen)];
+		unsigned int fl;
+
+		switch (kind_dist(gen)) {
+		case 0:
+			fl = RSPAMD_STAT_TOKEN_FLAG_META | RSPAMD_STAT_TOKEN_FLAG_UNIGRAM;
+			break;
+		case 1:
+			fl = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_EXCEPTION;
+			break;
+		case 2:
+			fl = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_STOP_WORD;
+			break;
+		case 3:
+			fl = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_SKIPPED;
+			break;
+		case 4:
+		case 5:
+			fl = RSPAMD_STAT_TOKEN_FLAG_META;
+			break;
+		case 6:
+			fl = RSPAMD_STAT_TOKEN_FLAG_LUA_META | RSPAMD_STAT_TOKEN_FLAG_UNIGRAM;
+			break;
+		default:
+			fl = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_UTF;
+			break;
+		}
+
+		fx.add_word(original, original + "_st", fl);
+	}
+}
+
+TEST_SUITE("osb_tokenizer")
+{
+	TEST_CASE("batched pairs match scalar pipe on mixed input")
+	{
+		std::mt19937 gen(42);
+
+		for (auto compat: {false, true}) {
+			for (auto window: {2u, 3u, 5u, 8u}) {
+				/* Short texts for the tail, block boundaries and long texts */
+				for (auto nwords: {1u, 2u, 3u, 5u, 8u, 9u, 63u, 64u, 65u, 70u, 129u, 500u}) {
+					CAPTURE(compat);
+					CAPTURE(window);
+					CAPTURE(nwords);
+
+					osb_fixture fx(window, compat);
+					fill_mixed_words(fx, nwords, gen);
+
+					auto expected = scalar_osb(fx.words, window, compat);
+					auto got = fx.tokenize();
+
+					REQUIRE(got.size() == expected.size());
+
+					for (auto i = 0u; i < got.size(); i++) {
+						CAPTURE(i);
+						CHECK(got[i] == expected[i]);
+					}
+				}
+			}
+		}
+	}
+
+	TEST_CASE("short text of pair words only")
+	{
+		for (auto window: {2u, 5u}) {
+			for (auto nwords = 1u; nwords <= window + 1; nwords++) {
+				CAPTURE(window);
+				CAPTURE(nwords);
+
+				osb_fixture fx(window, false);
+
+				for (auto i = 0u; i < nwords; i++) {
+					auto w = "word" + std::to_string(i);
+					fx.add_word(w, w, RSPAMD_STAT_TOKEN_FLAG_TEXT);
+				}
+
+				CHECK(fx.tokenize() == scalar_osb(fx.words, window, false));
+			}
+		}
+	}
+}
+
+}// namespace osb_test
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Differential tests of the quoted-printable decoders against the scalar ones */
+
+#ifndef RSPAMD_RSPAMD_CXX_UNIT_QP_HXX
+#define RSPAMD_RSPAMD_CXX_UNIT_QP_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include "libutil/str_util.h"
+
+namespace qp_test {
+
+/* Scalar decoders as they were before SIMD spans */
+static gssize
+ref_decode_qp_buf(const char *in, gsize inlen,
+				  char *out, gsize outlen)
+{
+	char *o, *end, *pos, c;
+	const char *p;
+	unsigned char ret;
+	gssize remain, processed;
+
+	p = in;
+	o = out;
+	end = out + outlen;
+	remain = inlen;
+
+	while (remain > 0 && o < end) {
+		if (*p == '=') {
+			remain--;
+
+			if (remain == 0) {
+				/* Last '=' character, bugon */
+				if (end - o > 0) {
+					*o++ = *p;
+				}
+				else {
+					/* Buffer overflow */
+					return (-1);
+				}
+
+				break;
+			}
+
+			p++;
+		decode:
+			/* Decode character after '=' */
+			c = *p++;
+			remain--;
+			ret = 0;
+
+			if (c >= '0' && c <= '9') {
+				ret = c - '0';
+			}
+			else if (c >= 'A' && c <= 'F') {
+				ret = c - 'A' + 10;
+			}
+			else if (c >= 'a' && c <= 'f') {
+				ret = c - 'a' + 10;
+			}
+			else if (c == '\r') {
+				/* Eat one more endline */
+				if (remain > 0 && *p == '\n') {
+					p++;
+					remain--;
+				}
+
+				continue;
+			}
+			else if (c == '\n') {
+				/* Soft line break */
+				continue;
+			}
+			else {
+				/* Hack, hack, hack, treat =<garbage> as =<garbage> */
+				if (end - o > 1) {
+					*o++ = '=';
+					*o++ = *(p - 1);
+				}
+				else {
+					return (-1);
+				}
+
+				continue;
+			}
+
+			if (remain > 0) {
+				c = *p++;
+				ret *= 16;
+				remain--;
+
+				if (c >= '0' && c <= '9') {
+					ret += c - '0';
+				}
+				else if (c >= 'A' && c <= 'F') {
+					ret += c - 'A' + 10;
+				}
+				else if (c >= 'a' && c <= 'f') {
+					ret += c - 'a' + 10;
+				}
+				else {
+					/* Treat =<good><rubbish> as =<good><rubbish> */
+					if (end - o > 2) {
+						*o++ = '=';
+						*o++ = *(p - 2);
+						*o++ = *(p - 1);
+					}
+					else {
+						return (-1);
+					}
+
+					continue;
+				}
+
+				if (end - o > 0) {
+					*o++ = (char) ret;
+				}
+				else {
+					return (-1);
+				}
+			}
+		}
+		else {
+			if (end - o >= remain) {
+				if ((pos = (char *) memccpy(o, p, '=', remain)) == NULL) {
+					/* All copied */
+					o += remain;
+					break;
+				}
+				else {
+					processed = pos - o;
+					remain -= processed;
+					p += processed;
+
+					if (remain > 0) {
+						o = pos - 1;
+						/*
+						 * Skip comparison and jump inside decode branch,
+						 * as we know that we have found match
+						 */
+						goto decode;
+					}
+					else {
+						/* Last '=' character, bugon */
+						o = pos;
+
+						if (end - o > 0) {
+							*o = '=';
+						}
+						else {
+							/* Buffer overflow */
+							return (-1);
+						}
+
+						break;
+					}
+				}
+			}
+			else {
+				/* Buffer overflow */
+				return (-1);
+			}
+		}
+	}
+
+	return (o - out);
+}
+
+static gssize
+ref_decode_qp2047_buf(const char *in, gsize inlen,
+					  char *out, gsize outlen)
+{
+	char *o, *end, c;
+	const char *p;
+	unsigned char ret;
+	gsize remain, processed;
+
+	p = in;
+	o = out;
+	end = out + outlen;
+	remain = inlen;
+
+	while (remain > 0 && o < end) {
+		if (*p == '=') {
+			p++;
+			remain--;
+
+			if (remain == 0) {
+				/* Last '=' character without following hex digits */
+				if (end - o > 0) {
+					*o++ = '=';
+				}
+				break;
+			}
+		decode:
+			/* Decode character after '=' */
+			c = *p++;
+			remain--;
+			ret = 0;
+
+			if (c >= '0' && c <= '9') { ret = c - '0'; }
+			else if (c >= 'A' && c <= 'F') {
+				ret = c - 'A' + 10;
+			}
+			else if (c >= 'a' && c <= 'f') {
+				ret = c - 'a' + 10;
+			}
+			else if (c == '\r' || c == '\n') {
+				/* Soft line break */
+				while (remain > 0 && (*p == '\r' || *p == '\n')) {
+					remain--;
+					p++;
+				}
+
+				continue;
+			}
+
+			if (remain > 0) {
+				c = *p++;
+				ret *= 16;
+
+				if (c >= '0' && c <= '9') { ret += c - '0'; }
+				else if (c >= 'A' && c <= 'F') {
+					ret += c - 'A' + 10;
+				}
+				else if (c >= 'a' && c <= 'f') {
+					ret += c - 'a' + 10;
+				}
+
+				if (end - o > 0) {
+					*o++ = (char) ret;
+				}
+				else {
+					return (-1);
+				}
+
+				remain--;
+			}
+		}
+		else {
+			if (end - o >= remain) {
+				processed = rspamd_memcspn(p, remain, "=_", 2);
+				memcpy(o, p, processed);
+				o += processed;
+
+				if (processed == remain) {
+					break;
+				}
+				else {
+
+					remain -= processed;
+					p += processed;
+
+					if (G_LIKELY(*p == '=')) {
+						p++;
+						/* Skip comparison, as we know that we have found match */
+						remain--;
+
+						if (remain == 0) {
+							/* Trailing '=' without hex digits */
+							if (end - o > 0) {
+								*o++ = '=';
+							}
+							break;
+						}
+						goto decode;
+					}
+					else {
+						*o++ = ' ';
+						p++;
+						remain--;
+					}
+				}
+			}
+			else {
+				/* Buffer overflow */
+				return (-1);
+			}
+		}
+	}
+
+	return (o - out);
+}
+
+using decoder_t = gssize (*)(const char *, gsize, char *, gsize);
+
+static auto
+decode(decoder_t func, const std::string &in) -> std::string
+{
+	/* Allocate more than needed to catch writes after the decoded data */
+	std::string out(in.size() + 64, '\xff');
+	auto r = func(in.data(), in.size(), out.data(), in.size() + 1);
+
+	if (r == -1) {
+		return "<error>";
+	}
+
+	return out.substr(0, r);
+}
+
+static auto
+random_qp(std::mt19937 &gen, std::size_t len) -> std::string
+{
+	/* Plain spans of various length mixed with escapes and line breaks */
+	const std::vector<std::string> specials{
+		"=", "_", "=3D", "=e9", "=C3=A9", "=\r\n", "=\n", "=\r", "=G1", "=4", "=\r\r\n",
+		"\r\n", " ", "\t"};
+	std::uniform_int_distribution<int> kind(0, 3), span(0, 80), byte(0, 255);
+	std::uniform_int_distribution<std::size_t> special_idx(0, specials.size() - 1);
+	std::string res;
+
+	while (res.size() < len) {
+		if (kind(gen) == 0) {
+			res += specials[special_idx(gen)];
+		}
+		else {
+			auto n = span(gen);
+
+			for (auto i = 0; i < n; i++) {
+				auto c = byte(gen);
+
+				if (c == '=' || c == '_') {
+					c = 'x';
+				}
+
+				res.push_back((char) c);
+			}
+		}
+	}
+
+	return res;
+}
+
+}// namespace qp_test
+
+TEST_SUITE("quoted-printable decode")
+{
+	using namespace qp_test;
+
+	TEST_CASE("corpus")
+	{
+		const std::vector<std::string> corpus{
+			"",
+			"=",
+			"_",
+			"abc=",
+			"abc=3",
+			"Hello=20world_and_more=3D=3d",
+			"Soft=\r\n break =3D QP",
+			"Soft=\n break",
+			"Caf=C3=A9 au lait, caf=c3=a9 _ =XY =4Z",
+			"A very long line without any special characters at all, long enough for any vector size",
+			"A very long line without any special characters at all, long enough for any vector size=",
+			"A very long line without any special characters at all, long enough for any vector_size=3D"};
+
+		for (const auto &text: corpus) {
+			CAPTURE(text);
+			CHECK(decode(rspamd_decode_qp_buf, text) == decode(ref_decode_qp_buf, text));
+			CHECK(decode(rspamd_decode_qp2047_buf, text) == decode(ref_decode_qp2047_buf, text));
+		}
+	}
+
+	TEST_CASE("random inputs")
+	{
+		std::mt19937 gen{42};
+		std::uniform_int_distribution<std::size_t> len(0, 512);
+
+		for (int i = 0; i < 20000; i++) {
+			auto text = random_qp(gen, len(gen));
+
+			CAPTURE(text);
+			REQUIRE(decode(rspamd_decode_qp_buf, text) == decode(ref_decode_qp_buf, text));
+			REQUIRE(decode(rspamd_decode_qp2047_buf, text) == decode(ref_decode_qp2047_buf, text));
+		}
+	}
+
+	TEST_CASE("speed" * doctest::skip())
+	{
+		std::string text;
+		const auto iters = 1000;
+
+		/* Mostly plain text with rare escapes like in typical letters */
+		while (text.size() < 1024 * 1024) {
+			text += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor=\r\n";
+			text += "incididunt ut labore et dolore magna aliqua caf=C3=A9.\r\n";
+		}
+
+		std::string out(text.size(), '\0');
+
+		for (auto simd: {false, true}) {
+			auto func = simd ? rspamd_decode_qp_buf : ref_decode_qp_buf;
+			auto t1 = std::chrono::steady_clock::now();
+
+			for (auto i = 0; i < iters; i++) {
+				func(text.data(), text.size(), out.data(), out.size());
+			}
+
+			auto t2 = std::chrono::steady_clock::now();
+			MESSAGE((simd ? "simd" : "scalar") << ": "
+											   << std::chrono::duration<double, std::milli>(t2 - t1).count() / iters
+											   << " ms per MiB");
+		}
+	}
+}
+
+#endif
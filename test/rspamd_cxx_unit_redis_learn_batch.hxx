@@ -0,0 +1,109 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unit tests for clamped deltas of the redis Bayes learn batches */
+
+#ifndef RSPAMD_CXX_UNIT_REDIS_LEARN_BATCH_HXX
+#define RSPAMD_CXX_UNIT_REDIS_LEARN_BATCH_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <random>
+#include "libstat/backends/redis_learn_batch.hxx"
+
+TEST_SUITE("redis_learn_batch")
+{
+	TEST_CASE("identity")
+	{
+		redis_learn_delta d;
+
+		CHECK(d.is_noop());
+
+		for (auto x: {0, 1, 5}) {
+			CHECK(d.apply(x) == x);
+		}
+	}
+
+	TEST_CASE("unlearn of a zero counter is clamped")
+	{
+		redis_learn_delta d;
+
+		/* Unlearn and learn back: a zero counter ends at 1, not 0 */
+		d.add(-1);
+		d.add(1);
+		CHECK(d.delta == 0);
+		CHECK(d.floor == 1);
+		CHECK_FALSE(d.is_noop());
+		CHECK(d.apply(0) == 1);
+		CHECK(d.apply(1) == 1);
+		CHECK(d.apply(3) == 3);
+
+		/* Learn and unlearn back is a no-op for any counter */
+		redis_learn_delta d2;
+		d2.add(1);
+		d2.add(-1);
+		CHECK(d2.is_noop());
+		CHECK(d2.apply(0) == 0);
+		CHECK(d2.apply(2) == 2);
+	}
+
+	TEST_CASE("learns only need no floor")
+	{
+		redis_learn_delta d;
+
+		for (auto i = 0; i < 10; i++) {
+			d.add(1);
+		}
+
+		CHECK(d.delta == 10);
+		CHECK(d.floor <= d.delta);
+		CHECK(d.apply(0) == 10);
+	}
+
+	TEST_CASE("matches updates applied one by one")
+	{
+		std::mt19937 gen(42);
+		std::bernoulli_distribution unlearn(0.5);
+		std::uniform_int_distribution<int> len_dist(1, 50);
+
+		for (auto iter = 0; iter < 1000; iter++) {
+			redis_learn_delta d;
+			std::vector<std::int64_t> updates;
+			auto len = len_dist(gen);
+
+			for (auto i = 0; i < len; i++) {
+				auto u = unlearn(gen) ? -1 : 1;
+				updates.push_back(u);
+				d.add(u);
+			}
+
+			for (std::int64_t x: {0, 1, 2, 3, 10, 100}) {
+				auto expected = x;
+
+				for (auto u: updates) {
+					expected = std::max<std::int64_t>(expected + u, 0);
+				}
+
+				CAPTURE(iter);
+				CAPTURE(x);
+				CHECK(d.apply(x) == expected);
+			}
+		}
+	}
+}
+
+#endif
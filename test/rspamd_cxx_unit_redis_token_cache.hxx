@@ -0,0 +1,97 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unit tests for the redis Bayes token counts cache */
+
+#ifndef RSPAMD_CXX_UNIT_REDIS_TOKEN_CACHE_HXX
+#define RSPAMD_CXX_UNIT_REDIS_TOKEN_CACHE_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include "libstat/backends/redis_token_cache.hxx"
+
+TEST_SUITE("redis_token_cache")
+{
+	TEST_CASE("hit and miss")
+	{
+		auto *cache = redis_token_cache_new(16);
+
+		redis_token_cache_insert(cache, 1, 100, {3.0, 5.0}, 1000, 60);
+
+		const auto *elt = redis_token_cache_lookup(cache, 1, 100, 1000);
+		REQUIRE(elt != nullptr);
+		CHECK(elt->counts.size() == 2);
+		CHECK(elt->counts[0] == 3.0);
+		CHECK(elt->counts[1] == 5.0);
+
+		/* Same token in another redis object, another token in the same object */
+		CHECK(redis_token_cache_lookup(cache, 2, 100, 1000) == nullptr);
+		CHECK(redis_token_cache_lookup(cache, 1, 101, 1000) == nullptr);
+
+		rspamd_lru_hash_destroy(cache);
+	}
+
+	TEST_CASE("ttl expiry")
+	{
+		auto *cache = redis_token_cache_new(16);
+
+		redis_token_cache_insert(cache, 1, 100, {1.0, 0.0}, 1000, 60);
+
+		CHECK(redis_token_cache_lookup(cache, 1, 100, 1060) != nullptr);
+		CHECK(redis_token_cache_lookup(cache, 1, 100, 1061) == nullptr);
+		CHECK(rspamd_lru_hash_size(cache) == 0);
+
+		rspamd_lru_hash_destroy(cache);
+	}
+
+	TEST_CASE("replace existing key")
+	{
+		auto *cache = redis_token_cache_new(16);
+
+		redis_token_cache_insert(cache, 1, 100, {1.0, 2.0}, 1000, 60);
+		redis_token_cache_insert(cache, 1, 100, {7.0, 8.0, 9.0}, 1010, 60);
+		CHECK(rspamd_lru_hash_size(cache) == 1);
+
+		const auto *elt = redis_token_cache_lookup(cache, 1, 100, 1065);
+		REQUIRE(elt != nullptr);
+		CHECK(elt->counts.size() == 3);
+		CHECK(elt->counts[0] == 7.0);
+		CHECK(elt->counts[2] == 9.0);
+
+		rspamd_lru_hash_destroy(cache);
+	}
+
+	TEST_CASE("invalidate after learn")
+	{
+		auto *cache = redis_token_cache_new(16);
+
+		redis_token_cache_insert(cache, 1, 100, {1.0, 2.0}, 1000, 60);
+		redis_token_cache_insert(cache, 1, 0, {10.0, 20.0}, 1000, 60);
+		redis_token_cache_insert(cache, 2, 100, {4.0, 4.0}, 1000, 60);
+
+		redis_token_cache_remove(cache, 1, 100);
+		redis_token_cache_remove(cache, 1, 0);
+
+		CHECK(redis_token_cache_lookup(cache, 1, 100, 1000) == nullptr);
+		CHECK(redis_token_cache_lookup(cache, 1, 0, 1000) == nullptr);
+		CHECK(redis_token_cache_lookup(cache, 2, 100, 1000) != nullptr);
+
+		rspamd_lru_hash_destroy(cache);
+	}
+}
+
+#endif
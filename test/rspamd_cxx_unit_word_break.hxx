@@ -0,0 +1,181 @@
+/*
+ * Copyright 2025 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Differential tests of the fast word boundaries against ICU break iterator */
+
+#ifndef RSPAMD_RSPAMD_CXX_UNIT_WORD_BREAK_HXX
+#define RSPAMD_RSPAMD_CXX_UNIT_WORD_BREAK_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include "libstat/tokenizers/tokenizers.h"
+
+#include <unicode/ubrk.h>
+#include <unicode/utext.h>
+#include <unicode/utf8.h>
+
+namespace word_break_test {
+
+static auto
+icu_breaks(const std::string &text) -> std::vector<int32_t>
+{
+	UErrorCode uc_err = U_ZERO_ERROR;
+	std::vector<int32_t> res;
+	auto *bi = ubrk_open(UBRK_WORD, nullptr, nullptr, 0, &uc_err);
+	auto *utxt = utext_openUTF8(nullptr, text.data(), text.size(), &uc_err);
+
+	ubrk_setUText(bi, utxt, &uc_err);
+	ubrk_first(bi);
+
+	for (auto p = ubrk_next(bi); p != UBRK_DONE; p = ubrk_next(bi)) {
+		res.push_back(p);
+	}
+
+	utext_close(utxt);
+	ubrk_close(bi);
+
+	return res;
+}
+
+static auto
+fast_breaks(const std::string &text) -> std::vector<int32_t>
+{
+	std::vector<int32_t> res;
+
+	for (auto p = rspamd_tokenize_fast_next_break(text.data(), text.size(), 0);
+		 p != UBRK_DONE;
+		 p = rspamd_tokenize_fast_next_break(text.data(), text.size(), p)) {
+		res.push_back(p);
+	}
+
+	return res;
+}
+
+static auto
+append_utf8(std::string &out, UChar32 c) -> void
+{
+	char buf[4];
+	int32_t len = 0;
+	UBool is_error = false;
+
+	U8_APPEND(buf, len, sizeof(buf), c, is_error);
+	out.append(buf, len);
+}
+
+}// namespace word_break_test
+
+TEST_SUITE("fast word break")
+{
+	using namespace word_break_test;
+
+	TEST_CASE("corpus")
+	{
+		const std::vector<std::string> corpus{
+			"Hello, world! This is a simple test.",
+			"Don't stop: e-mail user@example.com, visit www.example.com/path?x=1",
+			"Prices: 3.14, 1,000,000; 42nd street_name and foo_bar_baz",
+			"Über straße naïve café résumé coöperate",
+			"L'été dernier, j'ai vu l’homme à la fenêtre…",
+			"Привет, мир! Съешь же ещё этих мягких французских булок, да выпей чаю.",
+			"Ελληνικά: Ξεσκεπάζω την ψυχοφθόρα βδελυγμία, 2,5 ευρώ.",
+			"Mixed: abc123 123abc 1.2.3 a.b.c x'y 1'000 ‘quoted’ “double”",
+			"Tabs\tand\r\nnew\nlines\x0b\x0c"
+			"and  multiple   spaces\u00a0nbsp",
+			"Combining: e\u0301 a\u0308b \u0301start soft\u00adhyphen word\u2060joiner",
+			"Dashes – and — em… €100 $200 ½ ©2024",
+			"",
+			" ",
+			"a",
+		};
+
+		for (const auto &text: corpus) {
+			CAPTURE(text);
+			REQUIRE(rspamd_tokenize_fast_supported(text.data(), text.size()));
+			CHECK(fast_breaks(text) == icu_breaks(text));
+		}
+	}
+
+	TEST_CASE("unsupported scripts")
+	{
+		const std::vector<std::string> corpus{
+			"中文文本",
+			"日本語のテキスト",
+			"ภาษาไทย",
+			"שלום עולם",
+			"emoji 👍 here",
+			"zero\u200dwidth joiner",
+			"Polytonic Greek: καὶ",
+		};
+
+		for (const auto &text: corpus) {
+			CAPTURE(text);
+			CHECK(!rspamd_tokenize_fast_supported(text.data(), text.size()));
+		}
+
+		/* Invalid utf8 */
+		std::string invalid{"abc\xd0"};
+		CHECK(!rspamd_tokenize_fast_supported(invalid.data(), invalid.size()));
+	}
+
+	TEST_CASE("random texts")
+	{
+		std::mt19937 gen{42};
+		/* Characters with special break rules */
+		const std::vector<UChar32> special{
+			'a', 'Z', '1', ' ', '.', ',', ';', ':', '\'', '"', '_', '@', '\r', '\n',
+			0x0b, 0x85, 0xa0, 0xad, 0xb7, 0x301, 0x387, 0x430, 0x3b1, 0x2019,
+			0x2024, 0x2027, 0x2060, 0x202f, 0x2028, 0x20ac, 0x20d0};
+		std::uniform_int_distribution<int> kind(0, 3), nchars(1, 40);
+		std::uniform_int_distribution<UChar32> low(0, 0x52f), punct(0x2000, 0x20ff);
+		std::uniform_int_distribution<size_t> special_idx(0, special.size() - 1);
+		int checked = 0;
+
+		for (int i = 0; i < 20000; i++) {
+			std::string text;
+			auto n = nchars(gen);
+
+			for (auto j = 0; j < n; j++) {
+				switch (kind(gen)) {
+				case 0:
+					append_utf8(text, low(gen));
+					break;
+				case 1:
+					append_utf8(text, punct(gen));
+					break;
+				default:
+					append_utf8(text, special[special_idx(gen)]);
+					break;
+				}
+			}
+
+			if (!rspamd_tokenize_fast_supported(text.data(), text.size())) {
+				continue;
+			}
+
+			CAPTURE(text);
+			REQUIRE(fast_breaks(text) == icu_breaks(text));
+			checked++;
+		}
+
+		CHECK(checked > 10000);
+	}
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Unit tests for the per process cache of normalised words */
+
+#ifndef RSPAMD_CXX_UNIT_WORDS_CACHE_HXX
+#define RSPAMD_CXX_UNIT_WORDS_CACHE_HXX
+
+#define DOCTEST_CONFIG_IMPLEMENTATION_IN_DLL
+#include "doctest/doctest.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "libstat/tokenizers/tokenizers.h"
+
+namespace words_cache_test {
+
+struct cache_delta {
+	std::uint64_t hits;
+	std::uint64_t misses;
+};
+
+/*
+ * Normalises the words and returns cache hits and misses of this call;
+ * CJK words are used as Latin, Greek and Cyrillic ones bypass the cache
+ */
+static auto
+normalize(rspamd_mempool_t *pool, const std::vector<std::string_view> &input,
+		  std::vector<std::string> *out = nullptr) -> cache_delta
+{
+	rspamd_words_t words;
+	std::uint64_t hits, misses, new_hits, new_misses;
+
+	kv_init(words);
+
+	for (const auto &in: input) {
+		rspamd_word_t w;
+
+		memset(&w, 0, sizeof(w));
+		w.original.begin = in.data();
+		w.original.len = in.size();
+		w.flags = RSPAMD_STAT_TOKEN_FLAG_TEXT | RSPAMD_STAT_TOKEN_FLAG_UTF;
+		kv_push(rspamd_word_t, words, w);
+	}
+
+	rspamd_words_cache_stat(&hits, &misses);
+	rspamd_normalize_words(&words, pool);
+	rspamd_words_cache_stat(&new_hits, &new_misses);
+
+	if (out) {
+		for (auto i = 0u; i < kv_size(words); i++) {
+			const auto &w = kv_A(words, i);
+			out->emplace_back(w.normalized.begin, w.normalized.len);
+		}
+	}
+
+	kv_destroy(words);
+
+	return cache_delta{new_hits - hits, new_misses - misses};
+}
+
+TEST_SUITE("words_cache")
+{
+	TEST_CASE("hit returns the same normalised word")
+	{
+		auto *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "words_cache", 0);
+		std::vector<std::string> first, second;
+
+		auto d = normalize(pool, {"漢字テスト"}, &first);
+		CHECK(d.hits == 0);
+		CHECK(d.misses == 1);
+
+		d = normalize(pool, {"漢字テスト"}, &second);
+		CHECK(d.hits == 1);
+		CHECK(d.misses == 0);
+		CHECK(first == second);
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("miss on length mismatch")
+	{
+		auto *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "words_cache", 0);
+		std::string_view word{"長さ確認語"};
+		std::vector<std::string> res;
+
+		normalize(pool, {word});
+
+		/* The same bytes, but a shorter word must not match the cached one */
+		auto d = normalize(pool, {word.substr(0, 6)}, &res);
+		CHECK(d.hits == 0);
+		CHECK(d.misses == 1);
+		REQUIRE(res.size() == 1);
+		CHECK(res[0] == "長さ");
+
+		/* Words longer than the limit are never cached */
+		std::string long_word;
+		for (auto i = 0; i < 30; i++) {
+			long_word += "語";
+		}
+
+		normalize(pool, {long_word});
+		d = normalize(pool, {long_word});
+		CHECK(d.hits == 0);
+
+		rspamd_mempool_delete(pool);
+	}
+
+	TEST_CASE("arena reset drops old words")
+	{
+		auto *pool = rspamd_mempool_new(rspamd_mempool_suggest_size(), "words_cache", 0);
+		std::vector<std::string> storage;
+		std::vector<std::string_view> words;
+
+		/* Entries take about 64 bytes, so this overflows the 4Mb arena once */
+		for (auto i = 0; i < 100000; i++) {
+			storage.emplace_back("再" + std::to_string(i));
+		}
+		for (const auto &s: storage) {
+			words.emplace_back(s);
+		}
+
+		auto d = normalize(pool, words);
+		CHECK(d.misses == words.size());
+
+		/* The first words have been dropped, the last ones are still there */
+		d = normalize(pool, {words.front()});
+		CHECK(d.hits == 0);
+		CHECK(d.misses == 1);
+
+		d = normalize(pool, {words.back()});
+		CHECK(d.hits == 1);
+
+		rspamd_mempool_delete(pool);
+	}
+}
+
+}// namespace words_cache_test
+
+#endif
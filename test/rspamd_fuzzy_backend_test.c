@@ -0,0 +1,209 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+#include "libserver/fuzzy_wire.h"
+#include "libserver/fuzzy_backend/fuzzy_backend.h"
+#include "contrib/libev/ev.h"
+#include "unix-std.h"
+
+#include <sqlite3.h>
+
+extern struct ev_loop *event_loop;
+
+struct test_fuzzy_update_res {
+	gboolean called;
+	gboolean success;
+	unsigned int order;
+	unsigned int nadded;
+	unsigned int nextended;
+	unsigned int ncommitted;
+};
+
+static unsigned int test_fuzzy_order = 0;
+
+static void
+test_fuzzy_update_cb(gboolean success,
+					 unsigned int nadded,
+					 unsigned int ndeleted,
+					 unsigned int nextended,
+					 unsigned int nignored,
+					 unsigned int ncommitted,
+					 void *ud)
+{
+	struct test_fuzzy_update_res *res = (struct test_fuzzy_update_res *) ud;
+
+	g_assert(!res->called);
+	res->called = TRUE;
+	res->success = success;
+	res->order = ++test_fuzzy_order;
+	res->nadded = nadded;
+	res->nextended = nextended;
+	res->ncommitted = ncommitted;
+}
+
+static void
+test_fuzzy_check_cb(struct rspamd_fuzzy_multiflag_result *result, void *ud)
+{
+	int32_t *value = (int32_t *) ud;
+
+	*value = result->rep.v1.value;
+}
+
+static void
+test_fuzzy_cmd(GArray *updates, int cmd, uint32_t id)
+{
+	struct fuzzy_peer_cmd up;
+
+	memset(&up, 0, sizeof(up));
+	up.cmd.normal.cmd = cmd;
+	up.cmd.normal.flag = 1;
+	up.cmd.normal.value = 1;
+	memcpy(up.cmd.normal.digest, &id, sizeof(id));
+	g_array_append_val(updates, up);
+}
+
+static int32_t
+test_fuzzy_lookup(struct rspamd_fuzzy_backend *bk, uint32_t id)
+{
+	struct rspamd_fuzzy_cmd cmd;
+	int32_t value = -1;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.cmd = FUZZY_CHECK;
+	memcpy(cmd.digest, &id, sizeof(id));
+	rspamd_fuzzy_backend_check(bk, &cmd, test_fuzzy_check_cb, &value);
+	g_assert(value != -1);
+
+	return value;
+}
+
+static void
+test_fuzzy_wait(struct test_fuzzy_update_res *res)
+{
+	unsigned int i;
+
+	for (i = 0; i < 10000 && !res->called; i++) {
+		ev_run(event_loop, EVRUN_NOWAIT);
+	}
+
+	g_assert(res->called);
+}
+
+void rspamd_fuzzy_backend_test_func(void)
+{
+	struct rspamd_fuzzy_backend *bk;
+	struct test_fuzzy_update_res res1, res2, res3;
+	GArray *updates1, *updates2, *updates3;
+	ucl_object_t *obj;
+	sqlite3 *db;
+	GError *err = NULL;
+	char *dir, *path;
+	unsigned int i;
+
+	dir = g_dir_make_tmp("rspamd-fuzzy-XXXXXX", NULL);
+	g_assert(dir != NULL);
+	path = g_build_filename(dir, "fuzzy.db", NULL);
+
+	obj = ucl_object_typed_new(UCL_OBJECT);
+	ucl_object_insert_key(obj, ucl_object_fromstring("sqlite"), "backend", 0, false);
+	ucl_object_insert_key(obj, ucl_object_fromstring(path), "hashfile", 0, false);
+	ucl_object_insert_key(obj, ucl_object_fromint(2), "write_batch", 0, false);
+	bk = rspamd_fuzzy_backend_create(event_loop, obj, NULL, &err);
+	g_assert(bk != NULL);
+
+	/* Large queue is committed in chunks, the first one immediately */
+	memset(&res1, 0, sizeof(res1));
+	memset(&res2, 0, sizeof(res2));
+	updates1 = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+	updates2 = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+
+	for (i = 1; i <= 5; i++) {
+		test_fuzzy_cmd(updates1, FUZZY_WRITE, i);
+	}
+
+	test_fuzzy_cmd(updates2, FUZZY_WRITE, 6);
+	test_fuzzy_cmd(updates2, FUZZY_WRITE, 7);
+
+	rspamd_fuzzy_backend_process_updates(bk, updates1, "test",
+										 test_fuzzy_update_cb, &res1);
+	g_assert(!res1.called);
+	g_assert(test_fuzzy_lookup(bk, 1) == 1);
+	g_assert(test_fuzzy_lookup(bk, 2) == 1);
+	g_assert(test_fuzzy_lookup(bk, 3) == 0);
+
+	/* Queued behind the first one */
+	rspamd_fuzzy_backend_process_updates(bk, updates2, "test",
+										 test_fuzzy_update_cb, &res2);
+	g_assert(!res2.called);
+
+	test_fuzzy_wait(&res2);
+	g_assert(res1.called);
+	g_assert(res1.success && res2.success);
+	g_assert(res1.order < res2.order);
+	g_assert(res1.nadded == 5);
+	g_assert(res1.ncommitted == 5);
+	g_assert(res2.ncommitted == 2);
+
+	for (i = 1; i <= 7; i++) {
+		g_assert(test_fuzzy_lookup(bk, i) == 1);
+	}
+
+	/* Failed chunk: the committed prefix is reported and kept in the queue */
+	memset(&res3, 0, sizeof(res3));
+	updates3 = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+	test_fuzzy_cmd(updates3, FUZZY_WRITE, 8);
+	test_fuzzy_cmd(updates3, FUZZY_WRITE, 9);
+	test_fuzzy_cmd(updates3, FUZZY_REFRESH, 10);
+	test_fuzzy_cmd(updates3, FUZZY_REFRESH, 11);
+	rspamd_fuzzy_backend_process_updates(bk, updates3, "test",
+										 test_fuzzy_update_cb, &res3);
+	g_assert(!res3.called);
+
+	/* Version bump of the last chunk cannot get the write lock */
+	g_assert(sqlite3_open(path, &db) == SQLITE_OK);
+	g_assert(sqlite3_exec(db, "BEGIN EXCLUSIVE;", NULL, NULL, NULL) == SQLITE_OK);
+	test_fuzzy_wait(&res3);
+	sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+	sqlite3_close(db);
+
+	g_assert(!res3.success);
+	g_assert(res3.ncommitted == 2);
+	g_assert(updates3->len == 4);
+	g_assert(test_fuzzy_lookup(bk, 8) == 1);
+	g_assert(test_fuzzy_lookup(bk, 9) == 1);
+
+	rspamd_fuzzy_backend_close(bk);
+	ucl_object_unref(obj);
+	g_array_free(updates1, TRUE);
+	g_array_free(updates2, TRUE);
+	g_array_free(updates3, TRUE);
+
+	unlink(path);
+	/* WAL files */
+	for (i = 0; i < 2; i++) {
+		char *aux = g_strconcat(path, i == 0 ? "-wal" : "-shm", NULL);
+
+		unlink(aux);
+		g_free(aux);
+	}
+
+	rmdir(dir);
+	g_free(path);
+	g_free(dir);
+}
@@ -0,0 +1,483 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+#include "libserver/fuzzy_storage_internal.h"
+#include "contrib/libev/ev.h"
+#include "unix-std.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+extern struct ev_loop *event_loop;
+
+/* Wire format of the replication stream */
+RSPAMD_PACKED(test_replog_hdr)
+{
+	uint64_t seq;
+	uint32_t len;
+	uint16_t type;
+	uint16_t reserved;
+	uint64_t cksum;
+};
+
+RSPAMD_PACKED(test_replog_req)
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t from_seq;
+};
+
+#define TEST_REPLOG_FILE_HDR_LEN 24
+#define TEST_REPLOG_RECORD_LEN (sizeof(struct test_replog_hdr) + sizeof(struct fuzzy_peer_cmd))
+#define TEST_REPLOG_RECORD 1
+#define TEST_REPLOG_RESET 3
+
+struct test_replog_rec {
+	uint64_t seq;
+	unsigned int type;
+	uint32_t id;
+};
+
+static gboolean
+test_replog_flush(struct rspamd_fuzzy_storage_ctx *ctx, const char *source,
+				  gboolean final)
+{
+	return FALSE;
+}
+
+static void
+test_replog_cmd(GArray *updates, int cmd, uint32_t id)
+{
+	struct fuzzy_peer_cmd up;
+
+	memset(&up, 0, sizeof(up));
+	up.cmd.normal.cmd = cmd;
+	up.cmd.normal.value = 1;
+	memcpy(up.cmd.normal.digest, &id, sizeof(id));
+	g_array_append_val(updates, up);
+}
+
+static struct rspamd_fuzzy_storage_ctx *
+test_replog_ctx_new(const char *path, gsize limit)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx;
+
+	ctx = g_malloc0(sizeof(*ctx));
+	ctx->event_loop = event_loop;
+	ctx->replication_log = (char *) path;
+	ctx->replication_log_size = limit;
+	g_assert(rspamd_fuzzy_replication_init(ctx, NULL, test_replog_flush));
+	g_assert(ctx->replication != NULL);
+
+	return ctx;
+}
+
+static void
+test_replog_ctx_free(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	rspamd_fuzzy_replication_destroy(ctx);
+	g_free(ctx);
+}
+
+static int64_t
+test_replog_stat(struct rspamd_fuzzy_storage_ctx *ctx, const char *key)
+{
+	ucl_object_t *obj;
+	int64_t ret;
+
+	obj = rspamd_fuzzy_replication_stat(ctx);
+	g_assert(obj != NULL);
+	g_assert(ucl_object_lookup(obj, key) != NULL);
+	ret = ucl_object_toint(ucl_object_lookup(obj, key));
+	ucl_object_unref(obj);
+
+	return ret;
+}
+
+static gboolean
+test_replog_compacting(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	ucl_object_t *obj;
+	gboolean ret;
+
+	obj = rspamd_fuzzy_replication_stat(ctx);
+	ret = ucl_object_toboolean(ucl_object_lookup(obj, "compacting"));
+	ucl_object_unref(obj);
+
+	return ret;
+}
+
+static void
+test_replog_wait_compaction(struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	unsigned int i;
+
+	g_assert(test_replog_compacting(ctx));
+
+	for (i = 0; i < 100000 && test_replog_compacting(ctx); i++) {
+		ev_run(event_loop, EVRUN_NOWAIT);
+	}
+
+	g_assert(!test_replog_compacting(ctx));
+}
+
+/* Returns our side of the replica connection */
+static int
+test_replog_peer(struct rspamd_fuzzy_storage_ctx *ctx, uint64_t from_seq)
+{
+	struct test_replog_req req;
+	rspamd_inet_addr_t *addr = NULL;
+	int fds[2], sndbuf = 16384;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	rspamd_socket_nonblocking(fds[0]);
+	rspamd_socket_nonblocking(fds[1]);
+	/* Small buffer to have a lagging replica if we do not read */
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	g_assert(rspamd_parse_inet_address(&addr, "127.0.0.1", strlen("127.0.0.1"),
+									   RSPAMD_INET_ADDRESS_PARSE_DEFAULT));
+	rspamd_fuzzy_replication_add_peer(ctx, fds[0], addr);
+
+	memset(&req, 0, sizeof(req));
+	req.magic = 0x7266726cU;
+	req.version = 1;
+	req.from_seq = from_seq;
+	g_assert(write(fds[1], &req, sizeof(req)) == sizeof(req));
+
+	return fds[1];
+}
+
+/* Reads the stream until a record with sequence `last` */
+static GArray *
+test_replog_read(int fd, uint64_t last)
+{
+	GArray *recs = g_array_new(FALSE, FALSE, sizeof(struct test_replog_rec));
+	GByteArray *buf = g_byte_array_new();
+	struct test_replog_hdr hdr;
+	struct fuzzy_peer_cmd cmd;
+	struct test_replog_rec rec;
+	unsigned char chunk[8192];
+	unsigned int i;
+	gboolean done = FALSE;
+	gssize r;
+
+	for (i = 0; i < 100000 && !done; i++) {
+		ev_run(event_loop, EVRUN_NOWAIT);
+
+		while ((r = read(fd, chunk, sizeof(chunk))) > 0) {
+			g_byte_array_append(buf, chunk, r);
+		}
+
+		while (buf->len >= sizeof(hdr)) {
+			memcpy(&hdr, buf->data, sizeof(hdr));
+
+			if (buf->len < sizeof(hdr) + hdr.len) {
+				break;
+			}
+
+			memset(&rec, 0, sizeof(rec));
+			rec.seq = hdr.seq;
+			rec.type = hdr.type;
+
+			if (hdr.type == TEST_REPLOG_RECORD) {
+				g_assert(hdr.len == sizeof(cmd));
+				memcpy(&cmd, buf->data + sizeof(hdr), sizeof(cmd));
+				memcpy(&rec.id, cmd.cmd.normal.digest, sizeof(rec.id));
+
+				if (hdr.seq == last) {
+					done = TRUE;
+				}
+			}
+			else {
+				g_assert(hdr.len == 0);
+			}
+
+			g_array_append_val(recs, rec);
+			g_byte_array_remove_range(buf, 0, sizeof(hdr) + hdr.len);
+		}
+	}
+
+	g_assert(done);
+	g_assert(buf->len == 0);
+	g_byte_array_free(buf, TRUE);
+
+	return recs;
+}
+
+static void
+test_replog_framing(const char *path)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	struct test_replog_rec *rec;
+	GArray *updates, *recs;
+	unsigned int i;
+	int fd;
+
+	ctx = test_replog_ctx_new(path, 1024 * 1024);
+	updates = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+
+	for (i = 1; i <= 10; i++) {
+		test_replog_cmd(updates, FUZZY_WRITE, i);
+	}
+
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	g_assert(test_replog_stat(ctx, "first_seq") == 1);
+	g_assert(test_replog_stat(ctx, "last_seq") == 10);
+	g_assert(test_replog_stat(ctx, "log_size") ==
+			 TEST_REPLOG_FILE_HDR_LEN + 10 * TEST_REPLOG_RECORD_LEN);
+
+	/* Full stream */
+	fd = test_replog_peer(ctx, 0);
+	recs = test_replog_read(fd, 10);
+	g_assert(recs->len == 10);
+
+	for (i = 0; i < recs->len; i++) {
+		rec = &g_array_index(recs, struct test_replog_rec, i);
+		g_assert(rec->type == TEST_REPLOG_RECORD);
+		g_assert(rec->seq == i + 1);
+		g_assert(rec->id == i + 1);
+	}
+
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	/* Resume from an offset */
+	fd = test_replog_peer(ctx, 5);
+	recs = test_replog_read(fd, 10);
+	g_assert(recs->len == 5);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).seq == 6);
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	test_replog_ctx_free(ctx);
+
+	/* Reopen with a broken tail */
+	fd = open(path, O_WRONLY | O_APPEND);
+	g_assert(fd != -1);
+	g_assert(write(fd, updates->data, 100) == 100);
+	close(fd);
+
+	ctx = test_replog_ctx_new(path, 1024 * 1024);
+	g_assert(test_replog_stat(ctx, "last_seq") == 10);
+	g_assert(test_replog_stat(ctx, "log_size") ==
+			 TEST_REPLOG_FILE_HDR_LEN + 10 * TEST_REPLOG_RECORD_LEN);
+	g_array_set_size(updates, 0);
+	test_replog_cmd(updates, FUZZY_WRITE, 11);
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	g_assert(test_replog_stat(ctx, "last_seq") == 11);
+
+	fd = test_replog_peer(ctx, 10);
+	recs = test_replog_read(fd, 11);
+	g_assert(recs->len == 1);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).id == 11);
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	test_replog_ctx_free(ctx);
+	g_array_free(updates, TRUE);
+	unlink(path);
+}
+
+static void
+test_replog_compaction(const char *path)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	GArray *updates, *recs;
+	const uint64_t expected[] = {2, 3, 4, 18, 19, 20, 21};
+	unsigned int i, j;
+	int fd;
+
+	/* Log of 21 records is over the limit, its 7 survivors are not */
+	ctx = test_replog_ctx_new(path, 20 * TEST_REPLOG_RECORD_LEN);
+	updates = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+
+	/* seq 1-4 */
+	for (i = 1; i <= 4; i++) {
+		test_replog_cmd(updates, FUZZY_WRITE, i);
+	}
+
+	/* seq 5-20, only the last refresh of each digest survives */
+	for (j = 0; j < 4; j++) {
+		for (i = 1; i <= 4; i++) {
+			test_replog_cmd(updates, FUZZY_REFRESH, i);
+		}
+	}
+
+	/* seq 21, overrides everything for digest 1 */
+	test_replog_cmd(updates, FUZZY_DEL, 1);
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	test_replog_wait_compaction(ctx);
+
+	g_assert(test_replog_stat(ctx, "first_seq") == 2);
+	g_assert(test_replog_stat(ctx, "last_seq") == 21);
+	g_assert(test_replog_stat(ctx, "log_size") ==
+			 TEST_REPLOG_FILE_HDR_LEN + G_N_ELEMENTS(expected) * TEST_REPLOG_RECORD_LEN);
+
+	/* Offset before the base is reset */
+	fd = test_replog_peer(ctx, 0);
+	recs = test_replog_read(fd, 21);
+	g_assert(recs->len == G_N_ELEMENTS(expected) + 1);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).type == TEST_REPLOG_RESET);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).seq == 1);
+
+	for (i = 0; i < G_N_ELEMENTS(expected); i++) {
+		g_assert(g_array_index(recs, struct test_replog_rec, i + 1).seq == expected[i]);
+	}
+
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	/* Overridden records are skipped without reset */
+	fd = test_replog_peer(ctx, 4);
+	recs = test_replog_read(fd, 21);
+	g_assert(recs->len == 4);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).type == TEST_REPLOG_RECORD);
+	g_assert(g_array_index(recs, struct test_replog_rec, 0).seq == 18);
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	test_replog_ctx_free(ctx);
+	g_array_free(updates, TRUE);
+	unlink(path);
+}
+
+static void
+test_replog_lagging_peer(const char *path)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	struct test_replog_rec *rec;
+	GArray *updates, *recs;
+	uint64_t next = 1, base;
+	unsigned int i, nresets = 0;
+	int fd;
+
+	ctx = test_replog_ctx_new(path, 1000 * TEST_REPLOG_RECORD_LEN);
+	updates = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+
+	/* seq 1-1000 */
+	for (i = 1; i <= 1000; i++) {
+		test_replog_cmd(updates, FUZZY_WRITE, i);
+	}
+
+	/* seq 1001-1500, override seq 1-500 */
+	for (i = 1; i <= 500; i++) {
+		test_replog_cmd(updates, FUZZY_DEL, i);
+	}
+
+	/* Connected, but does not read while the log is compacted */
+	fd = test_replog_peer(ctx, 0);
+	ev_run(event_loop, EVRUN_NOWAIT);
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	test_replog_wait_compaction(ctx);
+
+	base = test_replog_stat(ctx, "first_seq") - 1;
+	g_assert(base == 500);
+
+	recs = test_replog_read(fd, 1500);
+
+	for (i = 0; i < recs->len; i++) {
+		rec = &g_array_index(recs, struct test_replog_rec, i);
+
+		if (rec->type == TEST_REPLOG_RESET) {
+			/* Sent after the records already buffered for the replica */
+			g_assert(rec->seq == base);
+			g_assert(next <= base);
+			next = base + 1;
+			nresets++;
+		}
+		else {
+			g_assert(rec->seq == next);
+			next++;
+		}
+	}
+
+	g_assert(nresets == 1);
+	g_assert(next == 1501);
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	test_replog_ctx_free(ctx);
+	g_array_free(updates, TRUE);
+	unlink(path);
+}
+
+static void
+test_replog_live_records(const char *path)
+{
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	GArray *updates, *recs;
+	unsigned int i;
+	int fd;
+
+	ctx = test_replog_ctx_new(path, 10 * TEST_REPLOG_RECORD_LEN);
+	updates = g_array_new(FALSE, FALSE, sizeof(struct fuzzy_peer_cmd));
+
+	/* seq 1-20, nothing is overridden */
+	for (i = 1; i <= 20; i++) {
+		test_replog_cmd(updates, FUZZY_WRITE, i);
+	}
+
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	test_replog_wait_compaction(ctx);
+
+	/* Adds are kept even if the log stays over its limit */
+	g_assert(test_replog_stat(ctx, "first_seq") == 1);
+	g_assert(test_replog_stat(ctx, "log_size") ==
+			 TEST_REPLOG_FILE_HDR_LEN + 20 * TEST_REPLOG_RECORD_LEN);
+
+	fd = test_replog_peer(ctx, 0);
+	recs = test_replog_read(fd, 20);
+	g_assert(recs->len == 20);
+
+	for (i = 0; i < recs->len; i++) {
+		g_assert(g_array_index(recs, struct test_replog_rec, i).type == TEST_REPLOG_RECORD);
+		g_assert(g_array_index(recs, struct test_replog_rec, i).id == i + 1);
+	}
+
+	g_array_free(recs, TRUE);
+	close(fd);
+
+	/* Next compaction waits for the log to double */
+	g_array_set_size(updates, 0);
+	test_replog_cmd(updates, FUZZY_WRITE, 21);
+	rspamd_fuzzy_replication_committed(ctx, updates, 0);
+	g_assert(!test_replog_compacting(ctx));
+
+	test_replog_ctx_free(ctx);
+	g_array_free(updates, TRUE);
+	unlink(path);
+}
+
+void rspamd_fuzzy_replication_test_func(void)
+{
+	char *dir, *path;
+
+	dir = g_dir_make_tmp("rspamd-replog-XXXXXX", NULL);
+	g_assert(dir != NULL);
+	path = g_build_filename(dir, "fuzzy_replication.log", NULL);
+
+	test_replog_framing(path);
+	test_replog_compaction(path);
+	test_replog_lagging_peer(path);
+	test_replog_live_records(path);
+
+	rmdir(dir);
+	g_free(path);
+	g_free(dir);
+}
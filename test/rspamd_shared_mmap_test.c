@@ -0,0 +1,227 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+#include "libstat/stat_internal.h"
+#include "unix-std.h"
+
+#include <sys/wait.h>
+
+extern struct ev_loop *event_loop;
+
+struct test_shared_mmap_cfg {
+	struct rspamd_classifier_config clcf;
+	struct rspamd_statfile_config stcf[2];
+	struct rspamd_statfile st[2];
+};
+
+static void
+test_shared_mmap_cfg_init(struct test_shared_mmap_cfg *cfg, const char *path)
+{
+	unsigned int i;
+
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->clcf.name = "bayes";
+	cfg->clcf.opts = ucl_object_typed_new(UCL_OBJECT);
+	ucl_object_insert_key(cfg->clcf.opts, ucl_object_fromstring(path),
+						  "filename", 0, false);
+	cfg->stcf[0].symbol = "BAYES_SPAM";
+	cfg->stcf[1].symbol = "BAYES_HAM";
+
+	for (i = 0; i < G_N_ELEMENTS(cfg->stcf); i++) {
+		cfg->stcf[i].clcf = &cfg->clcf;
+		cfg->clcf.statfiles = g_list_append(cfg->clcf.statfiles, &cfg->stcf[i]);
+		cfg->st[i].stcf = &cfg->stcf[i];
+	}
+}
+
+static void
+test_shared_mmap_cfg_free(struct test_shared_mmap_cfg *cfg)
+{
+	g_list_free(cfg->clcf.statfiles);
+	ucl_object_unref(cfg->clcf.opts);
+}
+
+static GPtrArray *
+test_shared_mmap_tokens(uint64_t start, unsigned int n, float value)
+{
+	GPtrArray *tokens = g_ptr_array_new_full(n, g_free);
+	rspamd_token_t *tok;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		tok = g_malloc0(sizeof(*tok) + sizeof(tok->values[0]));
+		tok->data = start + i;
+		tok->values[0] = value;
+		g_ptr_array_add(tokens, tok);
+	}
+
+	return tokens;
+}
+
+static float
+test_shared_mmap_get(struct rspamd_task *task, gpointer bk, uint64_t token)
+{
+	GPtrArray *tokens = test_shared_mmap_tokens(token, 1, -1);
+	float res;
+
+	g_assert(rspamd_shared_mmap_process_tokens(task, tokens, 0, bk));
+	res = ((rspamd_token_t *) g_ptr_array_index(tokens, 0))->values[0];
+	g_ptr_array_free(tokens, TRUE);
+
+	return res;
+}
+
+static void
+test_shared_mmap_learn(struct rspamd_task *task, gpointer bk,
+					   uint64_t start, unsigned int n, float value)
+{
+	GPtrArray *tokens = test_shared_mmap_tokens(start, n, value);
+
+	g_assert(rspamd_shared_mmap_learn_tokens(task, tokens, 0, bk));
+	g_ptr_array_free(tokens, TRUE);
+}
+
+static int64_t
+test_shared_mmap_stat(gpointer bk, const char *key)
+{
+	ucl_object_t *st = rspamd_shared_mmap_get_stat(bk, NULL);
+	int64_t res;
+
+	g_assert(st != NULL);
+	res = ucl_object_toint(ucl_object_lookup(st, key));
+	ucl_object_unref(st);
+
+	return res;
+}
+
+static void
+test_shared_mmap_open(struct test_shared_mmap_cfg *cfg, gpointer *spam, gpointer *ham)
+{
+	*spam = rspamd_shared_mmap_init(NULL, NULL, &cfg->st[0]);
+	*ham = rspamd_shared_mmap_init(NULL, NULL, &cfg->st[1]);
+	g_assert(*spam != NULL && *ham != NULL);
+}
+
+void rspamd_shared_mmap_test_func(void)
+{
+	struct test_shared_mmap_cfg cfg;
+	struct rspamd_task *task;
+	gpointer spam, ham;
+	char *dir, *path;
+	unsigned int i;
+	int status;
+	pid_t pid;
+
+	dir = g_dir_make_tmp("rspamd-shmap-XXXXXX", NULL);
+	g_assert(dir != NULL);
+	path = g_build_filename(dir, "bayes.shm", NULL);
+	test_shared_mmap_cfg_init(&cfg, path);
+	task = rspamd_task_new(NULL, NULL, NULL, NULL, event_loop, FALSE);
+
+	test_shared_mmap_open(&cfg, &spam, &ham);
+	g_assert(test_shared_mmap_stat(spam, "total") == 65536);
+
+	/* Insert and lookup, classes share slots */
+	test_shared_mmap_learn(task, spam, 1, 100, 1);
+	test_shared_mmap_learn(task, ham, 51, 100, 2);
+	g_assert(test_shared_mmap_get(task, spam, 1) == 1);
+	g_assert(test_shared_mmap_get(task, ham, 1) == 0);
+	g_assert(test_shared_mmap_get(task, spam, 100) == 1);
+	g_assert(test_shared_mmap_get(task, ham, 100) == 2);
+	g_assert(test_shared_mmap_get(task, spam, 150) == 0);
+	g_assert(test_shared_mmap_get(task, ham, 150) == 2);
+	g_assert(test_shared_mmap_get(task, spam, 151) == 0);
+	g_assert(test_shared_mmap_stat(spam, "used") == 150);
+
+	/* Counters never go below zero */
+	test_shared_mmap_learn(task, spam, 1, 10, -2);
+	g_assert(test_shared_mmap_get(task, spam, 1) == 0);
+	g_assert(test_shared_mmap_get(task, spam, 11) == 1);
+
+	g_assert(rspamd_shared_mmap_inc_learns(task, spam, NULL) == 1);
+	g_assert(rspamd_shared_mmap_inc_learns(task, spam, NULL) == 2);
+	g_assert(rspamd_shared_mmap_dec_learns(task, spam, NULL) == 1);
+	g_assert(rspamd_shared_mmap_inc_learns(task, ham, NULL) == 1);
+
+	/* Resize keeps tokens and learns */
+	test_shared_mmap_learn(task, ham, 1000, 50000, 1);
+	g_assert(test_shared_mmap_stat(spam, "total") == 131072);
+	g_assert(test_shared_mmap_stat(spam, "used") == 50150);
+	g_assert(test_shared_mmap_get(task, spam, 11) == 1);
+	g_assert(test_shared_mmap_get(task, ham, 150) == 2);
+	g_assert(test_shared_mmap_get(task, ham, 50999) == 1);
+	g_assert(rspamd_shared_mmap_total_learns(task, spam, NULL) == 1);
+	g_assert(rspamd_shared_mmap_total_learns(task, ham, NULL) == 1);
+
+	/* Reopen */
+	rspamd_shared_mmap_close(spam);
+	rspamd_shared_mmap_close(ham);
+	test_shared_mmap_open(&cfg, &spam, &ham);
+	g_assert(test_shared_mmap_stat(spam, "total") == 131072);
+	g_assert(test_shared_mmap_get(task, spam, 11) == 1);
+	g_assert(test_shared_mmap_get(task, ham, 50999) == 1);
+	g_assert(rspamd_shared_mmap_total_learns(task, spam, NULL) == 1);
+
+	/*
+	 * Another process resizes the table while this one counts learns: no
+	 * increments are lost and the resized table is picked up
+	 */
+	pid = fork();
+	g_assert(pid != -1);
+
+	if (pid == 0) {
+		gpointer cspam, cham;
+
+		/* Inherited handles share the file lock with the parent */
+		rspamd_shared_mmap_close(spam);
+		rspamd_shared_mmap_close(ham);
+		test_shared_mmap_open(&cfg, &cspam, &cham);
+		test_shared_mmap_learn(task, cham, 100000, 50000, 3);
+
+		for (i = 0; i < 1000; i++) {
+			rspamd_shared_mmap_inc_learns(task, cham, NULL);
+		}
+
+		_exit(test_shared_mmap_stat(cspam, "total") == 262144 ? 0 : 1);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		rspamd_shared_mmap_inc_learns(task, spam, NULL);
+	}
+
+	g_assert(waitpid(pid, &status, 0) == pid);
+	g_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	g_assert(test_shared_mmap_get(task, ham, 149999) == 3);
+	g_assert(test_shared_mmap_stat(spam, "total") == 262144);
+	g_assert(test_shared_mmap_stat(spam, "used") == 100150);
+	g_assert(test_shared_mmap_get(task, spam, 11) == 1);
+	g_assert(rspamd_shared_mmap_total_learns(task, spam, NULL) == 1001);
+	g_assert(rspamd_shared_mmap_total_learns(task, ham, NULL) == 1001);
+
+	rspamd_shared_mmap_close(spam);
+	rspamd_shared_mmap_close(ham);
+	rspamd_task_free(task);
+	test_shared_mmap_cfg_free(&cfg);
+
+	unlink(path);
+	rmdir(dir);
+	g_free(path);
+	g_free(dir);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2026 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+#include "libmime/message.h"
+#include "libstat/stat_internal.h"
+#include "libserver/mempool_vars_internal.h"
+
+extern struct ev_loop *event_loop;
+
+static uint64_t
+test_stat_word_hash(const char *w)
+{
+	return rspamd_cryptobox_fast_hash(w, strlen(w), 0);
+}
+
+/* A token per word, so the expected tokens are easy to write down */
+static int
+test_stat_tokenize_words(struct rspamd_stat_ctx *ctx,
+						 struct rspamd_task *task,
+						 rspamd_words_t *words,
+						 gboolean is_utf,
+						 const char *prefix,
+						 GPtrArray *result)
+{
+	rspamd_token_t *tok;
+	unsigned int i;
+
+	for (i = 0; i < kv_size(*words); i++) {
+		rspamd_word_t *w = &kv_A(*words, i);
+
+		tok = rspamd_mempool_alloc0(task->task_pool, sizeof(*tok));
+		tok->data = rspamd_cryptobox_fast_hash(w->original.begin, w->original.len, 0);
+		tok->t1 = w;
+		tok->t2 = w;
+		g_ptr_array_add(result, tok);
+	}
+
+	return TRUE;
+}
+
+static void
+test_stat_add_part(struct rspamd_task *task, const char *text)
+{
+	struct rspamd_mime_text_part *part;
+	char **words, **w;
+	rspamd_word_t elt;
+
+	part = rspamd_mempool_alloc0(task->task_pool, sizeof(*part));
+	kv_init(part->utf_words);
+	words = g_strsplit(text, " ", -1);
+
+	for (w = words; *w != NULL; w++) {
+		memset(&elt, 0, sizeof(elt));
+		elt.original.begin = rspamd_mempool_strdup(task->task_pool, *w);
+		elt.original.len = strlen(*w);
+		elt.flags = RSPAMD_STAT_TOKEN_FLAG_TEXT;
+		kv_push(rspamd_word_t, part->utf_words, elt);
+	}
+
+	g_strfreev(words);
+	g_ptr_array_add(MESSAGE_FIELD(task, text_parts), part);
+}
+
+static void
+test_stat_check_tokens(struct rspamd_task *task, const char *expected)
+{
+	char **words;
+	unsigned int i;
+
+	words = g_strsplit(expected, " ", -1);
+	g_assert_cmpuint(task->tokens->len, ==, g_strv_length(words));
+
+	for (i = 0; i < task->tokens->len; i++) {
+		rspamd_token_t *tok = g_ptr_array_index(task->tokens, i);
+
+		g_assert(tok->data == test_stat_word_hash(words[i]));
+	}
+
+	g_strfreev(words);
+}
+
+void rspamd_stat_tokenize_test_func(void)
+{
+	struct rspamd_stat_ctx st_ctx;
+	struct rspamd_stat_tokenizer tokenizer;
+	struct rspamd_task *task;
+
+	memcpy(&st_ctx, rspamd_stat_get_ctx(), sizeof(st_ctx));
+	memset(&tokenizer, 0, sizeof(tokenizer));
+	tokenizer.name = "words";
+	tokenizer.tokenize_func = test_stat_tokenize_words;
+	st_ctx.tokenizer = &tokenizer;
+	st_ctx.lua_stat_tokens_ref = -1;
+
+	/* Single part: repeats are kept */
+	task = rspamd_task_new(NULL, st_ctx.cfg, NULL, NULL, event_loop, FALSE);
+	task->message = rspamd_message_new(task);
+	test_stat_add_part(task, "a b a c");
+	rspamd_stat_process_tokenize(&st_ctx, task);
+	test_stat_check_tokens(task, "a b a c");
+	g_assert(rspamd_mempool_get_variable(task->task_pool,
+										 RSPAMD_MEMPOOL_STAT_SIGNATURE) != NULL);
+	rspamd_task_free(task);
+
+	/*
+	 * Alternative parts: tokens of previous parts are dropped, repeats
+	 * within a later part are kept
+	 */
+	task = rspamd_task_new(NULL, st_ctx.cfg, NULL, NULL, event_loop, FALSE);
+	task->message = rspamd_message_new(task);
+	test_stat_add_part(task, "a b c");
+	test_stat_add_part(task, "b d e d b");
+	test_stat_add_part(task, "d f f a");
+	rspamd_stat_process_tokenize(&st_ctx, task);
+	test_stat_check_tokens(task, "a b c d e d f f");
+	rspamd_task_free(task);
+}
@@ -83,6 +83,11 @@ int main(int argc, char **argv)
 	g_test_add_func("/rspamd/lua", rspamd_lua_test_func);
 	g_test_add_func("/rspamd/cryptobox", rspamd_cryptobox_test_func);
 	g_test_add_func("/rspamd/heap", rspamd_heap_test_func);
+	g_test_add_func("/rspamd/fuzzy_backend", rspamd_fuzzy_backend_test_func);
+	g_test_add_func("/rspamd/fuzzy_replication", rspamd_fuzzy_replication_test_func);
+	g_test_add_func("/rspamd/shared_mmap", rspamd_shared_mmap_test_func);
+	g_test_add_func("/rspamd/cdb_backend", rspamd_cdb_backend_test_func);
+	g_test_add_func("/rspamd/stat_tokenize", rspamd_stat_tokenize_test_func);
 	g_test_add_func("/rspamd/lua_pcall", rspamd_lua_lua_pcall_vs_resume_test_func);
 
 #if 0
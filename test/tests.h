@@ -42,6 +42,16 @@ void rspamd_cryptobox_test_func(void);
 
 void rspamd_heap_test_func(void);
 
+void rspamd_fuzzy_backend_test_func(void);
+
+void rspamd_fuzzy_replication_test_func(void);
+
+void rspamd_shared_mmap_test_func(void);
+
+void rspamd_cdb_backend_test_func(void);
+
+void rspamd_stat_tokenize_test_func(void);
+
 void rspamd_lua_lua_pcall_vs_resume_test_func(void);
 
 #ifdef __cplusplus